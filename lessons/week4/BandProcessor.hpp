@@ -0,0 +1,188 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <functional>
+
+#include "grtypes.hpp"
+#include "PixelBuffer.hpp"
+#include "PixelBufferRGBA32.hpp"
+#include "PixelBufferGray.hpp"
+#include "pbm.hpp"
+
+/*
+    BandProcessor
+
+    Runs a transform over a PPM, PGM or PAM that's too big to have in
+    memory, writing the result to another.  The output is made a band
+    of rows at a time:  the input rows the band needs are read into a
+    band buffer with PBMFile::readRows(), the transform fills an output
+    band buffer from them, and PBMWriter writes it out.  Then the
+    input rows that are finished with are let go of.  Memory is the two
+    band buffers, whatever the size of the image.
+
+    A transform that looks at the neighbours of a pixel, like a blur,
+    asks for halo rows, which are read in above and below each band,
+    where the image has them.  The output can be a different size from
+    the input, for scaling; the input rows for a band are the ones that
+    cover it, in proportion, plus the halo.
+
+        BandProcessor bands(256, 1);
+        bands.process("scan.ppm", "blurred.ppm", [](const ImageBand &band) {
+            blur3x3(band);
+        });
+
+    The band buffers are ordinary pixel buffers, so in the normal build
+    they can be at most 65535 pixels wide, but the image can be any
+    number of rows tall.
+*/
+
+// What a transform is given for each band
+struct ImageBand {
+    const PixelBuffer *input;   // input rows inputFirst on, from row 0
+    size_t inputFirst;
+    size_t inputRows;
+    PixelBuffer *output;        // to be filled with output rows outputFirst on, from row 0
+    size_t outputFirst;
+    size_t outputRows;
+
+    // the whole images
+    size_t inputWidth, inputHeight;
+    size_t outputWidth, outputHeight;
+};
+
+typedef std::function<void(const ImageBand &band)> BandTransform;
+
+class BandProcessor
+{
+public:
+    // bandRows - output rows in a band
+    // haloRows - extra input rows the transform needs above and below
+    BandProcessor(size_t abandRows = 256, size_t ahaloRows = 0)
+        : bandRows(abandRows < 1 ? 1 : abandRows), haloRows(ahaloRows), bandBytes(0)
+    {}
+
+    virtual ~BandProcessor() {}
+
+    /*
+        process()
+
+        Transform the binary PGM, PPM or PAM inputName into outputName.
+        outFormat is '5', '6' or '7', as for PBMWriter, or 0 for the same
+        kind of file as the input.  The output is the size of the input,
+        unless it's given.  The output band is gray for a PGM, RGBA
+        otherwise, and the input band is gray for a gray file.  Returns
+        false if the input can't be read, or the output written.
+    */
+    bool process(const char *inputName, const char *outputName, const BandTransform &transform,
+        char outFormat = 0, size_t outWidth = 0, size_t outHeight = 0)
+    {
+        PBMFile in;
+        if (!in.open(inputName) || !in.isBinary()) {
+            return false;
+        }
+
+        size_t inWidth = in.getWidth();
+        size_t inHeight = in.getHeight();
+        if (outFormat == 0) {
+            outFormat = in.getFormat();
+        }
+        if (outWidth == 0) {
+            outWidth = inWidth;
+        }
+        if (outHeight == 0) {
+            outHeight = inHeight;
+        }
+        if (inHeight == 0) {
+            return false;
+        }
+
+        // The most input rows a band can need
+        size_t outRows = bandRows < outHeight ? bandRows : outHeight;
+        size_t inRows = (outRows * inHeight + outHeight - 1) / outHeight + 1 + haloRows * 2;
+        if (inRows > inHeight) {
+            inRows = inHeight;
+        }
+
+        // every pixel of a band has to have a coordinate
+        if (!fits(inWidth) || !fits(inRows) || !fits(outWidth) || !fits(outRows)) {
+            return false;
+        }
+
+        PixelBuffer *inBand;
+        if (in.getChannels() == 1) {
+            inBand = new PixelBufferGray((GRSIZE)inWidth, (GRSIZE)inRows);
+        } else {
+            inBand = new PixelBufferRGBA32((GRSIZE)inWidth, (GRSIZE)inRows);
+        }
+        PixelBuffer *outBand;
+        if (outFormat == '5') {
+            outBand = new PixelBufferGray((GRSIZE)outWidth, (GRSIZE)outRows);
+        } else {
+            outBand = new PixelBufferRGBA32((GRSIZE)outWidth, (GRSIZE)outRows);
+        }
+        bandBytes = inWidth * inRows * inBand->getChannels() + outWidth * outRows * outBand->getChannels();
+
+        PBMWriter out;
+        bool ok = out.open(outputName, outWidth, outHeight, outFormat);
+
+        for (size_t outFirst = 0; outFirst < outHeight && ok; outFirst += bandRows) {
+            size_t count = outHeight - outFirst < bandRows ? outHeight - outFirst : bandRows;
+
+            // the input rows under the band, and the halo around them
+            size_t inFirst = outFirst * inHeight / outHeight;
+            size_t inEnd = ((outFirst + count) * inHeight + outHeight - 1) / outHeight;
+            inFirst = inFirst > haloRows ? inFirst - haloRows : 0;
+            inEnd = inEnd + haloRows < inHeight ? inEnd + haloRows : inHeight;
+            if (inEnd - inFirst > inRows) {
+                inEnd = inFirst + inRows;
+            }
+
+            ok = in.readRows(*inBand, inFirst, inEnd - inFirst);
+            if (!ok) {
+                break;
+            }
+
+            ImageBand band;
+            band.input = inBand;
+            band.inputFirst = inFirst;
+            band.inputRows = inEnd - inFirst;
+            band.output = outBand;
+            band.outputFirst = outFirst;
+            band.outputRows = count;
+            band.inputWidth = inWidth;
+            band.inputHeight = inHeight;
+            band.outputWidth = outWidth;
+            band.outputHeight = outHeight;
+            transform(band);
+
+            ok = out.writeRows(*outBand, count);
+
+            // rows above the next band's halo won't be read again
+            size_t nextFirst = (outFirst + count) * inHeight / outHeight;
+            in.releaseRows(nextFirst > haloRows ? nextFirst - haloRows : 0);
+        }
+
+        if (!out.close()) {
+            ok = false;
+        }
+
+        delete inBand;
+        delete outBand;
+        return ok;
+    }
+
+    // Bytes of pixels in the two band buffers, from the last process()
+    size_t getBandBytes() const { return bandBytes; }
+
+private:
+    static bool fits(size_t size)
+    {
+        return size > 0 && (size_t)(GRCOORD)(size - 1) == size - 1;
+    }
+
+    size_t bandRows;
+    size_t haloRows;
+    size_t bandBytes;
+};
@@ -0,0 +1,395 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "grtypes.hpp"
+#include "grmath.hpp"
+
+/*
+    CoverageRasterizer
+
+    Works out how much of each pixel a filled shape covers, for
+    anti-aliased edges, the way font renderers like stb_truetype and
+    font-rs do.
+
+    The obvious way to get smooth edges is to draw the shape several
+    times bigger, and average blocks of pixels back down.  That's
+    16 times the work for 16 levels of coverage, and still looks
+    stepped.  Here, the area is worked out exactly instead.
+
+    Each edge of the shape, as it crosses a row, adds the signed area
+    between itself and the right end of the row, into a row of cells.
+    Only the cells the edge actually passes through get anything.
+    Then a running sum along the row turns that into how much of each
+    pixel is inside.  Edges going down add, edges going up subtract, so
+    the sum is the winding number, smoothed at the edges.  The running
+    sum is done four cells at a time with SSE2, and turned straight
+    into 8 bit alpha.
+
+    Coordinates are 24.8 fixed point, in pixels, where whole numbers
+    are pixel centers, the same as the rest of the drawing.  Anything
+    outside the area given to begin() is clipped away, but what's to
+    the left of it still counts, as it has to for the rows to sum up.
+
+    Cells are set back to zero as they're summed, so the buffer is
+    always ready for the next shape, and is only cleared when it grows.
+*/
+class CoverageRasterizer
+{
+public:
+    CoverageRasterizer()
+        : cells(nullptr), cellCapacity(0), rowMin(nullptr), rowMax(nullptr), rowCapacity(0),
+        alpha(nullptr), alphaCapacity(0), width(0), height(0), stride(0), top(0), bottom(0)
+    {}
+
+    virtual ~CoverageRasterizer()
+    {
+        free(cells);
+        free(rowMin);
+        free(rowMax);
+        free(alpha);
+    }
+
+    // Start a new shape, which can only draw inside area.  Returns
+    // false if there's no memory for an area that big.
+    bool begin(const GRRectangle &area)
+    {
+        int newStride = area.width + 2;     // edges can touch two cells past the last pixel
+
+        size_t needed = (size_t)newStride * area.height;
+        if (needed > cellCapacity) {
+            free(cells);
+            cellCapacity = 0;
+            cells = (float *)calloc(needed, sizeof(float));
+            if (!cells) {
+                return false;
+            }
+            cellCapacity = needed;
+        }
+
+        if (area.height > rowCapacity) {
+            if (!grow(rowMin, area.height) || !grow(rowMax, area.height)) {
+                return false;
+            }
+            rowCapacity = area.height;
+        }
+
+        if (newStride > alphaCapacity) {
+            if (!grow(alpha, newStride)) {
+                return false;
+            }
+            alphaCapacity = newStride;
+        }
+
+        this->area = area;
+        width = area.width;
+        height = area.height;
+        stride = newStride;
+        for (int y = 0; y < height; y++) {
+            rowMin[y] = stride;
+            rowMax[y] = 0;
+        }
+
+        top = height;
+        bottom = 0;
+        return true;
+    }
+
+    const GRRectangle & getArea() const { return area; }
+
+    // The rows, relative to the area, that any edge touched
+    int getTop() const { return top; }
+    int getBottom() const { return bottom; }
+
+    /*
+    addLine()
+
+    Add an edge of the shape.  The edges have to join up into closed
+    loops, or the rows won't sum back to zero after the shape.
+    */
+    void addLine(GRFIXED fx0, GRFIXED fy0, GRFIXED fx1, GRFIXED fy1)
+    {
+        // pixel i covers [i, i + 1) from here on
+        float x0 = fixedToReal(fx0) + 0.5f - area.x;
+        float y0 = fixedToReal(fy0) + 0.5f - area.y;
+        float x1 = fixedToReal(fx1) + 0.5f - area.x;
+        float y1 = fixedToReal(fy1) + 0.5f - area.y;
+
+        // always downwards, remembering which way it really went
+        float dir = 1;
+        if (y0 > y1) {
+            float tmp;
+            tmp = x0; x0 = x1; x1 = tmp;
+            tmp = y0; y0 = y1; y1 = tmp;
+            dir = -1;
+        }
+
+        if (y0 == y1 || y1 <= 0 || y0 >= height) {
+            return;
+        }
+
+        // just the rows in the area
+        float dxdy = (x1 - x0) / (y1 - y0);
+        if (y0 < 0) {
+            x0 -= y0 * dxdy;
+            y0 = 0;
+        }
+        if (y1 > height) {
+            x1 -= (y1 - height) * dxdy;
+            y1 = (float)height;
+        }
+
+        // Cut it where it crosses the left and right sides.  The parts
+        // outside are pushed onto the sides, where they still count for
+        // the winding, but don't cover anything.
+        float cuts[2];
+        int ncuts = 0;
+        float sides[2] = {0, (float)width};
+        for (int i = 0; i < 2; i++) {
+            if ((x0 < sides[i]) != (x1 < sides[i]) && x0 != x1) {
+                float t = (sides[i] - x0) / (x1 - x0);
+                if (t > 0 && t < 1) {
+                    cuts[ncuts++] = t;
+                }
+            }
+        }
+        if (ncuts == 2 && cuts[0] > cuts[1]) {
+            float tmp = cuts[0]; cuts[0] = cuts[1]; cuts[1] = tmp;
+        }
+
+        float px = x0, py = y0;
+        for (int i = 0; i <= ncuts; i++) {
+            float nx = x1, ny = y1;
+            if (i < ncuts) {
+                nx = x0 + (x1 - x0) * cuts[i];
+                ny = y0 + (y1 - y0) * cuts[i];
+            }
+            accumulateLine(clampX(px), py, clampX(nx), ny, dir);
+            px = nx;
+            py = ny;
+        }
+    }
+
+    /*
+    rowAlpha()
+
+    Sum up a row, and turn it into alpha, 0 to 255, for the pixels
+    [x1, x2) of the row, relative to the area.  Returns false if
+    nothing touched the row.  The row is cleared for the next shape,
+    so each row can only be asked for once, and every row from
+    getTop() to getBottom() has to be.
+    */
+    bool rowAlpha(int y, GRFillRule rule, int &x1, int &x2, const uint8_t *&rowAlphas)
+    {
+        int from = rowMin[y];
+        int to = rowMax[y];
+        if (from >= to) {
+            return false;
+        }
+
+        rowMin[y] = stride;
+        rowMax[y] = 0;
+
+        accumulate(cells + (size_t)y * stride + from, alpha, to - from, rule);
+
+        x1 = from;
+        x2 = to < width ? to : width;
+        rowAlphas = alpha;
+        return x2 > x1;
+    }
+
+    /*
+    accumulate()
+
+    The running sum of count cells, written out as alpha.  The cells are
+    zeroed as they're read.  Under the non-zero rule, coverage is the
+    size of the sum, up to 1.  Under even-odd it goes up and back down
+    again, 0 at even windings, 1 at odd ones.
+    */
+    static void accumulate(float *cells, uint8_t *alpha, int count, GRFillRule rule)
+    {
+#ifdef GR_USE_SSE2
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 two = _mm_set1_ps(2.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 scale = _mm_set1_ps(255.0f);
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        __m128 carry = zero;
+
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+            // a b c d  ->  a, a+b, a+b+c, a+b+c+d, plus what came before
+            __m128 x = _mm_loadu_ps(cells + i);
+            x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+            x = _mm_add_ps(x, _mm_shuffle_ps(zero, x, 0x40));
+            x = _mm_add_ps(x, carry);
+            carry = _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3));
+            _mm_storeu_ps(cells + i, zero);
+
+            __m128 cover = _mm_and_ps(x, absMask);
+            if (rule == GR_EVENODD) {
+                // the distance from the nearest even number
+                __m128 pairs = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_mul_ps(cover, half)));
+                __m128 t = _mm_sub_ps(cover, _mm_mul_ps(pairs, two));
+                cover = _mm_sub_ps(one, _mm_and_ps(_mm_sub_ps(t, one), absMask));
+            }
+            cover = _mm_min_ps(cover, one);
+
+            __m128i v = _mm_cvtps_epi32(_mm_mul_ps(cover, scale));
+            v = _mm_packs_epi32(v, v);
+            v = _mm_packus_epi16(v, v);
+            int32_t four = _mm_cvtsi128_si32(v);
+            memcpy(alpha + i, &four, 4);
+        }
+
+        if (i < count) {
+            float sum = _mm_cvtss_f32(carry);
+            accumulateFrom(cells + i, alpha + i, count - i, rule, sum);
+        }
+#else
+        accumulateScalar(cells, alpha, count, rule);
+#endif
+    }
+
+    // The same thing, a cell at a time
+    static void accumulateScalar(float *cells, uint8_t *alpha, int count, GRFillRule rule)
+    {
+        accumulateFrom(cells, alpha, count, rule, 0);
+    }
+
+private:
+    // realloc(), leaving p as it was if there's no memory
+    template <typename T>
+    static bool grow(T *&p, size_t count)
+    {
+        T *grown = (T *)realloc(p, count * sizeof(T));
+        if (!grown) {
+            return false;
+        }
+        p = grown;
+        return true;
+    }
+
+    // Rasterizers hold on to buffers, so they shouldn't be copied
+    CoverageRasterizer(const CoverageRasterizer &other);
+    CoverageRasterizer & operator=(const CoverageRasterizer &other);
+
+    float clampX(float x) const
+    {
+        if (x < 0) return 0;
+        if (x > width) return (float)width;
+        return x;
+    }
+
+    static void accumulateFrom(float *cells, uint8_t *alpha, int count, GRFillRule rule, float sum)
+    {
+        for (int i = 0; i < count; i++) {
+            sum += cells[i];
+            cells[i] = 0;
+
+            float cover = fabsf(sum);
+            if (rule == GR_EVENODD) {
+                float t = cover - 2 * (float)(int)(cover * 0.5f);
+                cover = 1 - fabsf(t - 1);
+            }
+            if (cover > 1) {
+                cover = 1;
+            }
+            alpha[i] = (uint8_t)(cover * 255 + 0.5f);
+        }
+    }
+
+    /*
+    accumulateLine()
+
+    Add a line that's already in the area, going downwards, into the
+    cells.  For each row it crosses, the part of the row's height it
+    covers, dy, is shared out between the cells it passes through,
+    by how much of each cell is to the right of it.  A cell wholly to
+    the right of the line gets all of dy, which goes into the first
+    cell past it, so the running sum carries it along the row.
+    */
+    void accumulateLine(float x0, float y0, float x1, float y1, float dir)
+    {
+        if (y0 == y1) {
+            return;
+        }
+
+        float dxdy = (x1 - x0) / (y1 - y0);
+        float x = x0;
+        int first = (int)y0;
+        int last = (int)ceilf(y1);
+        if (last > height) {
+            last = height;
+        }
+
+        if (first < top) top = first;
+        if (last > bottom) bottom = last;
+
+        for (int y = first; y < last; y++) {
+            float *row = cells + (size_t)y * stride;
+            float rowTop = y > y0 ? (float)y : y0;
+            float rowBottom = y + 1 < y1 ? (float)(y + 1) : y1;
+            float dy = rowBottom - rowTop;
+            float xnext = clampX(x + dxdy * dy);     // rounding can drift past the sides
+            float d = dy * dir;
+
+            float left = x < xnext ? x : xnext;
+            float right = x < xnext ? xnext : x;
+            float leftFloor = floorf(left);
+            int li = (int)leftFloor;
+            float rightCeil = ceilf(right);
+            int ri = (int)rightCeil;
+
+            if (li < rowMin[y]) rowMin[y] = li;
+            if (ri + 2 > rowMax[y]) rowMax[y] = ri + 2 < stride ? ri + 2 : stride;
+
+            if (ri <= li + 1) {
+                // within one cell, split by where the middle of it is
+                float mid = 0.5f * (x + xnext) - leftFloor;
+                row[li] += d - d * mid;
+                row[li + 1] += d * mid;
+            } else {
+                // across several, each gets the area of a slice of a
+                // triangle, growing linearly in between
+                float s = 1.0f / (right - left);
+                float lf = left - leftFloor;
+                float a0 = 0.5f * s * (1 - lf) * (1 - lf);
+                float rf = right - rightCeil + 1;
+                float am = 0.5f * s * rf * rf;
+
+                row[li] += d * a0;
+                if (ri == li + 2) {
+                    row[li + 1] += d * (1 - a0 - am);
+                } else {
+                    float a1 = s * (1.5f - lf);
+                    row[li + 1] += d * (a1 - a0);
+                    for (int xi = li + 2; xi < ri - 1; xi++) {
+                        row[xi] += d * s;
+                    }
+                    float a2 = a1 + (ri - li - 3) * s;
+                    row[ri - 1] += d * (1 - a2 - am);
+                }
+                row[ri] += d * am;
+            }
+
+            x = xnext;
+        }
+    }
+
+    GRRectangle area;
+
+    float *cells;               // stride x height, zero between shapes
+    size_t cellCapacity;
+    int *rowMin, *rowMax;       // the cells touched in each row
+    int rowCapacity;
+    uint8_t *alpha;             // one row of output
+    int alphaCapacity;
+
+    int width, height, stride;
+    int top, bottom;
+};
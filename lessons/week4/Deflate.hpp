@@ -0,0 +1,831 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+    Deflater
+
+    Deflate compression (RFC 1951), the kind inside zlib streams and
+    PNG files, with nothing from outside.
+
+    Matches are found with hash chains over a 32K window, and with a
+    level from 1 to 9, longer chains and lazy matching are traded for
+    speed, like zlib's levels.  Level 0 doesn't look for matches at
+    all, and just stores.  The matches and literals are collected into
+    blocks of a few thousand, and each block is written with its own
+    Huffman codes, the fixed ones, or stored as it is, whichever comes
+    out smallest.
+
+    Each call to compress() starts with an empty window, and if it
+    isn't the last, ends on a byte boundary with an empty stored block
+    (a sync flush).  So pieces of one stream can be compressed on
+    different threads, each with its own Deflater, and their output
+    just put one after the other.
+
+        Deflater deflater(6);
+        deflater.compress(data, size, true);
+        fwrite(deflater.getOutput(), 1, deflater.getOutputSize(), fp);
+*/
+class Deflater
+{
+public:
+    static const int WindowSize = 32768;
+    static const int MinMatch = 3;
+    static const int MaxMatch = 258;
+    static const int HashBits = 15;
+
+    // Matches and literals in a block, before it's written
+    static const int BlockTokens = 16384;
+
+    Deflater(int alevel = 6)
+        : level(alevel < 0 ? 0 : alevel > 9 ? 9 : alevel),
+        head(NULL), prev(NULL), tokenLength(NULL), tokenValue(NULL), tokenCount(0),
+        output(NULL), outputSize(0), outputCapacity(0), bits(0), bitCount(0), failed(false)
+    {
+        head = (int32_t *)malloc((1 << HashBits) * sizeof(int32_t));
+        prev = (int32_t *)malloc(WindowSize * sizeof(int32_t));
+        tokenLength = (uint16_t *)malloc(BlockTokens * sizeof(uint16_t));
+        tokenValue = (uint16_t *)malloc(BlockTokens * sizeof(uint16_t));
+        failed = !head || !prev || !tokenLength || !tokenValue;
+    }
+
+    virtual ~Deflater()
+    {
+        free(head);
+        free(prev);
+        free(tokenLength);
+        free(tokenValue);
+        free(output);
+    }
+
+    int getLevel() const { return level; }
+
+    /*
+        compress()
+
+        Compress size bytes onto the end of the output.  The last piece
+        of a stream ends with the final block, any other with a sync
+        flush, so the next piece can follow on.  Returns false if memory
+        ran out, and then the output isn't a stream.
+    */
+    bool compress(const uint8_t *data, size_t size, bool last)
+    {
+        if (failed) {
+            return false;
+        }
+
+        if (level == 0) {
+            writeStored(data, size, last);
+        } else {
+            compressMatches(data, size, last);
+        }
+
+        if (!last) {
+            // an empty stored block, to get to a byte boundary
+            putBits(0, 3);
+            alignBits();
+            putByte(0x00);
+            putByte(0x00);
+            putByte(0xff);
+            putByte(0xff);
+        } else {
+            alignBits();
+        }
+
+        return !failed;
+    }
+
+    const uint8_t * getOutput() const { return output; }
+    size_t getOutputSize() const { return outputSize; }
+
+    // Start over with an empty output, keeping the memory
+    void clearOutput()
+    {
+        outputSize = 0;
+        bits = 0;
+        bitCount = 0;
+        failed = !head || !prev || !tokenLength || !tokenValue;
+    }
+
+    // The zlib stream header, which says it's deflate with a 32K window
+    static void zlibHeader(int level, uint8_t header[2])
+    {
+        header[0] = 0x78;
+        header[1] = level <= 1 ? 0x01 : level <= 5 ? 0x5e : level <= 6 ? 0x9c : 0xda;
+    }
+
+    // The zlib checksum, carried on from adler, which starts at 1
+    static uint32_t adler32(uint32_t adler, const uint8_t *data, size_t size)
+    {
+        const uint32_t BASE = 65521;
+        uint32_t a = adler & 0xffff;
+        uint32_t b = adler >> 16;
+
+        // 5552 bytes is as many as can be summed before b could overflow
+        while (size > 0) {
+            size_t n = size < 5552 ? size : 5552;
+            size -= n;
+            while (n--) {
+                a += *data++;
+                b += a;
+            }
+            a %= BASE;
+            b %= BASE;
+        }
+        return (b << 16) | a;
+    }
+
+    // The checksum of two pieces one after the other, from the
+    // checksums of each, and the size of the second
+    static uint32_t adler32Combine(uint32_t adler1, uint32_t adler2, size_t size2)
+    {
+        const uint32_t BASE = 65521;
+        uint32_t rem = (uint32_t)(size2 % BASE);
+        uint32_t sum1 = adler1 & 0xffff;
+        uint32_t sum2 = (uint32_t)(((uint64_t)rem * sum1) % BASE);
+        sum1 += (adler2 & 0xffff) + BASE - 1;
+        sum2 += (adler1 >> 16) + (adler2 >> 16) + BASE - rem;
+        if (sum1 >= BASE) sum1 -= BASE;
+        if (sum1 >= BASE) sum1 -= BASE;
+        if (sum2 >= (BASE << 1)) sum2 -= (BASE << 1);
+        if (sum2 >= BASE) sum2 -= BASE;
+        return sum1 | (sum2 << 16);
+    }
+
+private:
+    // How hard each level looks for matches
+    struct LevelConfig {
+        int chain;      // most hash chain links to follow
+        int nice;       // stop looking once a match is this long
+        bool lazy;      // check the next byte for a longer match first
+        int insert;     // the positions inside matches up to this long go in the chains
+    };
+
+    static const LevelConfig & config(int level)
+    {
+        static const LevelConfig configs[10] = {
+            {0, 0, false, 0},
+            {4, 8, false, 4}, {4, 16, false, 5}, {8, 32, false, 6},
+            {16, 32, true, MaxMatch}, {32, 64, true, MaxMatch}, {64, 128, true, MaxMatch},
+            {128, 128, true, MaxMatch}, {256, 258, true, MaxMatch}, {1024, 258, true, MaxMatch}
+        };
+        return configs[level];
+    }
+
+    // Length and distance codes, their extra bits, and lookups from a
+    // length or distance to its code
+    struct Tables {
+        uint16_t lengthBase[29];
+        uint8_t lengthExtra[29];
+        uint16_t distBase[30];
+        uint8_t distExtra[30];
+        uint8_t lengthCode[MaxMatch + 1];
+        uint8_t distCode[512];
+
+        Tables()
+        {
+            static const uint16_t lbase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+            static const uint8_t lextra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+            static const uint16_t dbase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+            static const uint8_t dextra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+            memcpy(lengthBase, lbase, sizeof(lbase));
+            memcpy(lengthExtra, lextra, sizeof(lextra));
+            memcpy(distBase, dbase, sizeof(dbase));
+            memcpy(distExtra, dextra, sizeof(dextra));
+
+            for (int code = 0; code < 29; code++) {
+                int end = code == 28 ? MaxMatch + 1 : lbase[code + 1];
+                for (int len = lbase[code]; len < end; len++) {
+                    lengthCode[len] = (uint8_t)code;
+                }
+            }
+            // distances up to 256 are looked up directly, longer ones by
+            // (distance - 1) / 128, as the codes are 128 apart by then
+            for (int code = 0; code < 30; code++) {
+                int end = code == 29 ? 32769 : dbase[code + 1];
+                for (int dist = dbase[code]; dist < end; dist++) {
+                    int d = dist - 1;
+                    if (d < 256) {
+                        distCode[d] = (uint8_t)code;
+                    } else {
+                        distCode[256 + (d >> 7)] = (uint8_t)code;
+                    }
+                }
+            }
+        }
+
+        int distanceCode(int dist) const
+        {
+            int d = dist - 1;
+            return d < 256 ? distCode[d] : distCode[256 + (d >> 7)];
+        }
+    };
+
+    static const Tables & tables()
+    {
+        static const Tables t;
+        return t;
+    }
+
+    // A Huffman code, the bit lengths and the codes themselves, reversed,
+    // because deflate packs bits from the bottom of each byte
+    struct Code {
+        uint8_t lengths[288];
+        uint16_t codes[288];
+        int count;
+    };
+
+    // Hash of the 3 bytes at p
+    static uint32_t hash3(const uint8_t *p)
+    {
+        uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+        return (v * 2654435761u) >> (32 - HashBits);
+    }
+
+    void compressMatches(const uint8_t *data, size_t size, bool last)
+    {
+        const LevelConfig &cfg = config(level);
+        for (int i = 0; i < (1 << HashBits); i++) {
+            head[i] = -1;
+        }
+
+        size_t blockStart = 0;
+        size_t pos = 0;
+        tokenCount = 0;
+
+        // a match found for pos while checking the one before it
+        bool ahead = false;
+        int aheadLength = 0, aheadDist = 0;
+
+        while (pos < size) {
+            int length = 0, dist = 0;
+            if (ahead) {
+                length = aheadLength;
+                dist = aheadDist;
+                ahead = false;
+            } else {
+                findMatch(data, size, pos, cfg, length, dist);
+            }
+            insert(data, size, pos);
+
+            if (length >= MinMatch && cfg.lazy && length < cfg.nice && pos + 1 < size) {
+                findMatch(data, size, pos + 1, cfg, aheadLength, aheadDist);
+                ahead = true;
+                if (aheadLength > length) {
+                    length = 0;
+                }
+            }
+
+            if (length >= MinMatch) {
+                addToken((uint16_t)length, (uint16_t)dist);
+                if (length <= cfg.insert) {
+                    for (int i = 1; i < length; i++) {
+                        insert(data, size, pos + i);
+                    }
+                }
+                pos += length;
+                ahead = false;
+            } else {
+                addToken(0, data[pos]);
+                pos++;
+            }
+
+            if (tokenCount == BlockTokens) {
+                writeBlock(data + blockStart, pos - blockStart, false);
+                blockStart = pos;
+            }
+        }
+
+        // the last piece always needs a final block, even an empty one
+        if (tokenCount > 0 || last) {
+            writeBlock(data + blockStart, pos - blockStart, last);
+        }
+    }
+
+    // Add position pos to the front of its hash chain
+    void insert(const uint8_t *data, size_t size, size_t pos)
+    {
+        if (pos + MinMatch > size) {
+            return;
+        }
+        uint32_t h = hash3(data + pos);
+        prev[pos & (WindowSize - 1)] = head[h];
+        head[h] = (int32_t)pos;
+    }
+
+    // The longest match for pos, going back along its hash chain
+    void findMatch(const uint8_t *data, size_t size, size_t pos, const LevelConfig &cfg, int &length, int &dist)
+    {
+        length = 0;
+        dist = 0;
+        if (pos + MinMatch > size) {
+            return;
+        }
+
+        int most = size - pos < (size_t)MaxMatch ? (int)(size - pos) : MaxMatch;
+        int best = MinMatch - 1;
+        int chain = cfg.chain;
+        int32_t cur = head[hash3(data + pos)];
+        const uint8_t *here = data + pos;
+
+        while (cur >= 0 && pos - cur <= (size_t)WindowSize && chain-- > 0) {
+            const uint8_t *there = data + cur;
+            if (there[best] == here[best] && there[0] == here[0]) {
+                int len = matchLength(here, there, most);
+                if (len > best) {
+                    best = len;
+                    dist = (int)(pos - cur);
+                    if (len >= cfg.nice || len == most) {
+                        break;
+                    }
+                }
+            }
+            int32_t next = prev[cur & (WindowSize - 1)];
+            if (next >= cur) {
+                break;  // that link has been overwritten by a newer position
+            }
+            cur = next;
+        }
+
+        // a short match far back costs more than the literals
+        if (best == MinMatch && dist > 4096) {
+            best = 0;
+        }
+        if (best >= MinMatch) {
+            length = best;
+        } else {
+            dist = 0;
+        }
+    }
+
+    // How many bytes are the same, up to most, compared 8 at a time
+    static int matchLength(const uint8_t *a, const uint8_t *b, int most)
+    {
+        int len = 0;
+        while (len + 8 <= most) {
+            uint64_t x, y;
+            memcpy(&x, a + len, 8);
+            memcpy(&y, b + len, 8);
+            uint64_t diff = x ^ y;
+            if (diff) {
+                // the first different byte, counting from the bottom
+                while ((diff & 0xff) == 0) {
+                    diff >>= 8;
+                    len++;
+                }
+                return len;
+            }
+            len += 8;
+        }
+        while (len < most && a[len] == b[len]) {
+            len++;
+        }
+        return len;
+    }
+
+    void addToken(uint16_t length, uint16_t value)
+    {
+        tokenLength[tokenCount] = length;
+        tokenValue[tokenCount] = value;
+        tokenCount++;
+    }
+
+    /*
+        writeBlock()
+
+        Write the tokens collected so far, for the size bytes at data,
+        as whichever kind of block is smallest.
+    */
+    void writeBlock(const uint8_t *data, size_t size, bool final)
+    {
+        const Tables &t = tables();
+        uint32_t litFreq[286] = {0};
+        uint32_t distFreq[30] = {0};
+        uint64_t extraBits = 0;
+
+        for (int i = 0; i < tokenCount; i++) {
+            if (tokenLength[i] == 0) {
+                litFreq[tokenValue[i]]++;
+            } else {
+                int lc = t.lengthCode[tokenLength[i]];
+                int dc = t.distanceCode(tokenValue[i]);
+                litFreq[257 + lc]++;
+                distFreq[dc]++;
+                extraBits += t.lengthExtra[lc] + t.distExtra[dc];
+            }
+        }
+        litFreq[256] = 1;
+
+        Code lit, dist;
+        buildCode(litFreq, 286, 15, lit);
+        buildCode(distFreq, 30, 15, dist);
+
+        // the code lengths, run length encoded, for the dynamic header
+        uint8_t runs[286 + 30];
+        uint8_t runExtra[286 + 30];
+        int runCount = 0;
+        Code runCode;
+        int hlit, hdist, hclen;
+        uint64_t headerBits = dynamicHeader(lit, dist, runs, runExtra, runCount, runCode, hlit, hdist, hclen);
+
+        uint64_t dynamicBits = 3 + headerBits + extraBits;
+        uint64_t fixedBits = 3 + extraBits;
+        Code fixedLit, fixedDist;
+        fixedCodes(fixedLit, fixedDist);
+        for (int i = 0; i < 286; i++) {
+            dynamicBits += (uint64_t)litFreq[i] * lit.lengths[i];
+            fixedBits += (uint64_t)litFreq[i] * fixedLit.lengths[i];
+        }
+        for (int i = 0; i < 30; i++) {
+            dynamicBits += (uint64_t)distFreq[i] * dist.lengths[i];
+            fixedBits += (uint64_t)distFreq[i] * fixedDist.lengths[i];
+        }
+        // LEN and NLEN for every 65535 bytes, and the padding
+        uint64_t storedBits = ((uint64_t)size + 5 * (size / 65535 + 1)) * 8 + 7;
+
+        if (storedBits < dynamicBits && storedBits < fixedBits) {
+            writeStored(data, size, final);
+        } else if (fixedBits <= dynamicBits) {
+            putBits(final ? 1 : 0, 1);
+            putBits(1, 2);
+            writeTokens(fixedLit, fixedDist);
+        } else {
+            putBits(final ? 1 : 0, 1);
+            putBits(2, 2);
+            putBits(hlit - 257, 5);
+            putBits(hdist - 1, 5);
+            putBits(hclen - 4, 4);
+            for (int i = 0; i < hclen; i++) {
+                putBits(runCode.lengths[lengthOrder()[i]], 3);
+            }
+            static const uint8_t extraFor[3] = {2, 3, 7};
+            for (int i = 0; i < runCount; i++) {
+                putBits(runCode.codes[runs[i]], runCode.lengths[runs[i]]);
+                if (runs[i] >= 16) {
+                    putBits(runExtra[i], extraFor[runs[i] - 16]);
+                }
+            }
+            writeTokens(lit, dist);
+        }
+
+        tokenCount = 0;
+    }
+
+    void writeTokens(const Code &lit, const Code &dist)
+    {
+        const Tables &t = tables();
+        for (int i = 0; i < tokenCount; i++) {
+            if (tokenLength[i] == 0) {
+                putBits(lit.codes[tokenValue[i]], lit.lengths[tokenValue[i]]);
+            } else {
+                int length = tokenLength[i];
+                int distance = tokenValue[i];
+                int lc = t.lengthCode[length];
+                int dc = t.distanceCode(distance);
+                putBits(lit.codes[257 + lc], lit.lengths[257 + lc]);
+                putBits(length - t.lengthBase[lc], t.lengthExtra[lc]);
+                putBits(dist.codes[dc], dist.lengths[dc]);
+                putBits(distance - t.distBase[dc], t.distExtra[dc]);
+            }
+        }
+        putBits(lit.codes[256], lit.lengths[256]);
+    }
+
+    // Stored blocks, at most 65535 bytes each
+    void writeStored(const uint8_t *data, size_t size, bool final)
+    {
+        do {
+            size_t n = size < 65535 ? size : 65535;
+            size -= n;
+            putBits(final && size == 0 ? 1 : 0, 1);
+            putBits(0, 2);
+            alignBits();
+            putByte((uint8_t)n);
+            putByte((uint8_t)(n >> 8));
+            putByte((uint8_t)~n);
+            putByte((uint8_t)(~n >> 8));
+            if (!reserve(n)) {
+                return;
+            }
+            memcpy(output + outputSize, data, n);
+            outputSize += n;
+            data += n;
+        } while (size > 0);
+    }
+
+    // The order the code length code lengths go in, most likely used first
+    static const uint8_t * lengthOrder()
+    {
+        static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+        return order;
+    }
+
+    /*
+        dynamicHeader()
+
+        Run length encode the literal and distance code lengths, build
+        the code for that, and return how many bits the header will be.
+        16 repeats the last length 3 to 6 times, 17 and 18 are runs of
+        3 to 10 and 11 to 138 zeros.
+    */
+    uint64_t dynamicHeader(const Code &lit, const Code &dist, uint8_t *runs, uint8_t *runExtra, int &runCount,
+        Code &runCode, int &hlit, int &hdist, int &hclen)
+    {
+        hlit = 286;
+        while (hlit > 257 && lit.lengths[hlit - 1] == 0) {
+            hlit--;
+        }
+        hdist = 30;
+        while (hdist > 1 && dist.lengths[hdist - 1] == 0) {
+            hdist--;
+        }
+
+        uint8_t lengths[286 + 30];
+        memcpy(lengths, lit.lengths, hlit);
+        memcpy(lengths + hlit, dist.lengths, hdist);
+        int total = hlit + hdist;
+
+        runCount = 0;
+        for (int i = 0; i < total;) {
+            int value = lengths[i];
+            int run = 1;
+            while (i + run < total && lengths[i + run] == value) {
+                run++;
+            }
+
+            if (value == 0 && run >= 3) {
+                int n = run > 138 ? 138 : run;
+                runs[runCount] = n >= 11 ? 18 : 17;
+                runExtra[runCount++] = (uint8_t)(n >= 11 ? n - 11 : n - 3);
+                i += n;
+            } else if (value != 0 && run >= 4) {
+                runs[runCount] = (uint8_t)value;
+                runExtra[runCount++] = 0;
+                int n = run - 1 > 6 ? 6 : run - 1;
+                runs[runCount] = 16;
+                runExtra[runCount++] = (uint8_t)(n - 3);
+                i += 1 + n;
+            } else {
+                runs[runCount] = (uint8_t)value;
+                runExtra[runCount++] = 0;
+                i++;
+            }
+        }
+
+        uint32_t freq[19] = {0};
+        for (int i = 0; i < runCount; i++) {
+            freq[runs[i]]++;
+        }
+        buildCode(freq, 19, 7, runCode);
+
+        hclen = 19;
+        while (hclen > 4 && runCode.lengths[lengthOrder()[hclen - 1]] == 0) {
+            hclen--;
+        }
+
+        uint64_t bitCount = 5 + 5 + 4 + 3 * hclen;
+        for (int i = 0; i < runCount; i++) {
+            bitCount += runCode.lengths[runs[i]];
+            if (runs[i] == 16) bitCount += 2;
+            if (runs[i] == 17) bitCount += 3;
+            if (runs[i] == 18) bitCount += 7;
+        }
+        return bitCount;
+    }
+
+    static void fixedCodes(Code &lit, Code &dist)
+    {
+        for (int i = 0; i < 288; i++) {
+            lit.lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+        }
+        lit.count = 288;
+        for (int i = 0; i < 30; i++) {
+            dist.lengths[i] = 5;
+        }
+        dist.count = 30;
+        makeCodes(lit);
+        makeCodes(dist);
+    }
+
+    /*
+        buildCode()
+
+        Huffman code lengths for the frequencies, no longer than limit.
+        If the tree comes out too deep, the frequencies are halved,
+        which flattens it, and it's built again.  A code needs at least
+        two symbols, so one is made up if there's only one, or none.
+    */
+    static void buildCode(const uint32_t *freq, int count, int limit, Code &code)
+    {
+        code.count = count;
+        memset(code.lengths, 0, sizeof(code.lengths));
+
+        int used[288];
+        int nUsed = 0;
+        for (int i = 0; i < count; i++) {
+            if (freq[i]) {
+                used[nUsed++] = i;
+            }
+        }
+        if (nUsed < 2) {
+            code.lengths[0] = 1;
+            code.lengths[1] = 1;
+            if (nUsed == 1 && used[0] > 1) {
+                code.lengths[1] = 0;
+                code.lengths[used[0]] = 1;
+            }
+            makeCodes(code);
+            return;
+        }
+
+        uint32_t weight[288];
+        for (int i = 0; i < nUsed; i++) {
+            weight[i] = freq[used[i]];
+        }
+
+        while (true) {
+            if (huffmanLengths(weight, nUsed, used, limit, code.lengths)) {
+                break;
+            }
+            for (int i = 0; i < nUsed; i++) {
+                weight[i] = (weight[i] + 1) / 2;
+            }
+        }
+        makeCodes(code);
+    }
+
+    // Build the tree with two queues, the leaves sorted by weight and
+    // the joined nodes, which come out in order.  False if too deep.
+    static bool huffmanLengths(const uint32_t *weight, int n, const int *symbols, int limit, uint8_t *lengths)
+    {
+        int order[288];
+        for (int i = 0; i < n; i++) {
+            order[i] = i;
+        }
+        // insertion sort, there are at most a few hundred
+        for (int i = 1; i < n; i++) {
+            int v = order[i];
+            int j = i;
+            while (j > 0 && weight[order[j - 1]] > weight[v]) {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = v;
+        }
+
+        // nodes 0..n-1 are leaves, in sorted order, n.. are joined
+        uint64_t nodeWeight[576];
+        int parent[576];
+        for (int i = 0; i < n; i++) {
+            nodeWeight[i] = weight[order[i]];
+        }
+        int leaf = 0, joined = n, next = n;
+        for (int k = 0; k < n - 1; k++) {
+            int pick[2];
+            for (int p = 0; p < 2; p++) {
+                if (leaf < n && (joined >= next || nodeWeight[leaf] <= nodeWeight[joined])) {
+                    pick[p] = leaf++;
+                } else {
+                    pick[p] = joined++;
+                }
+            }
+            nodeWeight[next] = nodeWeight[pick[0]] + nodeWeight[pick[1]];
+            parent[pick[0]] = next;
+            parent[pick[1]] = next;
+            next++;
+        }
+
+        // depths, from the root down, as parents come after children
+        int depth[576];
+        depth[next - 1] = 0;
+        for (int i = next - 2; i >= 0; i--) {
+            depth[i] = depth[parent[i]] + 1;
+            if (i < n && depth[i] > limit) {
+                return false;
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            lengths[symbols[order[i]]] = (uint8_t)depth[i];
+        }
+        return true;
+    }
+
+    // Canonical codes from the lengths, bit reversed
+    static void makeCodes(Code &code)
+    {
+        int lengthCount[16] = {0};
+        for (int i = 0; i < code.count; i++) {
+            lengthCount[code.lengths[i]]++;
+        }
+        lengthCount[0] = 0;
+
+        int nextCode[16];
+        int c = 0;
+        for (int bits = 1; bits < 16; bits++) {
+            c = (c + lengthCount[bits - 1]) << 1;
+            nextCode[bits] = c;
+        }
+
+        for (int i = 0; i < code.count; i++) {
+            int len = code.lengths[i];
+            code.codes[i] = 0;
+            if (len) {
+                int value = nextCode[len]++;
+                int reversed = 0;
+                for (int b = 0; b < len; b++) {
+                    reversed = (reversed << 1) | ((value >> b) & 1);
+                }
+                code.codes[i] = (uint16_t)reversed;
+            }
+        }
+    }
+
+    // Room for more bytes of output; once it can't be had, nothing more
+    // is written
+    bool reserve(size_t more)
+    {
+        if (failed) {
+            return false;
+        }
+        if (outputSize + more <= outputCapacity) {
+            return true;
+        }
+        size_t capacity = outputCapacity ? outputCapacity * 2 : 65536;
+        while (capacity < outputSize + more) {
+            capacity *= 2;
+        }
+        uint8_t *grown = (uint8_t *)realloc(output, capacity);
+        if (!grown) {
+            failed = true;
+            return false;
+        }
+        output = grown;
+        outputCapacity = capacity;
+        return true;
+    }
+
+    void putByte(uint8_t value)
+    {
+        if (reserve(1)) {
+            output[outputSize++] = value;
+        }
+    }
+
+    // Bits go in from the bottom, a whole number of bytes at a time
+    void putBits(uint32_t value, int count)
+    {
+        bits |= (uint64_t)value << bitCount;
+        bitCount += count;
+        if (bitCount >= 32) {
+            if (reserve(4)) {
+                uint8_t *out = output + outputSize;
+                out[0] = (uint8_t)bits;
+                out[1] = (uint8_t)(bits >> 8);
+                out[2] = (uint8_t)(bits >> 16);
+                out[3] = (uint8_t)(bits >> 24);
+                outputSize += 4;
+            }
+            bits >>= 32;
+            bitCount -= 32;
+        }
+    }
+
+    // Write out what's left, padded to a byte
+    void alignBits()
+    {
+        while (bitCount > 0) {
+            if (reserve(1)) {
+                output[outputSize++] = (uint8_t)bits;
+            }
+            bits >>= 8;
+            bitCount = bitCount > 8 ? bitCount - 8 : 0;
+        }
+        bits = 0;
+    }
+
+    // Not copyable, it owns its buffers
+    Deflater(const Deflater &);
+    Deflater & operator=(const Deflater &);
+
+    int level;
+
+    int32_t *head;          // the newest position for each hash
+    int32_t *prev;          // the one before, for each position in the window
+
+    uint16_t *tokenLength;  // 0 for a literal
+    uint16_t *tokenValue;   // the literal, or the distance back
+    int tokenCount;
+
+    uint8_t *output;
+    size_t outputSize;
+    size_t outputCapacity;
+    uint64_t bits;          // bits waiting to be written, from the bottom
+    int bitCount;
+    bool failed;            // memory ran out, the output is incomplete
+};
@@ -0,0 +1,371 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "grtypes.hpp"
+
+/*
+    A DisplayList is a recording of drawing commands.
+
+    Rather than touching pixels, a DrawingContext that is recording
+    appends each command to the list.  The list can then be played
+    back onto any PixelBuffer (through a DrawingContext), as many
+    times as you like, and at any offset.
+
+    The commands are stored in a single contiguous array of 32-bit words.
+    Each command is an opcode word, followed by a fixed number of
+    argument words, which depends on the opcode.  Colors are stored
+    as their intValue.  There are no pointers in the stream, so a
+    list can be copied around, or written to disk, as a single block.
+
+    A few commands, like polygons, don't have a fixed number of
+    arguments.  For those, the first argument word is how many more
+    words follow it.
+
+    Commands ending in FX have their coordinates in 24.8 fixed point
+    (GRFIXED), rather than whole pixels.
+*/
+
+enum DisplayOp {
+    DL_SETBACKGROUND,   // color
+    DL_SETFILL,         // color
+    DL_SETSTROKE,       // color
+    DL_SETCLIP,         // x, y, width, height
+    DL_CLEARCLIP,       //
+    DL_CLEAR,           //
+    DL_FILLPIXEL,       // x, y
+    DL_HORZLINE,        // x, y, width
+    DL_VERTLINE,        // x, y, length
+    DL_LINE,            // x1, y1, x2, y2
+    DL_STROKERECT,      // x, y, width, height
+    DL_FILLRECT,        // x, y, width, height
+    DL_STROKEELLIPSE,   // cx, cy, xradius, yradius
+    DL_FILLELLIPSE,     // cx, cy, xradius, yradius
+    DL_STROKETRIANGLE,  // x1, y1, x2, y2, x3, y3
+    DL_FILLTRIANGLE,    // x1, y1, x2, y2, x3, y3
+    DL_FILLRECTCOLOR,   // color, x, y, width, height
+    DL_FILLELLIPSECOLOR,// color, cx, cy, xradius, yradius
+    DL_LINECOLOR,       // color, x1, y1, x2, y2
+    DL_SHADETRIANGLE,   // x1, y1, color1, x2, y2, color2, x3, y3, color3
+    DL_LINEFX,          // x1, y1, x2, y2
+    DL_FILLTRIANGLEFX,  // x1, y1, x2, y2, x3, y3
+    DL_STROKEELLIPSEFX, // cx, cy, xradius, yradius
+    DL_FILLELLIPSEFX,   // cx, cy, xradius, yradius
+    DL_FILLPOLYGON,     // nwords, rule, x1, y1, x2, y2, ... (fixed point)
+    DL_LINEFXCOLOR,     // color, x1, y1, x2, y2
+    DL_FILLPOLYGONCOLOR,// nwords, color, rule, x1, y1, x2, y2, ...
+    DL_SHADETRIANGLEFX, // x1, y1, color1, x2, y2, color2, x3, y3, color3
+    DL_FILLPOLYGONAA,   // nwords, rule, x1, y1, x2, y2, ... (anti-aliased)
+
+    DL_NUMOPS
+};
+
+// Marks a command whose first argument is its length
+#define DL_VARIABLE     -1
+
+// How many argument words follow each opcode
+static const int DisplayOpArgs[DL_NUMOPS] = {
+    1, 1, 1,        // colors
+    4, 0,           // clipping
+    0,              // clear
+    2,              // pixel
+    3, 3, 4,        // lines
+    4, 4,           // rectangles
+    4, 4,           // ellipses
+    6, 6,           // triangles
+    5, 5, 5,        // primitives with their own color, from batches
+    9,              // smooth shaded triangle
+    4, 6, 4, 4,     // fixed point line, triangle, ellipses
+    DL_VARIABLE,    // polygon
+    5, DL_VARIABLE, // fixed point primitives with their own color
+    9,              // fixed point smooth shaded triangle
+    DL_VARIABLE     // anti-aliased polygon
+};
+
+class DisplayList
+{
+public:
+    DisplayList()
+        : words(nullptr), count(0), capacity(0)
+    {}
+
+    virtual ~DisplayList()
+    {
+        free(words);
+    }
+
+    // Throw away the recorded commands, but keep the memory
+    // around, so re-recording a list doesn't allocate
+    void reset()
+    {
+        count = 0;
+    }
+
+    bool isEmpty() const { return count == 0; }
+
+    // Number of 32-bit words used by the recording
+    size_t size() const { return count; }
+
+    const int32_t * getData() const { return words; }
+
+    // Append a command, returning a pointer to where its
+    // arguments should be written, or NULL if the list couldn't
+    // grow.  The pointer is only good until the next call to append()
+    int32_t * append(DisplayOp op)
+    {
+        size_t needed = count + 1 + DisplayOpArgs[op];
+        if (needed > capacity && !grow(needed)) {
+            return NULL;
+        }
+
+        int32_t * cmd = &words[count];
+        cmd[0] = op;
+        count = needed;
+
+        return cmd + 1;
+    }
+
+    // Append a command with a variable number of arguments,
+    // returning a pointer to where its nwords words go, or NULL
+    int32_t * appendVariable(DisplayOp op, int nwords)
+    {
+        size_t needed = count + 2 + nwords;
+        if (needed > capacity && !grow(needed)) {
+            return NULL;
+        }
+
+        int32_t * cmd = &words[count];
+        cmd[0] = op;
+        cmd[1] = nwords;
+        count = needed;
+
+        return cmd + 2;
+    }
+
+    bool appendColor(DisplayOp op, const PixRGBA pix)
+    {
+        int32_t * args = append(op);
+        if (!args) {
+            return false;
+        }
+        args[0] = (int32_t)pix.intValue;
+        return true;
+    }
+
+    bool appendArgs(DisplayOp op, int a0=0, int a1=0, int a2=0, int a3=0, int a4=0, int a5=0)
+    {
+        int32_t * args = append(op);
+        if (!args) {
+            return false;
+        }
+        int32_t values[6] = {a0, a1, a2, a3, a4, a5};
+        for (int i = 0; i < DisplayOpArgs[op]; i++) {
+            args[i] = values[i];
+        }
+        return true;
+    }
+
+    // Append a copy of a command taken from another list
+    bool appendCommand(const int32_t *cmd)
+    {
+        int size = commandSize(cmd);
+        if (count + size > capacity && !grow(count + size)) {
+            return false;
+        }
+
+        memcpy(&words[count], cmd, size * sizeof(int32_t));
+        count = count + size;
+        return true;
+    }
+
+    // The number of words in the command starting at cmd
+    static int commandSize(const int32_t *cmd)
+    {
+        if (DisplayOpArgs[cmd[0]] == DL_VARIABLE) {
+            return 2 + cmd[1];
+        }
+        return 1 + DisplayOpArgs[cmd[0]];
+    }
+
+    /*
+    getBounds()
+
+    Work out a rectangle that contains every pixel the command at cmd
+    could possibly touch, shifted by (dx, dy).  Returns false for
+    commands that are not limited to an area, such as state changes
+    and clear(), which have to be applied everywhere.
+    */
+    static bool getBounds(const int32_t *cmd, GRRectangle &bounds, int dx=0, int dy=0)
+    {
+        const int32_t *a = cmd + 1;
+
+        switch (cmd[0]) {
+            case DL_FILLPIXEL:
+                bounds = GRRectangle(a[0], a[1], 1, 1);
+            break;
+
+            case DL_HORZLINE:
+                bounds = GRRectangle(a[0], a[1], a[2], 1);
+            break;
+
+            case DL_VERTLINE:
+                bounds = GRRectangle(a[0], a[1], 1, a[2]);
+            break;
+
+            case DL_STROKERECT:
+            case DL_FILLRECT:
+                bounds = GRRectangle(a[0], a[1], a[2], a[3]);
+            break;
+
+            case DL_STROKEELLIPSE:
+            case DL_FILLELLIPSE:
+                bounds = GRRectangle(a[0] - a[2], a[1] - a[3], 2 * a[2] + 1, 2 * a[3] + 1);
+            break;
+
+            case DL_FILLRECTCOLOR:
+                bounds = GRRectangle(a[1], a[2], a[3], a[4]);
+            break;
+
+            case DL_FILLELLIPSECOLOR:
+                bounds = GRRectangle(a[1] - a[3], a[2] - a[4], 2 * a[3] + 1, 2 * a[4] + 1);
+            break;
+
+            case DL_LINECOLOR:
+                a = a + 1;      // skip the color, then it's just a line
+                // fall through
+            case DL_LINE:
+            case DL_STROKETRIANGLE:
+            case DL_FILLTRIANGLE:
+            {
+                int npoints = (cmd[0] == DL_LINECOLOR) ? 2 : DisplayOpArgs[cmd[0]] / 2;
+                int minx = a[0], maxx = a[0];
+                int miny = a[1], maxy = a[1];
+                for (int i = 1; i < npoints; i++) {
+                    if (a[i*2] < minx) minx = a[i*2];
+                    if (a[i*2] > maxx) maxx = a[i*2];
+                    if (a[i*2+1] < miny) miny = a[i*2+1];
+                    if (a[i*2+1] > maxy) maxy = a[i*2+1];
+                }
+                bounds = GRRectangle(minx, miny, maxx - minx + 1, maxy - miny + 1);
+            }
+            break;
+
+            case DL_LINEFX:
+            case DL_FILLTRIANGLEFX:
+                fixedBounds(a, DisplayOpArgs[cmd[0]] / 2, 2, bounds);
+            break;
+
+            case DL_FILLPOLYGON:
+            case DL_FILLPOLYGONAA:
+                fixedBounds(a + 2, (cmd[1] - 1) / 2, 2, bounds);
+            break;
+
+            case DL_LINEFXCOLOR:
+                fixedBounds(a + 1, 2, 2, bounds);
+            break;
+
+            case DL_FILLPOLYGONCOLOR:
+                fixedBounds(a + 3, (cmd[1] - 2) / 2, 2, bounds);
+            break;
+
+            case DL_SHADETRIANGLEFX:
+                fixedBounds(a, 3, 3, bounds);
+            break;
+
+            case DL_STROKEELLIPSEFX:
+            case DL_FILLELLIPSEFX:
+            {
+                int32_t corners[4] = {a[0] - a[2], a[1] - a[3], a[0] + a[2], a[1] + a[3]};
+                fixedBounds(corners, 2, 2, bounds);
+            }
+            break;
+
+            case DL_SHADETRIANGLE:
+            {
+                // each vertex is x, y, color
+                int minx = a[0], maxx = a[0];
+                int miny = a[1], maxy = a[1];
+                for (int i = 1; i < 3; i++) {
+                    if (a[i*3] < minx) minx = a[i*3];
+                    if (a[i*3] > maxx) maxx = a[i*3];
+                    if (a[i*3+1] < miny) miny = a[i*3+1];
+                    if (a[i*3+1] > maxy) maxy = a[i*3+1];
+                }
+                bounds = GRRectangle(minx, miny, maxx - minx + 1, maxy - miny + 1);
+            }
+            break;
+
+            default:
+                return false;
+        }
+
+        bounds.x += dx;
+        bounds.y += dy;
+
+        return true;
+    }
+
+    // The pixels around npoints fixed point coordinates, stride words
+    // apart.  It's generous by a pixel each way, as lines round to
+    // the nearest pixel.
+    static void fixedBounds(const int32_t *pts, int npoints, int stride, GRRectangle &bounds)
+    {
+        if (npoints < 1) {
+            bounds = GRRectangle();
+            return;
+        }
+
+        int32_t minx = pts[0], maxx = pts[0];
+        int32_t miny = pts[1], maxy = pts[1];
+        for (int i = 1; i < npoints; i++) {
+            const int32_t *p = pts + i * stride;
+            if (p[0] < minx) minx = p[0];
+            if (p[0] > maxx) maxx = p[0];
+            if (p[1] < miny) miny = p[1];
+            if (p[1] > maxy) maxy = p[1];
+        }
+
+        int left = (minx >> GRFIXED_SHIFT) - 1;
+        int top = (miny >> GRFIXED_SHIFT) - 1;
+        int right = (maxx >> GRFIXED_SHIFT) + 2;
+        int bottom = (maxy >> GRFIXED_SHIFT) + 2;
+        bounds = GRRectangle(left, top, right - left, bottom - top);
+    }
+
+    // Helper to turn a stored word back into a color
+    static PixRGBA toColor(int32_t word)
+    {
+        PixRGBA pix;
+        pix.intValue = (uint32_t)word;
+        return pix;
+    }
+
+private:
+    // Lists own a potentially large block of memory, so
+    // we don't want them copied by accident
+    DisplayList(const DisplayList &other);
+    DisplayList & operator=(const DisplayList &other);
+
+    // Returns false, with the list as it was, if there's no memory
+    bool grow(size_t needed)
+    {
+        size_t newCapacity = capacity ? capacity * 2 : 256;
+        while (newCapacity < needed) {
+            newCapacity = newCapacity * 2;
+        }
+
+        int32_t * grown = (int32_t *)realloc(words, newCapacity * sizeof(int32_t));
+        if (!grown) {
+            return false;
+        }
+        words = grown;
+        capacity = newCapacity;
+        return true;
+    }
+
+    int32_t * words;        // the command stream
+    size_t count;           // how many words are in use
+    size_t capacity;        // how many words are allocated
+};
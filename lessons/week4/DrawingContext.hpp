@@ -1,37 +1,16 @@
+#pragma once
+
 #include "PixelBuffer.hpp"
+#include "DisplayList.hpp"
+#include "FloodFill.hpp"
+#include "Texture.hpp"
+#include "Path.hpp"
+#include "CoverageRasterizer.hpp"
+#include "grmath.hpp"
 #include "colors.hpp"
 #include <math.h>
 
 
-typedef void(* EllipseHandler)(PixelBuffer &pb, GRCOORD cx, GRCOORD cy, GRCOORD x, GRCOORD y, const PixRGBA color);
-
-void Plot4EllipsePoints(PixelBuffer &pb, GRCOORD cx, GRCOORD cy, GRCOORD x, GRCOORD y, const PixRGBA color)
-{
-    pb.setPixel(cx + x, cy + y, color);
-    pb.setPixel(cx - x, cy + y, color);
-    pb.setPixel(cx - x, cy - y, color);
-    pb.setPixel(cx + x, cy - y, color);
-}
-
-void fill2EllipseLines(PixelBuffer &pb, GRCOORD cx, GRCOORD cy, GRCOORD x, GRCOORD y, const PixRGBA color)
-{
-	int x1 = cx - x;
-	int y1 = cy+y;
-	int x2 = cx + x;
-	int y2 = cy+y;
-
-	//if (clipLine(pb->frame, x1, y1, x2, y2)) {
-        pb.setPixels(x1, y1, x2-x1, color);
-	//}
-	
-	y1 = cy - y;
-	y2 = cy - y;
-	//if (clipLine(pb->frame, x1, y1, x2, y2)) {
-		pb.setPixels(x1, y2, x2 - x1, color);
-	//}
-}
-
-
 class DrawingContext {
 
 private:
@@ -42,52 +21,505 @@ private:
 
     PixRGBA *scratch;
 
+    // Spans waiting to be handed to the pixel buffer
+    GRSpan *spans;
+    int numSpans;
+    static const int SpanBatchSize = 1024;
+
+    // The clipping rectangle.  Nothing is drawn outside of it.
+    // It is always contained within the bounds of the pixel buffer.
+    GRRectangle clipRect;
+
+    // When not null, drawing commands are added to this
+    // list instead of being drawn
+    DisplayList *recorder;
+
+    // Created the first time floodFill() is used, and
+    // kept around so later fills don't allocate
+    FloodFiller *filler;
+
+    // Created the first time something is filled anti-aliased
+    CoverageRasterizer *coverage;
+
+    // Edges of the polygon being filled.  Like the spans, these
+    // are kept from one polygon to the next, and only ever grow.
+    struct PolygonEdge;
+    PolygonEdge *polyEdges;
+    PolygonEdge **activeEdges;
+    int numPolyEdges;
+    int polyEdgeCapacity;
+
+    // The current transform, and the ones saved by push()
+    Mat2D transform;
+    Mat2D *savedTransforms;
+    int numSaved;
+    int savedCapacity;
+
+    // When the transform just moves things by whole pixels,
+    // this is how far, and drawing takes the quick way
+    bool translateOnly;
+    int offsetX, offsetY;
+
+    // Points after transforming, kept from one call to the next
+    PointFx *mapped;
+    size_t mappedCapacity;
+
+    typedef void (DrawingContext::* EllipseHandler)(int cx, int cy, int x, int y, const PixRGBA color);
+
 public:
     DrawingContext(PixelBuffer &pb)
-    :pb(pb), 
-    strokePix(colors.black), 
+    :pb(pb),
+    strokePix(colors.black),
     fillPix(colors.white),
-    bgPix(colors.gray50)
+    bgPix(colors.gray50),
+    clipRect(0, 0, (int)pb.getWidth(), (int)pb.getHeight()),
+    recorder(nullptr),
+    filler(nullptr),
+    coverage(nullptr),
+    polyEdges(nullptr),
+    activeEdges(nullptr),
+    numPolyEdges(0),
+    polyEdgeCapacity(0),
+    savedTransforms(nullptr),
+    numSaved(0),
+    savedCapacity(0),
+    translateOnly(true),
+    offsetX(0),
+    offsetY(0),
+    mapped(nullptr),
+    mappedCapacity(0)
     {
         // create a scratch row for better optimization
         // of copy operators
         this->scratch = {new PixRGBA[pb.getWidth()]{}};
+
+        this->spans = new GRSpan[SpanBatchSize];
+        this->numSpans = 0;
     }
 
     virtual ~DrawingContext()
     {
         delete [] scratch;
+        delete [] spans;
+        delete filler;
+        delete coverage;
+        free(polyEdges);
+        free(activeEdges);
+        free(savedTransforms);
+        free(mapped);
     }
 
     bool setBackground(const PixRGBA pix)
     {
+        if (recorder) {
+            return recorder->appendColor(DL_SETBACKGROUND, pix);
+        }
+
         bgPix = pix;
         return true;
     }
 
     bool setFill(const PixRGBA pix)
     {
-        fillPix = pix;
-        
-        // Fill up a single row of pixels
-        for (GRSIZE idx=0;idx < pb.getWidth();idx++)
-        {
-            this->scratch[idx] = pix;
+        if (recorder) {
+            return recorder->appendColor(DL_SETFILL, pix);
         }
 
+        fillPix = pix;
         return true;
     }
 
     bool setStroke(const PixRGBA pix)
     {
+        if (recorder) {
+            return recorder->appendColor(DL_SETSTROKE, pix);
+        }
+
         strokePix = pix;
         return true;
     }
 
+    /*
+        Clipping
+
+        All drawing is limited to the clipping rectangle.  The
+        clip is always reduced to the bounds of the pixel buffer,
+        so a coordinate that is off the edge is simply not drawn.
+    */
+    bool setClip(int x, int y, int width, int height)
+    {
+        if (recorder) {
+            return recorder->appendArgs(DL_SETCLIP, x, y, width, height);
+        }
+
+        clipRect = GRRectangle(x, y, width, height).intersection(getBounds());
+        return true;
+    }
+
+    bool clearClip()
+    {
+        if (recorder) {
+            return recorder->appendArgs(DL_CLEARCLIP);
+        }
+
+        clipRect = getBounds();
+        return true;
+    }
+
+    const GRRectangle & getClip() const { return clipRect; }
+
+    GRRectangle getBounds() const { return GRRectangle(0, 0, (int)pb.getWidth(), (int)pb.getHeight()); }
+
+    /*
+        Recording
+
+        Between beginRecording() and endRecording(), drawing commands
+        are not drawn, they are appended to the display list instead.
+        State changes (colors, clipping) are also recorded, and do not
+        alter the context's current state.
+    */
+    bool beginRecording(DisplayList &list)
+    {
+        list.reset();
+        recorder = &list;
+        return true;
+    }
+
+    bool endRecording()
+    {
+        recorder = nullptr;
+        return true;
+    }
+
+    bool isRecording() const { return recorder != nullptr; }
+
+    /*
+    replay()
+
+    Play back a recorded display list into this context's pixel buffer,
+    with every coordinate shifted by (dx, dy).  The list starts with
+    this context's current colors, and any clip in the list is
+    further limited by this context's current clip.  The context's state
+    is restored afterwards, so a list can be replayed any number of
+    times, in any order, with the same result.
+    */
+    bool replay(const DisplayList &list, int dx=0, int dy=0)
+    {
+        // Replaying into a context that is itself recording
+        // is not supported
+        if (recorder) {
+            return false;
+        }
+
+        PixRGBA savedStroke = strokePix;
+        PixRGBA savedFill = fillPix;
+        PixRGBA savedBg = bgPix;
+        GRRectangle outerClip = clipRect;
+
+        const int32_t *cmd = list.getData();
+        const int32_t *end = cmd + list.size();
+
+        // the offset, for the commands in fixed point
+        GRFIXED fdx = fixedFromInt(dx);
+        GRFIXED fdy = fixedFromInt(dy);
+
+        while (cmd < end)
+        {
+            DisplayOp op = (DisplayOp)cmd[0];
+            const int32_t *a = cmd + 1;
+
+            switch (op) {
+                case DL_SETBACKGROUND:
+                    bgPix = DisplayList::toColor(a[0]);
+                break;
+
+                case DL_SETFILL:
+                    fillPix = DisplayList::toColor(a[0]);
+                break;
+
+                case DL_SETSTROKE:
+                    strokePix = DisplayList::toColor(a[0]);
+                break;
+
+                case DL_SETCLIP:
+                    clipRect = GRRectangle(a[0]+dx, a[1]+dy, a[2], a[3]).intersection(outerClip);
+                break;
+
+                case DL_CLEARCLIP:
+                    clipRect = outerClip;
+                break;
+
+                case DL_CLEAR:
+                    doClear();
+                break;
+
+                case DL_FILLPIXEL:
+                    plot(a[0]+dx, a[1]+dy, fillPix);
+                break;
+
+                case DL_HORZLINE:
+                    span(a[0]+dx, a[1]+dy, a[2], strokePix);
+                break;
+
+                case DL_VERTLINE:
+                    doVerticalLine(a[0]+dx, a[1]+dy, a[2]);
+                break;
+
+                case DL_LINE:
+                    doLine(a[0]+dx, a[1]+dy, a[2]+dx, a[3]+dy);
+                break;
+
+                case DL_STROKERECT:
+                    doStrokeRectangle(a[0]+dx, a[1]+dy, a[2], a[3]);
+                break;
+
+                case DL_FILLRECT:
+                    doFillRectangle(a[0]+dx, a[1]+dy, a[2], a[3]);
+                break;
+
+                case DL_STROKEELLIPSE:
+                    raster_rgba_ellipse(a[0]+dx, a[1]+dy, a[2], a[3], strokePix, &DrawingContext::Plot4EllipsePoints);
+                break;
+
+                case DL_FILLELLIPSE:
+                    ellipseSpans(a[0]+dx, a[1]+dy, a[2], a[3], fillPix);
+                    flushSpans();
+                break;
+
+                case DL_STROKETRIANGLE:
+                    doLine(a[0]+dx, a[1]+dy, a[2]+dx, a[3]+dy);
+                    doLine(a[2]+dx, a[3]+dy, a[4]+dx, a[5]+dy);
+                    doLine(a[4]+dx, a[5]+dy, a[0]+dx, a[1]+dy);
+                break;
+
+                case DL_FILLTRIANGLE:
+                    doFillTriangle(a[0]+dx, a[1]+dy, a[2]+dx, a[3]+dy, a[4]+dx, a[5]+dy, fillPix);
+                break;
+
+                case DL_SHADETRIANGLE:
+                {
+                    int32_t xs[3] = {fixedFromInt(a[0]+dx), fixedFromInt(a[3]+dx), fixedFromInt(a[6]+dx)};
+                    int32_t ys[3] = {fixedFromInt(a[1]+dy), fixedFromInt(a[4]+dy), fixedFromInt(a[7]+dy)};
+                    PixRGBA shades[3] = {DisplayList::toColor(a[2]), DisplayList::toColor(a[5]), DisplayList::toColor(a[8])};
+                    doShadeTriangle(xs, ys, shades);
+                }
+                break;
+
+                case DL_FILLRECTCOLOR:
+                    rectangleSpans(a[1]+dx, a[2]+dy, a[3], a[4], DisplayList::toColor(a[0]));
+                    flushSpans();
+                break;
+
+                case DL_FILLELLIPSECOLOR:
+                    ellipseSpans(a[1]+dx, a[2]+dy, a[3], a[4], DisplayList::toColor(a[0]));
+                    flushSpans();
+                break;
+
+                case DL_LINECOLOR:
+                    lineSpans(a[1]+dx, a[2]+dy, a[3]+dx, a[4]+dy, DisplayList::toColor(a[0]));
+                    flushSpans();
+                break;
+
+                case DL_LINEFX:
+                    lineSpansFx(a[0]+fdx, a[1]+fdy, a[2]+fdx, a[3]+fdy, strokePix);
+                    flushSpans();
+                break;
+
+                case DL_FILLTRIANGLEFX:
+                {
+                    int32_t xs[3] = {a[0]+fdx, a[2]+fdx, a[4]+fdx};
+                    int32_t ys[3] = {a[1]+fdy, a[3]+fdy, a[5]+fdy};
+                    TrianglePaint paint;
+                    paint.color = fillPix;
+                    triangleSpans(xs, ys, paint, &DrawingContext::flatRow);
+                    flushSpans();
+                }
+                break;
+
+                case DL_STROKEELLIPSEFX:
+                    ellipseOutlineFx(a[0]+fdx, a[1]+fdy, a[2], a[3], strokePix);
+                    flushSpans();
+                break;
+
+                case DL_FILLELLIPSEFX:
+                    ellipseSpansFx(a[0]+fdx, a[1]+fdy, a[2], a[3], fillPix);
+                    flushSpans();
+                break;
+
+                case DL_FILLPOLYGON:
+                {
+                    // the count comes from the list, so make sure
+                    // it doesn't run off the end
+                    if (a[0] < 1 || a[0] > end - cmd - 2) {
+                        cmd = end;
+                        continue;
+                    }
+
+                    int npoints = (a[0] - 1) / 2;
+                    const int32_t *pts = a + 2;
+                    numPolyEdges = 0;
+                    bool edges = true;
+                    for (int i = 0; i < npoints && edges; i++) {
+                        int j = (i + 1) % npoints;
+                        edges = addPolygonEdge(pts[i*2]+fdx, pts[i*2+1]+fdy, pts[j*2]+fdx, pts[j*2+1]+fdy);
+                    }
+                    if (edges) {
+                        polygonSpans((GRFillRule)a[1], fillPix);
+                        flushSpans();
+                    }
+                }
+                break;
+
+                case DL_LINEFXCOLOR:
+                    lineSpansFx(a[1]+fdx, a[2]+fdy, a[3]+fdx, a[4]+fdy, DisplayList::toColor(a[0]));
+                    flushSpans();
+                break;
+
+                case DL_FILLPOLYGONCOLOR:
+                {
+                    if (a[0] < 2 || a[0] > end - cmd - 2) {
+                        cmd = end;
+                        continue;
+                    }
+
+                    int npoints = (a[0] - 2) / 2;
+                    const int32_t *pts = a + 3;
+                    numPolyEdges = 0;
+                    bool edges = true;
+                    for (int i = 0; i < npoints && edges; i++) {
+                        int j = (i + 1) % npoints;
+                        edges = addPolygonEdge(pts[i*2]+fdx, pts[i*2+1]+fdy, pts[j*2]+fdx, pts[j*2+1]+fdy);
+                    }
+                    if (edges) {
+                        polygonSpans((GRFillRule)a[2], DisplayList::toColor(a[1]));
+                        flushSpans();
+                    }
+                }
+                break;
+
+                case DL_SHADETRIANGLEFX:
+                {
+                    int32_t xs[3] = {a[0]+fdx, a[3]+fdx, a[6]+fdx};
+                    int32_t ys[3] = {a[1]+fdy, a[4]+fdy, a[7]+fdy};
+                    PixRGBA shades[3] = {DisplayList::toColor(a[2]), DisplayList::toColor(a[5]), DisplayList::toColor(a[8])};
+                    doShadeTriangle(xs, ys, shades);
+                }
+                break;
+
+                case DL_FILLPOLYGONAA:
+                {
+                    if (a[0] < 1 || a[0] > end - cmd - 2) {
+                        cmd = end;
+                        continue;
+                    }
+
+                    int npoints = (a[0] - 1) / 2;
+                    const int32_t *pts = a + 2;
+                    if (reserveMapped(npoints)) {
+                        for (int i = 0; i < npoints; i++) {
+                            mapped[i] = PointFx(pts[i*2]+fdx, pts[i*2+1]+fdy);
+                        }
+                        fillPolygonCoverage(mapped, npoints, (GRFillRule)a[1], fillPix);
+                    }
+                }
+                break;
+
+                default:
+                    // A corrupt list, stop rather than interpret garbage
+                    cmd = end;
+                    continue;
+            }
+
+            cmd += DisplayList::commandSize(cmd);
+        }
+
+        strokePix = savedStroke;
+        fillPix = savedFill;
+        bgPix = savedBg;
+        clipRect = outerClip;
+
+        return true;
+    }
+
+    /*
+        Transforms
+
+        Everything drawn goes through the current transform first, which
+        starts out as the identity.  translate(), scale() and rotate() are
+        applied to the transform, so they affect what's drawn afterwards,
+        the same way as in most 2D APIs:  translate(100, 0) then scale(2, 2)
+        draws things twice as big, then moves them right by 100.
+
+        push() saves the transform, and pop() brings it back, so part of
+        a drawing can be moved about without disturbing the rest.
+
+        When the transform does nothing but move things by whole pixels,
+        which covers scrolling, drawing simply adds an offset to the
+        coordinates, and is otherwise exactly as it is without a
+        transform.  Anything else (scaling, rotation, fractions of a
+        pixel) turns each shape into a fixed point outline, which is filled
+        by the polygon and triangle fillers.  Rectangles and ellipses
+        become polygons, and lines stay one pixel wide.
+
+        Commands are transformed before they are recorded, so a display
+        list holds where things ended up, and replay() doesn't use the
+        transform.  The clip is in pixels, and isn't transformed either.
+    */
+    bool setTransform(const Mat2D &m)
+    {
+        transform = m;
+        translateOnly = m.isIntegerTranslation();
+        offsetX = translateOnly ? (int)m.m[0][2] : 0;
+        offsetY = translateOnly ? (int)m.m[1][2] : 0;
+        return true;
+    }
+
+    const Mat2D & getTransform() const { return transform; }
+
+    bool resetTransform() { return setTransform(Mat2D()); }
+
+    bool translate(REAL dx, REAL dy) { return setTransform(transform * Mat2D::translation(dx, dy)); }
+    bool scale(REAL sx, REAL sy) { return setTransform(transform * Mat2D::scaling(sx, sy)); }
+    bool rotate(REAL angle) { return setTransform(transform * Mat2D::rotation(angle)); }
+
+    // Returns false, and saves nothing, if there's no memory
+    bool push()
+    {
+        if (numSaved == savedCapacity) {
+            int capacity = savedCapacity ? savedCapacity * 2 : 16;
+            Mat2D *grown = (Mat2D *)realloc(savedTransforms, capacity * sizeof(Mat2D));
+            if (!grown) {
+                return false;
+            }
+            savedTransforms = grown;
+            savedCapacity = capacity;
+        }
+
+        savedTransforms[numSaved] = transform;
+        numSaved = numSaved + 1;
+        return true;
+    }
+
+    // Returns false, and leaves the transform alone, if there
+    // was no push() to match
+    bool pop()
+    {
+        if (numSaved == 0) {
+            return false;
+        }
+
+        numSaved = numSaved - 1;
+        return setTransform(savedTransforms[numSaved]);
+    }
+
     // clear the canvas to the background color
     bool clear()
     {
-        pb.setAllPixels(bgPix);
+        if (recorder) {
+            return recorder->appendArgs(DL_CLEAR);
+        }
+
+        doClear();
         return true;
     }
 
@@ -95,29 +527,51 @@ public:
     // Should be able to apply a drawing operator
     bool fillPixel(GRCOORD x, GRCOORD y)
     {
-        pb.setPixel(x, y, fillPix);
+        if (!translateOnly) {
+            PointFx box[4];
+            mapBox(x, y, 1, 1, box);
+            return fillDevicePolygon(box, 4, GR_NONZERO);
+        }
+
+        int tx = x + offsetX;
+        int ty = y + offsetY;
+        if (recorder) {
+            return recorder->appendArgs(DL_FILLPIXEL, tx, ty);
+        }
+
+        plot(tx, ty, fillPix);
         return true;
     }
 
     bool strokeHorizontalLine(GRCOORD x, GRCOORD y, GRSIZE width)
     {
-        GRCOORD idx = x;
-        while (idx < x+width)
-        {
-            pb.setPixel(idx, y, strokePix);
-            idx = idx + 1;
+        if (!translateOnly) {
+            return width == 0 || strokeDeviceLine(mapPoint(x, y), mapPoint((REAL)x + width - 1, y));
         }
 
+        int tx = x + offsetX;
+        int ty = y + offsetY;
+        if (recorder) {
+            return recorder->appendArgs(DL_HORZLINE, tx, ty, (int)width);
+        }
+
+        span(tx, ty, (int)width, strokePix);
         return true;
     }
 
     bool strokeVerticalLine(GRCOORD x, GRCOORD y, GRSIZE length)
     {
-        GRCOORD idx = y;
-        while (idx < y+length) {
-            this->pb.setPixel(x, idx, this->strokePix);
-            idx = idx + 1;
+        if (!translateOnly) {
+            return length == 0 || strokeDeviceLine(mapPoint(x, y), mapPoint(x, (REAL)y + length - 1));
+        }
+
+        int tx = x + offsetX;
+        int ty = y + offsetY;
+        if (recorder) {
+            return recorder->appendArgs(DL_VERTLINE, tx, ty, (int)length);
         }
+
+        doVerticalLine(tx, ty, (int)length);
         return true;
     }
 
@@ -125,61 +579,42 @@ public:
     strokeLine()
 
     Stroke a line using the current stroking pixel.
-    Uses Bresenham line drawing.  Does not check for clipping,
-    but the underlying PixelBuffer might.
+    Lights the same pixels as Bresenham line drawing.  Pixels
+    outside the clipping rectangle are discarded.
 
     Note: an easy optimization would be to use the specialized
     horizontal and vertical line drawing routines when necessary
     */
     bool strokeLine(GRCOORD x1, GRCOORD y1, GRCOORD x2, GRCOORD y2)
     {
-	    int sdx, sdy, dxabs, dyabs;
-	    unsigned int x, y, px, py;
-
-        int dx = x2 - x1;      // the horizontal distance of the line
-        int dy = y2 - y1;      // the vertical distance of the line
-        dxabs = abs(dx);
-        dyabs = abs(dy);
-        sdx = sgn(dx);
-        sdy = sgn(dy);
-        x = dyabs >> 1;
-        y = dxabs >> 1;
-        px = x1;
-        py = y1;
-
-        this->pb.setPixel(x1, y1, this->strokePix);
+        if (!translateOnly) {
+            return strokeDeviceLine(mapPoint(x1, y1), mapPoint(x2, y2));
+        }
 
-        if (dxabs >= dyabs) // the line is more horizontal than vertical
-        {
-            for (size_t i = 0; i<dxabs; i++)
-            {
-                y = y + dyabs;
-                if (y >= (unsigned int)dxabs)
-                {
-                    y = y - dxabs;
-                    py = py + sdy;
-                }
-                px = px + sdx;
-                this->pb.setPixel(px, py, this->strokePix);
-            }
-        } else // the line is more vertical than horizontal
-        {
-            for (size_t i = 0; i<dyabs; i++)
-            {
-                x += dxabs;
-                if (x >= (unsigned int)dyabs)
-                {
-                    x -= dyabs;
-                    px += sdx;
-                }
-                py += sdy;
-                this->pb.setPixel(px, py, this->strokePix);
-            }
+        int tx1 = x1 + offsetX, ty1 = y1 + offsetY;
+        int tx2 = x2 + offsetX, ty2 = y2 + offsetY;
+        if (recorder) {
+            return recorder->appendArgs(DL_LINE, tx1, ty1, tx2, ty2);
         }
 
+        doLine(tx1, ty1, tx2, ty2);
         return true;
     }
 
+    /*
+    strokeLine()
+
+    A line between fixed point end points, which can be between
+    pixels, or off the left and top of the canvas.  Moving an end point
+    by a fraction of a pixel moves the line by that much, rather than
+    it jumping a whole pixel at a time, which is what makes slow
+    animation smooth.
+    */
+    bool strokeLine(const PointFx &p1, const PointFx &p2)
+    {
+        return strokeDeviceLine(mapPoint(p1), mapPoint(p2));
+    }
+
 
     // drawPolyLine()
     // drawCubicBezier()
@@ -188,34 +623,45 @@ public:
 
     bool strokeRectangle(GRCOORD x, GRCOORD y, GRSIZE width, GRSIZE height)
     {
-        // Draw Horizontal Lines
-        strokeHorizontalLine(x, y ,width);
-        strokeHorizontalLine(x, y+height-1, width);
+        if (!translateOnly) {
+            // lines through the centers of the edge pixels
+            REAL right = (REAL)x + width - 1;
+            REAL bottom = (REAL)y + height - 1;
+            PointFx corners[4] = {mapPoint(x, y), mapPoint(right, y), mapPoint(right, bottom), mapPoint(x, bottom)};
+            for (int i = 0; i < 4; i++) {
+                strokeDeviceLine(corners[i], corners[(i + 1) % 4]);
+            }
+            return true;
+        }
 
-        // Draw Vertical lines
-        strokeVerticalLine(x,y,height);
-        strokeVerticalLine(x+width-1, y, height);
+        int tx = x + offsetX;
+        int ty = y + offsetY;
+        if (recorder) {
+            return recorder->appendArgs(DL_STROKERECT, tx, ty, (int)width, (int)height);
+        }
 
+        doStrokeRectangle(tx, ty, (int)width, (int)height);
         return true;
     }
 
     bool fillRectangle(GRCOORD x, GRCOORD y, GRSIZE width, GRSIZE height)
     {
-        // Fill up a single row of pixels
-        for (GRSIZE idx=0;idx < width;idx++)
-        {
-            this->scratch[idx] = this->fillPix;
+        if (!translateOnly) {
+            PointFx box[4];
+            mapBox(x, y, (REAL)width, (REAL)height, box);
+            return fillDevicePolygon(box, 4, GR_NONZERO);
         }
 
-        // use that scratch line to fill all lines of the rectangle
-        for (GRSIZE idx = 0; idx<height; idx++)
-        {
-            this->pb.setSpan(x, y+idx, width, this->scratch);
+        int tx = x + offsetX;
+        int ty = y + offsetY;
+        if (recorder) {
+            return recorder->appendArgs(DL_FILLRECT, tx, ty, (int)width, (int)height);
         }
 
+        doFillRectangle(tx, ty, (int)width, (int)height);
         return true;
     }
-    
+
     bool drawRectangle(GRCOORD x, GRCOORD y, GRSIZE width, GRSIZE height)
     {
         // fill rectangle
@@ -223,7 +669,7 @@ public:
 
         // stroke rectangle
         strokeRectangle(x, y, width, height);
-        
+
         return true;
     }
 
@@ -234,24 +680,28 @@ public:
     /*
         Ellipse drawing
     */
-    void raster_rgba_ellipse(GRCOORD cx, GRCOORD cy, size_t xradius, size_t yradius, const PixRGBA color, EllipseHandler handler)
+    void raster_rgba_ellipse(int cx, int cy, size_t xradius, size_t yradius, const PixRGBA color, EllipseHandler handler)
     {
-        int twoasquare = 2 * xradius*xradius;
-        int twobsquare = 2 * yradius*yradius;
+        // 64 bits, as the radii squared times the radii don't fit an int
+        // on a large canvas
+        int64_t a = (int64_t)xradius;
+        int64_t b = (int64_t)yradius;
+        int64_t twoasquare = 2 * a*a;
+        int64_t twobsquare = 2 * b*b;
 
 	    int x = xradius;
 	    int y = 0;
 
-        int xchange = yradius*yradius*(1 - 2 * xradius);
-        int ychange = xradius*xradius;
-        int ellipseerror = 0;
-        int stoppingx = twobsquare*xradius;
-        int stoppingy = 0;
+        int64_t xchange = b*b*(1 - 2 * a);
+        int64_t ychange = a*a;
+        int64_t ellipseerror = 0;
+        int64_t stoppingx = twobsquare*a;
+        int64_t stoppingy = 0;
 
         // first set of points, sides
         while (stoppingx >= stoppingy)
         {
-            handler(pb, cx, cy, x, y, color);
+            (this->*handler)(cx, cy, x, y, color);
             y = y + 1;
             stoppingy = stoppingy + twoasquare;
             ellipseerror += ychange;
@@ -268,19 +718,19 @@ public:
         // second set of points, top and bottom
         x = 0;
         y = yradius;
-        xchange = yradius*yradius;
-        ychange = xradius*xradius*(1 - 2 * yradius);
+        xchange = b*b;
+        ychange = a*a*(1 - 2 * b);
         ellipseerror = 0;
         stoppingx = 0;
-        stoppingy = twoasquare*yradius;
+        stoppingy = twoasquare*b;
 
         while (stoppingx <= stoppingy) {
-            handler(pb, cx, cy, x, y, color);
+            (this->*handler)(cx, cy, x, y, color);
             x = x + 1;
             stoppingx = stoppingx + twobsquare;
             ellipseerror = ellipseerror + xchange;
             xchange = xchange + twobsquare;
-            
+
             if ((2 * ellipseerror + ychange) > 0) {
                 y = y - 1;
                 stoppingy -= twoasquare;
@@ -293,18 +743,42 @@ public:
     // strokeEllipse()
     bool strokeEllipse(GRCOORD cx, GRCOORD cy, size_t xradius, size_t yradius)
     {
-        raster_rgba_ellipse(cx, cy, xradius, yradius, strokePix, Plot4EllipsePoints);
-        
+        if (!translateOnly) {
+            size_t count = mapEllipse((REAL)cx, (REAL)cy, (REAL)xradius, (REAL)yradius);
+            return strokeDevicePolygon(mapped, count);
+        }
+
+        int tx = cx + offsetX;
+        int ty = cy + offsetY;
+        if (recorder) {
+            return recorder->appendArgs(DL_STROKEELLIPSE, tx, ty, (int)xradius, (int)yradius);
+        }
+
+        raster_rgba_ellipse(tx, ty, xradius, yradius, strokePix, &DrawingContext::Plot4EllipsePoints);
+
         return true;
     }
 
     // fillEllipse()
     bool fillEllipse(GRCOORD cx, GRCOORD cy, size_t xradius, size_t yradius)
     {
-        raster_rgba_ellipse(cx, cy, xradius, yradius, fillPix, fill2EllipseLines);
+        if (!translateOnly) {
+            // out to the edges of the outline's pixels
+            size_t count = mapEllipse((REAL)cx, (REAL)cy, xradius + 0.5f, yradius + 0.5f);
+            return fillDevicePolygon(mapped, count, GR_NONZERO);
+        }
+
+        int tx = cx + offsetX;
+        int ty = cy + offsetY;
+        if (recorder) {
+            return recorder->appendArgs(DL_FILLELLIPSE, tx, ty, (int)xradius, (int)yradius);
+        }
+
+        ellipseSpans(tx, ty, xradius, yradius, fillPix);
+        flushSpans();
         return false;
     }
-    
+
     bool drawEllipse(GRCOORD cx, GRCOORD cy, size_t xradius, size_t yradius)
     {
         fillEllipse(cx, cy, xradius, yradius);
@@ -313,39 +787,1885 @@ public:
         return true;
     }
 
-    // drawEllipse()
+    /*
+    strokeEllipse(), fillEllipse()
 
+    Ellipses with a fixed point center and radii.  The fill covers
+    the pixels whose centers are inside the ellipse.  The outline is a
+    closed run of short lines around the edge, short enough that it's
+    never more than a quarter of a pixel from the true curve.
+    */
+    bool strokeEllipse(const PointFx &center, GRFIXED xradius, GRFIXED yradius)
+    {
+        if (!translateOnly) {
+            size_t count = mapEllipse(fixedToReal(center.x), fixedToReal(center.y), fixedToReal(xradius), fixedToReal(yradius));
+            return strokeDevicePolygon(mapped, count);
+        }
 
+        PointFx c = mapPoint(center);
+        if (recorder) {
+            return recorder->appendArgs(DL_STROKEELLIPSEFX, c.x, c.y, xradius, yradius);
+        }
 
-    // strokeTriangle()
-    bool strokeTriangle(const GRTriangle &geo)
+        ellipseOutlineFx(c.x, c.y, xradius, yradius, strokePix);
+        flushSpans();
+        return true;
+    }
+
+    bool fillEllipse(const PointFx &center, GRFIXED xradius, GRFIXED yradius)
     {
-        strokeLine(geo.verts[0].x, geo.verts[0].y, geo.verts[1].x, geo.verts[1].y);
-        strokeLine(geo.verts[1].x, geo.verts[1].y, geo.verts[2].x, geo.verts[2].y);
-        strokeLine(geo.verts[2].x, geo.verts[2].y, geo.verts[0].x, geo.verts[0].y);
+        if (!translateOnly) {
+            size_t count = mapEllipse(fixedToReal(center.x), fixedToReal(center.y), fixedToReal(xradius), fixedToReal(yradius));
+            return fillDevicePolygon(mapped, count, GR_NONZERO);
+        }
 
+        PointFx c = mapPoint(center);
+        if (recorder) {
+            return recorder->appendArgs(DL_FILLELLIPSEFX, c.x, c.y, xradius, yradius);
+        }
+
+        ellipseSpansFx(c.x, c.y, xradius, yradius, fillPix);
+        flushSpans();
         return true;
     }
 
-    // fillTriangle()
-    bool fillTriangle(const GRTriangle &geo)
+
+    /*
+        Batched drawing
+
+        These draw many primitives in a single call, which is the way
+        to go for things like scatter plots and particles.  The inputs
+        are parallel arrays, one entry per primitive.  If the colors
+        array is null, everything is drawn in the current fill (or
+        stroke) color, otherwise each primitive gets its own color,
+        and the context's current colors are left alone.
+
+        Everything turns into clipped spans, which are handed to the
+        pixel buffer a batch at a time, rather than a call per pixel.
+    */
+    bool fillRectangles(size_t count, const GRCOORD *xs, const GRCOORD *ys,
+        const GRSIZE *widths, const GRSIZE *heights, const PixRGBA *fills = nullptr)
     {
-        return false;
+        if (!translateOnly) {
+            for (size_t i = 0; i < count; i++) {
+                PointFx box[4];
+                mapBox(xs[i], ys[i], (REAL)widths[i], (REAL)heights[i], box);
+                fillDevicePolygon(box, 4, GR_NONZERO, fills ? &fills[i] : nullptr);
+            }
+            return true;
+        }
+
+        if (recorder) {
+            for (size_t i = 0; i < count; i++) {
+                bool recorded;
+                if (fills) {
+                    recorded = recorder->appendArgs(DL_FILLRECTCOLOR, fills[i].intValue, xs[i] + offsetX, ys[i] + offsetY, (int)widths[i], (int)heights[i]);
+                } else {
+                    recorded = recorder->appendArgs(DL_FILLRECT, xs[i] + offsetX, ys[i] + offsetY, (int)widths[i], (int)heights[i]);
+                }
+                if (!recorded) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            rectangleSpans(xs[i] + offsetX, ys[i] + offsetY, (int)widths[i], (int)heights[i], fills ? fills[i] : fillPix);
+        }
+        flushSpans();
+
+        return true;
     }
 
-    // drawTriangle()
-    bool drawTriangle(const GRTriangle geo)
+    bool fillEllipses(size_t count, const GRCOORD *cxs, const GRCOORD *cys,
+        const GRSIZE *xradii, const GRSIZE *yradii, const PixRGBA *fills = nullptr)
     {
-        fillTriangle(geo);
-        strokeTriangle(geo);
+        if (!translateOnly) {
+            for (size_t i = 0; i < count; i++) {
+                size_t n = mapEllipse((REAL)cxs[i], (REAL)cys[i], xradii[i] + 0.5f, yradii[i] + 0.5f);
+                fillDevicePolygon(mapped, n, GR_NONZERO, fills ? &fills[i] : nullptr);
+            }
+            return true;
+        }
+
+        if (recorder) {
+            for (size_t i = 0; i < count; i++) {
+                bool recorded;
+                if (fills) {
+                    recorded = recorder->appendArgs(DL_FILLELLIPSECOLOR, fills[i].intValue, cxs[i] + offsetX, cys[i] + offsetY, (int)xradii[i], (int)yradii[i]);
+                } else {
+                    recorded = recorder->appendArgs(DL_FILLELLIPSE, cxs[i] + offsetX, cys[i] + offsetY, (int)xradii[i], (int)yradii[i]);
+                }
+                if (!recorded) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            ellipseSpans(cxs[i] + offsetX, cys[i] + offsetY, (int)xradii[i], (int)yradii[i], fills ? fills[i] : fillPix);
+        }
+        flushSpans();
+
+        return true;
+    }
+
+    bool strokeLines(size_t count, const GRCOORD *x1s, const GRCOORD *y1s,
+        const GRCOORD *x2s, const GRCOORD *y2s, const PixRGBA *strokes = nullptr)
+    {
+        if (!translateOnly) {
+            for (size_t i = 0; i < count; i++) {
+                strokeDeviceLine(mapPoint(x1s[i], y1s[i]), mapPoint(x2s[i], y2s[i]), strokes ? &strokes[i] : nullptr);
+            }
+            return true;
+        }
+
+        if (recorder) {
+            for (size_t i = 0; i < count; i++) {
+                bool recorded;
+                if (strokes) {
+                    recorded = recorder->appendArgs(DL_LINECOLOR, strokes[i].intValue,
+                        x1s[i] + offsetX, y1s[i] + offsetY, x2s[i] + offsetX, y2s[i] + offsetY);
+                } else {
+                    recorded = recorder->appendArgs(DL_LINE, x1s[i] + offsetX, y1s[i] + offsetY, x2s[i] + offsetX, y2s[i] + offsetY);
+                }
+                if (!recorded) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            lineSpans(x1s[i] + offsetX, y1s[i] + offsetY, x2s[i] + offsetX, y2s[i] + offsetY,
+                strokes ? strokes[i] : strokePix);
+        }
+        flushSpans();
 
         return true;
     }
-    
-    // drawPolygon()
-    // strokePolygon()
-    // fillPolygon()
 
 
+    // strokeTriangle()
+    bool strokeTriangle(const GRTriangle &geo)
+    {
+        if (!translateOnly) {
+            return strokeDevicePolygon(mapPoints(geo.verts, 3), 3);
+        }
 
-};
\ No newline at end of file
+        int xs[3], ys[3];
+        for (int i = 0; i < 3; i++) {
+            xs[i] = geo.verts[i].x + offsetX;
+            ys[i] = geo.verts[i].y + offsetY;
+        }
+
+        if (recorder) {
+            return recorder->appendArgs(DL_STROKETRIANGLE, xs[0], ys[0], xs[1], ys[1], xs[2], ys[2]);
+        }
+
+        doLine(xs[0], ys[0], xs[1], ys[1]);
+        doLine(xs[1], ys[1], xs[2], ys[2]);
+        doLine(xs[2], ys[2], xs[0], ys[0]);
+
+        return true;
+    }
+
+    /*
+    fillTriangle()
+
+    Fill the inside of the triangle with the fill color.  Pixels along
+    the right and bottom edges are left out, so triangles that share an
+    edge, as in a mesh, never draw the same pixel twice, and never leave
+    a gap.  drawTriangle() strokes the outline on top, which covers them.
+    */
+    bool fillTriangle(const GRTriangle &geo)
+    {
+        if (!translateOnly) {
+            return fillDeviceTriangle(mapPoints(geo.verts, 3));
+        }
+
+        int xs[3], ys[3];
+        for (int i = 0; i < 3; i++) {
+            xs[i] = geo.verts[i].x + offsetX;
+            ys[i] = geo.verts[i].y + offsetY;
+        }
+
+        if (recorder) {
+            return recorder->appendArgs(DL_FILLTRIANGLE, xs[0], ys[0], xs[1], ys[1], xs[2], ys[2]);
+        }
+
+        doFillTriangle(xs[0], ys[0], xs[1], ys[1], xs[2], ys[2], fillPix);
+        return true;
+    }
+
+    /*
+    fillTriangle()
+
+    Smooth (Gouraud) shading.  Each vertex has its own color, and the
+    colors are blended linearly across the triangle.  Covers exactly the
+    same pixels as the flat version.
+    */
+    bool fillTriangle(const GRColorTriangle &geo)
+    {
+        if (!translateOnly) {
+            const PointFx *verts = mapPoints(geo.verts, 3);
+            if (!verts) {
+                return false;
+            }
+            if (recorder) {
+                int32_t *args = recorder->append(DL_SHADETRIANGLEFX);
+                if (!args) {
+                    return false;
+                }
+                for (int i = 0; i < 3; i++) {
+                    args[i*3] = verts[i].x;
+                    args[i*3+1] = verts[i].y;
+                    args[i*3+2] = (int32_t)geo.colors[i].intValue;
+                }
+                return true;
+            }
+
+            int32_t xs[3] = {verts[0].x, verts[1].x, verts[2].x};
+            int32_t ys[3] = {verts[0].y, verts[1].y, verts[2].y};
+            doShadeTriangle(xs, ys, geo.colors);
+            return true;
+        }
+
+        if (recorder) {
+            int32_t *args = recorder->append(DL_SHADETRIANGLE);
+            if (!args) {
+                return false;
+            }
+            for (int i = 0; i < 3; i++) {
+                args[i*3] = geo.verts[i].x + offsetX;
+                args[i*3+1] = geo.verts[i].y + offsetY;
+                args[i*3+2] = (int32_t)geo.colors[i].intValue;
+            }
+            return true;
+        }
+
+        int32_t xs[3], ys[3];
+        for (int i = 0; i < 3; i++) {
+            xs[i] = fixedFromInt(geo.verts[i].x + offsetX);
+            ys[i] = fixedFromInt(geo.verts[i].y + offsetY);
+        }
+        doShadeTriangle(xs, ys, geo.colors);
+
+        return true;
+    }
+
+    // fillTriangle(), with three fixed point vertices, in any order
+    bool fillTriangle(const PointFx *verts)
+    {
+        return fillDeviceTriangle(mapPoints(verts, 3));
+    }
+
+    /*
+    fillTriangle()
+
+    Texture mapping.  Each corner says where it is in the texture,
+    and the texture is stretched across the triangle to match.  With
+    perspective on, the w of each corner is used so the texture
+    recedes properly, otherwise the texture is mapped linearly, which
+    is quicker, and is right for flat 2D drawing.
+
+    The mipmap level is chosen as the triangle is drawn, based on how
+    much of the texture each pixel covers.
+
+    The display list can't hold on to a texture, so this can't be
+    recorded.  An empty texture, one that ran out of memory, can't be
+    drawn either.
+    */
+    bool fillTriangle(const GRTexVertex *verts, const Texture &tex,
+        TextureFilter filter = TEX_BILINEAR, bool perspective = true)
+    {
+        if (recorder || tex.getLevelCount() == 0) {
+            return false;
+        }
+
+        int32_t xs[3], ys[3];
+        for (int i = 0; i < 3; i++) {
+            PointFx p = mapPoint(verts[i].x, verts[i].y);
+            xs[i] = p.x;
+            ys[i] = p.y;
+        }
+
+        doTextureTriangle(xs, ys, verts, tex, filter, perspective);
+        return true;
+    }
+
+    // drawTriangle()
+    bool drawTriangle(const GRTriangle geo)
+    {
+        fillTriangle(geo);
+        strokeTriangle(geo);
+
+        return true;
+    }
+
+    /*
+    fillPolygon()
+
+    Fill a closed polygon, of any shape, with the fill color.  The last
+    point joins back up to the first.  It can be concave, and can cross
+    over itself, in which case the fill rule says which parts are inside.
+
+    Pixels are in or out by the same rule as triangles, so a polygon
+    covers exactly the pixels of the triangles it could be cut into.
+
+    The whole-pixel version is recorded in fixed point, the same as
+    the fixed point version.
+    */
+    bool fillPolygon(const Point2D *pts, size_t count, GRFillRule rule = GR_NONZERO)
+    {
+        return fillDevicePolygon(mapPoints(pts, count), count, rule);
+    }
+
+    bool fillPolygon(const PointFx *pts, size_t count, GRFillRule rule = GR_NONZERO)
+    {
+        return fillDevicePolygon(mapPoints(pts, count), count, rule);
+    }
+
+    // strokePolygon(), the outline, as a line per side
+    bool strokePolygon(const Point2D *pts, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            const Point2D &a = pts[i];
+            const Point2D &b = pts[(i + 1) % count];
+            strokeLine(a.x, a.y, b.x, b.y);
+        }
+
+        return true;
+    }
+
+    bool strokePolygon(const PointFx *pts, size_t count)
+    {
+        return strokeDevicePolygon(mapPoints(pts, count), count);
+    }
+
+    bool drawPolygon(const Point2D *pts, size_t count, GRFillRule rule = GR_NONZERO)
+    {
+        fillPolygon(pts, count, rule);
+        strokePolygon(pts, count);
+
+        return true;
+    }
+
+    /*
+    fillPath()
+
+    Fill all the contours of a path together, so the fill rule decides
+    which parts are inside, and a contour inside another can make a
+    hole.  Contours that weren't closed are filled as if they were.
+
+    The path is flattened for the scale of the current transform, and
+    keeps that, so drawing it again, even moved or turned, doesn't
+    flatten it again.  A path that's entirely outside the clip isn't
+    drawn at all, unless it's being recorded.  It's drawn, and recorded,
+    as a single polygon.
+    */
+    bool fillPath(const Path &path, GRFillRule rule = GR_NONZERO)
+    {
+        size_t count = mapPath(path);
+        return count > 0 && fillDevicePolygon(mapped, count, rule);
+    }
+
+    // strokePath(), a line along each contour, back to its start if it was closed
+    bool strokePath(const Path &path)
+    {
+        if (!path.flatten(transform.maxScale())) {
+            return false;
+        }
+        int contours = path.getContourCount();
+        if (contours == 0 || (!recorder && !pathInClip(path))) {
+            return false;
+        }
+
+        const PathPoint *flat = path.getFlatPoints();
+        for (int c = 0; c < contours; c++) {
+            const PathContour &contour = path.getContour(c);
+            const PathPoint *pts = flat + contour.first;
+            PointFx first = mapPoint(pts[0].x, pts[0].y);
+            PointFx prev = first;
+            for (int i = 1; i < contour.count; i++) {
+                PointFx p = mapPoint(pts[i].x, pts[i].y);
+                strokeDeviceLine(prev, p);
+                prev = p;
+            }
+            if (contour.closed) {
+                strokeDeviceLine(prev, first);
+            }
+        }
+
+        return true;
+    }
+
+    bool drawPath(const Path &path, GRFillRule rule = GR_NONZERO)
+    {
+        fillPath(path, rule);
+        strokePath(path);
+
+        return true;
+    }
+
+    /*
+    fillPolygonAA(), fillPathAA()
+
+    Fill with smooth edges.  Each pixel along an edge gets the fill
+    color blended in by how much of it is inside the shape, worked out
+    exactly, rather than being all in or all out.  The fill color's own
+    alpha makes the whole shape that much see-through.
+
+    Since the edges are blended with what's already there, these read
+    the pixels back as well as writing them.
+    */
+    bool fillPolygonAA(const Point2D *pts, size_t count, GRFillRule rule = GR_NONZERO)
+    {
+        return fillDevicePolygonAA(mapPoints(pts, count), count, rule);
+    }
+
+    bool fillPolygonAA(const PointFx *pts, size_t count, GRFillRule rule = GR_NONZERO)
+    {
+        return fillDevicePolygonAA(mapPoints(pts, count), count, rule);
+    }
+
+    bool fillPathAA(const Path &path, GRFillRule rule = GR_NONZERO)
+    {
+        size_t count = mapPath(path);
+        return count > 0 && fillDevicePolygonAA(mapped, count, rule);
+    }
+
+    /*
+    floodFill()
+
+    Fill the area connected to (x, y) that is the same color as (x, y),
+    with the fill color, within the clipping rectangle.  With a
+    tolerance, pixels whose channels are each within that much of the
+    starting pixel are included.
+
+    Since the result depends on what has already been drawn, this
+    can not be recorded into a display list.
+    */
+    bool floodFill(GRCOORD x, GRCOORD y, int tolerance = 0)
+    {
+        if (recorder) {
+            return false;
+        }
+
+        if (!filler) {
+            filler = new FloodFiller();
+        }
+
+        // the pixel the seed lands on
+        PointFx seed = mapPoint(x, y);
+        int sx = fixedRound(seed.x);
+        int sy = fixedRound(seed.y);
+        if (sx < clipRect.x || sy < clipRect.y || sx >= clipRect.right() || sy >= clipRect.bottom()) {
+            return false;
+        }
+
+        return filler->fill(pb, clipRect, (GRCOORD)sx, (GRCOORD)sy, fillPix, tolerance);
+    }
+
+private:
+    /*
+        Transformed drawing
+
+        Where shapes go when the transform isn't a whole pixel
+        translation.  Points come out in fixed point, in pixels, and
+        the shape is drawn (or recorded) from there.
+    */
+    PointFx mapPoint(REAL x, REAL y) const
+    {
+        if (translateOnly) {
+            return PointFx(fixedFromReal(x + offsetX), fixedFromReal(y + offsetY));
+        }
+        return transform.map(x, y);
+    }
+
+    PointFx mapPoint(const PointFx &p) const
+    {
+        if (translateOnly) {
+            return PointFx(p.x + fixedFromInt(offsetX), p.y + fixedFromInt(offsetY));
+        }
+        return transform.map(fixedToReal(p.x), fixedToReal(p.y));
+    }
+
+    // A path as one polygon, in pixels, into mapped.  The contours are
+    // joined by lines back to the start of the first, which go there and
+    // back over the same pixels, so they cancel out, by either rule.
+    // Returns how many points, 0 when there's nothing to draw.
+    size_t mapPath(const Path &path)
+    {
+        path.flatten(transform.maxScale());
+        int contours = path.getContourCount();
+        if (contours == 0 || (!recorder && !pathInClip(path))) {
+            return 0;
+        }
+
+        const PathPoint *flat = path.getFlatPoints();
+        size_t total = 0;
+        for (int c = 0; c < contours; c++) {
+            total += path.getContour(c).count + 2;
+        }
+
+        if (!reserveMapped(total)) {
+            return 0;
+        }
+        PointFx anchor = mapPoint(flat[0].x, flat[0].y);
+        size_t n = 0;
+        for (int c = 0; c < contours; c++) {
+            const PathContour &contour = path.getContour(c);
+            const PathPoint *pts = flat + contour.first;
+            for (int i = 0; i < contour.count; i++) {
+                mapped[n++] = mapPoint(pts[i].x, pts[i].y);
+            }
+            mapped[n] = mapped[n - contour.count];
+            mapped[n + 1] = anchor;
+            n += 2;
+        }
+        return n;
+    }
+
+    // Whether any of a flattened path's bounding box, transformed,
+    // lands in the clip, give or take a pixel
+    bool pathInClip(const Path &path) const
+    {
+        const PathBounds &b = path.getBounds();
+        PointFx corners[4] = {
+            mapPoint(b.left, b.top), mapPoint(b.right, b.top),
+            mapPoint(b.right, b.bottom), mapPoint(b.left, b.bottom)
+        };
+
+        GRFIXED left = corners[0].x, right = corners[0].x;
+        GRFIXED top = corners[0].y, bottom = corners[0].y;
+        for (int i = 1; i < 4; i++) {
+            if (corners[i].x < left) left = corners[i].x;
+            if (corners[i].x > right) right = corners[i].x;
+            if (corners[i].y < top) top = corners[i].y;
+            if (corners[i].y > bottom) bottom = corners[i].y;
+        }
+
+        return fixedRound(right) + 1 >= clipRect.x && fixedRound(left) - 1 < clipRect.right() &&
+            fixedRound(bottom) + 1 >= clipRect.y && fixedRound(top) - 1 < clipRect.bottom();
+    }
+
+    // Room for count points in mapped.  Returns false, with mapped
+    // as it was, if there's no memory.
+    bool reserveMapped(size_t count)
+    {
+        if (count > mappedCapacity) {
+            size_t capacity = count > 64 ? count : 64;
+            PointFx *grown = (PointFx *)realloc(mapped, capacity * sizeof(PointFx));
+            if (!grown) {
+                return false;
+            }
+            mapped = grown;
+            mappedCapacity = capacity;
+        }
+        return true;
+    }
+
+    // Transform a whole array of points, into mapped, which is
+    // good until the next call.  NULL if there's no memory for them.
+    const PointFx * mapPoints(const Point2D *pts, size_t count)
+    {
+        if (!reserveMapped(count)) {
+            return NULL;
+        }
+        if (translateOnly) {
+            for (size_t i = 0; i < count; i++) {
+                mapped[i] = PointFx::fromInt(pts[i].x + offsetX, pts[i].y + offsetY);
+            }
+        } else {
+            transformPoints(transform, pts, mapped, count);
+        }
+        return mapped;
+    }
+
+    const PointFx * mapPoints(const PointFx *pts, size_t count)
+    {
+        if (!reserveMapped(count)) {
+            return NULL;
+        }
+        for (size_t i = 0; i < count; i++) {
+            mapped[i] = mapPoint(pts[i]);
+        }
+        return mapped;
+    }
+
+    // The corners of the pixels from (x, y), width by height, which go
+    // from half a pixel before the first center to half after the last
+    void mapBox(REAL x, REAL y, REAL width, REAL height, PointFx *corners) const
+    {
+        REAL left = x - 0.5f, top = y - 0.5f;
+        REAL right = left + width, bottom = top + height;
+        corners[0] = transform.map(left, top);
+        corners[1] = transform.map(right, top);
+        corners[2] = transform.map(right, bottom);
+        corners[3] = transform.map(left, bottom);
+    }
+
+    // Points around an ellipse, transformed, into mapped.  Returns how
+    // many, 0 if there's no memory for them.
+    size_t mapEllipse(REAL cx, REAL cy, REAL xradius, REAL yradius)
+    {
+        REAL r = xradius > yradius ? xradius : yradius;
+        int sides = ellipseSides(r * transform.maxScale());
+
+        if (!reserveMapped(sides)) {
+            return 0;
+        }
+        for (int i = 0; i < sides; i++) {
+            double a = 2 * 3.14159265358979 * i / sides;
+            mapped[i] = mapPoint(cx + xradius * (REAL)cos(a), cy + yradius * (REAL)sin(a));
+        }
+        return sides;
+    }
+
+    // A line whose end points are already in pixels
+    bool strokeDeviceLine(const PointFx &p1, const PointFx &p2, const PixRGBA *color = nullptr)
+    {
+        if (recorder) {
+            if (color) {
+                int32_t *args = recorder->append(DL_LINEFXCOLOR);
+                if (!args) {
+                    return false;
+                }
+                args[0] = (int32_t)color->intValue;
+                args[1] = p1.x;
+                args[2] = p1.y;
+                args[3] = p2.x;
+                args[4] = p2.y;
+                return true;
+            }
+            return recorder->appendArgs(DL_LINEFX, p1.x, p1.y, p2.x, p2.y);
+        }
+
+        lineSpansFx(p1.x, p1.y, p2.x, p2.y, color ? *color : strokePix);
+        flushSpans();
+        return true;
+    }
+
+    bool strokeDevicePolygon(const PointFx *pts, size_t count)
+    {
+        if (!pts || count == 0) {
+            return false;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            strokeDeviceLine(pts[i], pts[(i + 1) % count]);
+        }
+        return true;
+    }
+
+    bool fillDeviceTriangle(const PointFx *verts)
+    {
+        if (!verts) {
+            return false;
+        }
+
+        if (recorder) {
+            return recorder->appendArgs(DL_FILLTRIANGLEFX,
+                verts[0].x, verts[0].y, verts[1].x, verts[1].y, verts[2].x, verts[2].y);
+        }
+
+        int32_t xs[3] = {verts[0].x, verts[1].x, verts[2].x};
+        int32_t ys[3] = {verts[0].y, verts[1].y, verts[2].y};
+
+        TrianglePaint paint;
+        paint.color = fillPix;
+        triangleSpans(xs, ys, paint, &DrawingContext::flatRow);
+        flushSpans();
+        return true;
+    }
+
+    // A polygon whose points are already in pixels, in its own color,
+    // or the fill color when color is null
+    bool fillDevicePolygon(const PointFx *pts, size_t count, GRFillRule rule, const PixRGBA *color = nullptr)
+    {
+        if (!pts || count < 3) {
+            return false;
+        }
+
+        if (recorder) {
+            int32_t *args;
+            if (color) {
+                args = recorder->appendVariable(DL_FILLPOLYGONCOLOR, 2 + 2 * (int)count);
+                if (args) {
+                    args[0] = (int32_t)color->intValue;
+                    args = args + 1;
+                }
+            } else {
+                args = recorder->appendVariable(DL_FILLPOLYGON, 1 + 2 * (int)count);
+            }
+            if (!args) {
+                return false;
+            }
+
+            args[0] = rule;
+            for (size_t i = 0; i < count; i++) {
+                args[1 + i*2] = pts[i].x;
+                args[2 + i*2] = pts[i].y;
+            }
+            return true;
+        }
+
+        numPolyEdges = 0;
+        for (size_t i = 0; i < count; i++) {
+            const PointFx &a = pts[i];
+            const PointFx &b = pts[(i + 1) % count];
+            if (!addPolygonEdge(a.x, a.y, b.x, b.y)) {
+                return false;
+            }
+        }
+        polygonSpans(rule, color ? *color : fillPix);
+        flushSpans();
+
+        return true;
+    }
+
+    // An anti-aliased polygon whose points are already in pixels
+    bool fillDevicePolygonAA(const PointFx *pts, size_t count, GRFillRule rule)
+    {
+        if (!pts || count < 3) {
+            return false;
+        }
+
+        if (recorder) {
+            int32_t *args = recorder->appendVariable(DL_FILLPOLYGONAA, 1 + 2 * (int)count);
+            if (!args) {
+                return false;
+            }
+            args[0] = rule;
+            for (size_t i = 0; i < count; i++) {
+                args[1 + i*2] = pts[i].x;
+                args[2 + i*2] = pts[i].y;
+            }
+            return true;
+        }
+
+        return fillPolygonCoverage(pts, count, rule, fillPix);
+    }
+
+    /*
+    fillPolygonCoverage()
+
+    Work out the coverage of a polygon, just over the pixels it could
+    touch in the clip, then blend the color in, a row at a time, with
+    getSpan() and setSpan().
+    */
+    bool fillPolygonCoverage(const PointFx *pts, size_t count, GRFillRule rule, const PixRGBA color)
+    {
+        GRFIXED left = pts[0].x, right = pts[0].x;
+        GRFIXED top = pts[0].y, bottom = pts[0].y;
+        for (size_t i = 1; i < count; i++) {
+            if (pts[i].x < left) left = pts[i].x;
+            if (pts[i].x > right) right = pts[i].x;
+            if (pts[i].y < top) top = pts[i].y;
+            if (pts[i].y > bottom) bottom = pts[i].y;
+        }
+
+        // any pixel an edge passes through, even a corner of
+        int x1 = fixedRound(left) - 1, y1 = fixedRound(top) - 1;
+        int x2 = fixedRound(right) + 2, y2 = fixedRound(bottom) + 2;
+        GRRectangle area = GRRectangle(x1, y1, x2 - x1, y2 - y1).intersection(clipRect);
+        if (area.isEmpty()) {
+            return true;
+        }
+
+        if (!coverage) {
+            coverage = new CoverageRasterizer();
+        }
+
+        if (!coverage->begin(area)) {
+            return false;
+        }
+        for (size_t i = 0; i < count; i++) {
+            const PointFx &a = pts[i];
+            const PointFx &b = pts[(i + 1) % count];
+            coverage->addLine(a.x, a.y, b.x, b.y);
+        }
+
+        for (int y = coverage->getTop(); y < coverage->getBottom(); y++) {
+            int from, to;
+            const uint8_t *alpha;
+            if (!coverage->rowAlpha(y, rule, from, to, alpha)) {
+                continue;
+            }
+
+            // the ends that aren't covered at all needn't be touched
+            while (from < to && alpha[0] == 0) {
+                alpha++;
+                from++;
+            }
+            while (to > from && alpha[to - from - 1] == 0) {
+                to--;
+            }
+            if (from == to) {
+                continue;
+            }
+
+            int x = area.x + from;
+            int row = area.y + y;
+            pb.getSpan(x, row, to - from, scratch);
+            blendCoverage(scratch, alpha, to - from, color);
+            pb.setSpan(x, row, to - from, scratch);
+        }
+
+        return true;
+    }
+
+    // Blend color into each pixel by its alpha, and the color's own
+    static void blendCoverage(PixRGBA *pix, const uint8_t *alpha, int count, const PixRGBA color)
+    {
+        for (int i = 0; i < count; i++) {
+            int a = div255(alpha[i] * color.a);
+            if (a == 0) {
+                continue;
+            }
+            if (a == 255) {
+                pix[i] = color;
+                continue;
+            }
+
+            PixRGBA &p = pix[i];
+            for (int c = 0; c < 4; c++) {
+                p.data[c] = (uint8_t)div255(color.data[c] * a + p.data[c] * (255 - a));
+            }
+        }
+    }
+
+    // t / 255, rounded, for t from 0 to 255 * 255
+    static int div255(int t)
+    {
+        t = t + 128;
+        return (t + (t >> 8)) >> 8;
+    }
+
+    /*
+        The clipped primitives
+
+        Everything eventually comes down to either setting a single
+        pixel, or setting a horizontal span of pixels.  These routines
+        work in signed integer coordinates, so things can hang off the
+        left and top edges, and they discard anything outside the
+        clipping rectangle.
+    */
+    bool plot(int x, int y, const PixRGBA pix)
+    {
+        if (x < clipRect.x || y < clipRect.y || x >= clipRect.right() || y >= clipRect.bottom()) {
+            return false;
+        }
+
+        return pb.setPixel(x, y, pix);
+    }
+
+    // Horizontal run of a single color, from x, for width pixels
+    void span(int x, int y, int width, const PixRGBA pix)
+    {
+        if (y < clipRect.y || y >= clipRect.bottom()) {
+            return;
+        }
+
+        int x1 = x < clipRect.x ? clipRect.x : x;
+        int x2 = x + width;
+        if (x2 > clipRect.right()) {
+            x2 = clipRect.right();
+        }
+
+        if (x2 > x1) {
+            pb.setPixels(x1, y, x2 - x1, pix);
+        }
+    }
+
+    void doClear()
+    {
+        if (clipRect.x == 0 && clipRect.y == 0 &&
+            (GRSIZE)clipRect.width == pb.getWidth() && (GRSIZE)clipRect.height == pb.getHeight())
+        {
+            pb.setAllPixels(bgPix);
+            return;
+        }
+
+        for (int row = clipRect.y; row < clipRect.bottom(); row++) {
+            pb.setPixels(clipRect.x, row, clipRect.width, bgPix);
+        }
+    }
+
+    void doVerticalLine(int x, int y, int length)
+    {
+        if (x < clipRect.x || x >= clipRect.right()) {
+            return;
+        }
+
+        int y1 = y < clipRect.y ? clipRect.y : y;
+        int y2 = y + length;
+        if (y2 > clipRect.bottom()) {
+            y2 = clipRect.bottom();
+        }
+
+        for (int idx = y1; idx < y2; idx++) {
+            pb.setPixel(x, idx, strokePix);
+        }
+    }
+
+    void doLine(int x1, int y1, int x2, int y2)
+    {
+        lineSpans(x1, y1, x2, y2, strokePix);
+        flushSpans();
+    }
+
+    void lineSpans(int x1, int y1, int x2, int y2, const PixRGBA color)
+    {
+        lineSpansFx(fixedFromInt(x1), fixedFromInt(y1), fixedFromInt(x2), fixedFromInt(y2), color);
+    }
+
+    /*
+    lineSpansFx()
+
+    A line between fixed point end points.  The line is walked along its
+    major axis (the one that changes the most), a pixel at a time, from
+    the pixel nearest one end to the pixel nearest the other.  At each
+    step, the minor axis pixel is the one nearest to where the line
+    really is, at the center of that major pixel.
+
+    That position is a fraction, kept as a whole part and a remainder,
+    like Bresenham, so it's exact, and with whole pixel end points the
+    pixels are exactly Bresenham's.  Both axes are flipped, if need be,
+    so the walk always goes up both, then flipped back when the pixel
+    is drawn.
+
+    The starting fraction can be worked out for any step, so the walk
+    begins at the first pixel inside the clip rectangle, rather than
+    at the start of the line.  This matters when a long line is drawn
+    into a small clip, as in tiled rendering.
+
+    Pixels of a shallow line that land on the same row are gathered
+    up into a single span.
+    */
+    void lineSpansFx(GRFIXED x1, GRFIXED y1, GRFIXED x2, GRFIXED y2, const PixRGBA color)
+    {
+        int64_t dx = (int64_t)x2 - x1;
+        int64_t dy = (int64_t)y2 - y1;
+        bool steep = (dy < 0 ? -dy : dy) > (dx < 0 ? -dx : dx);
+
+        int64_t major1 = steep ? y1 : x1;
+        int64_t minor1 = steep ? x1 : y1;
+        int64_t majorLen = steep ? dy : dx;
+        int64_t minorLen = steep ? dx : dy;
+
+        // flip so both lengths are positive
+        int smajor = majorLen < 0 ? -1 : 1;
+        int sminor = minorLen < 0 ? -1 : 1;
+        major1 = major1 * smajor;
+        minor1 = minor1 * sminor;
+        majorLen = majorLen * smajor;
+        minorLen = minorLen * sminor;
+
+        // the clip, in flipped coordinates, inclusive
+        int lo = steep ? clipRect.y : clipRect.x;
+        int hi = steep ? clipRect.bottom() - 1 : clipRect.right() - 1;
+        int minorLo = steep ? clipRect.x : clipRect.y;
+        int minorHi = steep ? clipRect.right() - 1 : clipRect.bottom() - 1;
+        if (smajor < 0) {
+            int tmp = lo;
+            lo = -hi;
+            hi = -tmp;
+        }
+        if (sminor < 0) {
+            int tmp = minorLo;
+            minorLo = -minorHi;
+            minorHi = -tmp;
+        }
+
+        // nearest pixels to the ends, clipped
+        int first = fixedRound((GRFIXED)major1);
+        int last = fixedRound((GRFIXED)(major1 + majorLen));
+        if (first < lo) first = lo;
+        if (last > hi) last = hi;
+        if (first > last) {
+            return;
+        }
+
+        // The minor pixel at major pixel c is
+        //      floor((minor1 + 1/2 + (c - major1) * minorLen / majorLen))
+        // in pixels, which is quot + rem/denom
+        int64_t quot = minor1 >> GRFIXED_SHIFT;
+        int64_t rem = 0, denom = 1;
+        int64_t stepQuot = 0, stepRem = 0;
+        if (majorLen == 0) {
+            // a single point
+            quot = fixedRound((GRFIXED)minor1);
+        } else {
+            denom = majorLen * GRFIXED_ONE;
+            int64_t frac = (minor1 & (GRFIXED_ONE - 1)) + GRFIXED_HALF;
+            int64_t q, r;
+            floorDivide(frac * majorLen + ((int64_t)first * GRFIXED_ONE - major1) * minorLen, denom, q, r);
+            quot = quot + q;
+            rem = r;
+            floorDivide(minorLen * GRFIXED_ONE, denom, stepQuot, stepRem);
+        }
+
+        // the run of pixels on the current row, for shallow lines
+        bool inRun = false;
+        int runRow = 0, runLow = 0, runHigh = 0;
+
+        for (int c = first; c <= last; c++)
+        {
+            int pminor = (int)quot;
+            if (pminor > minorHi) {
+                break;      // left the clip, and never coming back
+            }
+
+            if (pminor >= minorLo) {
+                int px = steep ? pminor * sminor : c * smajor;
+                int py = steep ? c * smajor : pminor * sminor;
+
+                if (steep) {
+                    pushSpan(px, py, 1, color);
+                } else if (inRun && py == runRow) {
+                    if (px < runLow) runLow = px;
+                    if (px > runHigh) runHigh = px;
+                } else {
+                    if (inRun) {
+                        pushSpan(runLow, runRow, runHigh - runLow + 1, color);
+                    }
+                    inRun = true;
+                    runRow = py;
+                    runLow = px;
+                    runHigh = px;
+                }
+            }
+
+            quot += stepQuot;
+            rem += stepRem;
+            if (rem >= denom) {
+                quot = quot + 1;
+                rem = rem - denom;
+            }
+        }
+
+        if (inRun) {
+            pushSpan(runLow, runRow, runHigh - runLow + 1, color);
+        }
+    }
+
+    void doStrokeRectangle(int x, int y, int width, int height)
+    {
+        // Draw Horizontal Lines
+        span(x, y, width, strokePix);
+        span(x, y+height-1, width, strokePix);
+
+        // Draw Vertical lines
+        doVerticalLine(x, y, height);
+        doVerticalLine(x+width-1, y, height);
+    }
+
+    void doFillRectangle(int x, int y, int width, int height)
+    {
+        GRRectangle r = GRRectangle(x, y, width, height).intersection(clipRect);
+
+        for (int idx = 0; idx<r.height; idx++)
+        {
+            this->pb.setPixels(r.x, r.y+idx, r.width, this->fillPix);
+        }
+    }
+
+    /*
+        Span batching
+
+        pushSpan() adds a span that is already clipped, addSpan() clips
+        it first.  Either way, when the batch fills up it is handed to the
+        pixel buffer, and whoever started drawing calls flushSpans()
+        when they're done to send the rest.
+    */
+    void pushSpan(int x, int y, int width, const PixRGBA color)
+    {
+        GRSpan &span = spans[numSpans];
+        span.x = x;
+        span.y = y;
+        span.width = width;
+        span.color = color;
+
+        numSpans = numSpans + 1;
+        if (numSpans == SpanBatchSize) {
+            flushSpans();
+        }
+    }
+
+    void addSpan(int x, int y, int width, const PixRGBA color)
+    {
+        if (y < clipRect.y || y >= clipRect.bottom()) {
+            return;
+        }
+
+        int x1 = x < clipRect.x ? clipRect.x : x;
+        int x2 = x + width;
+        if (x2 > clipRect.right()) {
+            x2 = clipRect.right();
+        }
+
+        if (x2 > x1) {
+            pushSpan(x1, y, x2 - x1, color);
+        }
+    }
+
+    void flushSpans()
+    {
+        if (numSpans > 0) {
+            pb.fillSpans(spans, numSpans);
+            numSpans = 0;
+        }
+    }
+
+    void rectangleSpans(int x, int y, int width, int height, const PixRGBA color)
+    {
+        GRRectangle r = GRRectangle(x, y, width, height).intersection(clipRect);
+
+        for (int row = r.y; row < r.bottom(); row++) {
+            pushSpan(r.x, row, r.width, color);
+        }
+    }
+
+    /*
+    ellipseSpans()
+
+    The same midpoint algorithm as raster_rgba_ellipse(), filling between
+    the left and right sides.  Along the top and bottom, the algorithm
+    steps across several times on the same row, with the row getting
+    wider each time, so only the last (widest) one is kept.
+    */
+    void ellipseSpans(int cx, int cy, int xradius, int yradius, const PixRGBA color)
+    {
+        // the terms are the radii squared, times the radii, which is
+        // too big for an int once a radius is past a thousand or so
+        int64_t a = xradius;
+        int64_t b = yradius;
+        int64_t twoasquare = 2 * a*a;
+        int64_t twobsquare = 2 * b*b;
+
+        int x = xradius;
+        int y = 0;
+
+        int64_t xchange = b*b*(1 - 2 * a);
+        int64_t ychange = a*a;
+        int64_t ellipseerror = 0;
+        int64_t stoppingx = twobsquare*a;
+        int64_t stoppingy = 0;
+
+        // first set of points, sides, one row at a time
+        while (stoppingx >= stoppingy)
+        {
+            addSpan(cx - x, cy + y, 2 * x, color);
+            addSpan(cx - x, cy - y, 2 * x, color);
+
+            y = y + 1;
+            stoppingy = stoppingy + twoasquare;
+            ellipseerror += ychange;
+            ychange += twoasquare;
+
+            if ((2 * ellipseerror + xchange) > 0) {
+                x--;
+                stoppingx -= twobsquare;
+                ellipseerror += xchange;
+                xchange += twobsquare;
+            }
+        }
+
+        // second set of points, top and bottom
+        x = 0;
+        y = yradius;
+        xchange = b*b;
+        ychange = a*a*(1 - 2 * b);
+        ellipseerror = 0;
+        stoppingx = 0;
+        stoppingy = twoasquare*b;
+
+        while (stoppingx <= stoppingy) {
+            int rowx = x;
+            int rowy = y;
+
+            x = x + 1;
+            stoppingx = stoppingx + twobsquare;
+            ellipseerror = ellipseerror + xchange;
+            xchange = xchange + twobsquare;
+
+            if ((2 * ellipseerror + ychange) > 0) {
+                y = y - 1;
+                stoppingy -= twoasquare;
+                ellipseerror += ychange;
+                ychange += twoasquare;
+            }
+
+            // moving to a new row, or finished
+            if (y != rowy || stoppingx > stoppingy) {
+                addSpan(cx - rowx, cy + rowy, 2 * rowx, color);
+                addSpan(cx - rowx, cy - rowy, 2 * rowx, color);
+            }
+        }
+    }
+
+    /*
+    ellipseSpansFx()
+
+    A filled ellipse with a fixed point center and radii.  Each row
+    gets the pixels whose centers are inside the ellipse, which is a
+    square root per row, rather than the midpoint stepping, which only
+    works with whole pixels.
+    */
+    void ellipseSpansFx(GRFIXED cx, GRFIXED cy, GRFIXED xradius, GRFIXED yradius, const PixRGBA color)
+    {
+        if (xradius <= 0 || yradius <= 0) {
+            return;
+        }
+
+        int first = fixedCeil(cy - yradius);
+        int last = (int)(((int64_t)cy + yradius) >> GRFIXED_SHIFT);
+        if (first < clipRect.y) {
+            first = clipRect.y;
+        }
+        if (last > clipRect.bottom() - 1) {
+            last = clipRect.bottom() - 1;
+        }
+
+        double ry = yradius;
+        for (int row = first; row <= last; row++)
+        {
+            double t = ((double)row * GRFIXED_ONE - cy) / ry;
+            double half = xradius * sqrt(1 - t * t);
+            if (half != half) {
+                continue;       // rounding put the row just outside
+            }
+
+            int x1 = (int)ceil((cx - half) / GRFIXED_ONE);
+            int x2 = (int)floor((cx + half) / GRFIXED_ONE);
+            addSpan(x1, row, x2 - x1 + 1, color);
+        }
+    }
+
+    // A chord across angle a of a circle of radius r is off the curve
+    // by about r*a*a/8.  Keeping that to 1/4 pixel gives the number
+    // of sides for an ellipse whose larger radius is r pixels.
+    static int ellipseSides(REAL r)
+    {
+        int sides = r > 1 ? (int)ceil(2 * 3.14159265358979 / sqrt(2 / r)) : 4;
+        return sides < 8 ? 8 : sides;
+    }
+
+    // The outline of a fixed point ellipse, as short lines
+    void ellipseOutlineFx(GRFIXED cx, GRFIXED cy, GRFIXED xradius, GRFIXED yradius, const PixRGBA color)
+    {
+        if (xradius < 0 || yradius < 0) {
+            return;
+        }
+
+        int sides = ellipseSides((xradius > yradius ? xradius : yradius) / (REAL)GRFIXED_ONE);
+
+        GRFIXED px = cx + xradius;
+        GRFIXED py = cy;
+        for (int i = 1; i <= sides; i++)
+        {
+            double a = 2 * 3.14159265358979 * i / sides;
+            GRFIXED nx = i == sides ? cx + xradius : cx + (GRFIXED)floor(xradius * cos(a) + 0.5);
+            GRFIXED ny = i == sides ? cy : cy + (GRFIXED)floor(yradius * sin(a) + 0.5);
+            lineSpansFx(px, py, nx, ny, color);
+            px = nx;
+            py = ny;
+        }
+    }
+
+    /*
+        Triangle filling
+
+        Triangles are filled a row at a time, between a left and a right
+        edge, sampling each pixel at its center.  The vertices are in 24.8
+        fixed point (GRFIXED), where a whole number is the center of that
+        pixel, so integer vertices come in multiplied by GRFIXED_ONE.
+
+        A pixel is in when its center is on or to the right of the left
+        edge, and strictly left of the right edge.  Likewise, rows are in
+        from the top vertex down to, but not including, the bottom one.
+        That's the usual "top left" rule.
+
+        The edges step from row to row in integer arithmetic, a whole
+        part and a remainder, like Bresenham, so there's no rounding
+        error.  An edge lands on exactly the same pixels no matter which
+        of its triangles is being filled, or where the clip starts.
+    */
+    // floor division, with a remainder that is never negative
+    static void floorDivide(int64_t num, int64_t denom, int64_t &quot, int64_t &rem)
+    {
+        quot = num / denom;
+        rem = num % denom;
+        if (rem < 0) {
+            quot = quot - 1;
+            rem = rem + denom;
+        }
+    }
+
+    struct TriangleEdge {
+        int64_t quot, rem;      // x in pixels is quot + rem/denom
+        int64_t stepQuot, stepRem;
+        int64_t denom;
+
+        // The edge from (xa, ya) down to (xb, yb), starting on the given row
+        void setup(int32_t xa, int32_t ya, int32_t xb, int32_t yb, int row)
+        {
+            int64_t dx = (int64_t)xb - xa;
+            int64_t dy = (int64_t)yb - ya;
+
+            denom = dy * GRFIXED_ONE;
+            floorDivide((int64_t)xa * dy + ((int64_t)row * GRFIXED_ONE - ya) * dx, denom, quot, rem);
+            floorDivide(dx * GRFIXED_ONE, denom, stepQuot, stepRem);
+        }
+
+        // The first pixel whose center is on or right of the edge
+        int x() const { return (int)(quot + (rem > 0 ? 1 : 0)); }
+
+        void step()
+        {
+            quot += stepQuot;
+            rem += stepRem;
+            if (rem >= denom) {
+                quot = quot + 1;
+                rem = rem - denom;
+            }
+        }
+    };
+
+    /*
+        Colors for smooth shading, as planes.  A channel at pixel (x, y) is
+        base + (x - x0)*dx + (y - y0)*dy, in 16.16 fixed point.  The
+        slopes are worked out once per triangle.  After that it's a
+        couple of multiplies at the start of each row, and one add per
+        channel for each pixel along it.  No division per pixel.
+    */
+    struct TriangleShade {
+        int32_t x0, y0;
+        int64_t base[4];
+        int64_t dx[4];
+        int64_t dy[4];
+    };
+
+    /*
+        Texture coordinates as planes, the same way, but in floating
+        point.  For perspective, the planes are u/w, v/w and 1/w, which
+        do change linearly across the screen, where u and v themselves
+        don't.  Getting u and v back means dividing by 1/w, which is
+        only done every TextureRun pixels.  In between, u and v step
+        linearly in fixed point, which is close enough to not be seen.
+        Without perspective, the third plane is simply 1.
+    */
+    struct TriangleTexture {
+        const Texture *texture;
+        TextureFilter filter;
+        bool perspective;
+        REAL x0, y0;
+        REAL base[3];
+        REAL dx[3];
+        REAL dy[3];
+    };
+
+    static const int TextureRun = 16;       // pixels between divides
+    static const int AffineRun = 256;       // keeps the fixed point in range
+
+    // What a triangle is being filled with.  Only the part that
+    // goes with the row handler is set up.
+    struct TrianglePaint {
+        PixRGBA color;
+        TriangleShade shade;
+        TriangleTexture texture;
+    };
+
+    typedef void (DrawingContext::* TriangleRowHandler)(const TrianglePaint &paint, int x1, int x2, int row);
+
+    static uint8_t shadeChannel(int64_t v)
+    {
+        int64_t c = v >> 16;
+        return (uint8_t)(c < 0 ? 0 : (c > 255 ? 255 : c));
+    }
+
+    void doFillTriangle(int x1, int y1, int x2, int y2, int x3, int y3, const PixRGBA color)
+    {
+        int32_t xs[3] = {fixedFromInt(x1), fixedFromInt(x2), fixedFromInt(x3)};
+        int32_t ys[3] = {fixedFromInt(y1), fixedFromInt(y2), fixedFromInt(y3)};
+
+        TrianglePaint paint;
+        paint.color = color;
+        triangleSpans(xs, ys, paint, &DrawingContext::flatRow);
+        flushSpans();
+    }
+
+    void doShadeTriangle(const int32_t *xs, const int32_t *ys, const PixRGBA *shades)
+    {
+        // twice the area, in the order given
+        int64_t cross = (int64_t)(xs[1] - xs[0]) * (ys[2] - ys[0]) - (int64_t)(ys[1] - ys[0]) * (xs[2] - xs[0]);
+        if (cross == 0) {
+            return;
+        }
+
+        TrianglePaint paint;
+        TriangleShade &shade = paint.shade;
+        shade.x0 = xs[0];
+        shade.y0 = ys[0];
+        for (int c = 0; c < 4; c++) {
+            int64_t c0 = shades[0].data[c];
+            int64_t c1 = shades[1].data[c] - c0;
+            int64_t c2 = shades[2].data[c] - c0;
+
+            // per pixel slopes, scaled up to 16.16
+            shade.dx[c] = (c1 * (ys[2] - ys[0]) - c2 * (ys[1] - ys[0])) * GRFIXED_ONE * 65536 / cross;
+            shade.dy[c] = (c2 * (xs[1] - xs[0]) - c1 * (xs[2] - xs[0])) * GRFIXED_ONE * 65536 / cross;
+            shade.base[c] = (c0 << 16) + 32768;     // rounded
+        }
+
+        triangleSpans(xs, ys, paint, &DrawingContext::shadeRow);
+    }
+
+    // The corners are at (xs, ys) in fixed point, and the rest of
+    // each corner comes from verts
+    void doTextureTriangle(const int32_t *xs, const int32_t *ys, const GRTexVertex *verts,
+        const Texture &tex, TextureFilter filter, bool perspective)
+    {
+        REAL ex1 = fixedToReal(xs[1] - xs[0]), ey1 = fixedToReal(ys[1] - ys[0]);
+        REAL ex2 = fixedToReal(xs[2] - xs[0]), ey2 = fixedToReal(ys[2] - ys[0]);
+        REAL cross = ex1 * ey2 - ey1 * ex2;
+        if (cross == 0) {
+            return;
+        }
+
+        TrianglePaint paint;
+        TriangleTexture &t = paint.texture;
+        t.texture = &tex;
+        t.filter = filter;
+        t.perspective = perspective;
+        t.x0 = fixedToReal(xs[0]);
+        t.y0 = fixedToReal(ys[0]);
+
+        REAL attrs[3][3];
+        for (int i = 0; i < 3; i++) {
+            REAL q = (perspective && verts[i].w != 0) ? 1 / verts[i].w : 1;
+            attrs[i][0] = verts[i].u * q;
+            attrs[i][1] = verts[i].v * q;
+            attrs[i][2] = q;
+        }
+
+        for (int k = 0; k < 3; k++) {
+            REAL a1 = attrs[1][k] - attrs[0][k];
+            REAL a2 = attrs[2][k] - attrs[0][k];
+            t.base[k] = attrs[0][k];
+            t.dx[k] = (a1 * ey2 - a2 * ey1) / cross;
+            t.dy[k] = (a2 * ex1 - a1 * ex2) / cross;
+        }
+
+        triangleSpans(xs, ys, paint, &DrawingContext::textureRow);
+    }
+
+    /*
+    triangleSpans()
+
+    Fill a triangle given by fixed point vertices, in any order, by
+    calling the row handler for each row, with the part of the row that
+    is inside both the triangle and the clip.
+    */
+    void triangleSpans(const int32_t *xs, const int32_t *ys, const TrianglePaint &paint, TriangleRowHandler handler)
+    {
+        // sort the vertices from top to bottom
+        int order[3] = {0, 1, 2};
+        int tmp;
+        if (ys[order[0]] > ys[order[1]]) { tmp = order[0]; order[0] = order[1]; order[1] = tmp; }
+        if (ys[order[1]] > ys[order[2]]) { tmp = order[1]; order[1] = order[2]; order[2] = tmp; }
+        if (ys[order[0]] > ys[order[1]]) { tmp = order[0]; order[0] = order[1]; order[1] = tmp; }
+
+        int32_t x0 = xs[order[0]], y0 = ys[order[0]];
+        int32_t x1 = xs[order[1]], y1 = ys[order[1]];
+        int32_t x2 = xs[order[2]], y2 = ys[order[2]];
+
+        // twice the area, positive when the middle vertex is
+        // right of the long edge from top to bottom
+        int64_t cross = (int64_t)(x1 - x0) * (y2 - y0) - (int64_t)(y1 - y0) * (x2 - x0);
+        if (cross == 0) {
+            return;
+        }
+
+        int mid = fixedCeil(y1);
+        int first = fixedCeil(y0);
+        int last = fixedCeil(y2);
+        if (first < clipRect.y) {
+            first = clipRect.y;
+        }
+        if (last > clipRect.bottom()) {
+            last = clipRect.bottom();
+        }
+        if (first >= last) {
+            return;
+        }
+
+        bool longIsLeft = cross > 0;
+        TriangleEdge longEdge;
+        longEdge.setup(x0, y0, x2, y2, first);
+
+        // top half, down to the middle vertex
+        if (first < mid) {
+            int end = mid < last ? mid : last;
+            TriangleEdge edge;
+            edge.setup(x0, y0, x1, y1, first);
+            triangleRows(longIsLeft ? longEdge : edge, longIsLeft ? edge : longEdge,
+                first, end, paint, handler);
+        }
+
+        // bottom half
+        int start = mid > first ? mid : first;
+        if (start < last) {
+            TriangleEdge edge;
+            edge.setup(x1, y1, x2, y2, start);
+            triangleRows(longIsLeft ? longEdge : edge, longIsLeft ? edge : longEdge,
+                start, last, paint, handler);
+        }
+    }
+
+    void triangleRows(TriangleEdge &left, TriangleEdge &right, int first, int last,
+        const TrianglePaint &paint, TriangleRowHandler handler)
+    {
+        for (int row = first; row < last; row++)
+        {
+            int x1 = left.x();
+            int x2 = right.x();
+            left.step();
+            right.step();
+
+            if (x1 < clipRect.x) {
+                x1 = clipRect.x;
+            }
+            if (x2 > clipRect.right()) {
+                x2 = clipRect.right();
+            }
+            if (x2 > x1) {
+                (this->*handler)(paint, x1, x2, row);
+            }
+        }
+    }
+
+    /*
+        Polygon filling
+
+        The same idea as triangles, but with any number of edges.  Each
+        edge is stepped exactly like a triangle edge, so a pixel center
+        on an edge is decided the same way in both.
+
+        Edges are sorted by their top row.  Going down the rows, edges
+        join the active list when the row reaches their top, and leave
+        it at their bottom.  The active edges are sorted across the row
+        each time, which is an insertion sort that has almost nothing to
+        do, since edges rarely pass each other from one row to the next.
+        Then the row is filled between the crossings, wherever the fill
+        rule says it is inside.
+    */
+    struct PolygonEdge {
+        TriangleEdge edge;
+        int32_t xa, ya, xb, yb;     // top and bottom end points
+        int first, last;            // rows [first, last)
+        int winding;                // 1 going down, -1 going up
+        int x;                      // where it crosses the current row
+    };
+
+    // Returns false if there's no memory for another edge
+    bool addPolygonEdge(GRFIXED xa, GRFIXED ya, GRFIXED xb, GRFIXED yb)
+    {
+        // horizontal edges don't cross any row
+        if (ya == yb) {
+            return true;
+        }
+
+        if (numPolyEdges == polyEdgeCapacity) {
+            int capacity = polyEdgeCapacity ? polyEdgeCapacity * 2 : 64;
+            PolygonEdge *edges = (PolygonEdge *)realloc(polyEdges, capacity * sizeof(PolygonEdge));
+            if (!edges) {
+                return false;
+            }
+            polyEdges = edges;
+            PolygonEdge **active = (PolygonEdge **)realloc(activeEdges, capacity * sizeof(PolygonEdge *));
+            if (!active) {
+                return false;
+            }
+            activeEdges = active;
+            polyEdgeCapacity = capacity;
+        }
+
+        PolygonEdge &e = polyEdges[numPolyEdges];
+        e.winding = ya < yb ? 1 : -1;
+        if (ya > yb) {
+            int32_t tmp;
+            tmp = xa; xa = xb; xb = tmp;
+            tmp = ya; ya = yb; yb = tmp;
+        }
+        e.xa = xa;
+        e.ya = ya;
+        e.xb = xb;
+        e.yb = yb;
+        e.first = fixedCeil(ya);
+        e.last = fixedCeil(yb);
+
+        // one that falls between two rows can be dropped now
+        if (e.first < e.last) {
+            numPolyEdges = numPolyEdges + 1;
+        }
+        return true;
+    }
+
+    static int compareEdgeTops(const void *a, const void *b)
+    {
+        return ((const PolygonEdge *)a)->first - ((const PolygonEdge *)b)->first;
+    }
+
+    /*
+    polygonSpans()
+
+    Fill the polygon made of the edges added so far.  They don't
+    have to be in order, so long as together they make closed loops.
+    */
+    void polygonSpans(GRFillRule rule, const PixRGBA color)
+    {
+        if (numPolyEdges == 0) {
+            return;
+        }
+
+        qsort(polyEdges, numPolyEdges, sizeof(PolygonEdge), compareEdgeTops);
+
+        int first = polyEdges[0].first;
+        int last = polyEdges[0].last;
+        for (int i = 1; i < numPolyEdges; i++) {
+            if (polyEdges[i].last > last) {
+                last = polyEdges[i].last;
+            }
+        }
+        if (first < clipRect.y) {
+            first = clipRect.y;
+        }
+        if (last > clipRect.bottom()) {
+            last = clipRect.bottom();
+        }
+
+        int next = 0;           // the next edge to join
+        int numActive = 0;
+
+        for (int row = first; row < last; row++)
+        {
+            // drop edges that have ended
+            int kept = 0;
+            for (int i = 0; i < numActive; i++) {
+                if (activeEdges[i]->last > row) {
+                    activeEdges[kept++] = activeEdges[i];
+                }
+            }
+            numActive = kept;
+
+            // add those that start here, or started above the clip
+            while (next < numPolyEdges && polyEdges[next].first <= row) {
+                PolygonEdge &e = polyEdges[next++];
+                if (e.last > row) {
+                    e.edge.setup(e.xa, e.ya, e.xb, e.yb, row);
+                    activeEdges[numActive++] = &e;
+                }
+            }
+
+            // where each crosses this row, sorted left to right
+            for (int i = 0; i < numActive; i++) {
+                PolygonEdge *e = activeEdges[i];
+                e->x = e->edge.x();
+                e->edge.step();
+
+                int j = i;
+                while (j > 0 && activeEdges[j - 1]->x > e->x) {
+                    activeEdges[j] = activeEdges[j - 1];
+                    j = j - 1;
+                }
+                activeEdges[j] = e;
+            }
+
+            // fill between crossings, where it's inside
+            int winding = 0;
+            for (int i = 0; i + 1 < numActive; i++) {
+                winding += activeEdges[i]->winding;
+                bool inside = (rule == GR_EVENODD) ? (winding & 1) != 0 : winding != 0;
+                if (!inside) {
+                    continue;
+                }
+
+                int x1 = activeEdges[i]->x;
+                int x2 = activeEdges[i + 1]->x;
+                if (x1 < clipRect.x) {
+                    x1 = clipRect.x;
+                }
+                if (x2 > clipRect.right()) {
+                    x2 = clipRect.right();
+                }
+                if (x2 > x1) {
+                    pushSpan(x1, row, x2 - x1, color);
+                }
+            }
+        }
+    }
+
+    // A row of a single color goes into the span batch
+    void flatRow(const TrianglePaint &paint, int x1, int x2, int row)
+    {
+        pushSpan(x1, row, x2 - x1, paint.color);
+    }
+
+    // Shade the pixels [x1, x2) of a row into scratch, and write them
+    void shadeRow(const TrianglePaint &paint, int x1, int x2, int row)
+    {
+        const TriangleShade &shade = paint.shade;
+        int64_t ox = (int64_t)x1 * GRFIXED_ONE - shade.x0;
+        int64_t oy = (int64_t)row * GRFIXED_ONE - shade.y0;
+
+        int32_t value[4], delta[4];
+        int64_t start[4];
+        for (int c = 0; c < 4; c++) {
+            start[c] = shade.base[c] + ((ox * shade.dx[c] + oy * shade.dy[c]) >> 8);
+            value[c] = (int32_t)start[c];
+            delta[c] = (int32_t)shade.dx[c];
+        }
+
+        // Pixel centers are inside the triangle, so the colors should
+        // stay in range, but rounding can push them just outside.  Only
+        // bother clamping when the ends of the row say it's needed.
+        int width = x2 - x1;
+        bool inRange = true;
+        for (int c = 0; c < 4; c++) {
+            int64_t last = start[c] + shade.dx[c] * (width - 1);
+            if (start[c] < 0 || last < 0 || start[c] > 0xffffff || last > 0xffffff) {
+                inRange = false;
+            }
+        }
+
+        if (inRange) {
+            for (int i = 0; i < width; i++)
+            {
+                PixRGBA &pix = scratch[i];
+                pix.r = (uint8_t)(value[0] >> 16);
+                pix.g = (uint8_t)(value[1] >> 16);
+                pix.b = (uint8_t)(value[2] >> 16);
+                pix.a = (uint8_t)(value[3] >> 16);
+
+                value[0] += delta[0];
+                value[1] += delta[1];
+                value[2] += delta[2];
+                value[3] += delta[3];
+            }
+        } else {
+            // in 64 bits, since a sliver of a triangle can have very steep slopes
+            for (int i = 0; i < width; i++)
+            {
+                PixRGBA &pix = scratch[i];
+                pix.r = shadeChannel(start[0]);
+                pix.g = shadeChannel(start[1]);
+                pix.b = shadeChannel(start[2]);
+                pix.a = shadeChannel(start[3]);
+
+                for (int c = 0; c < 4; c++) {
+                    start[c] += shade.dx[c];
+                }
+            }
+        }
+
+        pb.setSpan(x1, row, width, scratch);
+    }
+
+    /*
+    textureRow()
+
+    Sample the texture for the pixels [x1, x2) of a row, a run at a
+    time.  At the start and end of each run, u and v are worked out
+    properly, along with how fast they're changing, which decides the
+    mipmap level.  Across the run they step in 16.16 fixed point, in
+    texels of that level.
+    */
+    void textureRow(const TrianglePaint &paint, int x1, int x2, int row)
+    {
+        const TriangleTexture &t = paint.texture;
+        const Texture &tex = *t.texture;
+
+        REAL fx = x1 - t.x0;
+        REAL fy = row - t.y0;
+        REAL su = t.base[0] + fx * t.dx[0] + fy * t.dy[0];
+        REAL sv = t.base[1] + fx * t.dx[1] + fy * t.dy[1];
+        REAL sq = t.base[2] + fx * t.dx[2] + fy * t.dy[2];
+
+        REAL width0 = (REAL)tex.getWidth();
+        REAL height0 = (REAL)tex.getHeight();
+        int runLength = t.perspective ? TextureRun : AffineRun;
+
+        PixRGBA *out = scratch;
+        for (int x = x1; x < x2; x += runLength)
+        {
+            int len = (x2 - x) < runLength ? x2 - x : runLength;
+
+            REAL q = 1 / sq;
+            REAL u = su * q;
+            REAL v = sv * q;
+
+            REAL eu = su + len * t.dx[0];
+            REAL ev = sv + len * t.dx[1];
+            REAL eq = sq + len * t.dx[2];
+            REAL endU = eu / eq;
+            REAL endV = ev / eq;
+
+            // how far one pixel moves, in full size texels
+            int level = 0;
+            if (tex.getLevelCount() > 1) {
+                REAL dudx = (t.dx[0] - u * t.dx[2]) * q * width0;
+                REAL dvdx = (t.dx[1] - v * t.dx[2]) * q * height0;
+                REAL dudy = (t.dy[0] - u * t.dy[2]) * q * width0;
+                REAL dvdy = (t.dy[1] - v * t.dy[2]) * q * height0;
+                level = tex.selectLevel(dudx, dvdx, dudy, dvdy);
+            }
+
+            // the start is moved into the first repeat of the
+            // texture, to keep the fixed point numbers small
+            REAL scaleU = (REAL)tex.getWidth(level) * 65536;
+            REAL scaleV = (REAL)tex.getHeight(level) * 65536;
+            REAL wholeU = floorf(u);
+            REAL wholeV = floorf(v);
+
+            int32_t tu = (int32_t)((u - wholeU) * scaleU);
+            int32_t tv = (int32_t)((v - wholeV) * scaleV);
+            int32_t du = (int32_t)((endU - u) * scaleU / len);
+            int32_t dv = (int32_t)((endV - v) * scaleV / len);
+
+            if (t.filter == TEX_NEAREST) {
+                for (int i = 0; i < len; i++) {
+                    out[i] = tex.sampleNearest(level, tu, tv);
+                    tu += du;
+                    tv += dv;
+                }
+            } else {
+                for (int i = 0; i < len; i++) {
+                    out[i] = tex.sampleBilinear(level, tu, tv);
+                    tu += du;
+                    tv += dv;
+                }
+            }
+
+            out += len;
+            su = eu;
+            sv = ev;
+            sq = eq;
+        }
+
+        pb.setSpan(x1, row, x2 - x1, scratch);
+    }
+
+    // Ellipse stroking handler, called for each step around a quadrant
+    void Plot4EllipsePoints(int cx, int cy, int x, int y, const PixRGBA color)
+    {
+        plot(cx + x, cy + y, color);
+        plot(cx - x, cy + y, color);
+        plot(cx - x, cy - y, color);
+        plot(cx + x, cy - y, color);
+    }
+};
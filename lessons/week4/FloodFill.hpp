@@ -0,0 +1,306 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "PixelBuffer.hpp"
+
+/*
+    FloodFiller
+
+    Fills the connected region of pixels around a seed point that
+    match the seed's color, using the scanline (span stack) method.
+
+    The usual recursive flood, getPixel()/setPixel() on each pixel and
+    recurse on the four neighbors, uses one stack frame per pixel,
+    which blows the stack on any decent sized region.  Here, we find a
+    whole horizontal run of matching pixels at once, fill it, then look
+    along the rows above and below it for runs that still need doing,
+    and push just one seed for each of those onto an explicit stack
+    that lives on the heap.
+
+    Pixels aren't tested one at a time either.  The first time a row is
+    visited, it is read with a single getSpan(), and each pixel's
+    "still needs filling" state is recorded as a bit in a mask.  From
+    then on, the fill only looks at the mask, and clears bits as it
+    fills.  That also means the fill always terminates, even when the
+    fill color itself matches, as can happen with a tolerance.
+
+    The mask, row buffer, and stack are kept between fills, so
+    repeated fills don't allocate.
+*/
+class FloodFiller
+{
+private:
+    struct Seed {
+        int x, y;
+    };
+
+public:
+    FloodFiller()
+        : mask(nullptr), maskWords(0), rowReady(nullptr), rowCapacity(0),
+        row(nullptr), rowBufSize(0), stack(nullptr), stackSize(0), stackCapacity(0),
+        spans(nullptr), numSpans(0)
+    {
+        spans = new GRSpan[SpanBatchSize];
+    }
+
+    virtual ~FloodFiller()
+    {
+        free(mask);
+        free(rowReady);
+        free(row);
+        free(stack);
+        delete [] spans;
+    }
+
+    /*
+    fill()
+
+    Fill the region connected to (x, y) with color, staying inside
+    the clip rectangle.  A pixel is part of the region when each of its
+    channels is within tolerance of the seed pixel; a tolerance of 0
+    means an exact match.  Returns false if (x, y) is outside the clip,
+    or there's no memory to carry on, when the region may be only
+    partly filled.
+    */
+    bool fill(PixelBuffer &pb, const GRRectangle &clip, int x, int y, const PixRGBA color, int tolerance = 0)
+    {
+        if (x < clip.x || y < clip.y || x >= clip.right() || y >= clip.bottom()) {
+            return false;
+        }
+
+        area = clip;
+        wordsPerRow = (area.width + 63) / 64;
+        if (!prepare()) {
+            return false;
+        }
+
+        // what we're looking for
+        target = pb.getPixel(x, y);
+        this->tolerance = tolerance;
+
+        // nothing to do, and we'd just be churning
+        if (tolerance == 0 && target.intValue == color.intValue) {
+            return true;
+        }
+
+        stackSize = 0;
+        bool ok = push(x - area.x, y - area.y);
+
+        while (stackSize > 0 && ok)
+        {
+            stackSize = stackSize - 1;
+            Seed seed = stack[stackSize];
+
+            uint64_t *bits = loadRow(pb, seed.y);
+            if (!testBit(bits, seed.x)) {
+                continue;       // somebody got here first
+            }
+
+            // extend the run both ways as far as it goes
+            int left = seed.x;
+            while (left > 0 && testBit(bits, left - 1)) {
+                left = left - 1;
+            }
+
+            int right = seed.x;
+            while (right + 1 < area.width && testBit(bits, right + 1)) {
+                right = right + 1;
+            }
+
+            clearBits(bits, left, right);
+            pushSpan(pb, area.x + left, area.y + seed.y, right - left + 1, color);
+
+            // look for runs in the rows above and below
+            if (seed.y > 0) {
+                ok = seedRow(pb, seed.y - 1, left, right);
+            }
+            if (seed.y + 1 < area.height && ok) {
+                ok = seedRow(pb, seed.y + 1, left, right);
+            }
+        }
+
+        // what was filled before running out of memory stays filled
+        flushSpans(pb);
+
+        return ok;
+    }
+
+private:
+    static const int SpanBatchSize = 1024;
+
+    // make sure the mask, row flags and row buffer are big enough,
+    // and mark every row as not yet read.  Returns false if there's
+    // no memory for them.
+    bool prepare()
+    {
+        size_t wordsNeeded = (size_t)wordsPerRow * area.height;
+        if (wordsNeeded > maskWords) {
+            free(mask);
+            mask = (uint64_t *)malloc(wordsNeeded * sizeof(uint64_t));
+            maskWords = mask ? wordsNeeded : 0;
+        }
+
+        if ((size_t)area.height > rowCapacity) {
+            free(rowReady);
+            rowReady = (uint8_t *)malloc(area.height);
+            rowCapacity = rowReady ? area.height : 0;
+        }
+
+        if ((size_t)area.width > rowBufSize) {
+            free(row);
+            row = (PixRGBA *)malloc(area.width * sizeof(PixRGBA));
+            rowBufSize = row ? area.width : 0;
+        }
+
+        if (!mask || !rowReady || !row) {
+            return false;
+        }
+        memset(rowReady, 0, area.height);
+        return true;
+    }
+
+    bool matches(const PixRGBA pix) const
+    {
+        if (tolerance == 0) {
+            return pix.intValue == target.intValue;
+        }
+
+        return abs(pix.r - target.r) <= tolerance &&
+            abs(pix.g - target.g) <= tolerance &&
+            abs(pix.b - target.b) <= tolerance &&
+            abs(pix.a - target.a) <= tolerance;
+    }
+
+    // The mask for a row (relative to the clip), reading
+    // the row from the pixel buffer the first time
+    uint64_t * loadRow(PixelBuffer &pb, int y)
+    {
+        uint64_t *bits = &mask[(size_t)y * wordsPerRow];
+        if (rowReady[y]) {
+            return bits;
+        }
+
+        pb.getSpan(area.x, area.y + y, area.width, row);
+
+        memset(bits, 0, wordsPerRow * sizeof(uint64_t));
+        for (int i = 0; i < area.width; i++) {
+            if (matches(row[i])) {
+                bits[i >> 6] |= (uint64_t)1 << (i & 63);
+            }
+        }
+
+        rowReady[y] = 1;
+        return bits;
+    }
+
+    static bool testBit(const uint64_t *bits, int x)
+    {
+        return (bits[x >> 6] >> (x & 63)) & 1;
+    }
+
+    static void clearBits(uint64_t *bits, int left, int right)
+    {
+        for (int x = left; x <= right; x++) {
+            if ((x & 63) == 0 && x + 63 <= right) {
+                bits[x >> 6] = 0;
+                x = x + 63;
+            } else {
+                bits[x >> 6] &= ~((uint64_t)1 << (x & 63));
+            }
+        }
+    }
+
+    // Push a seed for each run of set bits in row y, between left and
+    // right.  Returns false if the stack couldn't grow.
+    bool seedRow(PixelBuffer &pb, int y, int left, int right)
+    {
+        uint64_t *bits = loadRow(pb, y);
+
+        bool inRun = false;
+        for (int x = left; x <= right; x++)
+        {
+            // skip over empty words quickly
+            if (!inRun && (x & 63) == 0 && bits[x >> 6] == 0) {
+                x = x + 63;
+                continue;
+            }
+
+            if (testBit(bits, x)) {
+                if (!inRun) {
+                    if (!push(x, y)) {
+                        return false;
+                    }
+                    inRun = true;
+                }
+            } else {
+                inRun = false;
+            }
+        }
+        return true;
+    }
+
+    bool push(int x, int y)
+    {
+        if (stackSize == stackCapacity) {
+            size_t capacity = stackCapacity ? stackCapacity * 2 : 1024;
+            Seed *grown = (Seed *)realloc(stack, capacity * sizeof(Seed));
+            if (!grown) {
+                return false;
+            }
+            stack = grown;
+            stackCapacity = capacity;
+        }
+
+        stack[stackSize].x = x;
+        stack[stackSize].y = y;
+        stackSize = stackSize + 1;
+        return true;
+    }
+
+    void pushSpan(PixelBuffer &pb, int x, int y, int width, const PixRGBA color)
+    {
+        spans[numSpans].x = x;
+        spans[numSpans].y = y;
+        spans[numSpans].width = width;
+        spans[numSpans].color = color;
+
+        numSpans = numSpans + 1;
+        if (numSpans == SpanBatchSize) {
+            flushSpans(pb);
+        }
+    }
+
+    void flushSpans(PixelBuffer &pb)
+    {
+        if (numSpans > 0) {
+            pb.fillSpans(spans, numSpans);
+            numSpans = 0;
+        }
+    }
+
+    // Not copyable, it owns its buffers
+    FloodFiller(const FloodFiller &other);
+    FloodFiller & operator=(const FloodFiller &other);
+
+    GRRectangle area;       // the clip rectangle being filled within
+    int wordsPerRow;
+    PixRGBA target;
+    int tolerance;
+
+    uint64_t *mask;         // one bit per pixel, set while it needs filling
+    size_t maskWords;
+    uint8_t *rowReady;      // which rows of the mask have been read
+    size_t rowCapacity;
+    PixRGBA *row;           // a row read from the pixel buffer
+    size_t rowBufSize;
+
+    Seed *stack;            // seeds waiting to be filled
+    size_t stackSize;
+    size_t stackCapacity;
+
+    GRSpan *spans;          // filled spans waiting to be written
+    int numSpans;
+};
@@ -0,0 +1,369 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "grtypes.hpp"
+#include "grmath.hpp"
+#include "PixelBuffer.hpp"
+
+/*
+    FrameWriter
+
+    Writes the frames of an animation, one after another, into a
+    single file, rather than a file per frame.  The file is either a
+    Y4M, which ffmpeg and most players read as it is, or a raw stream
+    of RGBA frames with no header at all, which ffmpeg reads with
+    -f rawvideo -pix_fmt rgba -s WxH.
+
+    Y4M frames are YUV 4:2:0, BT.601 with the video range of 16..235,
+    which is what every player assumes.  Each 2x2 block of pixels
+    shares its U and V, from the average of the four.  Alpha is dropped.
+
+    addFrame() only copies the frame, with getSpan(), into a buffer the
+    writer owns, and returns.  A thread of the writer's own converts
+    and writes it while the next frame is being drawn.  There are only
+    two buffers, so if a frame is added before the last one has been
+    picked up, addFrame() waits for it.
+
+        FrameWriter video;
+        video.open("spin.y4m", 1280, 720);
+        for (int i = 0; i < 300; i++) {
+            drawFrame(fb, i);
+            video.addFrame(fb);
+        }
+        video.close();
+*/
+class FrameWriter
+{
+public:
+    enum Format {
+        Y4M,
+        RawRGBA
+    };
+
+    FrameWriter()
+        : fp(NULL), format(Y4M), width(0), height(0), frameCount(0),
+        capture(NULL), working(NULL), output(NULL), outputBytes(0),
+        hasPending(false), stopping(false), failed(false)
+    {}
+
+    virtual ~FrameWriter()
+    {
+        close();
+    }
+
+    /*
+        open()
+
+        Start a new file of frames that are width by height.  fps is
+        only written in a Y4M's header.  Returns false if the file
+        can't be created.
+    */
+    bool open(const char *filename, size_t awidth, size_t aheight, Format aformat = Y4M, int fps = 30)
+    {
+        close();
+        if (awidth == 0 || aheight == 0 || awidth > 0x7fffffff || aheight > 0x7fffffff) {
+            return false;
+        }
+
+        fp = fopen(filename, "wb");
+        if (!fp) {
+            return false;
+        }
+        // frames are written whole, so stdio's buffer would only be a copy
+        setvbuf(fp, NULL, _IONBF, 0);
+
+        format = aformat;
+        width = awidth;
+        height = aheight;
+        frameCount = 0;
+        hasPending = false;
+        stopping = false;
+        failed = false;
+
+        capture = (PixRGBA *)malloc(width * height * sizeof(PixRGBA));
+        working = (PixRGBA *)malloc(width * height * sizeof(PixRGBA));
+        if (format == Y4M) {
+            // "FRAME\n", then the Y, U and V planes
+            size_t chroma = ((width + 1) / 2) * ((height + 1) / 2);
+            outputBytes = 6 + width * height + chroma * 2;
+            output = (uint8_t *)malloc(outputBytes);
+            if (output) {
+                memcpy(output, "FRAME\n", 6);
+            }
+        }
+
+        bool ok = capture && working && (format == RawRGBA || output);
+        if (ok && format == Y4M) {
+            char header[128];
+            int headerBytes = snprintf(header, sizeof(header), "YUV4MPEG2 W%llu H%llu F%d:1 Ip A1:1 C420jpeg\n",
+                (unsigned long long)width, (unsigned long long)height, fps);
+            ok = fwrite(header, 1, headerBytes, fp) == (size_t)headerBytes;
+        }
+        if (!ok) {
+            failed = true;
+            close();
+            return false;
+        }
+
+        writer = std::thread(&FrameWriter::writerLoop, this);
+        return true;
+    }
+
+    /*
+        addFrame()
+
+        Copy the top left of pb, which has to be at least as big as the
+        frames, to be written as the next frame.  Returns false if the
+        file isn't open, pb is too small, or writing has already failed.
+    */
+    bool addFrame(const PixelBuffer &pb)
+    {
+        if (!fp || pb.getWidth() < width || pb.getHeight() < height) {
+            return false;
+        }
+
+        // capture is free once the writer has picked up the last frame
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [this] { return !hasPending; });
+            if (failed) {
+                return false;
+            }
+        }
+
+        for (size_t y = 0; y < height; y++) {
+            pb.getSpan(0, (GRCOORD)y, (GRSIZE)width, capture + y * width);
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            hasPending = true;
+        }
+        changed.notify_all();
+        frameCount++;
+
+        return true;
+    }
+
+    /*
+        close()
+
+        Wait for the last frame to be written, and close the file.
+        Returns false if any of it couldn't be written.
+    */
+    bool close()
+    {
+        if (writer.joinable()) {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                stopping = true;
+            }
+            changed.notify_all();
+            writer.join();
+        }
+
+        bool ok = !failed;
+        if (fp && fclose(fp) != 0) {
+            ok = false;
+        }
+        fp = NULL;
+
+        free(capture);
+        free(working);
+        free(output);
+        capture = working = NULL;
+        output = NULL;
+        outputBytes = 0;
+
+        return ok;
+    }
+
+    size_t getFrameCount() const { return frameCount; }
+
+    /*
+        rgbToYUV420()
+
+        Convert a pair of rows.  Both get their Y, and each pair of
+        pixels across gets one U and one V, from the average of the four
+        pixels in the two rows.  For the last row of a picture with an
+        odd height, top and bottom are the same row, and yBottom is NULL.
+        Eight pixels across at a time with SSE2.
+    */
+    static void rgbToYUV420(const PixRGBA *top, const PixRGBA *bottom, size_t count,
+        uint8_t *yTop, uint8_t *yBottom, uint8_t *u, uint8_t *v)
+    {
+        size_t x = 0;
+#ifdef GR_USE_SSE2
+        const __m128i low = _mm_set1_epi32(0xff);
+        const __m128i ones = _mm_set1_epi16(1);
+        const __m128i half = _mm_set1_epi16(128);
+        const __m128i two = _mm_set1_epi32(2);
+        for (; x + 8 <= count; x += 8) {
+            __m128i t0 = _mm_loadu_si128((const __m128i *)(top + x));
+            __m128i t1 = _mm_loadu_si128((const __m128i *)(top + x + 4));
+            __m128i b0 = _mm_loadu_si128((const __m128i *)(bottom + x));
+            __m128i b1 = _mm_loadu_si128((const __m128i *)(bottom + x + 4));
+
+            // each channel of 8 pixels, in 16 bit lanes
+            __m128i rt = _mm_packs_epi32(_mm_and_si128(t0, low), _mm_and_si128(t1, low));
+            __m128i gt = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(t0, 8), low), _mm_and_si128(_mm_srli_epi32(t1, 8), low));
+            __m128i bt = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(t0, 16), low), _mm_and_si128(_mm_srli_epi32(t1, 16), low));
+            __m128i rb = _mm_packs_epi32(_mm_and_si128(b0, low), _mm_and_si128(b1, low));
+            __m128i gb = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(b0, 8), low), _mm_and_si128(_mm_srli_epi32(b1, 8), low));
+            __m128i bb = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(b0, 16), low), _mm_and_si128(_mm_srli_epi32(b1, 16), low));
+
+            __m128i lumas = _mm_packus_epi16(luma8(rt, gt, bt), luma8(rb, gb, bb));
+            _mm_storel_epi64((__m128i *)(yTop + x), lumas);
+            if (yBottom) {
+                _mm_storel_epi64((__m128i *)(yBottom + x), _mm_srli_si128(lumas, 8));
+            }
+
+            // _mm_madd_epi16() against ones adds each pair across, which
+            // with the two rows added first is the sum of each 2x2 block
+            __m128i r = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_add_epi16(rt, rb), ones), two), 2);
+            __m128i g = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_add_epi16(gt, gb), ones), two), 2);
+            __m128i b = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_add_epi16(bt, bb), ones), two), 2);
+            r = _mm_packs_epi32(r, r);
+            g = _mm_packs_epi32(g, g);
+            b = _mm_packs_epi32(b, b);
+
+            __m128i us = _mm_sub_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(112)),
+                _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(38)), _mm_mullo_epi16(g, _mm_set1_epi16(74))));
+            __m128i vs = _mm_sub_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(112)),
+                _mm_add_epi16(_mm_mullo_epi16(g, _mm_set1_epi16(94)), _mm_mullo_epi16(b, _mm_set1_epi16(18))));
+            us = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(us, half), 8), half);
+            vs = _mm_add_epi16(_mm_srai_epi16(_mm_add_epi16(vs, half), 8), half);
+
+            // U in the low 4 bytes, V in the next 4
+            __m128i chroma = _mm_packus_epi16(_mm_unpacklo_epi64(us, vs), _mm_setzero_si128());
+            uint32_t word = (uint32_t)_mm_cvtsi128_si32(chroma);
+            memcpy(u + x / 2, &word, 4);
+            word = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(chroma, 4));
+            memcpy(v + x / 2, &word, 4);
+        }
+#endif
+        for (; x < count; x += 2) {
+            // past the end of an odd width, the last pixel is used twice
+            size_t x1 = x + 1 < count ? x + 1 : x;
+            yTop[x] = luma(top[x]);
+            if (x1 != x) {
+                yTop[x1] = luma(top[x1]);
+            }
+            if (yBottom) {
+                yBottom[x] = luma(bottom[x]);
+                if (x1 != x) {
+                    yBottom[x1] = luma(bottom[x1]);
+                }
+            }
+
+            int r = (top[x].r + top[x1].r + bottom[x].r + bottom[x1].r + 2) >> 2;
+            int g = (top[x].g + top[x1].g + bottom[x].g + bottom[x1].g + 2) >> 2;
+            int b = (top[x].b + top[x1].b + bottom[x].b + bottom[x1].b + 2) >> 2;
+            u[x / 2] = (uint8_t)(((112 * b - 38 * r - 74 * g + 128) >> 8) + 128);
+            v[x / 2] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+
+private:
+    static inline uint8_t luma(const PixRGBA pix)
+    {
+        return (uint8_t)(((66 * pix.r + 129 * pix.g + 25 * pix.b + 128) >> 8) + 16);
+    }
+
+#ifdef GR_USE_SSE2
+    // Y of 8 pixels.  The sum goes to 56228 at most, so it wraps into
+    // 16 bits unsigned, and comes back out with the logical shift.
+    static inline __m128i luma8(__m128i r, __m128i g, __m128i b)
+    {
+        __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)),
+            _mm_mullo_epi16(g, _mm_set1_epi16(129))), _mm_mullo_epi16(b, _mm_set1_epi16(25)));
+        return _mm_add_epi16(_mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(128)), 8), _mm_set1_epi16(16));
+    }
+#endif
+
+    // The writer's thread.  Picks up each frame as it's added, and
+    // writes it, until it's told to stop and there's nothing left.
+    void writerLoop()
+    {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [this] { return hasPending || stopping; });
+                if (!hasPending) {
+                    return;
+                }
+                // the frame just written becomes the one to fill
+                PixRGBA *frame = capture;
+                capture = working;
+                working = frame;
+                hasPending = false;
+            }
+            changed.notify_all();
+
+            if (failed) {
+                continue;
+            }
+
+            bool ok;
+            if (format == Y4M) {
+                encodeFrame();
+                ok = fwrite(output, 1, outputBytes, fp) == outputBytes;
+            } else {
+                size_t bytes = width * height * sizeof(PixRGBA);
+                ok = fwrite(working, 1, bytes, fp) == bytes;
+            }
+
+            if (!ok) {
+                std::lock_guard<std::mutex> guard(lock);
+                failed = true;
+            }
+        }
+    }
+
+    // working, into output, as Y4M planes
+    void encodeFrame()
+    {
+        size_t chromaWidth = (width + 1) / 2;
+        uint8_t *yPlane = output + 6;
+        uint8_t *uPlane = yPlane + width * height;
+        uint8_t *vPlane = uPlane + chromaWidth * ((height + 1) / 2);
+
+        for (size_t y = 0; y < height; y += 2) {
+            const PixRGBA *top = working + y * width;
+            bool pair = y + 1 < height;
+            rgbToYUV420(top, pair ? top + width : top, width,
+                yPlane + y * width, pair ? yPlane + (y + 1) * width : NULL,
+                uPlane + (y / 2) * chromaWidth, vPlane + (y / 2) * chromaWidth);
+        }
+    }
+
+    // Not copyable, it owns the file and a thread
+    FrameWriter(const FrameWriter &);
+    FrameWriter & operator=(const FrameWriter &);
+
+    FILE *fp;
+    Format format;
+    size_t width;
+    size_t height;
+    size_t frameCount;
+
+    PixRGBA *capture;       // filled by addFrame()
+    PixRGBA *working;       // being written by the writer's thread
+    uint8_t *output;        // a Y4M frame
+    size_t outputBytes;
+
+    std::thread writer;
+    std::mutex lock;
+    std::condition_variable changed;
+    bool hasPending;        // capture has a frame the writer hasn't picked up
+    bool stopping;
+    bool failed;
+};
@@ -0,0 +1,618 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "grtypes.hpp"
+#include "PixelBuffer.hpp"
+
+/*
+    GIFWriter
+
+    Writes an animated GIF (GIF89a), which loops, and which anything
+    that shows pictures can show.  GIF has at most 256 colors a frame,
+    so each frame gets a palette of its own, chosen by median cut.
+
+    Only what changed since the last frame is written.  Each frame
+    after the first is the rectangle around the pixels that changed,
+    drawn over the frame before, and in that rectangle the pixels that
+    didn't change are transparent, which makes long runs that compress
+    down to almost nothing.  A frame with nothing changed isn't written
+    at all, the one before is just shown for longer.
+
+    Choosing the palette looks at no more than SampleCount of the
+    pixels that changed.  Each color is matched to the palette once,
+    at 5 bits a channel, and remembered for the rest of the frame.  The
+    pixels are then compressed with LZW, with the dictionary kept in a
+    hash table.
+
+    Alpha is ignored, the frames are taken as opaque.
+
+        GIFWriter gif;
+        gif.open("spin.gif", 640, 480, 4);
+        for (int i = 0; i < 60; i++) {
+            drawFrame(fb, i);
+            gif.addFrame(fb);
+        }
+        gif.close();
+*/
+class GIFWriter
+{
+public:
+    // How many pixels, at most, are looked at to choose a palette
+    static const size_t SampleCount = 16384;
+
+    GIFWriter()
+        : fp(NULL), width(0), height(0), delay(0), frameCount(0),
+        previous(NULL), current(NULL), indexes(NULL), samples(NULL),
+        pending(NULL), pendingSize(0), pendingCapacity(0), pendingDelay(0),
+        bitBuffer(0), bitCount(0), blockSize(0), failed(false)
+    {}
+
+    virtual ~GIFWriter()
+    {
+        close();
+    }
+
+    /*
+        open()
+
+        Start a new GIF of frames that are width by height.  delay is
+        how long each frame is shown, in hundredths of a second, and
+        loops is how many times to play it, with 0 being forever.
+        Returns false if the file can't be created, or it's bigger than
+        a GIF can be, which is 65535 either way.
+    */
+    bool open(const char *filename, size_t awidth, size_t aheight, int adelay = 4, int loops = 0)
+    {
+        close();
+        if (awidth == 0 || aheight == 0 || awidth > 0xffff || aheight > 0xffff) {
+            return false;
+        }
+
+        fp = fopen(filename, "wb");
+        if (!fp) {
+            return false;
+        }
+
+        width = awidth;
+        height = aheight;
+        delay = adelay;
+        frameCount = 0;
+        pendingSize = 0;
+        failed = false;
+
+        previous = (PixRGBA *)malloc(width * height * sizeof(PixRGBA));
+        current = (PixRGBA *)malloc(width * height * sizeof(PixRGBA));
+        indexes = (uint8_t *)malloc(width * height);
+        samples = (uint32_t *)malloc(SampleCount * sizeof(uint32_t));
+        if (!previous || !current || !indexes || !samples) {
+            failed = true;
+            close();
+            return false;
+        }
+
+        // The screen, with no global palette, then the NETSCAPE2.0
+        // extension that makes it loop
+        uint8_t header[] = {
+            'G', 'I', 'F', '8', '9', 'a',
+            (uint8_t)width, (uint8_t)(width >> 8), (uint8_t)height, (uint8_t)(height >> 8), 0, 0, 0,
+            0x21, 0xff, 11, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0',
+            3, 1, (uint8_t)loops, (uint8_t)(loops >> 8), 0
+        };
+        if (fwrite(header, 1, sizeof(header), fp) != sizeof(header)) {
+            failed = true;
+        }
+
+        return !failed;
+    }
+
+    /*
+        addFrame()
+
+        Add the top left of pb, which has to be at least as big as the
+        frames, shown for delay hundredths of a second, or the delay
+        given to open() if it's negative.  Returns false if the file
+        isn't open, pb is too small, or writing has already failed.
+    */
+    bool addFrame(const PixelBuffer &pb, int frameDelay = -1)
+    {
+        if (!fp || failed || pb.getWidth() < width || pb.getHeight() < height) {
+            return false;
+        }
+        if (frameDelay < 0) {
+            frameDelay = delay;
+        }
+
+        for (size_t y = 0; y < height; y++) {
+            pb.getSpan(0, (GRCOORD)y, (GRSIZE)width, current + y * width);
+        }
+
+        GRRectangle box;
+        bool delta = frameCount > 0;
+        if (delta) {
+            if (!findChanges(box)) {
+                // nothing's different, show the last one for longer
+                pendingDelay += frameDelay;
+                frameCount++;
+                return true;
+            }
+        } else {
+            box.x = 0;
+            box.y = 0;
+            box.width = (int)width;
+            box.height = (int)height;
+        }
+
+        flushPending();
+        encodeFrame(box, delta);
+        pendingDelay = frameDelay;
+
+        PixRGBA *frame = previous;
+        previous = current;
+        current = frame;
+        frameCount++;
+
+        return !failed;
+    }
+
+    /*
+        close()
+
+        Write the last frame and the end of the file, and close it.
+        Returns false if any of it couldn't be written.
+    */
+    bool close()
+    {
+        bool ok = !failed;
+        if (fp) {
+            flushPending();
+            ok = !failed && fputc(0x3b, fp) != EOF;
+            if (fclose(fp) != 0) {
+                ok = false;
+            }
+        }
+        fp = NULL;
+
+        free(previous);
+        free(current);
+        free(indexes);
+        free(samples);
+        free(pending);
+        previous = current = NULL;
+        indexes = NULL;
+        samples = NULL;
+        pending = NULL;
+        pendingSize = pendingCapacity = 0;
+
+        return ok;
+    }
+
+    size_t getFrameCount() const { return frameCount; }
+
+private:
+    // A piece of the samples, [first, first + count), that's one color
+    // of the palette once it can't be split any more
+    struct ColorBox {
+        size_t first;
+        size_t count;
+        int channel;        // the channel with the widest range
+        int range;          // and how wide it is
+    };
+
+    enum {
+        Transparent = 255,
+        ClearCode = 256,
+        EndCode = 257,
+        HashSize = 8192     // twice the codes there can be
+    };
+
+    // Pixels are compared without their alpha
+    static bool same(const PixRGBA a, const PixRGBA b)
+    {
+        return ((a.intValue ^ b.intValue) & 0xffffff) == 0;
+    }
+
+    // The rectangle around every pixel that's changed since the last
+    // frame.  Returns false if none have.
+    bool findChanges(GRRectangle &box) const
+    {
+        size_t top = height, bottom = 0, left = width, right = 0;
+        for (size_t y = 0; y < height; y++) {
+            const PixRGBA *now = current + y * width;
+            const PixRGBA *then = previous + y * width;
+            if (memcmp(now, then, width * sizeof(PixRGBA)) == 0) {
+                continue;
+            }
+
+            size_t first = 0;
+            while (first < width && same(now[first], then[first])) {
+                first++;
+            }
+            if (first == width) {
+                continue;
+            }
+            size_t last = width - 1;
+            while (same(now[last], then[last])) {
+                last--;
+            }
+
+            if (top == height) {
+                top = y;
+            }
+            bottom = y;
+            left = std::min(left, first);
+            right = std::max(right, last);
+        }
+
+        if (top == height) {
+            return false;
+        }
+
+        box.x = (int)left;
+        box.y = (int)top;
+        box.width = (int)(right - left + 1);
+        box.height = (int)(bottom - top + 1);
+        return true;
+    }
+
+    /*
+        encodeFrame()
+
+        The box of current, as the next frame, into pending.  In a delta
+        frame, the pixels that are the same as the last frame are
+        Transparent, and the palette has one color less.
+    */
+    void encodeFrame(const GRRectangle &box, bool delta)
+    {
+        PixRGBA palette[256];
+        memset(palette, 0, sizeof(palette));
+        int colors = choosePalette(box, delta, palette, delta ? 255 : 256);
+
+        // the nearest palette color for each 5 bit color, as it's needed
+        int16_t nearest[32768];
+        memset(nearest, 0xff, sizeof(nearest));
+
+        uint8_t *out = indexes;
+        for (size_t y = box.y; y < (size_t)(box.y + box.height); y++) {
+            const PixRGBA *now = current + y * width + box.x;
+            const PixRGBA *then = previous + y * width + box.x;
+            for (size_t x = 0; x < (size_t)box.width; x++) {
+                if (delta && same(now[x], then[x])) {
+                    *out++ = Transparent;
+                    continue;
+                }
+                int key = ((now[x].r >> 3) << 10) | ((now[x].g >> 3) << 5) | (now[x].b >> 3);
+                if (nearest[key] < 0) {
+                    nearest[key] = (int16_t)closest(palette, colors, key);
+                }
+                *out++ = (uint8_t)nearest[key];
+            }
+        }
+
+        // Graphic control extension: no disposal, so the next frame is
+        // drawn over this one, the delay, which is filled in when the
+        // frame is written, and the transparent color
+        uint8_t control[] = {0x21, 0xf9, 4, (uint8_t)(delta ? 0x05 : 0x04), 0, 0, Transparent, 0};
+        put(control, sizeof(control));
+
+        // Image descriptor, with a local palette of 256 colors
+        uint8_t descriptor[] = {
+            0x2c,
+            (uint8_t)box.x, (uint8_t)(box.x >> 8), (uint8_t)box.y, (uint8_t)(box.y >> 8),
+            (uint8_t)box.width, (uint8_t)(box.width >> 8), (uint8_t)box.height, (uint8_t)(box.height >> 8),
+            0x87
+        };
+        put(descriptor, sizeof(descriptor));
+
+        uint8_t table[768];
+        for (int i = 0; i < 256; i++) {
+            table[i * 3] = palette[i].r;
+            table[i * 3 + 1] = palette[i].g;
+            table[i * 3 + 2] = palette[i].b;
+        }
+        put(table, sizeof(table));
+
+        compress(indexes, (size_t)box.width * box.height);
+    }
+
+    /*
+        choosePalette()
+
+        Median cut.  Up to SampleCount of the pixels that are going to
+        be drawn are spread evenly through the box.  Starting with all
+        of them in one box, the box with the widest range in any channel
+        is split at the middle of that channel, until there are as many
+        boxes as colors, or none can be split.  Each color is the
+        average of its box.  Returns how many colors there are.
+    */
+    int choosePalette(const GRRectangle &box, bool delta, PixRGBA *palette, int maxColors)
+    {
+        // Every pixel that changed, then every step'th of them
+        size_t changed = 0;
+        for (size_t y = box.y; y < (size_t)(box.y + box.height); y++) {
+            const PixRGBA *now = current + y * width + box.x;
+            const PixRGBA *then = previous + y * width + box.x;
+            for (size_t x = 0; x < (size_t)box.width; x++) {
+                changed += !delta || !same(now[x], then[x]);
+            }
+        }
+        size_t step = (changed + SampleCount - 1) / SampleCount;
+        size_t count = 0, seen = 0;
+        for (size_t y = box.y; y < (size_t)(box.y + box.height); y++) {
+            const PixRGBA *now = current + y * width + box.x;
+            const PixRGBA *then = previous + y * width + box.x;
+            for (size_t x = 0; x < (size_t)box.width; x++) {
+                if (delta && same(now[x], then[x])) {
+                    continue;
+                }
+                if (seen++ % step == 0 && count < SampleCount) {
+                    samples[count++] = now[x].intValue & 0xffffff;
+                }
+            }
+        }
+
+        ColorBox boxes[256];
+        int boxCount = 1;
+        boxes[0].first = 0;
+        boxes[0].count = count;
+        measure(boxes[0]);
+
+        while (boxCount < maxColors) {
+            int widest = 0;
+            for (int i = 1; i < boxCount; i++) {
+                if (boxes[i].range > boxes[widest].range) {
+                    widest = i;
+                }
+            }
+            ColorBox &split = boxes[widest];
+            if (split.range == 0) {
+                break;
+            }
+
+            // the lower half stays where it is, the upper half is a new box
+            int shift = split.channel * 8;
+            uint32_t *first = samples + split.first;
+            size_t half = split.count / 2;
+            std::nth_element(first, first + half, first + split.count, [shift](uint32_t a, uint32_t b) {
+                return ((a >> shift) & 0xff) < ((b >> shift) & 0xff);
+            });
+
+            ColorBox &upper = boxes[boxCount++];
+            upper.first = split.first + half;
+            upper.count = split.count - half;
+            split.count = half;
+            measure(split);
+            measure(upper);
+        }
+
+        for (int i = 0; i < boxCount; i++) {
+            uint32_t sum[3] = {0, 0, 0};
+            for (size_t j = 0; j < boxes[i].count; j++) {
+                uint32_t color = samples[boxes[i].first + j];
+                sum[0] += color & 0xff;
+                sum[1] += (color >> 8) & 0xff;
+                sum[2] += (color >> 16) & 0xff;
+            }
+            size_t n = boxes[i].count;
+            palette[i].r = (uint8_t)((sum[0] + n / 2) / n);
+            palette[i].g = (uint8_t)((sum[1] + n / 2) / n);
+            palette[i].b = (uint8_t)((sum[2] + n / 2) / n);
+            palette[i].a = 255;
+        }
+
+        return boxCount;
+    }
+
+    // Find the channel with the widest range in a box of samples
+    void measure(ColorBox &box) const
+    {
+        int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+        for (size_t i = 0; i < box.count; i++) {
+            uint32_t color = samples[box.first + i];
+            for (int c = 0; c < 3; c++) {
+                int value = (color >> (c * 8)) & 0xff;
+                lo[c] = std::min(lo[c], value);
+                hi[c] = std::max(hi[c], value);
+            }
+        }
+
+        // a box of one sample has no range at all
+        box.channel = 0;
+        box.range = box.count > 1 ? hi[0] - lo[0] : 0;
+        for (int c = 1; c < 3 && box.count > 1; c++) {
+            if (hi[c] - lo[c] > box.range) {
+                box.channel = c;
+                box.range = hi[c] - lo[c];
+            }
+        }
+    }
+
+    // The palette color nearest the middle of a 5 bit color
+    static int closest(const PixRGBA *palette, int colors, int key)
+    {
+        int r = ((key >> 10) << 3) | 4;
+        int g = (((key >> 5) & 31) << 3) | 4;
+        int b = ((key & 31) << 3) | 4;
+
+        int best = 0;
+        int bestDistance = 1 << 30;
+        for (int i = 0; i < colors; i++) {
+            int dr = palette[i].r - r;
+            int dg = palette[i].g - g;
+            int db = palette[i].b - b;
+            int distance = dr * dr + dg * dg + db * db;
+            if (distance < bestDistance) {
+                best = i;
+                bestDistance = distance;
+            }
+        }
+        return best;
+    }
+
+    /*
+        compress()
+
+        LZW, with 8 bit pixels, so codes start at 9 bits and go up to
+        12.  The dictionary is a hash table from a code and the pixel
+        after it, to the code for the two together.  When the codes
+        run out, a clear code starts it over.
+    */
+    void compress(const uint8_t *data, size_t count)
+    {
+        uint32_t keys[HashSize];        // the code and pixel, plus one, so 0 is empty
+        uint16_t codes[HashSize];
+        memset(keys, 0, sizeof(keys));
+
+        putByte(8);
+        bitBuffer = 0;
+        bitCount = 0;
+        blockSize = 0;
+
+        int codeSize = 9;
+        int maxCode = EndCode;      // the last code handed out
+        putCode(ClearCode, codeSize);
+
+        int prefix = data[0];
+        for (size_t i = 1; i < count; i++) {
+            uint32_t key = ((uint32_t)prefix << 8) | data[i];
+            uint32_t slot = (key * 2654435761u) >> 19;
+            while (keys[slot] && keys[slot] != key + 1) {
+                slot = (slot + 1) & (HashSize - 1);
+            }
+            if (keys[slot]) {
+                prefix = codes[slot];
+                continue;
+            }
+
+            putCode(prefix, codeSize);
+            keys[slot] = key + 1;
+            codes[slot] = (uint16_t)++maxCode;
+            if (maxCode >= (1 << codeSize)) {
+                codeSize++;
+            }
+            if (maxCode == 4095) {
+                putCode(ClearCode, codeSize);
+                memset(keys, 0, sizeof(keys));
+                codeSize = 9;
+                maxCode = EndCode;
+            }
+            prefix = data[i];
+        }
+
+        putCode(prefix, codeSize);
+
+        // The reader adds a code after that last one, as it would for
+        // any other, which can take it up to the next size
+        if (maxCode + 1 >= (1 << codeSize) && codeSize < 12) {
+            codeSize++;
+        }
+        putCode(EndCode, codeSize);
+
+        if (bitCount > 0) {
+            putBlockByte((uint8_t)bitBuffer);
+        }
+        if (blockSize > 0) {
+            putByte((uint8_t)blockSize);
+            put(block, blockSize);
+        }
+        putByte(0);
+    }
+
+    // Codes go in least significant bit first, in blocks of 255 bytes
+    void putCode(int code, int size)
+    {
+        bitBuffer |= (uint32_t)code << bitCount;
+        bitCount += size;
+        while (bitCount >= 8) {
+            putBlockByte((uint8_t)bitBuffer);
+            bitBuffer >>= 8;
+            bitCount -= 8;
+        }
+    }
+
+    void putBlockByte(uint8_t value)
+    {
+        block[blockSize++] = value;
+        if (blockSize == 255) {
+            putByte(255);
+            put(block, 255);
+            blockSize = 0;
+        }
+    }
+
+    void putByte(uint8_t value)
+    {
+        put(&value, 1);
+    }
+
+    // Onto the end of pending
+    void put(const uint8_t *data, size_t count)
+    {
+        if (pendingSize + count > pendingCapacity) {
+            size_t capacity = pendingCapacity ? pendingCapacity * 2 : 64 * 1024;
+            while (capacity < pendingSize + count) {
+                capacity *= 2;
+            }
+            uint8_t *grown = (uint8_t *)realloc(pending, capacity);
+            if (!grown) {
+                failed = true;
+                return;
+            }
+            pending = grown;
+            pendingCapacity = capacity;
+        }
+        memcpy(pending + pendingSize, data, count);
+        pendingSize += count;
+    }
+
+    // Write the frame that's waiting, now that its delay is known
+    void flushPending()
+    {
+        if (pendingSize == 0) {
+            return;
+        }
+
+        // the delay is in the graphic control extension, at the front
+        int frameDelay = std::min(pendingDelay, 0xffff);
+        pending[4] = (uint8_t)frameDelay;
+        pending[5] = (uint8_t)(frameDelay >> 8);
+        if (!failed && fwrite(pending, 1, pendingSize, fp) != pendingSize) {
+            failed = true;
+        }
+        pendingSize = 0;
+    }
+
+    // Not copyable, it owns the file
+    GIFWriter(const GIFWriter &);
+    GIFWriter & operator=(const GIFWriter &);
+
+    FILE *fp;
+    size_t width;
+    size_t height;
+    int delay;
+    size_t frameCount;
+
+    PixRGBA *previous;      // the last frame added
+    PixRGBA *current;       // the one being added
+    uint8_t *indexes;       // its pixels as palette colors
+    uint32_t *samples;      // for choosing the palette
+
+    // The last frame, encoded, which isn't written until the next one
+    // is different, as until then its delay keeps growing
+    uint8_t *pending;
+    size_t pendingSize;
+    size_t pendingCapacity;
+    int pendingDelay;
+
+    uint32_t bitBuffer;
+    int bitCount;
+    uint8_t block[255];
+    int blockSize;
+
+    bool failed;
+};
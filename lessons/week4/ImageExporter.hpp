@@ -0,0 +1,350 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <set>
+#include <string>
+#include <functional>
+#include <atomic>
+
+#include "grtypes.hpp"
+#include "PixelBuffer.hpp"
+#include "PixelBufferRGBA32.hpp"
+#include "PixelBufferGray.hpp"
+#include "TaskScheduler.hpp"
+#include "pbm.hpp"
+#include "png.hpp"
+#include "qoi.hpp"
+#include "bmp.hpp"
+
+/*
+    ImageExporter
+
+    Writes images to files on a thread of its own, so the thread that's
+    drawing doesn't wait for the disk, or for the compressing.
+
+    exportImage() takes a snapshot of the buffer, a whole row at a time
+    with getSpan(), across the scheduler's workers, which takes a few
+    milliseconds even for a big frame.  Then it puts the snapshot on a
+    queue and returns, and drawing can carry straight on into the live
+    buffer.  Snapshots are kept once they've been written, to be used
+    again for the next export of the same size, so a steady stream of
+    exports doesn't allocate anything.
+
+    The queue holds at most maxQueued snapshots.  When it's full,
+    exportImage() either waits for room, or with wait false, returns 0
+    straight away, so a render loop can skip an export rather than
+    stall.  getQueued() says how far behind the writer is.
+
+    Each export gets a number.  waitFor() waits for one to be written,
+    and says whether it was, and waitAll() waits for the queue to be
+    empty.  A completion function, if there is one, is called on the
+    writer's thread as each file is finished.
+
+        ImageExporter exporter;
+        for (int frame = 0; ; frame++) {
+            drawFrame(fb, frame);
+            if (frame % 60 == 0) {
+                exporter.exportImage("frame.png", fb, ImageExporter::FormatPNG, false);
+            }
+        }
+*/
+
+// Called when an export has been written, or has failed
+typedef std::function<void(int id, const char *filename, bool ok)> ExportDone;
+
+class ImageExporter
+{
+public:
+    enum Format {
+        FormatPPM,
+        FormatPGM,
+        FormatPAM,
+        FormatPNG,
+        FormatQOI,
+        FormatBMP
+    };
+
+    ImageExporter(size_t amaxQueued = 4)
+        : maxQueued(amaxQueued < 1 ? 1 : amaxQueued), reserved(0), nextId(1), finishedThrough(0),
+        pngLevel(6), stopping(false)
+    {
+        writer = std::thread(&ImageExporter::writerLoop, this);
+    }
+
+    // Writes whatever is still queued before it goes
+    virtual ~ImageExporter()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        changed.notify_all();
+        writer.join();
+
+        while (!spares.empty()) {
+            delete spares.front();
+            spares.pop_front();
+        }
+    }
+
+    // Called on the writer's thread as each export is finished
+    void setCompletion(const ExportDone &done)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        completion = done;
+    }
+
+    // The compression level for PNGs exported from now on, 0 to 9
+    void setPNGLevel(int level)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        pngLevel = level;
+    }
+
+    /*
+        exportImage()
+
+        Snapshot pb, and queue it to be written to filename.  A gray
+        buffer is snapshotted as gray.  Returns the export's number, or
+        0 if the queue is full and wait is false, in which case nothing
+        was snapshotted, or if memory ran out taking the snapshot.
+    */
+    int exportImage(const char *filename, const PixelBuffer &pb, Format format, bool wait = true)
+    {
+        if (pb.getWidth() == 0 || pb.getHeight() == 0) {
+            return 0;
+        }
+
+        // A place in the queue is kept while the snapshot is taken
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            if (!wait && queue.size() + reserved >= maxQueued) {
+                return 0;
+            }
+            changed.wait(guard, [this] { return queue.size() + reserved < maxQueued; });
+            reserved++;
+        }
+
+        Export job;
+        job.filename = filename;
+        job.format = format;
+        job.snapshot = snapshot(pb);
+        if (!job.snapshot) {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                reserved--;
+            }
+            changed.notify_all();
+            return 0;
+        }
+
+        int id;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            reserved--;
+            id = nextId++;
+            job.id = id;
+            job.level = pngLevel;
+            queue.push_back(job);
+        }
+        changed.notify_all();
+
+        return id;
+    }
+
+    // How many exports are waiting to be written, or being written
+    size_t getQueued() const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return queue.size();
+    }
+
+    bool isFinished(int id) const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return id < nextId && id <= finishedThrough;
+    }
+
+    // Wait for an export to be written.  Returns false if it couldn't be.
+    bool waitFor(int id)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        if (id <= 0 || id >= nextId) {
+            return false;
+        }
+        changed.wait(guard, [this, id] { return finishedThrough >= id; });
+        return failures.count(id) == 0;
+    }
+
+    // Wait for every export so far.  Returns false if any have failed.
+    bool waitAll()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [this] { return queue.empty() && reserved == 0; });
+        return failures.empty();
+    }
+
+private:
+    struct Export {
+        int id;
+        std::string filename;
+        Format format;
+        int level;              // for a PNG
+        PixelBuffer *snapshot;
+    };
+
+    // A copy of pb, in a spare buffer if there's one the right size.
+    // NULL if a worker couldn't get its row buffer.
+    PixelBuffer * snapshot(const PixelBuffer &pb)
+    {
+        bool gray = pb.getChannels() == 1;
+        PixelBuffer *copy = NULL;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            for (size_t i = 0; i < spares.size(); i++) {
+                PixelBuffer *spare = spares[i];
+                if (spare->getWidth() == pb.getWidth() && spare->getHeight() == pb.getHeight()
+                    && (spare->getChannels() == 1) == gray) {
+                    copy = spare;
+                    spares.erase(spares.begin() + i);
+                    break;
+                }
+            }
+        }
+
+        if (!copy) {
+            if (gray) {
+                copy = new PixelBufferGray(pb.getWidth(), pb.getHeight());
+            } else {
+                copy = new PixelBufferRGBA32(pb.getWidth(), pb.getHeight());
+            }
+        }
+
+        size_t width = pb.getWidth();
+        int height = (int)pb.getHeight();
+        TaskScheduler &scheduler = TaskScheduler::shared();
+        std::atomic<bool> failed(false);
+        scheduler.parallelFor(0, height, scheduler.rowGrain(height), [&](int first, int last) {
+            if (gray) {
+                uint8_t *row = (uint8_t *)malloc(width);
+                if (!row) {
+                    failed = true;
+                    return;
+                }
+                for (int y = first; y < last; y++) {
+                    pb.getGraySpan(0, (GRCOORD)y, (GRSIZE)width, row);
+                    copy->setGraySpan(0, (GRCOORD)y, (GRSIZE)width, row);
+                }
+                free(row);
+            } else {
+                PixRGBA *row = (PixRGBA *)malloc(width * sizeof(PixRGBA));
+                if (!row) {
+                    failed = true;
+                    return;
+                }
+                for (int y = first; y < last; y++) {
+                    pb.getSpan(0, (GRCOORD)y, (GRSIZE)width, row);
+                    copy->setSpan(0, (GRCOORD)y, (GRSIZE)width, row);
+                }
+                free(row);
+            }
+        });
+
+        if (failed) {
+            // it can still be a spare
+            std::lock_guard<std::mutex> guard(lock);
+            spares.push_back(copy);
+            return NULL;
+        }
+        return copy;
+    }
+
+    static bool write(const Export &job)
+    {
+        const char *filename = job.filename.c_str();
+        const PixelBuffer &pb = *job.snapshot;
+        switch (job.format) {
+        case FormatPPM:
+            return PBM::writePPMBinary(filename, pb);
+        case FormatPGM:
+            return PBM::writePGMBinary(filename, pb);
+        case FormatPAM:
+            return PBM::writePAM(filename, pb);
+        case FormatPNG:
+            return PNG::writePNG(filename, pb, job.level);
+        case FormatQOI:
+            return QOI::writeQOI(filename, pb);
+        case FormatBMP:
+            return BMP::writeBMP(filename, pb);
+        }
+        return false;
+    }
+
+    // The writer's thread.  The export at the front of the queue stays
+    // there while it's written, so it counts against maxQueued.
+    void writerLoop()
+    {
+        for (;;) {
+            Export job;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [this] { return !queue.empty() || stopping; });
+                if (queue.empty()) {
+                    return;
+                }
+                job = queue.front();
+            }
+
+            bool ok = write(job);
+
+            ExportDone done;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                queue.pop_front();
+                finishedThrough = job.id;
+                if (!ok) {
+                    failures.insert(job.id);
+                }
+
+                // keep enough spares for a full queue, and one being filled
+                if (spares.size() <= maxQueued) {
+                    spares.push_back(job.snapshot);
+                } else {
+                    delete job.snapshot;
+                }
+                done = completion;
+            }
+            changed.notify_all();
+
+            if (done) {
+                done(job.id, job.filename.c_str(), ok);
+            }
+        }
+    }
+
+    // Not copyable, it owns a thread
+    ImageExporter(const ImageExporter &);
+    ImageExporter & operator=(const ImageExporter &);
+
+    size_t maxQueued;
+    size_t reserved;            // places being filled by exportImage()
+    int nextId;
+    int finishedThrough;        // every export up to this one is done
+    int pngLevel;
+
+    std::deque<Export> queue;
+    std::deque<PixelBuffer *> spares;
+    std::set<int> failures;
+    ExportDone completion;
+
+    std::thread writer;
+    mutable std::mutex lock;
+    std::condition_variable changed;
+    bool stopping;
+};
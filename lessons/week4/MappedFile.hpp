@@ -0,0 +1,208 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/*
+    MappedFile
+
+    A whole file, read only, mapped into memory, so it can be parsed
+    where it is rather than being read through stdio a piece at a
+    time.  The pages are only read in from the disk as they're touched.
+
+    On Windows this is a file mapping, everywhere else it's mmap().
+    If mapping fails, the file is read into memory instead, so the
+    caller can't tell the difference.
+
+        MappedFile file;
+        if (file.open("texture.ppm")) {
+            parse(file.getData(), file.getSize());
+        }
+*/
+class MappedFile
+{
+public:
+    MappedFile()
+        : data(NULL), size(0), mapped(false)
+#ifdef _WIN32
+        , file(INVALID_HANDLE_VALUE), mapping(NULL)
+#endif
+    {}
+
+    virtual ~MappedFile()
+    {
+        close();
+    }
+
+    /*
+        open()
+
+        Map the whole file.  Returns false if it can't be opened, or
+        it's empty, as there's nothing to map.
+    */
+    bool open(const char *filename)
+    {
+        close();
+
+#ifdef _WIN32
+        file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            close();
+            return false;
+        }
+        size = (size_t)fileSize.QuadPart;
+
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping) {
+            data = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+        mapped = data != NULL;
+#else
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+            ::close(fd);
+            return false;
+        }
+        size = (size_t)info.st_size;
+
+        void *view = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED) {
+            // it'll mostly be read from the front to the back
+            madvise(view, size, MADV_SEQUENTIAL);
+            data = (const uint8_t *)view;
+            mapped = true;
+        }
+        ::close(fd);
+#endif
+
+        if (!mapped && !readWhole(filename)) {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    // Unmap the file, or free the copy of it
+    void close()
+    {
+        if (data) {
+            if (mapped) {
+#ifdef _WIN32
+                UnmapViewOfFile(data);
+#else
+                munmap((void *)data, size);
+#endif
+            } else {
+                free((void *)data);
+            }
+        }
+#ifdef _WIN32
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#endif
+        data = NULL;
+        size = 0;
+        mapped = false;
+    }
+
+    const uint8_t * getData() const { return data; }
+    size_t getSize() const { return size; }
+
+    // Whether the data is the file itself, or a copy read into memory
+    bool isMapped() const { return mapped; }
+
+    /*
+        release()
+
+        Say that bytes offset to offset + length won't be looked at for
+        a while, so the pages that are wholly inside them can be let go
+        of, rather than waiting for the system to need the memory.  They
+        are read back in from the file if they're touched again.  Only
+        a hint; a copy read into memory keeps everything, and Windows
+        trims a mapping's pages from the working set by itself.
+    */
+    void release(size_t offset, size_t length)
+    {
+#ifndef _WIN32
+        if (!mapped || offset >= size) {
+            return;
+        }
+        if (length > size - offset) {
+            length = size - offset;
+        }
+
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t first = (offset + page - 1) / page * page;
+        size_t last = (offset + length) / page * page;
+        if (last > first) {
+            madvise((void *)(data + first), last - first, MADV_DONTNEED);
+        }
+#else
+        (void)offset;
+        (void)length;
+#endif
+    }
+
+private:
+    // When it can't be mapped, read it all in with stdio
+    bool readWhole(const char *filename)
+    {
+        FILE *fp = fopen(filename, "rb");
+        if (!fp) {
+            return false;
+        }
+
+        uint8_t *copy = (uint8_t *)malloc(size);
+        bool ok = copy && fread(copy, 1, size, fp) == size;
+        fclose(fp);
+        if (!ok) {
+            free(copy);
+            return false;
+        }
+
+        data = copy;
+        return true;
+    }
+
+    // Not copyable, it owns the mapping
+    MappedFile(const MappedFile &);
+    MappedFile & operator=(const MappedFile &);
+
+    const uint8_t *data;
+    size_t size;
+    bool mapped;
+
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
@@ -0,0 +1,451 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "grtypes.hpp"
+
+/*
+    Path
+
+    An outline made of straight lines and curves, built up a piece at a
+    time, the way you'd draw it with a pen:  moveTo() picks the pen up
+    and puts it down somewhere else, lineTo(), quadTo() and cubicTo()
+    draw from wherever the pen is, and close() draws back to where the
+    current piece (contour) started.  A path can have any number of
+    contours, which is how shapes with holes are made.
+
+    Coordinates are REAL, and go through the DrawingContext's transform
+    when the path is drawn.
+
+    Curves can't be drawn directly.  They're flattened into short
+    straight lines first, short enough that they're never more than a
+    quarter of a pixel from the real curve.  That depends on how big the
+    path ends up on the screen, so the flattened path is made for a
+    particular scale.
+
+    Paths that are drawn over and over, like icons, don't change, so the
+    flattened version, and its bounding box, are kept.  They're only
+    made again when the path is changed, or it's drawn at a larger scale
+    than they were made for (or a much smaller one, where they'd be
+    wastefully fine).  Moving or rotating the path doesn't matter.
+*/
+
+// A point of a path, in the path's own coordinates
+struct PathPoint {
+    REAL x, y;
+};
+
+// One piece of a flattened path, count points from first
+struct PathContour {
+    int first;
+    int count;
+    bool closed;
+};
+
+// The smallest rectangle around a path, in the path's coordinates
+struct PathBounds {
+    REAL left, top, right, bottom;
+};
+
+enum PathVerb {
+    PATH_MOVE,      // 1 point
+    PATH_LINE,      // 1 point
+    PATH_QUAD,      // control point, end point
+    PATH_CUBIC,     // two control points, end point
+    PATH_CLOSE      // no points
+};
+
+class Path
+{
+public:
+    // How far, in pixels, the flattened lines can be from the curve
+    static const int FlattenTolerance256 = 64;      // 1/4 pixel, in 256ths
+
+    Path()
+        : verbs(nullptr), numVerbs(0), verbCapacity(0),
+        points(nullptr), numPoints(0), pointCapacity(0),
+        flat(nullptr), numFlat(0), flatCapacity(0),
+        contours(nullptr), numContours(0), contourCapacity(0),
+        flatScale(0), flattenCount(0), hasCurrent(false)
+    {
+        bounds.left = bounds.top = bounds.right = bounds.bottom = 0;
+    }
+
+    virtual ~Path()
+    {
+        free(verbs);
+        free(points);
+        free(flat);
+        free(contours);
+    }
+
+    // Throw away the outline, but keep the memory
+    void reset()
+    {
+        numVerbs = 0;
+        numPoints = 0;
+        hasCurrent = false;
+        invalidate();
+    }
+
+    bool isEmpty() const { return numVerbs == 0; }
+
+    // Each of these returns false, and leaves the path as it was, if
+    // there's no memory for another piece
+    bool moveTo(REAL x, REAL y)
+    {
+        if (!reserve(1, 1)) {
+            return false;
+        }
+
+        addVerb(PATH_MOVE);
+        addPoint(x, y);
+        hasCurrent = true;
+        return true;
+    }
+
+    // Without a moveTo() first, the line starts a new contour where it ends
+    bool lineTo(REAL x, REAL y)
+    {
+        if (!hasCurrent) {
+            return moveTo(x, y);
+        }
+        if (!reserve(1, 1)) {
+            return false;
+        }
+
+        addVerb(PATH_LINE);
+        addPoint(x, y);
+        return true;
+    }
+
+    // A quadratic Bezier curve, pulled towards (cx, cy)
+    bool quadTo(REAL cx, REAL cy, REAL x, REAL y)
+    {
+        if (!reserve(2, 3)) {
+            return false;
+        }
+        if (!hasCurrent) {
+            moveTo(cx, cy);
+        }
+
+        addVerb(PATH_QUAD);
+        addPoint(cx, cy);
+        addPoint(x, y);
+        return true;
+    }
+
+    // A cubic Bezier curve, leaving towards (c1x, c1y), and
+    // arriving from the direction of (c2x, c2y)
+    bool cubicTo(REAL c1x, REAL c1y, REAL c2x, REAL c2y, REAL x, REAL y)
+    {
+        if (!reserve(2, 4)) {
+            return false;
+        }
+        if (!hasCurrent) {
+            moveTo(c1x, c1y);
+        }
+
+        addVerb(PATH_CUBIC);
+        addPoint(c1x, c1y);
+        addPoint(c2x, c2y);
+        addPoint(x, y);
+        return true;
+    }
+
+    // Back to the start of the contour.  The next thing drawn starts a new one.
+    bool close()
+    {
+        if (!hasCurrent) {
+            return true;
+        }
+        if (!reserve(1, 0)) {
+            return false;
+        }
+
+        addVerb(PATH_CLOSE);
+        hasCurrent = false;
+        return true;
+    }
+
+    /*
+    flatten()
+
+    Make sure the flattened path is good for drawing at the given scale,
+    which is how much the transform makes things bigger.  Does nothing
+    if it already is.  Returns false if there's no memory for it, when
+    the flattened path is left empty, so nothing is drawn.
+    */
+    bool flatten(REAL scale) const
+    {
+        if (scale <= 0) {
+            scale = 1;
+        }
+
+        if (flatScale > 0 && scale <= flatScale && scale * 4 >= flatScale) {
+            return true;
+        }
+
+        return buildFlat(scale);
+    }
+
+    // The flattened path, after flatten()
+    int getContourCount() const { return numContours; }
+    const PathContour & getContour(int index) const { return contours[index]; }
+    const PathPoint * getFlatPoints() const { return flat; }
+    int getFlatPointCount() const { return numFlat; }
+    const PathBounds & getBounds() const { return bounds; }
+
+    // How many times the path has been flattened, to see the cache working
+    int getFlattenCount() const { return flattenCount; }
+
+    // Forget the flattened path, so the next flatten() starts again
+    void invalidate()
+    {
+        flatScale = 0;
+    }
+
+private:
+    // Paths own their memory, so they shouldn't be copied by accident
+    Path(const Path &other);
+    Path & operator=(const Path &other);
+
+    // Room for moreVerbs and morePoints, so a piece is added whole or
+    // not at all.  Returns false if there's no memory.
+    bool reserve(int moreVerbs, int morePoints)
+    {
+        if (numVerbs + moreVerbs > verbCapacity) {
+            int capacity = verbCapacity ? verbCapacity * 2 : 32;
+            uint8_t *grown = (uint8_t *)realloc(verbs, capacity);
+            if (!grown) {
+                return false;
+            }
+            verbs = grown;
+            verbCapacity = capacity;
+        }
+
+        if (numPoints + morePoints > pointCapacity) {
+            int capacity = pointCapacity ? pointCapacity * 2 : 64;
+            PathPoint *grown = (PathPoint *)realloc(points, capacity * sizeof(PathPoint));
+            if (!grown) {
+                return false;
+            }
+            points = grown;
+            pointCapacity = capacity;
+        }
+
+        return true;
+    }
+
+    // After reserve()
+    void addVerb(PathVerb verb)
+    {
+        verbs[numVerbs] = (uint8_t)verb;
+        numVerbs = numVerbs + 1;
+        invalidate();
+    }
+
+    void addPoint(REAL x, REAL y)
+    {
+        points[numPoints].x = x;
+        points[numPoints].y = y;
+        numPoints = numPoints + 1;
+    }
+
+    bool addFlat(REAL x, REAL y) const
+    {
+        if (numFlat == flatCapacity) {
+            int capacity = flatCapacity ? flatCapacity * 2 : 256;
+            PathPoint *grown = (PathPoint *)realloc(flat, capacity * sizeof(PathPoint));
+            if (!grown) {
+                return false;
+            }
+            flat = grown;
+            flatCapacity = capacity;
+        }
+
+        flat[numFlat].x = x;
+        flat[numFlat].y = y;
+        numFlat = numFlat + 1;
+
+        if (x < bounds.left) bounds.left = x;
+        if (x > bounds.right) bounds.right = x;
+        if (y < bounds.top) bounds.top = y;
+        if (y > bounds.bottom) bounds.bottom = y;
+        return true;
+    }
+
+    bool beginContour() const
+    {
+        endContour(false);
+
+        if (numContours == contourCapacity) {
+            int capacity = contourCapacity ? contourCapacity * 2 : 16;
+            PathContour *grown = (PathContour *)realloc(contours, capacity * sizeof(PathContour));
+            if (!grown) {
+                return false;
+            }
+            contours = grown;
+            contourCapacity = capacity;
+        }
+
+        PathContour &c = contours[numContours];
+        c.first = numFlat;
+        c.count = 0;
+        c.closed = false;
+        numContours = numContours + 1;
+        return true;
+    }
+
+    void endContour(bool closed) const
+    {
+        if (numContours > 0 && contours[numContours - 1].count == 0) {
+            PathContour &c = contours[numContours - 1];
+            c.count = numFlat - c.first;
+            c.closed = closed;
+
+            // a contour that's just a point isn't anything
+            if (c.count < 2) {
+                numFlat = c.first;
+                numContours = numContours - 1;
+            }
+        }
+    }
+
+    // How many lines a curve needs, given how much it bends.  With n
+    // lines, the error is at most bend / (8 n^2), where bend is twice
+    // the second difference of a quadratic's control points, and six
+    // times the biggest one of a cubic's.
+    static int segmentsFor(REAL bend, REAL scale)
+    {
+        REAL tolerance = FlattenTolerance256 / 256.0f;
+        int n = (int)ceilf(sqrtf(bend * scale / (8 * tolerance)));
+        if (n < 1) return 1;
+        if (n > 1024) return 1024;
+        return n;
+    }
+
+    // Out of memory part way through, so leave nothing, and try again
+    // next time
+    bool flattenFailed() const
+    {
+        numFlat = 0;
+        numContours = 0;
+        bounds.left = bounds.top = bounds.right = bounds.bottom = 0;
+        flatScale = 0;
+        return false;
+    }
+
+    bool buildFlat(REAL scale) const
+    {
+        numFlat = 0;
+        numContours = 0;
+        bounds.left = bounds.top = 1e30f;
+        bounds.right = bounds.bottom = -1e30f;
+
+        const PathPoint *p = points;
+        REAL x = 0, y = 0;
+
+        for (int i = 0; i < numVerbs; i++)
+        {
+            switch (verbs[i]) {
+                case PATH_MOVE:
+                    x = p[0].x;
+                    y = p[0].y;
+                    if (!beginContour() || !addFlat(x, y)) {
+                        return flattenFailed();
+                    }
+                    p += 1;
+                break;
+
+                case PATH_LINE:
+                    x = p[0].x;
+                    y = p[0].y;
+                    if (!addFlat(x, y)) {
+                        return flattenFailed();
+                    }
+                    p += 1;
+                break;
+
+                case PATH_QUAD:
+                {
+                    REAL bx = x - 2 * p[0].x + p[1].x;
+                    REAL by = y - 2 * p[0].y + p[1].y;
+                    int n = segmentsFor(2 * sqrtf(bx * bx + by * by), scale);
+                    for (int k = 1; k <= n; k++) {
+                        REAL t = (REAL)k / n;
+                        REAL s = 1 - t;
+                        if (!addFlat(s * s * x + 2 * s * t * p[0].x + t * t * p[1].x,
+                            s * s * y + 2 * s * t * p[0].y + t * t * p[1].y)) {
+                            return flattenFailed();
+                        }
+                    }
+                    x = p[1].x;
+                    y = p[1].y;
+                    p += 2;
+                }
+                break;
+
+                case PATH_CUBIC:
+                {
+                    REAL ax = x - 2 * p[0].x + p[1].x, ay = y - 2 * p[0].y + p[1].y;
+                    REAL bx = p[0].x - 2 * p[1].x + p[2].x, by = p[0].y - 2 * p[1].y + p[2].y;
+                    REAL a = sqrtf(ax * ax + ay * ay);
+                    REAL b = sqrtf(bx * bx + by * by);
+                    int n = segmentsFor(6 * (a > b ? a : b), scale);
+                    for (int k = 1; k <= n; k++) {
+                        REAL t = (REAL)k / n;
+                        REAL s = 1 - t;
+                        REAL w0 = s * s * s, w1 = 3 * s * s * t, w2 = 3 * s * t * t, w3 = t * t * t;
+                        if (!addFlat(w0 * x + w1 * p[0].x + w2 * p[1].x + w3 * p[2].x,
+                            w0 * y + w1 * p[0].y + w2 * p[1].y + w3 * p[2].y)) {
+                            return flattenFailed();
+                        }
+                    }
+                    x = p[2].x;
+                    y = p[2].y;
+                    p += 3;
+                }
+                break;
+
+                case PATH_CLOSE:
+                    if (numContours > 0) {
+                        const PathContour &c = contours[numContours - 1];
+                        x = flat[c.first].x;
+                        y = flat[c.first].y;
+                    }
+                    endContour(true);
+                break;
+            }
+        }
+        endContour(false);
+
+        if (numFlat == 0) {
+            bounds.left = bounds.top = bounds.right = bounds.bottom = 0;
+        }
+
+        flatScale = scale;
+        flattenCount = flattenCount + 1;
+        return true;
+    }
+
+    // The outline, as given
+    uint8_t *verbs;
+    int numVerbs, verbCapacity;
+    PathPoint *points;
+    int numPoints, pointCapacity;
+
+    // The flattened outline, made when it's needed
+    mutable PathPoint *flat;
+    mutable int numFlat, flatCapacity;
+    mutable PathContour *contours;
+    mutable int numContours, contourCapacity;
+    mutable PathBounds bounds;
+    mutable REAL flatScale;         // 0 when there isn't one
+    mutable int flattenCount;
+
+    // Whether there's a contour to carry on drawing
+    bool hasCurrent;
+};
@@ -5,6 +5,12 @@
 
 #include "grtypes.hpp"
 
+// Gray level of a color, with the BT709 weights
+inline uint8_t toGray(const PixRGBA pix)
+{
+    return (0.2125 * pix.r) + (0.7154 * pix.g) + (0.0721 * pix.b);
+}
+
 /*
     This base class essentially defines an interface
     for the lowest level drawing API on a buffer of pixels.
@@ -17,7 +23,7 @@
 class PixelBuffer
 {
 public:
-    PixelBuffer(GRCOORD awidth, GRCOORD aheight)
+    PixelBuffer(GRSIZE awidth, GRSIZE aheight)
         :width(awidth), height(aheight)
     {}
 
@@ -30,10 +36,58 @@ public:
     // Retrieve a single pixel value from the specified location 
     virtual PixRGBA getPixel(GRCOORD x, GRCOORD y) const = 0;
     
+    // Retrieve a contiguous run of pixels from a row.
+    // Sub-classes should override this so that reading a row isn't
+    // a virtual call per pixel.
+    virtual void getSpan(GRCOORD x, GRCOORD y, GRSIZE width, PixRGBA * pix) const {
+        for (GRSIZE i=0; i<width; i++) {
+            pix[i] = getPixel(x+i, y);
+        }
+    }
+
+    // How many channels a pixel really has, 4 for RGBA, 1 for gray.
+    // Writers use this to save a gray buffer without expanding it.
+    virtual int getChannels() const { return 4; }
+
+    // Retrieve a run of pixels from a row as gray levels.
+    // A gray buffer should override this with a straight copy.
+    virtual void getGraySpan(GRCOORD x, GRCOORD y, GRSIZE width, uint8_t * gray) const {
+        PixRGBA pix[256];
+        for (GRSIZE done=0; done<width; done+=256) {
+            GRSIZE n = width - done < 256 ? width - done : 256;
+            getSpan((GRCOORD)(x+done), y, n, pix);
+            for (GRSIZE i=0; i<n; i++) {
+                gray[done+i] = toGray(pix[i]);
+            }
+        }
+    }
+
+    // Copy a run of gray levels into a row.
+    // A gray buffer should override this with a straight copy.
+    virtual void setGraySpan(GRCOORD x, GRCOORD y, GRSIZE width, const uint8_t * gray) {
+        PixRGBA pix[256];
+        for (GRSIZE done=0; done<width; done+=256) {
+            GRSIZE n = width - done < 256 ? width - done : 256;
+            for (GRSIZE i=0; i<n; i++) {
+                pix[i].r = pix[i].g = pix[i].b = gray[done+i];
+                pix[i].a = 255;
+            }
+            setSpan((GRCOORD)(x+done), y, n, pix);
+        }
+    }
+
     // Draw a horizontal line
     virtual void setPixels(GRCOORD x, GRCOORD y, GRSIZE width, const PixRGBA pix) {
-        for (int col=x; col<x+width; col++) {
-            setPixel(col,y, pix);
+        for (GRSIZE i=0; i<width; i++) {
+            setPixel(x+i, y, pix);
+        }
+    }
+
+    // Draw a batch of horizontal lines, each with its own color.
+    // The spans must already be clipped to the buffer.
+    virtual void fillSpans(const GRSpan *spans, size_t count) {
+        for (size_t i=0; i<count; i++) {
+            setPixels(spans[i].x, spans[i].y, spans[i].width, spans[i].color);
         }
     }
 
@@ -46,6 +100,25 @@ public:
     GRSIZE getWidth() const { return this->width;}
     GRSIZE getHeight() const { return this->height;}
 
+    // Is (x, y) inside the buffer.  Casting to GRSIZE turns
+    // a negative coordinate into a huge one, so it's one
+    // compare for each axis, whether GRCOORD is signed or not.
+    bool contains(GRCOORD x, GRCOORD y) const {
+        return (GRSIZE)x < width && (GRSIZE)y < height;
+    }
+
+protected:
+    // Where pixel (x, y) is, counting along the rows from the top left.
+    // The multiply has to be done in GROFFSET, as y * width doesn't fit
+    // in 32 bits on a big canvas.  No checking, this is for inner loops.
+    GROFFSET pixelOffset(GRCOORD x, GRCOORD y) const {
+        return (GROFFSET)y * width + x;
+    }
+
+    GROFFSET pixelCount() const {
+        return (GROFFSET)width * height;
+    }
+
 private:
     // private default constructor, so this can not
     // be an un-initialized element in an array 
@@ -1,13 +1,11 @@
 #pragma once
 
 #include <stdint.h>
+#include <string.h>
 
 #include "PixelBuffer.hpp"
+#include "TaskScheduler.hpp"
 
-inline uint8_t toGray(const PixRGBA pix)
-{
-    return (0.2125 * pix.r) + (0.7154 * pix.g) + (0.0721 * pix.b);
-}
 /*
     This is a class that represents a framebuffer.
     A framebuffer is the most rudimentary graphics
@@ -38,7 +36,7 @@ public:
     PixelBufferGray(GRSIZE width, GRSIZE height)
         : PixelBuffer(width, height)
     {
-        data = {new uint8_t[width*height]{}};
+        data = {new uint8_t[(GROFFSET)width * height]{}};
     }
 
     // Virtual destructor so this can be sub-classed
@@ -51,11 +49,11 @@ public:
     // Set the value of a single pixel
     bool setPixel(GRCOORD x, GRCOORD y, const PixRGBA pix)
     {
-        if (x>= getWidth() || y >= getHeight()) 
+        if (!contains(x, y))
         {
             return false;   // outside bounds
         }
-        size_t offset = y * getWidth() + x;
+        GROFFSET offset = pixelOffset(x, y);
         
         // convert pix to gray
         // use BT709 gray standard
@@ -69,7 +67,7 @@ public:
     // of the FrameBuffer
     PixRGBA getPixel(GRCOORD x, GRCOORD y) const
     {
-        size_t offset = y * getWidth() + x;
+        GROFFSET offset = pixelOffset(x, y);
         uint8_t value = data[offset];
         PixRGBA pix;
         pix.a=255;
@@ -80,6 +78,51 @@ public:
         return pix;
     }
 
+    // Read a run of pixels from a row, expanding gray to RGBA
+    void getSpan(GRCOORD x, GRCOORD y, GRSIZE width, PixRGBA * pix) const
+    {
+        const uint8_t * src = &data[pixelOffset(x, y)];
+        for (GRSIZE i=0; i<width; i++)
+        {
+            pix[i].r = src[i];
+            pix[i].g = src[i];
+            pix[i].b = src[i];
+            pix[i].a = 255;
+        }
+    }
+
+    // One channel, so writers can save the gray levels as they are
+    int getChannels() const { return 1; }
+
+    // Read a run of pixels from a row, as they are
+    void getGraySpan(GRCOORD x, GRCOORD y, GRSIZE width, uint8_t * gray) const
+    {
+        memcpy(gray, &data[pixelOffset(x, y)], width);
+    }
+
+    // Copy a run of gray levels into a row, as they are
+    void setGraySpan(GRCOORD x, GRCOORD y, GRSIZE width, const uint8_t * gray)
+    {
+        memcpy(&data[pixelOffset(x, y)], gray, width);
+    }
+
+    // Draw a horizontal line of a single color
+    void setPixels(GRCOORD x, GRCOORD y, GRSIZE width, const PixRGBA pix)
+    {
+        memset(&data[pixelOffset(x, y)], toGray(pix), width);
+    }
+
+    // Draw a batch of horizontal lines, without going through
+    // a virtual call for each one
+    void fillSpans(const GRSpan *spans, size_t count)
+    {
+        for (size_t s=0; s<count; s++)
+        {
+            const GRSpan &span = spans[s];
+            memset(&data[pixelOffset(span.x, span.y)], toGray(span.color), span.width);
+        }
+    }
+
     // setPixels()
     // 
     // set the values of a contiguous set of pixels
@@ -89,9 +132,9 @@ public:
         // if you use someting too small, it will rollover
         // uint16_t offset = y * this->width + x;
 
-        // size_t is a good choice, as it's typically the machine's largest
-        // unsigned int
-        size_t offset = y * getWidth() + x;
+        // GROFFSET is a size_t, which is typically the machine's largest
+        // unsigned int, and pixelOffset() multiplies in that size
+        GROFFSET offset = pixelOffset(x, y);
         
         // BUGBUG
         // we can do clipping here by reducing width to whatever
@@ -115,15 +158,22 @@ public:
     {
         uint8_t grayValue = toGray(value);
 
-        size_t nPixels = getWidth() * getHeight();
-        // BUGBUG
-        // we could do this with a simple memset 
-        // as an optimization
-        while (nPixels > 0){
-            data[nPixels-1] = grayValue;
-            nPixels = nPixels - 1;
+        // Small buffers are a single memset, big ones are
+        // split into bands of rows on the shared task scheduler
+        GROFFSET nPixels = pixelCount();
+        if (nPixels < ParallelPixels) {
+            memset(data, grayValue, nPixels);
+            return true;
         }
 
+        TaskScheduler &scheduler = TaskScheduler::shared();
+        scheduler.parallelFor(0, getHeight(), scheduler.rowGrain(getHeight()), [&](int first, int last) {
+            memset(&data[pixelOffset(0, (GRCOORD)first)], grayValue, (GROFFSET)(last - first) * getWidth());
+        });
+
         return true;
     }
+
+    // Below this many pixels, it's not worth waking up other threads
+    static const size_t ParallelPixels = 1024 * 1024;
 };
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <stdint.h>
+#include <string.h>
 
 #include "PixelBuffer.hpp"
+#include "TaskScheduler.hpp"
 
 /*
     This is a class that represents a framebuffer.
@@ -27,7 +29,7 @@ public:
     PixelBufferRGBA32(GRSIZE width, GRSIZE height)
         : PixelBuffer(width, height)
     {
-        data = {new PixRGBA[width*height]{}};
+        data = {new PixRGBA[(GROFFSET)width * height]{}};
     }
 
     // Virtual destructor so this can be sub-classed
@@ -40,11 +42,11 @@ public:
     // Set the value of a single pixel
     bool setPixel(GRCOORD x, GRCOORD y, const PixRGBA pix)
     {
-        if (x>= getWidth() || y >= getHeight()) 
+        if (!contains(x, y))
         {
             return false;   // outside bounds
         }
-        size_t offset = y * getWidth() + x;
+        GROFFSET offset = pixelOffset(x, y);
         data[offset] = pix;
 
         return true;
@@ -55,10 +57,41 @@ public:
     // of the FrameBuffer
     PixRGBA getPixel(GRCOORD x, GRCOORD y) const
     {
-        size_t offset = y * getWidth() + x;
+        GROFFSET offset = pixelOffset(x, y);
         return this->data[offset];
     }
 
+    // Read a run of pixels from a row
+    void getSpan(GRCOORD x, GRCOORD y, GRSIZE width, PixRGBA * pix) const
+    {
+        memcpy(pix, &data[pixelOffset(x, y)], width * sizeof(PixRGBA));
+    }
+
+    // Draw a horizontal line of a single color
+    void setPixels(GRCOORD x, GRCOORD y, GRSIZE width, const PixRGBA pix)
+    {
+        PixRGBA * ptr = &data[pixelOffset(x, y)];
+        for (GRSIZE i=0; i<width; i++)
+        {
+            ptr[i] = pix;
+        }
+    }
+
+    // Draw a batch of horizontal lines, without going through
+    // a virtual call for each one
+    void fillSpans(const GRSpan *spans, size_t count)
+    {
+        for (size_t s=0; s<count; s++)
+        {
+            const GRSpan &span = spans[s];
+            PixRGBA * ptr = &data[pixelOffset(span.x, span.y)];
+            for (int i=0; i<span.width; i++)
+            {
+                ptr[i] = span.color;
+            }
+        }
+    }
+
     // setPixels()
     // 
     // set the values of a contiguous set of pixels
@@ -68,9 +101,9 @@ public:
         // if you use someting too small, it will rollover
         // uint16_t offset = y * this->width + x;
 
-        // size_t is a good choice, as it's typically the machine's largest
-        // unsigned int
-        size_t offset = y * getWidth() + x;
+        // GROFFSET is a size_t, which is typically the machine's largest
+        // unsigned int, and pixelOffset() multiplies in that size
+        GROFFSET offset = pixelOffset(x, y);
         
         // BUGBUG
         // we can do clipping here by reducing width to whatever
@@ -90,17 +123,27 @@ public:
     // Set all the pixels in the framebuffer to the value specified
     // This is done here in case a framebuffer has a way of doing it
     // really fast.
+    // Big buffers are split into bands of rows, which are filled
+    // on the shared task scheduler.
     bool setAllPixels(const PixRGBA value)
     {
-        size_t nPixels = getWidth() * getHeight();
-        while (nPixels > 0){
-            data[nPixels-1] = value;
-            nPixels = nPixels - 1;
+        GROFFSET nPixels = pixelCount();
+        if (nPixels < ParallelPixels) {
+            fillRows(0, getHeight(), value);
+            return true;
         }
 
+        TaskScheduler &scheduler = TaskScheduler::shared();
+        scheduler.parallelFor(0, getHeight(), scheduler.rowGrain(getHeight()), [&](int first, int last) {
+            fillRows(first, last, value);
+        });
+
         return true;
     }
 
+    // Below this many pixels, it's not worth waking up other threads
+    static const size_t ParallelPixels = 256 * 1024;
+
     // We should not do the following as it allows
     // the data pointer to escape our control
     // it also allows unrestricted access to the data itself
@@ -112,5 +155,15 @@ private:
     // be an un-initialized element in an array 
     PixelBufferRGBA32();
 
+    // Set every pixel in rows [first, last)
+    void fillRows(GRSIZE first, GRSIZE last, const PixRGBA value)
+    {
+        PixRGBA * ptr = &data[pixelOffset(0, (GRCOORD)first)];
+        GROFFSET nPixels = (GROFFSET)(last - first) * getWidth();
+        for (size_t i = 0; i < nPixels; i++) {
+            ptr[i] = value;
+        }
+    }
+
     PixRGBA * data;         // a pointer to the actual pixel data
 };
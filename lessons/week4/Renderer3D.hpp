@@ -0,0 +1,751 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "grtypes.hpp"
+#include "grmath.hpp"
+#include "PixelBuffer.hpp"
+#include "TaskScheduler.hpp"
+
+/*
+    Renderer3D
+
+    A small software 3D pipeline, following the scratchapixel
+    rasterization lessons.
+
+    - Vertices are transformed by a single 4x4 matrix into clip space
+    - Triangles are clipped against the near and far planes (and
+      against a generous guard band, so the fixed point math below
+      can't overflow), then divided by w, and mapped to the screen
+    - Triangle setup turns each triangle into three integer edge
+      functions, in 24.8 fixed point, and a set of attribute planes
+    - Rasterization walks the bounding box in 8x8 blocks.  Blocks
+      entirely outside an edge are skipped, and blocks entirely inside
+      all three edges skip the per-pixel edge tests
+    - Depth is a float per pixel, and colors are interpolated
+      perspective correctly, as color/w and 1/w
+
+    Because a triangle's setup is separate from rasterizing it, and
+    rasterizing can be limited to any rectangle, a list of triangles
+    can be drawn by splitting the screen into tiles and having the
+    task scheduler do the tiles in parallel.  The result is the same
+    as drawing them one after the other.
+
+    Meshes can be drawn from a vertex array and an index array, in
+    which case each vertex is transformed once, however many triangles
+    use it, and edges shared by two triangles are set up once.
+
+    Drawing happens in the renderer's own color and depth buffers.
+    begin() reads in the target's current pixels, so 3D can go on top
+    of 2D drawing, and end() writes them back out.
+*/
+
+struct Vertex3D {
+    Vec3 pos;
+    PixRGBA color;
+};
+
+class Renderer3D
+{
+public:
+    // How many values are interpolated across a triangle.
+    // z, 1/w, then r, g, b, a (each divided by w)
+    static const int NumAttributes = 6;
+
+    // Screen tiles used when drawing lists of triangles in parallel
+    static const int TileSize = 64;
+
+    Renderer3D(PixelBuffer &target)
+        : target(target),
+        width(target.getWidth()),
+        height(target.getHeight()),
+        cullBackfaces(false),
+        setups(nullptr), numSetups(0), setupCapacity(0), setupFailed(false),
+        meshClip(nullptr), meshScreen(nullptr), meshOutside(nullptr), meshCapacity(0),
+        edgeGeneration(0), edgeCacheHits(0)
+    {
+        color = new PixRGBA[(size_t)width * height]{};
+        depth = new float[(size_t)width * height];
+        clearDepth();
+
+        memset(edgeCache, 0, sizeof(edgeCache));
+    }
+
+    virtual ~Renderer3D()
+    {
+        delete [] color;
+        delete [] depth;
+        free(setups);
+        free(meshClip);
+        free(meshScreen);
+        free(meshOutside);
+    }
+
+    void setTransform(const Mat4 &m) { transform = m; }
+    const Mat4 & getTransform() const { return transform; }
+
+    // Skip triangles that face away from the viewer.  Front facing
+    // triangles are counter clockwise, as in OpenGL.
+    void setBackfaceCulling(bool cull) { cullBackfaces = cull; }
+
+    // Load the target's pixels, and reset depth
+    bool begin()
+    {
+        for (int row = 0; row < height; row++) {
+            target.getSpan(0, row, width, &color[(size_t)row * width]);
+        }
+        clearDepth();
+        return true;
+    }
+
+    // Write the finished pixels back to the target
+    bool end()
+    {
+        for (int row = 0; row < height; row++) {
+            target.setSpan(0, row, width, &color[(size_t)row * width]);
+        }
+        return true;
+    }
+
+    bool clear(const PixRGBA pix)
+    {
+        size_t nPixels = (size_t)width * height;
+        for (size_t i = 0; i < nPixels; i++) {
+            color[i] = pix;
+        }
+        return true;
+    }
+
+    bool clearDepth()
+    {
+        size_t nPixels = (size_t)width * height;
+        for (size_t i = 0; i < nPixels; i++) {
+            depth[i] = 1.0f;
+        }
+        return true;
+    }
+
+    // Draw a single triangle.  Like the other draw calls, returns false
+    // if there was no memory to set up every triangle, when the ones
+    // that were set up are still drawn.
+    bool drawTriangle(const Vertex3D &v0, const Vertex3D &v1, const Vertex3D &v2)
+    {
+        numSetups = 0;
+        setupFailed = false;
+        addTriangle(transformVertex(v0), transformVertex(v1), transformVertex(v2));
+
+        GRRectangle screen(0, 0, width, height);
+        for (int i = 0; i < numSetups; i++) {
+            rasterize(setups[i], screen);
+        }
+
+        return !setupFailed;
+    }
+
+    /*
+    drawTriangles()
+
+    Draw a list of triangles, three vertices each.  All of them are
+    transformed and set up first, then the screen is rasterized
+    a tile at a time, in parallel.
+    */
+    bool drawTriangles(const Vertex3D *verts, size_t count)
+    {
+        numSetups = 0;
+        setupFailed = false;
+        for (size_t i = 0; i + 2 < count; i += 3) {
+            addTriangle(transformVertex(verts[i]), transformVertex(verts[i+1]), transformVertex(verts[i+2]));
+        }
+
+        rasterizeAll();
+        return !setupFailed;
+    }
+
+    /*
+    drawIndexed()
+
+    Draw a mesh, given as an array of vertices, and an array of
+    indices into it, three per triangle.  In a mesh, each vertex is
+    typically used by six triangles, so rather than transforming it six
+    times, all the vertices are transformed and projected once, up front,
+    and the triangles are set up from those.  Edges shared between
+    neighboring triangles are only worked out once as well.
+
+    Triangles that cross the near or far plane, or the guard band,
+    are clipped as usual.
+    */
+    bool drawIndexed(const Vertex3D *verts, size_t numVerts, const uint32_t *indices, size_t numIndices)
+    {
+        if (!transformMesh(verts, numVerts)) {
+            return false;
+        }
+
+        edgeGeneration = edgeGeneration + 1;
+        numSetups = 0;
+        setupFailed = false;
+
+        for (size_t i = 0; i + 2 < numIndices; i += 3)
+        {
+            uint32_t ids[3] = {indices[i], indices[i+1], indices[i+2]};
+            if (ids[0] >= numVerts || ids[1] >= numVerts || ids[2] >= numVerts) {
+                continue;
+            }
+
+            if (meshOutside[ids[0]] | meshOutside[ids[1]] | meshOutside[ids[2]]) {
+                addTriangle(meshClip[ids[0]], meshClip[ids[1]], meshClip[ids[2]]);
+            } else {
+                const ScreenVertex *sv[3] = {&meshScreen[ids[0]], &meshScreen[ids[1]], &meshScreen[ids[2]]};
+                setupProjected(sv, ids);
+            }
+        }
+
+        rasterizeAll();
+        return !setupFailed;
+    }
+
+    // How many edges drawIndexed() has found in its cache
+    size_t getEdgeCacheHits() const { return edgeCacheHits; }
+
+protected:
+    // A vertex in clip space, with its attributes
+    struct ClipVertex {
+        Vec4 pos;
+        REAL r, g, b, a;
+    };
+
+    // Everything needed to rasterize a triangle
+    struct TriangleSetup {
+        int minx, miny, maxx, maxy;     // pixel bounds, inclusive
+
+        // Edge functions, E(px, py) = a*px + b*py + c, for pixel px, py.
+        // A pixel is inside when all three are >= 0
+        int64_t ea[3], eb[3], ec[3];
+
+        // Attribute planes, f = f0 + fdx*(px-minx) + fdy*(py-miny)
+        float f0[NumAttributes];
+        float fdx[NumAttributes];
+        float fdy[NumAttributes];
+    };
+
+    ClipVertex transformVertex(const Vertex3D &v) const
+    {
+        ClipVertex cv;
+        cv.pos = transform.transform(v.pos);
+        cv.r = v.color.r;
+        cv.g = v.color.g;
+        cv.b = v.color.b;
+        cv.a = v.color.a;
+        return cv;
+    }
+
+    static ClipVertex lerp(const ClipVertex &a, const ClipVertex &b, REAL t)
+    {
+        ClipVertex v;
+        v.pos = a.pos + (b.pos - a.pos) * t;
+        v.r = a.r + (b.r - a.r) * t;
+        v.g = a.g + (b.g - a.g) * t;
+        v.b = a.b + (b.b - a.b) * t;
+        v.a = a.a + (b.a - a.a) * t;
+        return v;
+    }
+
+    /*
+    clipPolygon()
+
+    Sutherland-Hodgman, against the plane where plane.dot(pos) >= 0.
+    */
+    static int clipPolygon(const ClipVertex *in, int count, ClipVertex *out, const Vec4 &plane)
+    {
+        int nOut = 0;
+        for (int i = 0; i < count; i++)
+        {
+            const ClipVertex &a = in[i];
+            const ClipVertex &b = in[(i + 1) % count];
+            REAL da = plane.dot(a.pos);
+            REAL db = plane.dot(b.pos);
+
+            if (da >= 0) {
+                out[nOut++] = a;
+            }
+            if ((da >= 0) != (db >= 0)) {
+                out[nOut++] = lerp(a, b, da / (da - db));
+            }
+        }
+        return nOut;
+    }
+
+    // Clip a triangle, and set up whatever is left of it
+    void addTriangle(const ClipVertex &v0, const ClipVertex &v1, const ClipVertex &v2)
+    {
+        // Room for the triangle plus one vertex per clip plane
+        ClipVertex polyA[12], polyB[12];
+        polyA[0] = v0;
+        polyA[1] = v1;
+        polyA[2] = v2;
+        int count = 3;
+
+        // Near and far planes are always clipped against.  The sides are
+        // clipped at a guard band, well outside the screen, only to keep
+        // coordinates small enough for the fixed point edge math.
+        const REAL guard = 4.0f;
+        Vec4 planes[6] = {
+            Vec4(0, 0, 1, 1),       // near   z >= -w
+            Vec4(0, 0, -1, 1),      // far    z <= w
+            Vec4(1, 0, 0, guard),   // x >= -guard*w
+            Vec4(-1, 0, 0, guard),  // x <= guard*w
+            Vec4(0, 1, 0, guard),   // y >= -guard*w
+            Vec4(0, -1, 0, guard)   // y <= guard*w
+        };
+
+        ClipVertex *in = polyA;
+        ClipVertex *out = polyB;
+        for (int p = 0; p < 6; p++)
+        {
+            bool allInside = true;
+            for (int i = 0; i < count; i++) {
+                if (planes[p].dot(in[i].pos) < 0) {
+                    allInside = false;
+                    break;
+                }
+            }
+            if (allInside) {
+                continue;
+            }
+
+            count = clipPolygon(in, count, out, planes[p]);
+            if (count < 3) {
+                return;
+            }
+
+            ClipVertex *tmp = in;
+            in = out;
+            out = tmp;
+        }
+
+        // what's left is convex, so a fan covers it
+        for (int i = 1; i + 1 < count; i++) {
+            setupTriangle(in[0], in[i], in[i+1]);
+        }
+    }
+
+    // A vertex after projection onto the screen
+    struct ScreenVertex {
+        int64_t X, Y;                   // 24.8 fixed point
+        double attr[NumAttributes];     // already divided by w
+    };
+
+    // An edge function, without the top-left adjustment
+    struct Edge {
+        int64_t ea, eb, ec;
+    };
+
+    void projectVertex(const ClipVertex &cv, ScreenVertex &sv) const
+    {
+        REAL invw = 1.0f / cv.pos.w;
+        double sx = (cv.pos.x * invw * 0.5 + 0.5) * width;
+        double sy = (0.5 - cv.pos.y * invw * 0.5) * height;
+
+        // 24.8 fixed point
+        sv.X = (int64_t)floor(sx * 256 + 0.5);
+        sv.Y = (int64_t)floor(sy * 256 + 0.5);
+
+        sv.attr[0] = cv.pos.z * invw;
+        sv.attr[1] = invw;
+        sv.attr[2] = cv.r * invw;
+        sv.attr[3] = cv.g * invw;
+        sv.attr[4] = cv.b * invw;
+        sv.attr[5] = cv.a * invw;
+    }
+
+    // The edge from a to b, positive on its left (on the screen, y down)
+    static void computeEdge(const ScreenVertex &a, const ScreenVertex &b, Edge &edge)
+    {
+        int64_t dx = b.X - a.X;
+        int64_t dy = b.Y - a.Y;
+
+        edge.ea = -dy * 256;
+        edge.eb = dx * 256;
+        edge.ec = dx * (128 - a.Y) - dy * (128 - a.X);
+    }
+
+    /*
+    setupTriangle()
+
+    Project the triangle onto the screen, and work out its edge
+    functions and attribute planes.
+    */
+    void setupTriangle(const ClipVertex &c0, const ClipVertex &c1, const ClipVertex &c2)
+    {
+        ScreenVertex s[3];
+        projectVertex(c0, s[0]);
+        projectVertex(c1, s[1]);
+        projectVertex(c2, s[2]);
+
+        const ScreenVertex *sv[3] = {&s[0], &s[1], &s[2]};
+        setupProjected(sv, nullptr);
+    }
+
+    /*
+    setupProjected()
+
+    The rest of setupTriangle(), once the vertices are on the screen.
+    When the triangle comes from an indexed mesh, ids are the vertex
+    numbers, and edges are looked up in the edge cache, rather than
+    being worked out again for the neighboring triangle.
+    */
+    void setupProjected(const ScreenVertex **sv, const uint32_t *ids)
+    {
+        // twice the signed area.  Counter clockwise in clip space
+        // (facing us) comes out negative, as y is flipped on the screen
+        int64_t area = (sv[1]->X - sv[0]->X) * (sv[2]->Y - sv[0]->Y) - (sv[1]->Y - sv[0]->Y) * (sv[2]->X - sv[0]->X);
+        if (area == 0) {
+            return;
+        }
+
+        if (area > 0 && cullBackfaces) {
+            return;
+        }
+
+        // the edge functions below want a positive area
+        int order[3] = {0, 1, 2};
+        if (area < 0) {
+            order[1] = 2;
+            order[2] = 1;
+            area = -area;
+        }
+
+        TriangleSetup *setup = newSetup();
+        if (!setup) {
+            return;
+        }
+        TriangleSetup &t = *setup;
+
+        int64_t minX = sv[0]->X, maxX = sv[0]->X, minY = sv[0]->Y, maxY = sv[0]->Y;
+        for (int i = 1; i < 3; i++) {
+            if (sv[i]->X < minX) minX = sv[i]->X;
+            if (sv[i]->X > maxX) maxX = sv[i]->X;
+            if (sv[i]->Y < minY) minY = sv[i]->Y;
+            if (sv[i]->Y > maxY) maxY = sv[i]->Y;
+        }
+
+        // pixel centers are at +0.5, round inwards
+        t.minx = (int)((minX + 127) >> 8);
+        t.miny = (int)((minY + 127) >> 8);
+        t.maxx = (int)((maxX - 128) >> 8);
+        t.maxy = (int)((maxY - 128) >> 8);
+
+        // Edge i is opposite vertex i
+        for (int i = 0; i < 3; i++)
+        {
+            int a = order[(i + 1) % 3];
+            int b = order[(i + 2) % 3];
+
+            Edge edge;
+            if (ids) {
+                cachedEdge(ids[a], ids[b], *sv[a], *sv[b], edge);
+            } else {
+                computeEdge(*sv[a], *sv[b], edge);
+            }
+
+            // Top-left rule: pixels exactly on an edge belong to the
+            // triangle only if it's a top or left edge, so triangles
+            // sharing an edge never both draw the same pixel
+            int64_t dx = edge.eb;
+            int64_t dy = -edge.ea;
+            bool topLeft = (dy < 0) || (dy == 0 && dx > 0);
+
+            t.ea[i] = edge.ea;
+            t.eb[i] = edge.eb;
+            t.ec[i] = edge.ec - (topLeft ? 0 : 1);
+        }
+
+        // Attribute planes from the barycentric weights, which
+        // are the edge functions divided by the area
+        double invArea = 1.0 / (double)area;
+        for (int k = 0; k < NumAttributes; k++)
+        {
+            double at0 = 0, adx = 0, ady = 0;
+            for (int i = 0; i < 3; i++)
+            {
+                double f = sv[order[i]]->attr[k] * invArea;
+                double e0 = (double)(t.ea[i] * t.minx + t.eb[i] * t.miny + t.ec[i]);
+                at0 += e0 * f;
+                adx += (double)t.ea[i] * f;
+                ady += (double)t.eb[i] * f;
+            }
+            t.f0[k] = (float)at0;
+            t.fdx[k] = (float)adx;
+            t.fdy[k] = (float)ady;
+        }
+    }
+
+    /*
+    cachedEdge()
+
+    In a mesh, most edges are shared by two triangles, which go along
+    them in opposite directions.  Going the other way is just the same
+    edge function negated, so each edge is kept in a small cache under
+    its pair of vertex numbers, lowest first, and the second triangle
+    to use it gets it from there.  It is also exactly the same edge,
+    bit for bit, so the top-left rule splits the pixels along it
+    perfectly between the two.
+
+    The cache is direct mapped, like a CPU cache, so a lookup is one
+    hash and one compare.  Neighboring triangles are usually close
+    together in the index list, so their edges are still there.
+    */
+    void cachedEdge(uint32_t from, uint32_t to, const ScreenVertex &a, const ScreenVertex &b, Edge &edge)
+    {
+        bool reversed = from > to;
+        uint32_t lo = reversed ? to : from;
+        uint32_t hi = reversed ? from : to;
+
+        EdgeCacheEntry &entry = edgeCache[((lo * 0x9E3779B1u) ^ hi) & (EdgeCacheSize - 1)];
+        if (entry.generation == edgeGeneration && entry.lo == lo && entry.hi == hi) {
+            edgeCacheHits = edgeCacheHits + 1;
+        } else {
+            entry.generation = edgeGeneration;
+            entry.lo = lo;
+            entry.hi = hi;
+            if (reversed) {
+                computeEdge(b, a, entry.edge);
+            } else {
+                computeEdge(a, b, entry.edge);
+            }
+        }
+
+        if (reversed) {
+            edge.ea = -entry.edge.ea;
+            edge.eb = -entry.edge.eb;
+            edge.ec = -entry.edge.ec;
+        } else {
+            edge = entry.edge;
+        }
+    }
+
+    /*
+    transformMesh()
+
+    The post-transform vertex cache.  Every vertex of the mesh is
+    transformed, and if it's inside the clip volume, projected too.
+    The arrays are kept between calls, so drawing doesn't allocate.
+    Returns false if there's no memory for them.
+    */
+    bool transformMesh(const Vertex3D *verts, size_t numVerts)
+    {
+        if (numVerts > meshCapacity) {
+            free(meshClip);
+            free(meshScreen);
+            free(meshOutside);
+            meshClip = (ClipVertex *)malloc(numVerts * sizeof(ClipVertex));
+            meshScreen = (ScreenVertex *)malloc(numVerts * sizeof(ScreenVertex));
+            meshOutside = (uint8_t *)malloc(numVerts);
+            meshCapacity = numVerts;
+            if (!meshClip || !meshScreen || !meshOutside) {
+                meshCapacity = 0;
+                return false;
+            }
+        }
+
+        const REAL guard = 4.0f;
+        for (size_t i = 0; i < numVerts; i++)
+        {
+            ClipVertex &cv = meshClip[i];
+            cv = transformVertex(verts[i]);
+
+            // the same planes addTriangle() clips against
+            REAL gw = guard * cv.pos.w;
+            bool outside = cv.pos.z < -cv.pos.w || cv.pos.z > cv.pos.w ||
+                cv.pos.x < -gw || cv.pos.x > gw || cv.pos.y < -gw || cv.pos.y > gw;
+
+            meshOutside[i] = outside ? 1 : 0;
+            if (!outside) {
+                projectVertex(cv, meshScreen[i]);
+            }
+        }
+        return true;
+    }
+
+    // NULL, and setupFailed set, if there's no memory for another
+    TriangleSetup * newSetup()
+    {
+        if (numSetups == setupCapacity) {
+            int capacity = setupCapacity ? setupCapacity * 2 : 256;
+            TriangleSetup *grown = (TriangleSetup *)realloc(setups, capacity * sizeof(TriangleSetup));
+            if (!grown) {
+                setupFailed = true;
+                return NULL;
+            }
+            setups = grown;
+            setupCapacity = capacity;
+        }
+        numSetups = numSetups + 1;
+        return &setups[numSetups - 1];
+    }
+
+    // Rasterize everything that has been set up, in parallel tiles
+    // when there's enough work to make it worthwhile
+    void rasterizeAll()
+    {
+        GRRectangle screen(0, 0, width, height);
+        TaskScheduler &scheduler = TaskScheduler::shared();
+
+        if (numSetups < 16 || scheduler.getWorkerCount() == 0) {
+            for (int i = 0; i < numSetups; i++) {
+                rasterize(setups[i], screen);
+            }
+            return;
+        }
+
+        scheduler.parallelForTiles(screen, TileSize, TileSize, [&](const GRRectangle &tile) {
+            for (int i = 0; i < numSetups; i++) {
+                rasterize(setups[i], tile);
+            }
+        });
+    }
+
+    /*
+    rasterize()
+
+    Fill the pixels of a set up triangle that are inside clip.
+    */
+    void rasterize(const TriangleSetup &t, const GRRectangle &clip)
+    {
+        int x0 = t.minx > clip.x ? t.minx : clip.x;
+        int y0 = t.miny > clip.y ? t.miny : clip.y;
+        int x1 = t.maxx < clip.right() - 1 ? t.maxx : clip.right() - 1;
+        int y1 = t.maxy < clip.bottom() - 1 ? t.maxy : clip.bottom() - 1;
+
+        if (x1 < x0 || y1 < y0) {
+            return;
+        }
+
+        for (int by = y0; by <= y1; by += 8)
+        {
+            int by1 = by + 7 < y1 ? by + 7 : y1;
+
+            for (int bx = x0; bx <= x1; bx += 8)
+            {
+                int bx1 = bx + 7 < x1 ? bx + 7 : x1;
+
+                // Test the corners of the block against each edge.
+                // Since edges are straight, the corners are the extremes.
+                bool partial = false;
+                bool outside = false;
+                for (int i = 0; i < 3 && !outside; i++)
+                {
+                    int64_t e00 = t.ea[i] * bx + t.eb[i] * by + t.ec[i];
+                    int64_t e10 = e00 + t.ea[i] * (bx1 - bx);
+                    int64_t e01 = e00 + t.eb[i] * (by1 - by);
+                    int64_t e11 = e10 + t.eb[i] * (by1 - by);
+
+                    if ((e00 & e10 & e01 & e11) < 0) {
+                        outside = true;     // all four negative
+                    } else if ((e00 | e10 | e01 | e11) < 0) {
+                        partial = true;     // some negative
+                    }
+                }
+
+                if (!outside) {
+                    shadeBlock(t, bx, by, bx1, by1, partial);
+                }
+            }
+        }
+    }
+
+    /*
+    shadeBlock()
+
+    Attributes are evaluated from the plane at each pixel, rather than
+    by adding up steps, so a pixel gets exactly the same value no matter
+    which block or tile it was reached from.
+    */
+    void shadeBlock(const TriangleSetup &t, int bx, int by, int bx1, int by1, bool partial)
+    {
+        for (int py = by; py <= by1; py++)
+        {
+            int64_t e0 = t.ea[0] * bx + t.eb[0] * py + t.ec[0];
+            int64_t e1 = t.ea[1] * bx + t.eb[1] * py + t.ec[1];
+            int64_t e2 = t.ea[2] * bx + t.eb[2] * py + t.ec[2];
+
+            float rowf[NumAttributes];
+            for (int k = 0; k < NumAttributes; k++) {
+                rowf[k] = t.f0[k] + t.fdy[k] * (py - t.miny);
+            }
+
+            PixRGBA *crow = &color[(size_t)py * width];
+            float *drow = &depth[(size_t)py * width];
+
+            for (int px = bx; px <= bx1; px++)
+            {
+                if (!partial || (e0 | e1 | e2) >= 0)
+                {
+                    float dx = (float)(px - t.minx);
+                    float z = (rowf[0] + t.fdx[0] * dx) * 0.5f + 0.5f;
+                    if (z < drow[px])
+                    {
+                        drow[px] = z;
+
+                        // undo the divide by w
+                        float w = 1.0f / (rowf[1] + t.fdx[1] * dx);
+                        crow[px].r = toByte((rowf[2] + t.fdx[2] * dx) * w);
+                        crow[px].g = toByte((rowf[3] + t.fdx[3] * dx) * w);
+                        crow[px].b = toByte((rowf[4] + t.fdx[4] * dx) * w);
+                        crow[px].a = toByte((rowf[5] + t.fdx[5] * dx) * w);
+                    }
+                }
+
+                e0 += t.ea[0];
+                e1 += t.ea[1];
+                e2 += t.ea[2];
+            }
+        }
+    }
+
+    static uint8_t toByte(float value)
+    {
+        if (value <= 0) return 0;
+        if (value >= 255) return 255;
+        return (uint8_t)(value + 0.5f);
+    }
+
+    PixelBuffer &target;
+    int width;
+    int height;
+
+    PixRGBA *color;         // the pixels being drawn into
+    float *depth;           // depth of each pixel, 0 is near, 1 is far
+
+    Mat4 transform;
+    bool cullBackfaces;
+
+    TriangleSetup *setups;  // triangles ready to rasterize
+    int numSetups;
+    int setupCapacity;
+    bool setupFailed;       // a triangle was dropped for want of memory
+
+    // The transformed vertices of the mesh being drawn
+    ClipVertex *meshClip;
+    ScreenVertex *meshScreen;   // only good where meshOutside is 0
+    uint8_t *meshOutside;       // needs clipping
+    size_t meshCapacity;
+
+    // Edges shared between triangles of a mesh.  Bumping the
+    // generation empties the cache without touching it.
+    static const int EdgeCacheSize = 4096;
+    struct EdgeCacheEntry {
+        uint32_t generation;
+        uint32_t lo, hi;
+        Edge edge;
+    };
+    EdgeCacheEntry edgeCache[EdgeCacheSize];
+    uint32_t edgeGeneration;
+    size_t edgeCacheHits;
+
+private:
+    // Not copyable, it owns its buffers
+    Renderer3D(const Renderer3D &other);
+    Renderer3D & operator=(const Renderer3D &other);
+};
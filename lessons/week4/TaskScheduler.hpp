@@ -0,0 +1,329 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <functional>
+
+#include "grtypes.hpp"
+
+/*
+    TaskScheduler
+
+    A pool of worker threads that everything parallel in the library
+    shares, rather than each routine starting threads of its own.
+
+    Work is handed out with parallelFor(), which splits a range of
+    integers (typically rows, or tile numbers) into pieces.  Each
+    worker has its own double ended queue of pieces.  A worker takes
+    work from the back of its own queue, and when that runs dry, it
+    steals from the front of somebody else's, where the biggest pieces
+    are.  Pieces are split in half as they are taken, until they're
+    down to the 'grain' size, so the work spreads itself out without
+    anybody deciding up front who does what.
+
+    The thread calling parallelFor() helps out until its range is
+    finished, so parallelFor() can be called from inside a task without
+    tying up a worker.
+
+    With zero workers, everything simply runs on the calling thread.
+*/
+
+typedef std::function<void(int begin, int end)> RangeTask;
+typedef std::function<void(const GRRectangle &tile)> TileTask;
+
+class TaskScheduler
+{
+private:
+    // One call to parallelFor()
+    struct Job {
+        const RangeTask *body;
+        int grain;
+        std::atomic<int> pending;   // pieces not yet finished
+    };
+
+    // A piece of a job, the range [begin, end)
+    struct Task {
+        Job *job;
+        int begin;
+        int end;
+    };
+
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+public:
+    // numWorkers - how many threads to start. -1 picks one fewer than
+    // the number of processors, since the calling thread works too.
+    TaskScheduler(int numWorkers = -1)
+        : queues(nullptr), workers(nullptr), numWorkers(0), queued(0), stopping(false)
+    {
+        setWorkerCount(numWorkers);
+    }
+
+    virtual ~TaskScheduler()
+    {
+        stopWorkers();
+    }
+
+    // The scheduler shared by the pixel buffers, renderers and writers
+    static TaskScheduler & shared()
+    {
+        static TaskScheduler scheduler;
+        return scheduler;
+    }
+
+    int getWorkerCount() const { return numWorkers; }
+
+    /*
+    setWorkerCount()
+
+    Change the number of worker threads.  Zero means run everything
+    serially on the calling thread.  This must not be called while
+    work is in progress.
+    */
+    void setWorkerCount(int count)
+    {
+        if (count < 0) {
+            count = (int)std::thread::hardware_concurrency() - 1;
+        }
+        if (count < 0) {
+            count = 0;
+        }
+
+        stopWorkers();
+
+        numWorkers = count;
+        stopping = false;
+
+        // The extra queue, at the end, is where threads that aren't
+        // workers put their work
+        queues = new WorkQueue[numWorkers + 1];
+
+        if (numWorkers > 0) {
+            workers = new std::thread[numWorkers];
+            for (int i = 0; i < numWorkers; i++) {
+                workers[i] = std::thread(&TaskScheduler::workerLoop, this, i);
+            }
+        }
+    }
+
+    /*
+    parallelFor()
+
+    Call body(begin, end) on pieces of the range [begin, end), where
+    each piece is no bigger than grain, possibly from several threads at
+    once.  Returns when the whole range has been done.
+    */
+    void parallelFor(int begin, int end, int grain, const RangeTask &body)
+    {
+        if (end <= begin) {
+            return;
+        }
+
+        if (grain < 1) {
+            grain = 1;
+        }
+
+        if (numWorkers == 0 || end - begin <= grain) {
+            for (int i = begin; i < end; i += grain) {
+                body(i, (end - i) < grain ? end : i + grain);
+            }
+            return;
+        }
+
+        Job job;
+        job.body = &body;
+        job.grain = grain;
+        job.pending = 1;
+
+        Task root = {&job, begin, end};
+        runTask(root, myQueue());
+
+        // Help out until all the pieces are done
+        while (job.pending.load() > 0)
+        {
+            Task task;
+            if (findTask(task)) {
+                runTask(task, myQueue());
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Call body() for each tile of the area, in parallel.  Tiles on
+    // the right and bottom edges are trimmed to fit the area.
+    void parallelForTiles(const GRRectangle &area, int tileWidth, int tileHeight, const TileTask &body)
+    {
+        if (area.isEmpty() || tileWidth < 1 || tileHeight < 1) {
+            return;
+        }
+
+        int tilesWide = (area.width + tileWidth - 1) / tileWidth;
+        int tilesHigh = (area.height + tileHeight - 1) / tileHeight;
+
+        parallelFor(0, tilesWide * tilesHigh, 1, [&](int first, int last) {
+            for (int tile = first; tile < last; tile++) {
+                int x = area.x + (tile % tilesWide) * tileWidth;
+                int y = area.y + (tile / tilesWide) * tileHeight;
+
+                body(GRRectangle(x, y, tileWidth, tileHeight).intersection(area));
+            }
+        });
+    }
+
+    // Convenience for splitting the rows of an image, aiming for a few
+    // pieces per worker, but never less than minRows rows per piece
+    int rowGrain(int rows, int minRows = 16) const
+    {
+        int grain = rows / ((numWorkers + 1) * 4);
+        return grain < minRows ? minRows : grain;
+    }
+
+private:
+    // Index of the queue belonging to the current thread
+    int myQueue() const
+    {
+        WorkerId &me = currentWorker();
+        return (me.owner == this) ? me.index : numWorkers;
+    }
+
+    // Which scheduler, and which of its workers, the current thread is
+    struct WorkerId {
+        const TaskScheduler *owner;
+        int index;
+    };
+
+    static WorkerId & currentWorker()
+    {
+        static thread_local WorkerId id = {nullptr, -1};
+        return id;
+    }
+
+    void push(int q, const Task &task)
+    {
+        {
+            std::lock_guard<std::mutex> guard(queues[q].lock);
+            queues[q].tasks.push_back(task);
+        }
+        queued.fetch_add(1);
+
+        std::lock_guard<std::mutex> guard(sleepLock);
+        wakeup.notify_one();
+    }
+
+    // Take from the back of our own queue, or steal from the
+    // front of somebody else's
+    bool findTask(Task &task)
+    {
+        if (queued.load() == 0) {
+            return false;
+        }
+
+        int mine = myQueue();
+        int nQueues = numWorkers + 1;
+
+        for (int i = 0; i < nQueues; i++)
+        {
+            int q = (mine + i) % nQueues;
+            std::lock_guard<std::mutex> guard(queues[q].lock);
+            if (queues[q].tasks.empty()) {
+                continue;
+            }
+
+            if (q == mine) {
+                task = queues[q].tasks.back();
+                queues[q].tasks.pop_back();
+            } else {
+                task = queues[q].tasks.front();
+                queues[q].tasks.pop_front();
+            }
+            queued.fetch_sub(1);
+            return true;
+        }
+
+        return false;
+    }
+
+    // Split off the top half of the range for others to take,
+    // until what's left is small enough, then run it
+    void runTask(Task task, int q)
+    {
+        Job *job = task.job;
+
+        while (task.end - task.begin > job->grain)
+        {
+            int middle = task.begin + (task.end - task.begin) / 2;
+            Task other = {job, middle, task.end};
+            job->pending.fetch_add(1);
+            push(q, other);
+            task.end = middle;
+        }
+
+        (*job->body)(task.begin, task.end);
+        job->pending.fetch_sub(1);
+    }
+
+    void workerLoop(int index)
+    {
+        currentWorker().owner = this;
+        currentWorker().index = index;
+
+        while (true)
+        {
+            Task task;
+            if (findTask(task)) {
+                runTask(task, index);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> guard(sleepLock);
+            if (stopping) {
+                break;
+            }
+            wakeup.wait(guard, [this]() { return stopping || queued.load() > 0; });
+            if (stopping) {
+                break;
+            }
+        }
+    }
+
+    void stopWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            stopping = true;
+            wakeup.notify_all();
+        }
+
+        for (int i = 0; i < numWorkers; i++) {
+            workers[i].join();
+        }
+
+        delete [] workers;
+        delete [] queues;
+        workers = nullptr;
+        queues = nullptr;
+        numWorkers = 0;
+    }
+
+    // Not copyable, it owns threads
+    TaskScheduler(const TaskScheduler &other);
+    TaskScheduler & operator=(const TaskScheduler &other);
+
+    WorkQueue *queues;          // one per worker, plus one for everyone else
+    std::thread *workers;
+    int numWorkers;
+
+    std::atomic<int> queued;    // how many tasks are sitting in queues
+    std::mutex sleepLock;
+    std::condition_variable wakeup;
+    bool stopping;
+};
@@ -0,0 +1,771 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <set>
+#include <algorithm>
+
+#include "grtypes.hpp"
+
+/*
+    Tessellator
+
+    Cuts polygons up into triangles, for things that want triangles
+    rather than spans, like the 3D renderer, or writing shapes out.
+    The polygon can have holes in it.  What comes out is a list of
+    indices into the polygon's points, three to a triangle, which is
+    what Renderer3D::drawIndexed() takes.
+
+    The usual way, cutting off one "ear" after another, looks at every
+    point again for each ear, so it's O(n^2).  This does it in
+    O(n log n) the way the textbooks do (de Berg et al, chapter 3):
+
+    A line sweeps down the polygon, from the top point to the bottom,
+    remembering the edges it's crossing, in order, in a std::set.
+    Wherever the outline turns back on itself, a split point sticking
+    up into the shape, or a merge point hanging down, a diagonal is
+    added to a point above it.  That cuts the polygon into pieces that
+    are monotone: going down either side of each, you never go back
+    up.  Holes just add more split and merge points, and get joined to
+    the outline by the diagonals.
+
+    A monotone piece is easy to cut into triangles in one pass down it,
+    with a stack of the points that can't be joined up yet.
+
+    Tessellating the same shape every frame is a waste, so tessellate()
+    keeps the last few results, and hands back the same indices when
+    it's given the same points again.  The points are checked, by a
+    hash, so a polygon that's been changed in place is done again.
+*/
+class Tessellator
+{
+public:
+    static const int CacheSize = 32;
+
+    Tessellator()
+        : verts(nullptr), vertCapacity(0), numVerts(0),
+        types(nullptr), helpers(nullptr), order(nullptr), used(nullptr), edgeAt(nullptr),
+        chain(nullptr), side(nullptr), stack(nullptr), chainCapacity(0),
+        indices(nullptr), numIndices(0), indexCapacity(0),
+        clock(0), hits(0), misses(0)
+    {
+        memset(cache, 0, sizeof(cache));
+    }
+
+    virtual ~Tessellator()
+    {
+        free(verts);
+        free(types);
+        free(helpers);
+        free(order);
+        free(used);
+        delete [] edgeAt;
+        free(chain);
+        free(side);
+        free(stack);
+        free(indices);
+        for (int i = 0; i < CacheSize; i++) {
+            free(cache[i].indices);
+        }
+    }
+
+    /*
+    triangulate()
+
+    Tessellate a polygon.  The first counts[0] points are its outline,
+    then counts[1] points of the first hole, and so on.  Either way
+    around is fine, for the outline and the holes.  The holes have to
+    be inside the outline, and nothing can cross over anything else.
+    Coordinates have to fit in 30 bits.
+
+    Returns false if it couldn't be done.  Otherwise the triangles are
+    in getIndices(), until the next call, all wound the same way as the
+    outline was given.
+    */
+    bool triangulate(const Point2D *pts, const int *counts, int numContours)
+    {
+        numIndices = 0;
+        if (!buildVertices(pts, counts, numContours)) {
+            return false;
+        }
+
+        return partition() && triangulatePieces();
+    }
+
+    bool triangulate(const Point2D *pts, int count)
+    {
+        return triangulate(pts, &count, 1);
+    }
+
+    const uint32_t * getIndices() const { return indices; }
+    size_t getIndexCount() const { return numIndices; }
+
+    /*
+    tessellate()
+
+    The same as triangulate(), but remembers the result, keyed by where
+    the points are and what's in them.  The indices are good until
+    tessellate() has to do a polygon it doesn't have.  Returns null if
+    the polygon couldn't be done.
+    */
+    const uint32_t * tessellate(const Point2D *pts, const int *counts, int numContours, size_t &count)
+    {
+        uint32_t hash = hashPolygon(pts, counts, numContours);
+        clock = clock + 1;
+
+        for (int i = 0; i < CacheSize; i++) {
+            CacheEntry &e = cache[i];
+            if (e.pts == pts && e.numContours == numContours && e.hash == hash && e.indices) {
+                e.lastUsed = clock;
+                hits = hits + 1;
+                count = e.numIndices;
+                return e.indices;
+            }
+        }
+
+        misses = misses + 1;
+        count = 0;
+        if (!triangulate(pts, counts, numContours)) {
+            return nullptr;
+        }
+
+        // in place of whatever was used longest ago
+        int oldest = 0;
+        for (int i = 1; i < CacheSize; i++) {
+            if (cache[i].lastUsed < cache[oldest].lastUsed) {
+                oldest = i;
+            }
+        }
+
+        // if there's no room to keep it, it's still the answer, until
+        // the next polygon
+        CacheEntry &e = cache[oldest];
+        if (!grow(e.indices, numIndices ? numIndices : 1)) {
+            count = numIndices;
+            return indices;
+        }
+        memcpy(e.indices, indices, numIndices * sizeof(uint32_t));
+        e.numIndices = numIndices;
+        e.pts = pts;
+        e.numContours = numContours;
+        e.hash = hash;
+        e.lastUsed = clock;
+
+        count = numIndices;
+        return e.indices;
+    }
+
+    const uint32_t * tessellate(const Point2D *pts, int count, size_t &numIndices)
+    {
+        return tessellate(pts, &count, 1, numIndices);
+    }
+
+    // How often tessellate() found what it was asked for
+    int getCacheHits() const { return hits; }
+    int getCacheMisses() const { return misses; }
+
+private:
+    // Tessellators hold on to buffers, so they shouldn't be copied
+    Tessellator(const Tessellator &other);
+    Tessellator & operator=(const Tessellator &other);
+
+    /*
+        The polygon, as rings of points.  y is turned upside down, so
+        "above" means a bigger y, the way the textbook draws it, and
+        the outline goes counter clockwise, with the inside on the left.
+        Diagonals split a ring in two, which needs copies of the points
+        at each end, so there can be up to three times as many points
+        as went in.
+    */
+    struct TessVertex {
+        int64_t x, y;
+        uint32_t index;     // of the point it came from
+        int prev, next;
+    };
+
+    enum VertexType {
+        VT_START,       // both neighbors below, inside below it
+        VT_END,         // both neighbors above, inside above it
+        VT_SPLIT,       // both neighbors below, inside above it too
+        VT_MERGE,       // both neighbors above, inside below it too
+        VT_REGULAR      // one above and one below
+    };
+
+    // An edge the sweep is crossing, from the point numbered index to the next
+    struct SweepEdge {
+        int64_t x1, y1, x2, y2;
+        mutable int index;
+
+        // Left to right, where the sweep crosses them.  Edges in the
+        // sweep never cross, so which is left of the other can be told
+        // from which side of one the other's end points are on.
+        bool operator<(const SweepEdge &other) const
+        {
+            if (other.y1 == other.y2) {
+                if (y1 == y2) {
+                    return y1 < other.y1;
+                }
+                return leftTurn(x1, y1, x2, y2, other.x1, other.y1);
+            }
+            if (y1 == y2) {
+                return !leftTurn(other.x1, other.y1, other.x2, other.y2, x1, y1);
+            }
+            if (y1 < other.y1) {
+                return !leftTurn(other.x1, other.y1, other.x2, other.y2, x1, y1);
+            }
+            return leftTurn(x1, y1, x2, y2, other.x1, other.y1);
+        }
+    };
+
+    typedef std::set<SweepEdge> SweepSet;
+
+    struct CacheEntry {
+        const Point2D *pts;
+        int numContours;
+        uint32_t hash;
+        uint32_t *indices;
+        size_t numIndices;
+        uint32_t lastUsed;
+    };
+
+    // Whether (x3, y3) is to the left of the line from (x1, y1) to (x2, y2)
+    static bool leftTurn(int64_t x1, int64_t y1, int64_t x2, int64_t y2, int64_t x3, int64_t y3)
+    {
+        return (x2 - x1) * (y3 - y1) - (y2 - y1) * (x3 - x1) > 0;
+    }
+
+    // Whether a comes before b going down the sweep
+    static bool below(const TessVertex &a, const TessVertex &b)
+    {
+        return a.y < b.y || (a.y == b.y && a.x < b.x);
+    }
+
+    static uint32_t hashPolygon(const Point2D *pts, const int *counts, int numContours)
+    {
+        // FNV-1a, over the counts, then the points
+        uint32_t hash = 2166136261u;
+        int total = 0;
+        for (int c = 0; c < numContours; c++) {
+            hash = (hash ^ (uint32_t)counts[c]) * 16777619u;
+            total += counts[c];
+        }
+        for (int i = 0; i < total; i++) {
+            hash = (hash ^ (uint32_t)pts[i].x) * 16777619u;
+            hash = (hash ^ (uint32_t)pts[i].y) * 16777619u;
+        }
+        return hash;
+    }
+
+    // realloc(), leaving p as it was if there's no memory
+    template <typename T>
+    static bool grow(T *&p, size_t count)
+    {
+        T *grown = (T *)realloc(p, count * sizeof(T));
+        if (!grown) {
+            return false;
+        }
+        p = grown;
+        return true;
+    }
+
+    bool reserve(int points)
+    {
+        int needed = points * 3;
+        if (needed > vertCapacity) {
+            if (!grow(verts, needed) || !grow(types, needed) || !grow(helpers, needed) ||
+                !grow(order, needed) || !grow(used, needed)) {
+                return false;
+            }
+            delete [] edgeAt;
+            edgeAt = new SweepSet::iterator[needed];
+            vertCapacity = needed;
+        }
+        return true;
+    }
+
+    // The rings, without repeated points, each going the right way around
+    bool buildVertices(const Point2D *pts, const int *counts, int numContours)
+    {
+        int total = 0;
+        for (int c = 0; c < numContours; c++) {
+            total += counts[c];
+        }
+        if (!reserve(total)) {
+            return false;
+        }
+        numVerts = 0;
+
+        int start = 0;
+        for (int c = 0; c < numContours; c++) {
+            int first = numVerts;
+            for (int i = 0; i < counts[c]; i++) {
+                const Point2D &p = pts[start + i];
+                int64_t x = p.x, y = -(int64_t)p.y;
+                if (numVerts > first && verts[numVerts - 1].x == x && verts[numVerts - 1].y == y) {
+                    continue;
+                }
+                TessVertex &v = verts[numVerts++];
+                v.x = x;
+                v.y = y;
+                v.index = (uint32_t)(start + i);
+            }
+            while (numVerts - first > 1 && verts[numVerts - 1].x == verts[first].x && verts[numVerts - 1].y == verts[first].y) {
+                numVerts--;
+            }
+            start += counts[c];
+
+            int n = numVerts - first;
+            if (n < 3) {
+                if (c == 0) {
+                    return false;
+                }
+                numVerts = first;       // a hole with nothing in it
+                continue;
+            }
+
+            // twice the area, positive when counter clockwise
+            int64_t area = 0;
+            for (int i = 0; i < n; i++) {
+                const TessVertex &a = verts[first + i];
+                const TessVertex &b = verts[first + (i + 1) % n];
+                area += a.x * b.y - b.x * a.y;
+            }
+            if (area == 0) {
+                if (c == 0) {
+                    return false;
+                }
+                numVerts = first;
+                continue;
+            }
+
+            // the outline goes counter clockwise, holes clockwise
+            bool forwards = (c == 0) == (area > 0);
+            if (c == 0) {
+                outlineReversed = !forwards;
+            }
+            for (int i = 0; i < n; i++) {
+                int before = first + (i + n - 1) % n;
+                int after = first + (i + 1) % n;
+                verts[first + i].prev = forwards ? before : after;
+                verts[first + i].next = forwards ? after : before;
+            }
+        }
+
+        return true;
+    }
+
+    // Which way the outline turns at a point, and which way the sweep goes past it
+    VertexType classify(int i) const
+    {
+        const TessVertex &v = verts[i];
+        const TessVertex &prev = verts[v.prev];
+        const TessVertex &next = verts[v.next];
+        bool convex = leftTurn(prev.x, prev.y, v.x, v.y, next.x, next.y);
+
+        if (below(prev, v) && below(next, v)) {
+            return convex ? VT_START : VT_SPLIT;
+        }
+        if (below(v, prev) && below(v, next)) {
+            return convex ? VT_END : VT_MERGE;
+        }
+        return VT_REGULAR;
+    }
+
+    // Sorted from the top down
+    struct ByHeight {
+        const TessVertex *verts;
+        bool operator()(int a, int b) const
+        {
+            return below(verts[b], verts[a]);
+        }
+    };
+
+    SweepSet::iterator insertEdge(int i)
+    {
+        const TessVertex &a = verts[i];
+        const TessVertex &b = verts[a.next];
+        SweepEdge e = {a.x, a.y, b.x, b.y, i};
+        return sweep.insert(e).first;
+    }
+
+    // The edge in the sweep that's directly left of point i
+    bool edgeLeftOf(int i, SweepSet::iterator &it)
+    {
+        const TessVertex &v = verts[i];
+        SweepEdge probe = {v.x, v.y, v.x, v.y, i};
+        it = sweep.lower_bound(probe);
+        if (it == sweep.begin()) {
+            return false;
+        }
+        --it;
+        return true;
+    }
+
+    /*
+    addDiagonal()
+
+    Join points a and b, which splits the ring they're on into two, or
+    joins a hole's ring onto the outline's.  Each of them gets a copy,
+    so each ring has its own.  The copies take over the edges going
+    out of the originals, the originals go out along the diagonal.
+    */
+    void addDiagonal(int a, int b)
+    {
+        int na = numVerts++;
+        int nb = numVerts++;
+        verts[na] = verts[a];
+        verts[nb] = verts[b];
+
+        verts[nb].next = verts[b].next;
+        verts[na].next = verts[a].next;
+        verts[verts[b].next].prev = nb;
+        verts[verts[a].next].prev = na;
+        verts[a].next = nb;
+        verts[nb].prev = a;
+        verts[b].next = na;
+        verts[na].prev = b;
+
+        copyState(na, a);
+        copyState(nb, b);
+    }
+
+    void copyState(int to, int from)
+    {
+        types[to] = types[from];
+        helpers[to] = helpers[from];
+        edgeAt[to] = edgeAt[from];
+        if (edgeAt[to] != sweep.end()) {
+            edgeAt[to]->index = to;
+        }
+    }
+
+    /*
+    partition()
+
+    The sweep, adding diagonals until every piece is monotone.  Each
+    edge in the sweep has a helper, the lowest point above the sweep
+    that can see it, which is where a diagonal from below would go.
+    */
+    bool partition()
+    {
+        int original = numVerts;
+        sweep.clear();
+        for (int i = 0; i < original; i++) {
+            types[i] = (uint8_t)classify(i);
+            order[i] = i;
+            edgeAt[i] = sweep.end();
+        }
+        for (int i = original; i < vertCapacity; i++) {
+            edgeAt[i] = sweep.end();
+        }
+
+        ByHeight byHeight = {verts};
+        std::sort(order, order + original, byHeight);
+
+        for (int k = 0; k < original; k++) {
+            int i = order[k];
+            int prev = verts[i].prev;
+            SweepSet::iterator left;
+
+            switch (types[i]) {
+                case VT_START:
+                    edgeAt[i] = insertEdge(i);
+                    helpers[i] = i;
+                break;
+
+                case VT_END:
+                    if (edgeAt[prev] == sweep.end()) {
+                        return false;
+                    }
+                    if (types[helpers[prev]] == VT_MERGE) {
+                        addDiagonal(i, helpers[prev]);
+                    }
+                    sweep.erase(edgeAt[prev]);
+                    edgeAt[prev] = sweep.end();
+                break;
+
+                case VT_SPLIT:
+                {
+                    if (!edgeLeftOf(i, left)) {
+                        return false;
+                    }
+                    addDiagonal(i, helpers[left->index]);
+                    helpers[left->index] = i;
+
+                    // the copy of i carries on along i's old edge
+                    int out = numVerts - 2;
+                    edgeAt[out] = insertEdge(out);
+                    helpers[out] = out;
+                }
+                break;
+
+                case VT_MERGE:
+                {
+                    if (edgeAt[prev] == sweep.end()) {
+                        return false;
+                    }
+                    int at = i;
+                    if (types[helpers[prev]] == VT_MERGE) {
+                        addDiagonal(i, helpers[prev]);
+                        at = numVerts - 2;
+                    }
+                    sweep.erase(edgeAt[prev]);
+                    edgeAt[prev] = sweep.end();
+
+                    if (!edgeLeftOf(i, left)) {
+                        return false;
+                    }
+                    if (types[helpers[left->index]] == VT_MERGE) {
+                        addDiagonal(at, helpers[left->index]);
+                    }
+                    helpers[left->index] = at;
+                }
+                break;
+
+                case VT_REGULAR:
+                    if (below(verts[i], verts[prev])) {
+                        // going down the left side, the inside is to the right
+                        if (edgeAt[prev] == sweep.end()) {
+                            return false;
+                        }
+                        int at = i;
+                        if (types[helpers[prev]] == VT_MERGE) {
+                            addDiagonal(i, helpers[prev]);
+                            at = numVerts - 2;
+                        }
+                        sweep.erase(edgeAt[prev]);
+                        edgeAt[prev] = sweep.end();
+
+                        // below here, the point is the copy, if there is one
+                        edgeAt[at] = insertEdge(at);
+                        helpers[at] = at;
+                    } else {
+                        if (!edgeLeftOf(i, left)) {
+                            return false;
+                        }
+                        if (types[helpers[left->index]] == VT_MERGE) {
+                            addDiagonal(i, helpers[left->index]);
+                        }
+                        helpers[left->index] = i;
+                    }
+                break;
+            }
+        }
+
+        sweep.clear();
+        return true;
+    }
+
+    bool reserveChain(int count)
+    {
+        if (count > chainCapacity) {
+            if (!grow(chain, count) || !grow(side, count) || !grow(stack, count)) {
+                return false;
+            }
+            chainCapacity = count;
+        }
+        return true;
+    }
+
+    // Each ring of n points makes n - 2 triangles, so there are never
+    // more triangles than points
+    bool reserveIndices(size_t count)
+    {
+        if (count > indexCapacity) {
+            size_t capacity = indexCapacity ? indexCapacity * 2 : 256;
+            if (capacity < count) {
+                capacity = count;
+            }
+            if (!grow(indices, capacity)) {
+                return false;
+            }
+            indexCapacity = capacity;
+        }
+        return true;
+    }
+
+    // After reserveIndices()
+    void addTriangle(int a, int b, int c)
+    {
+        // counter clockwise in the flipped coordinates, so turn them
+        // back the way the outline came in
+        indices[numIndices++] = verts[a].index;
+        if (outlineReversed) {
+            indices[numIndices++] = verts[c].index;
+            indices[numIndices++] = verts[b].index;
+        } else {
+            indices[numIndices++] = verts[b].index;
+            indices[numIndices++] = verts[c].index;
+        }
+    }
+
+    // Walk each ring the diagonals made, and cut it into triangles
+    bool triangulatePieces()
+    {
+        memset(used, 0, numVerts);
+        if (!reserveChain(numVerts) || !reserveIndices((size_t)numVerts * 3)) {
+            return false;
+        }
+
+        for (int i = 0; i < numVerts; i++) {
+            if (used[i]) {
+                continue;
+            }
+
+            int n = 0;
+            int v = i;
+            do {
+                used[v] = 1;
+                chain[n++] = v;
+                v = verts[v].next;
+            } while (v != i && n < numVerts);
+
+            if (!triangulateMonotone(n)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /*
+    triangulateMonotone()
+
+    The ring of n points in chain, which goes down one side and back up
+    the other.  Merge the sides into one list from the top down, then
+    go down it, keeping a stack of points that are waiting for a
+    triangle.  A point on the other side from the stack can see all of
+    them, and fans out to them.  One on the same side cuts off
+    triangles for as long as the corner it makes is convex.
+    */
+    bool triangulateMonotone(int n)
+    {
+        if (n < 3) {
+            return true;
+        }
+        if (n == 3) {
+            addTriangle(chain[0], chain[1], chain[2]);
+            return true;
+        }
+
+        int top = 0, bottom = 0;
+        for (int i = 1; i < n; i++) {
+            if (below(verts[chain[i]], verts[chain[bottom]])) bottom = i;
+            if (below(verts[chain[top]], verts[chain[i]])) top = i;
+        }
+
+        // order[] gets the positions in chain from the top down, side[]
+        // which side each is on: 1 going down the left (the way the
+        // ring goes), -1 coming back up the right
+        int *sorted = order;
+        sorted[0] = top;
+        side[top] = 0;
+        int l = (top + 1) % n;
+        int r = (top + n - 1) % n;
+        for (int i = 1; i < n - 1; i++) {
+            bool takeLeft;
+            if (l == bottom) {
+                takeLeft = false;
+            } else if (r == bottom) {
+                takeLeft = true;
+            } else {
+                takeLeft = !below(verts[chain[l]], verts[chain[r]]);
+            }
+
+            if (takeLeft) {
+                sorted[i] = l;
+                side[l] = 1;
+                l = (l + 1) % n;
+            } else {
+                sorted[i] = r;
+                side[r] = -1;
+                r = (r + n - 1) % n;
+            }
+        }
+        sorted[n - 1] = bottom;
+        side[bottom] = 0;
+
+        int sp = 0;
+        stack[sp++] = sorted[0];
+        stack[sp++] = sorted[1];
+
+        int i;
+        for (i = 2; i < n - 1; i++) {
+            int u = sorted[i];
+            if (side[u] != side[stack[sp - 1]]) {
+                // the other side, it can see everything on the stack
+                for (int j = 0; j < sp - 1; j++) {
+                    if (side[u] == 1) {
+                        addTriangle(chain[stack[j + 1]], chain[stack[j]], chain[u]);
+                    } else {
+                        addTriangle(chain[stack[j]], chain[stack[j + 1]], chain[u]);
+                    }
+                }
+                stack[0] = sorted[i - 1];
+                stack[1] = u;
+                sp = 2;
+            } else {
+                // the same side, cut off corners while they're convex
+                sp--;
+                while (sp > 0) {
+                    const TessVertex &pu = verts[chain[u]];
+                    const TessVertex &pa = verts[chain[stack[sp - 1]]];
+                    const TessVertex &pb = verts[chain[stack[sp]]];
+                    if (side[u] == 1) {
+                        if (!leftTurn(pu.x, pu.y, pa.x, pa.y, pb.x, pb.y)) {
+                            break;
+                        }
+                        addTriangle(chain[u], chain[stack[sp - 1]], chain[stack[sp]]);
+                    } else {
+                        if (!leftTurn(pu.x, pu.y, pb.x, pb.y, pa.x, pa.y)) {
+                            break;
+                        }
+                        addTriangle(chain[u], chain[stack[sp]], chain[stack[sp - 1]]);
+                    }
+                    sp--;
+                }
+                sp++;
+                stack[sp++] = u;
+            }
+        }
+
+        // the bottom point sees whatever is left
+        int u = sorted[i];
+        for (int j = 0; j < sp - 1; j++) {
+            if (side[stack[j + 1]] == 1) {
+                addTriangle(chain[stack[j]], chain[stack[j + 1]], chain[u]);
+            } else {
+                addTriangle(chain[stack[j + 1]], chain[stack[j]], chain[u]);
+            }
+        }
+
+        return true;
+    }
+
+    // The working polygon
+    TessVertex *verts;
+    int vertCapacity;
+    int numVerts;
+    uint8_t *types;
+    int *helpers;
+    int *order;
+    uint8_t *used;
+    SweepSet::iterator *edgeAt;     // where each point's edge is in the sweep
+    SweepSet sweep;
+    bool outlineReversed;
+
+    // One monotone piece at a time
+    int *chain;
+    int8_t *side;
+    int *stack;
+    int chainCapacity;
+
+    // The answer
+    uint32_t *indices;
+    size_t numIndices, indexCapacity;
+
+    CacheEntry cache[CacheSize];
+    uint32_t clock;
+    int hits, misses;
+};
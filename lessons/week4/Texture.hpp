@@ -0,0 +1,245 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "PixelBuffer.hpp"
+
+/*
+    Texture
+
+    A copy of a PixelBuffer, kept in a form that is quick to sample
+    from when drawing textured triangles.
+
+    Texels are not stored a row at a time.  They're stored in 4x4
+    blocks, 64 bytes each, which is one cache line.  A triangle can run
+    across the texture in any direction, and going down a column of a
+    row-major image touches a new cache line for every texel.  With
+    blocks, neighbors in both directions are usually in the same line,
+    and bilinear filtering, which reads a 2x2 square, touches a
+    single block most of the time.
+
+    Along with the full size image are the mipmap levels, each half
+    the size of the one before, down to 1x1.  When a texture is drawn
+    smaller than it really is, sampling the full size image skips over
+    texels, which both shimmers and thrashes the cache.  Drawing picks
+    the level that's closest to one texel per pixel instead.
+
+    Texture coordinates are in texels of the level being sampled, as
+    16.16 fixed point.  Coordinates outside the texture wrap around, so
+    a texture can be repeated across a triangle.
+*/
+
+enum TextureFilter {
+    TEX_NEAREST,        // the texel the sample lands in
+    TEX_BILINEAR        // blend of the four nearest texels
+};
+
+class Texture
+{
+public:
+    static const int MaxLevels = 32;
+
+    Texture(const PixelBuffer &src, bool mipmaps = true)
+        : texels(nullptr), numLevels(0)
+    {
+        // work out the size of each level, and where it goes
+        int width = src.getWidth();
+        int height = src.getHeight();
+        size_t total = 0;
+
+        while (numLevels < MaxLevels)
+        {
+            Level &level = levels[numLevels];
+            level.width = width;
+            level.height = height;
+            level.blocksWide = (width + 3) / 4;
+            level.offset = total;
+            total += (size_t)level.blocksWide * ((height + 3) / 4) * 16;
+            numLevels = numLevels + 1;
+
+            if (!mipmaps || (width == 1 && height == 1)) {
+                break;
+            }
+            width = width > 1 ? width / 2 : 1;
+            height = height > 1 ? height / 2 : 1;
+        }
+
+        texels = (PixRGBA *)malloc(total * sizeof(PixRGBA));
+
+        // the full size image, a row at a time
+        PixRGBA *row = (PixRGBA *)malloc(levels[0].width * sizeof(PixRGBA));
+        if (!texels || !row) {
+            // out of memory, so the texture is empty
+            free(texels);
+            free(row);
+            texels = nullptr;
+            numLevels = 0;
+            return;
+        }
+        for (int y = 0; y < levels[0].height; y++) {
+            src.getSpan(0, y, levels[0].width, row);
+            for (int x = 0; x < levels[0].width; x++) {
+                texels[texelIndex(levels[0], x, y)] = row[x];
+            }
+        }
+        free(row);
+
+        for (int i = 1; i < numLevels; i++) {
+            buildLevel(i);
+        }
+    }
+
+    virtual ~Texture()
+    {
+        free(texels);
+    }
+
+    // 0 if the texels couldn't be allocated, and then it can't be drawn
+    int getLevelCount() const { return numLevels; }
+    int getWidth(int level = 0) const { return levels[level].width; }
+    int getHeight(int level = 0) const { return levels[level].height; }
+
+    PixRGBA getTexel(int level, int x, int y) const
+    {
+        const Level &l = levels[level];
+        return texels[texelIndex(l, wrap(x, l.width), wrap(y, l.height))];
+    }
+
+    // The texel that (u, v) lands in
+    PixRGBA sampleNearest(int level, int32_t u, int32_t v) const
+    {
+        const Level &l = levels[level];
+        int x = u >> 16;
+        int y = v >> 16;
+        if ((unsigned)x >= (unsigned)l.width) x = wrap(x, l.width);
+        if ((unsigned)y >= (unsigned)l.height) y = wrap(y, l.height);
+
+        return texels[texelIndex(l, x, y)];
+    }
+
+    // The four texels around (u, v), weighted by how close they are.
+    // Texel centers are at the halves, so (0.5, 0.5) is exactly texel 0.
+    PixRGBA sampleBilinear(int level, int32_t u, int32_t v) const
+    {
+        const Level &l = levels[level];
+        u = u - 32768;
+        v = v - 32768;
+
+        int x0 = u >> 16;
+        int y0 = v >> 16;
+        int fx = (u >> 8) & 0xff;
+        int fy = (v >> 8) & 0xff;
+
+        int x1 = x0 + 1;
+        int y1 = y0 + 1;
+        if ((unsigned)x0 >= (unsigned)l.width) x0 = wrap(x0, l.width);
+        if ((unsigned)y0 >= (unsigned)l.height) y0 = wrap(y0, l.height);
+        if ((unsigned)x1 >= (unsigned)l.width) x1 = wrap(x1, l.width);
+        if ((unsigned)y1 >= (unsigned)l.height) y1 = wrap(y1, l.height);
+
+        PixRGBA t00 = texels[texelIndex(l, x0, y0)];
+        PixRGBA t10 = texels[texelIndex(l, x1, y0)];
+        PixRGBA t01 = texels[texelIndex(l, x0, y1)];
+        PixRGBA t11 = texels[texelIndex(l, x1, y1)];
+
+        PixRGBA pix;
+        for (int c = 0; c < 4; c++) {
+            int top = t00.data[c] * 256 + (t10.data[c] - t00.data[c]) * fx;
+            int bottom = t01.data[c] * 256 + (t11.data[c] - t01.data[c]) * fx;
+            pix.data[c] = (uint8_t)((top * 256 + (bottom - top) * fy + 32768) >> 16);
+        }
+
+        return pix;
+    }
+
+    PixRGBA sample(TextureFilter filter, int level, int32_t u, int32_t v) const
+    {
+        return filter == TEX_NEAREST ? sampleNearest(level, u, v) : sampleBilinear(level, u, v);
+    }
+
+    /*
+    selectLevel()
+
+    Pick the mipmap level for a spot where moving one pixel across
+    the screen moves (dudx, dvdx) in the full size texture, and moving
+    one pixel down moves (dudy, dvdy).  Level n is right when a pixel
+    covers about 2^n texels in the direction it covers the most.
+    */
+    int selectLevel(REAL dudx, REAL dvdx, REAL dudy, REAL dvdy) const
+    {
+        REAL acrossSq = dudx * dudx + dvdx * dvdx;
+        REAL downSq = dudy * dudy + dvdy * dvdy;
+        REAL rhoSq = acrossSq > downSq ? acrossSq : downSq;
+
+        // comparing squares, so each level is 4 times the last
+        int level = 0;
+        REAL limit = 4;
+        while (level + 1 < numLevels && rhoSq >= limit) {
+            level = level + 1;
+            limit = limit * 4;
+        }
+
+        return level;
+    }
+
+private:
+    struct Level {
+        int width, height;
+        int blocksWide;     // how many 4x4 blocks across
+        size_t offset;      // where its texels start
+    };
+
+    static size_t texelIndex(const Level &level, int x, int y)
+    {
+        return level.offset + ((size_t)(y >> 2) * level.blocksWide + (x >> 2)) * 16 + ((y & 3) << 2) + (x & 3);
+    }
+
+    static int wrap(int x, int size)
+    {
+        x = x % size;
+        return x < 0 ? x + size : x;
+    }
+
+    // Each texel of a level is the average of the 2x2 texels below it.
+    // A level is half the size of the one below, rounded down, so when
+    // that one has an odd size its last row or column is left out.
+    // Once the level below is only 1 texel wide or high, that texel is
+    // used twice.
+    void buildLevel(int index)
+    {
+        const Level &src = levels[index - 1];
+        const Level &dst = levels[index];
+
+        for (int y = 0; y < dst.height; y++)
+        {
+            int sy0 = y * 2 < src.height ? y * 2 : src.height - 1;
+            int sy1 = y * 2 + 1 < src.height ? y * 2 + 1 : src.height - 1;
+
+            for (int x = 0; x < dst.width; x++)
+            {
+                int sx0 = x * 2 < src.width ? x * 2 : src.width - 1;
+                int sx1 = x * 2 + 1 < src.width ? x * 2 + 1 : src.width - 1;
+
+                PixRGBA a = texels[texelIndex(src, sx0, sy0)];
+                PixRGBA b = texels[texelIndex(src, sx1, sy0)];
+                PixRGBA c = texels[texelIndex(src, sx0, sy1)];
+                PixRGBA d = texels[texelIndex(src, sx1, sy1)];
+
+                PixRGBA pix;
+                for (int ch = 0; ch < 4; ch++) {
+                    pix.data[ch] = (uint8_t)((a.data[ch] + b.data[ch] + c.data[ch] + d.data[ch] + 2) / 4);
+                }
+                texels[texelIndex(dst, x, y)] = pix;
+            }
+        }
+    }
+
+    // Not copyable, it owns its texels
+    Texture(const Texture &other);
+    Texture & operator=(const Texture &other);
+
+    PixRGBA *texels;            // every level, one after another
+    Level levels[MaxLevels];
+    int numLevels;
+};
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "PixelBuffer.hpp"
+#include "TaskScheduler.hpp"
+#include "DisplayList.hpp"
+#include "DrawingContext.hpp"
+
+/*
+    TileRenderer
+
+    Renders a recorded DisplayList using multiple threads.
+
+    The pixel buffer is divided into square tiles.  Each drawing
+    command is placed into the bin of every tile its bounding box
+    touches, preceded by whatever state (colors, clipping) it needs,
+    so each tile sees the commands that matter to it, in their
+    original order.  Then the tiles are handed to the task scheduler,
+    and each tile's bin is replayed with the clip set to that tile's
+    rectangle.
+
+    Since tiles never overlap, and clipping only ever discards pixels,
+    the result is exactly what you'd get replaying the list on a single
+    thread with a fresh DrawingContext.
+*/
+class TileRenderer
+{
+public:
+    // tileSize - width and height of each tile, in pixels
+    // scheduler - the worker threads to render on
+    TileRenderer(int tileSize = 128, TaskScheduler &scheduler = TaskScheduler::shared())
+        : tileSize(tileSize < 8 ? 8 : tileSize),
+        scheduler(scheduler),
+        bins(nullptr),
+        binVersions(nullptr),
+        numBins(0)
+    {}
+
+    virtual ~TileRenderer()
+    {
+        delete [] bins;
+        delete [] binVersions;
+    }
+
+    int getTileSize() const { return tileSize; }
+    int getThreadCount() const { return scheduler.getWorkerCount() + 1; }
+
+    /*
+    render()
+
+    Play the list back into the pixel buffer, offset by (dx, dy).
+    */
+    bool render(const DisplayList &list, PixelBuffer &pb, int dx = 0, int dy = 0)
+    {
+        tilesWide = (pb.getWidth() + tileSize - 1) / tileSize;
+        tilesHigh = (pb.getHeight() + tileSize - 1) / tileSize;
+
+        if (tilesWide * tilesHigh == 0) {
+            return true;
+        }
+
+        binCommands(list, pb, dx, dy);
+
+        scheduler.parallelFor(0, tilesWide * tilesHigh, 1, [&](int first, int last) {
+            renderTiles(pb, first, last, dx, dy);
+        });
+
+        return true;
+    }
+
+private:
+    /*
+    binCommands()
+
+    Sort the commands of the list into per-tile bins.  State changes
+    are not copied into every bin as they happen, since most of them
+    are followed by a draw that only touches a few tiles.  Instead we
+    keep track of the current state, and bring a tile's bin up to date
+    just before a drawing command is added to it.
+    */
+    void binCommands(const DisplayList &list, PixelBuffer &pb, int dx, int dy)
+    {
+        int nTiles = tilesWide * tilesHigh;
+        if (nTiles > numBins) {
+            delete [] bins;
+            delete [] binVersions;
+            bins = new DisplayList[nTiles];
+            binVersions = new int[nTiles];
+            numBins = nTiles;
+        }
+
+        for (int i = 0; i < nTiles; i++) {
+            bins[i].reset();
+            binVersions[i] = 0;
+        }
+
+        // The latest state commands seen, or null if not seen yet
+        const int32_t *state[DL_SETCLIP+1] = {nullptr, nullptr, nullptr, nullptr};
+        const int32_t *clipCmd = nullptr;
+        int version = 0;
+
+        GRRectangle canvas(0, 0, pb.getWidth(), pb.getHeight());
+
+        const int32_t *cmd = list.getData();
+        const int32_t *end = cmd + list.size();
+
+        while (cmd < end)
+        {
+            if (cmd[0] < 0 || cmd[0] >= DL_NUMOPS) {
+                break;
+            }
+
+            GRRectangle bounds;
+            bool isState = false;
+
+            switch (cmd[0]) {
+                case DL_SETBACKGROUND:
+                case DL_SETFILL:
+                case DL_SETSTROKE:
+                    state[cmd[0]] = cmd;
+                    isState = true;
+                break;
+
+                case DL_SETCLIP:
+                case DL_CLEARCLIP:
+                    clipCmd = cmd;
+                    isState = true;
+                break;
+
+                case DL_CLEAR:
+                    bounds = canvas;
+                break;
+
+                default:
+                    DisplayList::getBounds(cmd, bounds, dx, dy);
+                    bounds = bounds.intersection(canvas);
+                break;
+            }
+
+            if (isState) {
+                version = version + 1;
+            } else if (!bounds.isEmpty()) {
+                int col1 = bounds.x / tileSize;
+                int col2 = (bounds.right() - 1) / tileSize;
+                int row1 = bounds.y / tileSize;
+                int row2 = (bounds.bottom() - 1) / tileSize;
+
+                for (int row = row1; row <= row2; row++) {
+                    for (int col = col1; col <= col2; col++) {
+                        int tile = row * tilesWide + col;
+
+                        if (binVersions[tile] != version) {
+                            for (int i = 0; i < DL_SETCLIP; i++) {
+                                if (state[i]) {
+                                    bins[tile].appendCommand(state[i]);
+                                }
+                            }
+                            if (clipCmd) {
+                                bins[tile].appendCommand(clipCmd);
+                            }
+                            binVersions[tile] = version;
+                        }
+
+                        bins[tile].appendCommand(cmd);
+                    }
+                }
+            }
+
+            cmd += DisplayList::commandSize(cmd);
+        }
+    }
+
+    // Replay the bins of tiles [first, last)
+    void renderTiles(PixelBuffer &pb, int first, int last, int dx, int dy)
+    {
+        DrawingContext dc(pb);
+
+        for (int tile = first; tile < last; tile++)
+        {
+            if (bins[tile].isEmpty()) {
+                continue;
+            }
+
+            int col = tile % tilesWide;
+            int row = tile / tilesWide;
+
+            dc.setClip(col * tileSize, row * tileSize, tileSize, tileSize);
+            dc.replay(bins[tile], dx, dy);
+        }
+    }
+
+    // Not copyable, it owns the bins
+    TileRenderer(const TileRenderer &other);
+    TileRenderer & operator=(const TileRenderer &other);
+
+    int tileSize;
+    TaskScheduler &scheduler;
+
+    int tilesWide;
+    int tilesHigh;
+
+    DisplayList *bins;      // one list of commands per tile
+    int *binVersions;       // the state each bin was last brought up to
+    int numBins;
+};
@@ -0,0 +1,391 @@
+#pragma once
+
+#include "grtypes.hpp"
+#include "grmath.hpp"
+#include "PixelBuffer.hpp"
+#include "PixelBufferRGBA32.hpp"
+#include "PixelBufferGray.hpp"
+#include "MappedFile.hpp"
+#include "TaskScheduler.hpp"
+#include "pbm.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+
+/*
+	BMP
+
+	Reads and writes Windows bitmaps, the same DIB that StretchDIBits()
+	takes, which makes it the quickest thing to hand to a viewer on
+	Windows.  An RGBA buffer is written as 32 bits a pixel, BGRA, with
+	the alpha where Windows keeps its reserved byte.  A gray buffer is
+	written as 8 bits a pixel, with a palette of 256 grays.
+
+	The headers are BITMAPFILEHEADER and BITMAPINFOHEADER, as in w32.hpp,
+	but put together a field at a time, little endian, since LONG and
+	DWORD are 64 bits on some compilers and the structs can't just be
+	written out.
+
+	Rows go in the file from the bottom of the picture to the top, and
+	each one is padded out to a multiple of 4 bytes.  They're converted
+	in big bands, a whole row at a time, across the scheduler's workers.
+
+	Reading also takes 24 bit files, files with a color palette, and
+	files stored top down.  Compressed files aren't read.
+*/
+class BMP
+{
+public:
+	// Rows are converted in bands of about this many bytes,
+	// and each band is written with a single fwrite()
+	static const size_t BandBytes = 4 * 1024 * 1024;
+
+	static const size_t FileHeaderBytes = 14;
+	static const size_t InfoHeaderBytes = 40;
+
+	/*
+	writeBMP()
+
+	Write the buffer as a bottom up BMP, 8 bits a pixel for a gray
+	buffer, 32 for anything else.  Returns false if the file can't be
+	written, or the picture is too big for a BMP, which has to fit in
+	4GB.
+	*/
+	static bool writeBMP(const char *filename, const PixelBuffer &pb)
+	{
+		bool gray = pb.getChannels() == 1;
+		size_t width = pb.getWidth();
+		size_t height = pb.getHeight();
+		size_t rowBytes = gray ? (width + 3) & ~(size_t)3 : width * 4;
+		size_t paletteBytes = gray ? 256 * 4 : 0;
+		size_t offset = FileHeaderBytes + InfoHeaderBytes + paletteBytes;
+
+		if (width == 0 || height == 0 || width > 0x7fffffff || height > 0x7fffffff
+			|| (0xffffffff - offset) / rowBytes < height)
+			return false;
+
+		uint8_t header[FileHeaderBytes + InfoHeaderBytes + 256 * 4];
+		memset(header, 0, sizeof(header));
+
+		// BITMAPFILEHEADER
+		header[0] = 'B';
+		header[1] = 'M';
+		putLittle32(header + 2, (uint32_t)(offset + rowBytes * height));
+		putLittle32(header + 10, (uint32_t)offset);
+
+		// BITMAPINFOHEADER, with a positive height, for bottom up
+		uint8_t * info = header + FileHeaderBytes;
+		putLittle32(info, (uint32_t)InfoHeaderBytes);
+		putLittle32(info + 4, (uint32_t)width);
+		putLittle32(info + 8, (uint32_t)height);
+		putLittle16(info + 12, 1);
+		putLittle16(info + 14, gray ? 8 : 32);
+		putLittle32(info + 16, 0);      // BI_RGB
+		putLittle32(info + 20, (uint32_t)(rowBytes * height));
+		putLittle32(info + 24, 2835);   // 72 dpi
+		putLittle32(info + 28, 2835);
+		putLittle32(info + 32, gray ? 256 : 0);
+
+		// RGBQUADs, all gray
+		if (gray)
+		{
+			uint8_t * palette = info + InfoHeaderBytes;
+			for (int i = 0; i < 256; i++)
+				palette[i * 4] = palette[i * 4 + 1] = palette[i * 4 + 2] = (uint8_t)i;
+		}
+
+		FILE * fp = fopen(filename, "wb");
+		if (!fp)
+			return false;
+		setvbuf(fp, NULL, _IONBF, 0);
+
+		size_t bandRows = BandBytes / rowBytes;
+		if (bandRows < 1)
+			bandRows = 1;
+		if (bandRows > height)
+			bandRows = height;
+
+		// calloc(), so the padding on the end of gray rows is zeros
+		uint8_t * band = (uint8_t *)calloc(bandRows, rowBytes);
+		bool ok = band && fwrite(header, 1, offset, fp) == offset;
+
+		TaskScheduler &scheduler = TaskScheduler::shared();
+		for (size_t fileRow = 0; fileRow < height && ok; fileRow += bandRows)
+		{
+			int nRows = (int)(height - fileRow);
+			if (nRows > (int)bandRows)
+				nRows = (int)bandRows;
+
+			scheduler.parallelFor(0, nRows, scheduler.rowGrain(nRows), [&](int first, int last) {
+				for (int i = first; i < last; i++)
+				{
+					// the first row in the file is the bottom of the picture
+					GRCOORD y = (GRCOORD)(height - 1 - (fileRow + i));
+					uint8_t * dst = band + i * rowBytes;
+					if (gray)
+					{
+						pb.getGraySpan(0, y, (GRSIZE)width, dst);
+					}
+					else
+					{
+						pb.getSpan(0, y, (GRSIZE)width, (PixRGBA *)dst);
+						swapRB(dst, dst, width);
+					}
+				}
+			});
+
+			size_t bytes = rowBytes * nRows;
+			ok = fwrite(band, 1, bytes, fp) == bytes;
+		}
+
+		free(band);
+		if (fclose(fp) != 0)
+			ok = false;
+
+		return ok;
+	}
+
+	/*
+	readBMP()
+
+	Read a BMP into a new buffer.  8 bit files with a palette of grays
+	go into a gray buffer, everything else into RGBA.  Returns NULL if
+	the file can't be read, or isn't a kind of BMP that's handled, or
+	memory runs out.  The caller deletes the buffer.
+
+	The fourth byte of a 32 bit pixel is only alpha if something in the
+	file says it is.  Without BI_BITFIELDS and an alpha mask, it's taken
+	as alpha unless it's zero everywhere, which is how most programs
+	leave the reserved byte, and then the picture is opaque.
+	*/
+	static PixelBuffer * readBMP(const char *filename)
+	{
+		MappedFile file;
+		if (!file.open(filename))
+			return NULL;
+
+		const uint8_t * data = file.getData();
+		size_t size = file.getSize();
+		if (size < FileHeaderBytes + InfoHeaderBytes || data[0] != 'B' || data[1] != 'M')
+			return NULL;
+
+		size_t offset = getLittle32(data + 10);
+		const uint8_t * info = data + FileHeaderBytes;
+		size_t infoBytes = getLittle32(info);
+		int32_t fileWidth = (int32_t)getLittle32(info + 4);
+		int32_t fileHeight = (int32_t)getLittle32(info + 8);
+		int bits = getLittle16(info + 14);
+		uint32_t compression = getLittle32(info + 16);
+		size_t colors = getLittle32(info + 32);
+
+		// a negative height is a top down file
+		if (infoBytes < InfoHeaderBytes || infoBytes > size - FileHeaderBytes
+			|| fileWidth <= 0 || fileHeight == 0 || fileHeight == INT32_MIN)
+			return NULL;
+		bool topDown = fileHeight < 0;
+		size_t width = (size_t)fileWidth;
+		size_t height = (size_t)(topDown ? -fileHeight : fileHeight);
+
+		// every pixel has to have a coordinate
+		if ((size_t)(GRCOORD)(width - 1) != width - 1 || (size_t)(GRCOORD)(height - 1) != height - 1)
+			return NULL;
+
+		// What's in the fourth byte of a 32 bit pixel
+		enum { AlphaNone, AlphaMaybe, AlphaYes } alpha = AlphaNone;
+		if (bits == 32 && compression == 0)
+		{
+			alpha = AlphaMaybe;
+		}
+		else if (bits == 32 && compression == 3)
+		{
+			// the masks follow a BITMAPINFOHEADER, and are the end of
+			// the bigger headers, so they're in the same place
+			const uint8_t * masks = info + InfoHeaderBytes;
+			if (masks + 12 > data + size || getLittle32(masks) != 0x00ff0000
+				|| getLittle32(masks + 4) != 0x0000ff00 || getLittle32(masks + 8) != 0x000000ff)
+				return NULL;
+			if (infoBytes >= InfoHeaderBytes + 16 && getLittle32(masks + 12) == 0xff000000)
+				alpha = AlphaYes;
+		}
+		else if (compression != 0 || (bits != 24 && bits != 8))
+		{
+			return NULL;
+		}
+
+		// The palette, for 8 bit files
+		PixRGBA palette[256];
+		uint8_t grays[256];
+		bool gray = false;
+		bool straight = false;
+		if (bits == 8)
+		{
+			if (colors == 0)
+				colors = 256;
+			const uint8_t * quads = info + infoBytes;
+			if (colors > 256 || (size_t)(quads - data) + colors * 4 > size)
+				return NULL;
+
+			gray = true;
+			straight = true;
+			for (size_t i = 0; i < 256; i++)
+			{
+				// anything past the end of the palette is black
+				palette[i].intValue = 0;
+				if (i < colors)
+				{
+					palette[i].b = quads[i * 4];
+					palette[i].g = quads[i * 4 + 1];
+					palette[i].r = quads[i * 4 + 2];
+				}
+				palette[i].a = 255;
+				grays[i] = palette[i].r;
+				gray = gray && palette[i].r == palette[i].g && palette[i].r == palette[i].b;
+				straight = straight && grays[i] == i;
+			}
+		}
+
+		size_t rowBytes = (width * bits / 8 + 3) & ~(size_t)3;
+		if (offset > size || (size - offset) / rowBytes < height)
+			return NULL;
+		const uint8_t * pixels = data + offset;
+
+		// Zero everywhere, and it's not alpha
+		if (alpha == AlphaMaybe)
+		{
+			alpha = AlphaNone;
+			for (size_t y = 0; y < height && alpha == AlphaNone; y++)
+			{
+				const uint8_t * src = pixels + y * rowBytes;
+				for (size_t x = 0; x < width; x++)
+				{
+					if (src[x * 4 + 3])
+					{
+						alpha = AlphaYes;
+						break;
+					}
+				}
+			}
+		}
+
+		PixelBuffer * pb;
+		if (gray)
+			pb = new PixelBufferGray((GRSIZE)width, (GRSIZE)height);
+		else
+			pb = new PixelBufferRGBA32((GRSIZE)width, (GRSIZE)height);
+
+		TaskScheduler &scheduler = TaskScheduler::shared();
+		std::atomic<bool> failed(false);
+		scheduler.parallelFor(0, (int)height, scheduler.rowGrain((int)height), [&](int first, int last) {
+			uint8_t * grayRow = gray ? (uint8_t *)malloc(width) : NULL;
+			PixRGBA * row = gray ? NULL : (PixRGBA *)malloc(width * sizeof(PixRGBA));
+			if (gray ? !grayRow : !row)
+			{
+				failed = true;
+				return;
+			}
+
+			for (int y = first; y < last; y++)
+			{
+				const uint8_t * src = pixels + (topDown ? y : height - 1 - y) * rowBytes;
+				if (gray && straight)
+				{
+					pb->setGraySpan(0, (GRCOORD)y, (GRSIZE)width, src);
+					continue;
+				}
+
+				if (gray)
+				{
+					for (size_t x = 0; x < width; x++)
+						grayRow[x] = grays[src[x]];
+					pb->setGraySpan(0, (GRCOORD)y, (GRSIZE)width, grayRow);
+					continue;
+				}
+
+				if (bits == 8)
+				{
+					for (size_t x = 0; x < width; x++)
+						row[x] = palette[src[x]];
+				}
+				else if (bits == 24)
+				{
+					PBMFile::unpackRGB(src, row, width);
+					swapRB((uint8_t *)row, (uint8_t *)row, width);
+				}
+				else
+				{
+					swapRB(src, (uint8_t *)row, width);
+					if (alpha == AlphaNone)
+					{
+						for (size_t x = 0; x < width; x++)
+							row[x].a = 255;
+					}
+				}
+				pb->setSpan(0, (GRCOORD)y, (GRSIZE)width, row);
+			}
+
+			free(grayRow);
+			free(row);
+		});
+
+		if (failed)
+		{
+			delete pb;
+			return NULL;
+		}
+		return pb;
+	}
+
+	// Swap the first and third bytes of each 4 byte pixel, which turns
+	// RGBA to BGRA and back again.  src and dst can be the same, and
+	// don't have to be aligned.
+	static void swapRB(const uint8_t * src, uint8_t * dst, size_t count)
+	{
+		size_t i = 0;
+#ifdef GR_USE_SSE2
+		const __m128i ga = _mm_set1_epi32((int)0xff00ff00);
+		const __m128i low = _mm_set1_epi32(0xff);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i p = _mm_loadu_si128((const __m128i *)(src + i * 4));
+			__m128i r = _mm_slli_epi32(_mm_and_si128(p, low), 16);
+			__m128i b = _mm_and_si128(_mm_srli_epi32(p, 16), low);
+			_mm_storeu_si128((__m128i *)(dst + i * 4), _mm_or_si128(_mm_and_si128(p, ga), _mm_or_si128(r, b)));
+		}
+#endif
+		for (; i < count; i++)
+		{
+			uint32_t p;
+			memcpy(&p, src + i * 4, 4);
+			p = (p & 0xff00ff00) | ((p >> 16) & 0xff) | ((p & 0xff) << 16);
+			memcpy(dst + i * 4, &p, 4);
+		}
+	}
+
+private:
+	static void putLittle16(uint8_t * out, uint16_t value)
+	{
+		out[0] = (uint8_t)value;
+		out[1] = (uint8_t)(value >> 8);
+	}
+
+	static void putLittle32(uint8_t * out, uint32_t value)
+	{
+		out[0] = (uint8_t)value;
+		out[1] = (uint8_t)(value >> 8);
+		out[2] = (uint8_t)(value >> 16);
+		out[3] = (uint8_t)(value >> 24);
+	}
+
+	static uint16_t getLittle16(const uint8_t * in)
+	{
+		return (uint16_t)(in[0] | (in[1] << 8));
+	}
+
+	static uint32_t getLittle32(const uint8_t * in)
+	{
+		return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+	}
+};
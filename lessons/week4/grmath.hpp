@@ -0,0 +1,323 @@
+#pragma once
+
+#include <math.h>
+
+#include "grtypes.hpp"
+
+/*
+    Vectors and matrices for 3D work.
+
+    Matrices are 4x4, stored row major, and vectors are columns,
+    so a point is transformed with  m * v, and transforms combine
+    right to left:  projection * view * model.
+*/
+
+struct Vec3 {
+    REAL x, y, z;
+
+    Vec3() : x(0), y(0), z(0) {}
+    Vec3(REAL ax, REAL ay, REAL az) : x(ax), y(ay), z(az) {}
+
+    Vec3 operator + (const Vec3 &b) const { return Vec3(x + b.x, y + b.y, z + b.z); }
+    Vec3 operator - (const Vec3 &b) const { return Vec3(x - b.x, y - b.y, z - b.z); }
+    Vec3 operator * (REAL s) const { return Vec3(x * s, y * s, z * s); }
+    Vec3 operator - () const { return Vec3(-x, -y, -z); }
+
+    REAL dot(const Vec3 &b) const { return x * b.x + y * b.y + z * b.z; }
+    Vec3 cross(const Vec3 &b) const { return Vec3(y * b.z - z * b.y, z * b.x - x * b.z, x * b.y - y * b.x); }
+    REAL length() const { return sqrtf(dot(*this)); }
+
+    Vec3 normalized() const
+    {
+        REAL len = length();
+        return len > 0 ? (*this) * (1 / len) : *this;
+    }
+};
+
+struct Vec4 {
+    REAL x, y, z, w;
+
+    Vec4() : x(0), y(0), z(0), w(0) {}
+    Vec4(REAL ax, REAL ay, REAL az, REAL aw) : x(ax), y(ay), z(az), w(aw) {}
+    Vec4(const Vec3 &v, REAL aw) : x(v.x), y(v.y), z(v.z), w(aw) {}
+
+    Vec4 operator + (const Vec4 &b) const { return Vec4(x + b.x, y + b.y, z + b.z, w + b.w); }
+    Vec4 operator - (const Vec4 &b) const { return Vec4(x - b.x, y - b.y, z - b.z, w - b.w); }
+    Vec4 operator * (REAL s) const { return Vec4(x * s, y * s, z * s, w * s); }
+
+    REAL dot(const Vec4 &b) const { return x * b.x + y * b.y + z * b.z + w * b.w; }
+};
+
+struct Mat4 {
+    REAL m[4][4];
+
+    // identity by default
+    Mat4()
+    {
+        for (int row = 0; row < 4; row++) {
+            for (int col = 0; col < 4; col++) {
+                m[row][col] = (row == col) ? 1.0f : 0.0f;
+            }
+        }
+    }
+
+    Mat4 operator * (const Mat4 &b) const
+    {
+        Mat4 r;
+        for (int row = 0; row < 4; row++) {
+            for (int col = 0; col < 4; col++) {
+                r.m[row][col] = m[row][0] * b.m[0][col] + m[row][1] * b.m[1][col] +
+                    m[row][2] * b.m[2][col] + m[row][3] * b.m[3][col];
+            }
+        }
+        return r;
+    }
+
+    Vec4 operator * (const Vec4 &v) const
+    {
+        return Vec4(
+            m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z + m[0][3] * v.w,
+            m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z + m[1][3] * v.w,
+            m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z + m[2][3] * v.w,
+            m[3][0] * v.x + m[3][1] * v.y + m[3][2] * v.z + m[3][3] * v.w);
+    }
+
+    // Transform a point (w = 1)
+    Vec4 transform(const Vec3 &p) const { return (*this) * Vec4(p, 1); }
+
+    static Mat4 translation(REAL tx, REAL ty, REAL tz)
+    {
+        Mat4 r;
+        r.m[0][3] = tx;
+        r.m[1][3] = ty;
+        r.m[2][3] = tz;
+        return r;
+    }
+
+    static Mat4 scaling(REAL sx, REAL sy, REAL sz)
+    {
+        Mat4 r;
+        r.m[0][0] = sx;
+        r.m[1][1] = sy;
+        r.m[2][2] = sz;
+        return r;
+    }
+
+    // Rotations, angles in radians
+    static Mat4 rotationX(REAL angle)
+    {
+        Mat4 r;
+        REAL c = cosf(angle), s = sinf(angle);
+        r.m[1][1] = c; r.m[1][2] = -s;
+        r.m[2][1] = s; r.m[2][2] = c;
+        return r;
+    }
+
+    static Mat4 rotationY(REAL angle)
+    {
+        Mat4 r;
+        REAL c = cosf(angle), s = sinf(angle);
+        r.m[0][0] = c; r.m[0][2] = s;
+        r.m[2][0] = -s; r.m[2][2] = c;
+        return r;
+    }
+
+    static Mat4 rotationZ(REAL angle)
+    {
+        Mat4 r;
+        REAL c = cosf(angle), s = sinf(angle);
+        r.m[0][0] = c; r.m[0][1] = -s;
+        r.m[1][0] = s; r.m[1][1] = c;
+        return r;
+    }
+
+    /*
+    perspective()
+
+    The usual OpenGL style projection.  Looking down -z, with the
+    near and far planes ending up at z = -1 and z = 1 after the
+    divide by w.  fovy is the vertical field of view, in radians.
+    */
+    static Mat4 perspective(REAL fovy, REAL aspect, REAL znear, REAL zfar)
+    {
+        Mat4 r;
+        REAL f = 1.0f / tanf(fovy / 2);
+
+        r.m[0][0] = f / aspect;
+        r.m[1][1] = f;
+        r.m[2][2] = (zfar + znear) / (znear - zfar);
+        r.m[2][3] = (2 * zfar * znear) / (znear - zfar);
+        r.m[3][2] = -1;
+        r.m[3][3] = 0;
+        return r;
+    }
+
+    // A camera at eye, looking at target
+    static Mat4 lookAt(const Vec3 &eye, const Vec3 &target, const Vec3 &up)
+    {
+        Vec3 f = (target - eye).normalized();
+        Vec3 s = f.cross(up).normalized();
+        Vec3 u = s.cross(f);
+
+        Mat4 r;
+        r.m[0][0] = s.x;  r.m[0][1] = s.y;  r.m[0][2] = s.z;  r.m[0][3] = -s.dot(eye);
+        r.m[1][0] = u.x;  r.m[1][1] = u.y;  r.m[1][2] = u.z;  r.m[1][3] = -u.dot(eye);
+        r.m[2][0] = -f.x; r.m[2][1] = -f.y; r.m[2][2] = -f.z; r.m[2][3] = f.dot(eye);
+        return r;
+    }
+};
+
+/*
+    Mat2D
+
+    A 2D affine transform: a 3x3 matrix whose bottom row is always
+    0 0 1, so only the top two rows are kept.  Like Mat4, vectors are
+    columns, so a point goes to
+
+        x' = m[0][0]*x + m[0][1]*y + m[0][2]
+        y' = m[1][0]*x + m[1][1]*y + m[1][2]
+
+    and transforms combine right to left.
+*/
+struct Mat2D {
+    REAL m[2][3];
+
+    // identity by default
+    Mat2D()
+    {
+        m[0][0] = 1; m[0][1] = 0; m[0][2] = 0;
+        m[1][0] = 0; m[1][1] = 1; m[1][2] = 0;
+    }
+
+    Mat2D operator * (const Mat2D &b) const
+    {
+        Mat2D r;
+        for (int row = 0; row < 2; row++) {
+            r.m[row][0] = m[row][0] * b.m[0][0] + m[row][1] * b.m[1][0];
+            r.m[row][1] = m[row][0] * b.m[0][1] + m[row][1] * b.m[1][1];
+            r.m[row][2] = m[row][0] * b.m[0][2] + m[row][1] * b.m[1][2] + m[row][2];
+        }
+        return r;
+    }
+
+    REAL mapX(REAL x, REAL y) const { return m[0][0] * x + m[0][1] * y + m[0][2]; }
+    REAL mapY(REAL x, REAL y) const { return m[1][0] * x + m[1][1] * y + m[1][2]; }
+
+    // The point, in fixed point
+    PointFx map(REAL x, REAL y) const { return PointFx(fixedFromReal(mapX(x, y)), fixedFromReal(mapY(x, y))); }
+
+    // True when this does nothing but move things by whole pixels
+    bool isIntegerTranslation() const
+    {
+        return m[0][0] == 1 && m[0][1] == 0 && m[1][0] == 0 && m[1][1] == 1 &&
+            m[0][2] == floorf(m[0][2]) && m[1][2] == floorf(m[1][2]) &&
+            fabsf(m[0][2]) < 0x1000000 && fabsf(m[1][2]) < 0x1000000;
+    }
+
+    // How much lengths grow, at most, in any direction
+    REAL maxScale() const
+    {
+        REAL sx = sqrtf(m[0][0] * m[0][0] + m[1][0] * m[1][0]);
+        REAL sy = sqrtf(m[0][1] * m[0][1] + m[1][1] * m[1][1]);
+        return sx > sy ? sx : sy;
+    }
+
+    static Mat2D translation(REAL tx, REAL ty)
+    {
+        Mat2D r;
+        r.m[0][2] = tx;
+        r.m[1][2] = ty;
+        return r;
+    }
+
+    static Mat2D scaling(REAL sx, REAL sy)
+    {
+        Mat2D r;
+        r.m[0][0] = sx;
+        r.m[1][1] = sy;
+        return r;
+    }
+
+    // Angle in radians.  With y going down the screen, positive
+    // angles turn clockwise.
+    static Mat2D rotation(REAL angle)
+    {
+        Mat2D r;
+        REAL c = cosf(angle), s = sinf(angle);
+        r.m[0][0] = c; r.m[0][1] = -s;
+        r.m[1][0] = s; r.m[1][1] = c;
+        return r;
+    }
+};
+
+/*
+    transformPoints()
+
+    Transform a whole array of points at once, into fixed point, since
+    the results are generally between pixels, and can be negative.  Each
+    result is rounded to the nearest 1/256, with halves rounding up.
+
+    With SSE2, two points go through at a time: both x and y of both
+    points in one register, so a point is two multiplies and two adds
+    for the pair, then a convert back to integers.  Otherwise it's the
+    same arithmetic a point at a time, with the same results.
+*/
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GR_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+inline void transformPointsScalar(const Mat2D &mat, const Point2D *src, PointFx *dst, size_t count)
+{
+    // the matrix scaled up to fixed point, once
+    REAL a = mat.m[0][0] * GRFIXED_ONE, b = mat.m[0][1] * GRFIXED_ONE, c = mat.m[0][2] * GRFIXED_ONE;
+    REAL d = mat.m[1][0] * GRFIXED_ONE, e = mat.m[1][1] * GRFIXED_ONE, f = mat.m[1][2] * GRFIXED_ONE;
+
+    for (size_t i = 0; i < count; i++) {
+        REAL x = (REAL)src[i].x;
+        REAL y = (REAL)src[i].y;
+        dst[i].x = (GRFIXED)floorf(a * x + b * y + c + 0.5f);
+        dst[i].y = (GRFIXED)floorf(d * x + e * y + f + 0.5f);
+    }
+}
+
+inline void transformPoints(const Mat2D &mat, const Point2D *src, PointFx *dst, size_t count)
+{
+#ifdef GR_USE_SSE2
+    // lanes are x0 y0 x1 y1, so the matrix columns are laid out to match
+    const __m128 colX = _mm_setr_ps(mat.m[0][0] * GRFIXED_ONE, mat.m[1][0] * GRFIXED_ONE,
+        mat.m[0][0] * GRFIXED_ONE, mat.m[1][0] * GRFIXED_ONE);
+    const __m128 colY = _mm_setr_ps(mat.m[0][1] * GRFIXED_ONE, mat.m[1][1] * GRFIXED_ONE,
+        mat.m[0][1] * GRFIXED_ONE, mat.m[1][1] * GRFIXED_ONE);
+    const __m128 offset = _mm_setr_ps(mat.m[0][2] * GRFIXED_ONE, mat.m[1][2] * GRFIXED_ONE,
+        mat.m[0][2] * GRFIXED_ONE, mat.m[1][2] * GRFIXED_ONE);
+    const __m128 half = _mm_set1_ps(0.5f);
+
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+#ifdef GR_LARGE_CANVAS
+        __m128i pts = _mm_loadu_si128((const __m128i *)&src[i]);
+#else
+        __m128i pts = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)&src[i]), _mm_setzero_si128());
+#endif
+        __m128 v = _mm_cvtepi32_ps(pts);
+        __m128 xs = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 0, 0));
+        __m128 ys = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 1, 1));
+
+        // the same order of operations as the scalar version
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(colX, xs), _mm_mul_ps(colY, ys)), offset), half);
+
+        // floor: truncate, then take one off where that went up
+        __m128i t = _mm_cvttps_epi32(r);
+        __m128i wentUp = _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(t), r));
+        t = _mm_add_epi32(t, wentUp);
+
+        _mm_storeu_si128((__m128i *)&dst[i], t);
+    }
+
+    transformPointsScalar(mat, src + i, dst + i, count - i);
+#else
+    transformPointsScalar(mat, src, dst, count);
+#endif
+}
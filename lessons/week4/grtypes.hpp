@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 
 #if BUILD_AS_DLL
   #define GPROC_API		__declspec(dllexport)
@@ -26,8 +27,73 @@ typedef double	float64;
 typedef float32 REAL;
 typedef float coord;
 
+/*
+  Sizes and coordinates
+
+  Normally coordinates are 16 bits, and sizes 32 bits, which is
+  plenty for anything that goes on a screen.  Defining GR_LARGE_CANVAS
+  before including anything makes coordinates signed 32 bits, and
+  sizes 64 bits, for canvases bigger than 65535 pixels across, such
+  as for print.  Either way, where a pixel is in a buffer (its offset)
+  is a GROFFSET, since width * height is past 32 bits long before
+  either the width or height is.
+*/
+#ifdef GR_LARGE_CANVAS
+typedef uint64_t GRSIZE;
+typedef int32_t GRCOORD;
+#else
 typedef uint32_t GRSIZE;
 typedef uint16_t GRCOORD;
+#endif
+
+typedef size_t GROFFSET;
+
+/*
+  GRFIXED
+
+  A signed coordinate in 24.8 fixed point.  The top 24 bits are
+  whole pixels, and the bottom 8 bits are 256ths of a pixel, so
+  things can be placed between pixels, and can be off the left
+  or top of the canvas.
+
+  A whole number is the center of that pixel, just as with the
+  integer coordinates, so 10 and fixedFromInt(10) are the same place.
+*/
+typedef int32_t GRFIXED;
+
+#define GRFIXED_SHIFT   8
+#define GRFIXED_ONE     (1 << GRFIXED_SHIFT)
+#define GRFIXED_HALF    (1 << (GRFIXED_SHIFT - 1))
+
+inline GRFIXED fixedFromInt(int v) { return v * GRFIXED_ONE; }
+inline GRFIXED fixedFromReal(REAL v) { return (GRFIXED)(v * GRFIXED_ONE + (v < 0 ? -0.5f : 0.5f)); }
+inline REAL fixedToReal(GRFIXED v) { return (REAL)v / GRFIXED_ONE; }
+
+// The pixel a coordinate is in, and the first pixel whose
+// center is at or after it.  Both round towards negative infinity,
+// so they work the same on either side of the origin.
+inline int fixedRound(GRFIXED v) { return (int)(((int64_t)v + GRFIXED_HALF) >> GRFIXED_SHIFT); }
+inline int fixedCeil(GRFIXED v) { return (int)(((int64_t)v + GRFIXED_ONE - 1) >> GRFIXED_SHIFT); }
+
+// A point with fixed point coordinates
+struct PointFx {
+    GRFIXED x, y;
+
+    PointFx() : x(0), y(0) {}
+    PointFx(GRFIXED ax, GRFIXED ay) : x(ax), y(ay) {}
+
+    static PointFx fromInt(int ax, int ay) { return PointFx(fixedFromInt(ax), fixedFromInt(ay)); }
+    static PointFx fromReal(REAL ax, REAL ay) { return PointFx(fixedFromReal(ax), fixedFromReal(ay)); }
+};
+
+// Which parts of a shape that crosses over itself are inside.
+// Non-zero is inside wherever the outline winds around more one
+// way than the other, even-odd is inside where it crosses an odd
+// number of times, which leaves holes in overlaps.
+enum GRFillRule {
+    GR_NONZERO,
+    GR_EVENODD
+};
 
 // Declaration of 2D Point structure
 // This is convenient when representing multiple
@@ -58,6 +124,60 @@ struct Point2D {
     Point2D operator - () {return Point2D(-x, -y);}
 };
 
+/*
+  GRRectangle
+
+  A rectangle in signed integer coordinates.  Used for clipping
+  and for the bounds of drawing operations, where it's perfectly
+  reasonable for something to be partially left of, or above, the
+  origin.  The right and bottom edges are exclusive.
+*/
+struct GRRectangle {
+    int x, y;
+    int width, height;
+
+    GRRectangle() : x(0), y(0), width(0), height(0) {}
+    GRRectangle(int ax, int ay, int awidth, int aheight)
+      : x(ax), y(ay), width(awidth), height(aheight) {}
+
+    int right() const { return x + width; }
+    int bottom() const { return y + height; }
+    bool isEmpty() const { return width <= 0 || height <= 0; }
+
+    bool intersects(const GRRectangle &b) const
+    {
+        return x < b.right() && b.x < right() && y < b.bottom() && b.y < bottom();
+    }
+
+    // The overlapping area of two rectangles, which might be empty
+    GRRectangle intersection(const GRRectangle &b) const
+    {
+        int left = x > b.x ? x : b.x;
+        int top = y > b.y ? y : b.y;
+        int r = right() < b.right() ? right() : b.right();
+        int btm = bottom() < b.bottom() ? bottom() : b.bottom();
+
+        if (r <= left || btm <= top) {
+            return GRRectangle(left, top, 0, 0);
+        }
+
+        return GRRectangle(left, top, r - left, btm - top);
+    }
+};
+
+
+/*
+  GRSpan
+
+  A horizontal run of a single color.  Drawing routines that
+  produce lots of these hand them to the PixelBuffer in batches,
+  so it's one call per batch, rather than one call per pixel.
+*/
+struct GRSpan {
+    int x, y;
+    int width;
+    PixRGBA color;
+};
 
 
 /*
@@ -104,6 +224,69 @@ struct GRTriangle  {
     }
 } ;
 
+/*
+  GRColorTriangle
+
+  A triangle with a color at each vertex, for smooth (Gouraud)
+  shading, where the colors are blended across the face.  Like
+  GRTriangle, the vertices are sorted from top to bottom, and each
+  color travels along with its vertex.
+*/
+struct GRColorTriangle {
+    Point2D verts[3];
+    PixRGBA colors[3];
+
+    GRColorTriangle(GRCOORD x1, GRCOORD y1, const PixRGBA c1,
+      GRCOORD x2, GRCOORD y2, const PixRGBA c2,
+      GRCOORD x3, GRCOORD y3, const PixRGBA c3)
+    {
+      verts[0] = {x1, y1};
+      verts[1] = {x2, y2};
+      verts[2] = {x3, y3};
+      colors[0] = c1;
+      colors[1] = c2;
+      colors[2] = c3;
+
+      // the same 3 element bubble sort as GRTriangle
+      if (verts[0].y > verts[1].y) swapVertex(0, 1);
+      if (verts[1].y > verts[2].y) swapVertex(1, 2);
+      if (verts[0].y > verts[1].y) swapVertex(0, 1);
+    }
+
+    void swapVertex(int i, int j)
+    {
+      Point2D pt = verts[i];
+      verts[i] = verts[j];
+      verts[j] = pt;
+
+      PixRGBA pix = colors[i];
+      colors[i] = colors[j];
+      colors[j] = pix;
+    }
+};
+
+/*
+  GRTexVertex
+
+  A corner of a textured triangle.  u and v say where in the texture
+  the corner is, with 0 to 1 going across (or down) the whole texture.
+  Beyond that it repeats.
+
+  w is the depth of the corner, as in the w of a 3D point after
+  projection.  It only matters for perspective correct texturing,
+  where it makes the texture shrink into the distance properly.  Use
+  1 for all three corners when there's no depth.
+*/
+struct GRTexVertex {
+    GRCOORD x, y;
+    REAL u, v;
+    REAL w;
+
+    GRTexVertex() : x(0), y(0), u(0), v(0), w(1) {}
+    GRTexVertex(GRCOORD ax, GRCOORD ay, REAL au, REAL av, REAL aw = 1)
+      : x(ax), y(ay), u(au), v(av), w(aw) {}
+};
+
 // Some useful routines
 // returns the sign of the value
 // value  < 0 --> -1
@@ -3,9 +3,15 @@
 
 #include "grtypes.hpp"
 #include "PixelBuffer.hpp"
+#include "PixelBufferRGBA32.hpp"
+#include "PixelBufferGray.hpp"
+#include "MappedFile.hpp"
+#include "TaskScheduler.hpp"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <atomic>
 
 
 /*
@@ -45,27 +51,919 @@ int write_PPM_ascii(const char *filename, PixelBuffer *fb)
 class PBM
 {
 public:
+	// Rows are converted in bands of about this many bytes,
+	// and each band is written with a single fwrite()
+	static const size_t BandBytes = 4 * 1024 * 1024;
+
+	// Bands start on a cache line
+	static const size_t BandAlign = 64;
+
+	/*
+	writePPMBinary()
+
+	Write the buffer as a binary PPM (P6), 3 bytes a pixel, whatever
+	kind of buffer it is.
+	*/
 	static bool writePPMBinary(const char *filename, const PixelBuffer &pb)
+	{
+		char header[128];
+		int headerBytes = formatHeader(header, sizeof(header), '6', pb.getWidth(), pb.getHeight(), 3);
+
+		return writeBands(filename, pb, header, headerBytes, 3);
+	}
+
+	/*
+	writePGMBinary()
+
+	Write the buffer as a binary PGM (P5), a byte a pixel.  A gray
+	buffer's rows are copied out as they are, anything else is
+	turned to gray.
+	*/
+	static bool writePGMBinary(const char *filename, const PixelBuffer &pb)
+	{
+		char header[128];
+		int headerBytes = formatHeader(header, sizeof(header), '5', pb.getWidth(), pb.getHeight(), 1);
+
+		return writeBands(filename, pb, header, headerBytes, 1);
+	}
+
+	/*
+	writePAM()
+
+	Write the buffer as a PAM (P7), which keeps the alpha.  A gray
+	buffer is written as GRAYSCALE, a byte a pixel, and anything else
+	as RGB_ALPHA, which is exactly how PixRGBA is laid out, so the rows
+	go out without any converting.
+	*/
+	static bool writePAM(const char *filename, const PixelBuffer &pb)
+	{
+		int pixelBytes = pb.getChannels() == 1 ? 1 : 4;
+		char header[128];
+		int headerBytes = formatHeader(header, sizeof(header), '7', pb.getWidth(), pb.getHeight(), pixelBytes);
+
+		return writeBands(filename, pb, header, headerBytes, pixelBytes);
+	}
+
+	/*
+	readImage()
+
+	Read a P2, P3, P5, P6 or P7 file into a new buffer, a gray one for
+	gray files, and RGBA for the rest.  Returns NULL if the file can't
+	be read.  The caller deletes the buffer.
+	*/
+	static PixelBuffer * readImage(const char *filename);
+
+	/*
+	writeImage()
+
+	Write the buffer in whichever format fits it best:  P5 for a gray
+	buffer, a third the size of a PPM, and P7 with alpha for the rest.
+	*/
+	static bool writeImage(const char *filename, const PixelBuffer &pb)
+	{
+		if (pb.getChannels() == 1)
+			return writePGMBinary(filename, pb);
+
+		return writePAM(filename, pb);
+	}
+
+	// Pack RGBA pixels down to RGB.  Four pixels at a time go in three
+	// 32 bit words, with red in the low byte of intValue, as on x86.
+	static void packRGB(const PixRGBA * src, uint8_t * dst, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			uint32_t p0 = src[i].intValue & 0xffffff;
+			uint32_t p1 = src[i + 1].intValue & 0xffffff;
+			uint32_t p2 = src[i + 2].intValue & 0xffffff;
+			uint32_t p3 = src[i + 3].intValue & 0xffffff;
+			uint32_t words[3] = {
+				p0 | (p1 << 24),
+				(p1 >> 8) | (p2 << 16),
+				(p2 >> 16) | (p3 << 8)
+			};
+			memcpy(dst, words, 12);
+			dst += 12;
+		}
+		for (; i < count; i++)
+		{
+			dst[0] = src[i].r;
+			dst[1] = src[i].g;
+			dst[2] = src[i].b;
+			dst += 3;
+		}
+	}
+
+	/*
+	packRows()
+
+	Rows first to first + count of the buffer, at 1 (gray), 3 (RGB) or
+	4 (RGBA) bytes a pixel, one after another into dst, which has room
+	for them all.  Whole rows are read with getSpan() or getGraySpan(),
+	rather than a virtual getPixel() for every pixel, spread across the
+	scheduler's workers.  Returns false if memory ran out, and then
+	some of the rows weren't packed.
+	*/
+	static bool packRows(const PixelBuffer &pb, size_t first, int count, uint8_t *dst, int pixelBytes)
+	{
+		size_t width = pb.getWidth();
+		size_t rowBytes = width * pixelBytes;
+
+		TaskScheduler &scheduler = TaskScheduler::shared();
+		std::atomic<bool> failed(false);
+		scheduler.parallelFor(0, count, scheduler.rowGrain(count), [&](int begin, int end) {
+			PixRGBA * row = pixelBytes == 3 ? (PixRGBA *)malloc(width * sizeof(PixRGBA)) : NULL;
+			if (pixelBytes == 3 && !row)
+			{
+				failed = true;
+				return;
+			}
+			for (int i = begin; i < end; i++)
+			{
+				GRCOORD y = (GRCOORD)(first + i);
+				uint8_t * out = dst + i * rowBytes;
+				if (pixelBytes == 1)
+				{
+					pb.getGraySpan(0, y, (GRSIZE)width, out);
+				}
+				else if (pixelBytes == 4)
+				{
+					pb.getSpan(0, y, (GRSIZE)width, (PixRGBA *)out);
+				}
+				else
+				{
+					pb.getSpan(0, y, (GRSIZE)width, row);
+					packRGB(row, out, width);
+				}
+			}
+			free(row);
+		});
+
+		return !failed;
+	}
+
+	// The header of a P5, P6 or P7 file.  A P7 is GRAYSCALE at 1 byte
+	// a pixel, RGB_ALPHA otherwise.  Returns how long it is.
+	static int formatHeader(char *header, size_t size, char format, size_t width, size_t height, int pixelBytes)
+	{
+		// GRSIZE is 32 or 64 bits, depending on GR_LARGE_CANVAS,
+		// so sizes are printed at the biggest size
+		if (format == '7')
+		{
+			bool gray = pixelBytes == 1;
+			return snprintf(header, size,
+				"P7\nWIDTH %llu\nHEIGHT %llu\nDEPTH %d\nMAXVAL 255\nTUPLTYPE %s\nENDHDR\n",
+				(unsigned long long)width, (unsigned long long)height,
+				gray ? 1 : 4, gray ? "GRAYSCALE" : "RGB_ALPHA");
+		}
+
+		return snprintf(header, size, "P%c\n%llu %llu\n255\n", format,
+			(unsigned long long)width, (unsigned long long)height);
+	}
+
+private:
+	/*
+	writeBands()
+
+	Write the header, then the pixels at 1 (gray), 3 (RGB) or 4 (RGBA)
+	bytes each, packed a big band of rows at a time with packRows().
+	The file isn't buffered by stdio, so each band goes straight out
+	in one write, and the header goes out with the first band.
+	*/
+	static bool writeBands(const char *filename, const PixelBuffer &pb, const char *header, int headerBytes, int pixelBytes)
 	{
 		FILE * fp = fopen(filename, "wb");
 	
 		if (!fp)
 			return false;
+		setvbuf(fp, NULL, _IONBF, 0);
+
+		size_t width = pb.getWidth();
+		size_t rowBytes = width * pixelBytes;
+		size_t bandRows = rowBytes ? BandBytes / rowBytes : 1;
+		if (bandRows < 1)
+			bandRows = 1;
+		if (bandRows > pb.getHeight())
+			bandRows = pb.getHeight();
+
+		// room for the header in front of the first band, lined up so
+		// the rows themselves start on a cache line
+		size_t lead = (headerBytes + BandAlign - 1) / BandAlign * BandAlign;
+		uint8_t * block = (uint8_t *)malloc(lead + rowBytes * bandRows + BandAlign);
+		if (!block)
+		{
+			fclose(fp);
+			return false;
+		}
+		uint8_t * band = (uint8_t *)(((uintptr_t)block + lead + BandAlign - 1) & ~(uintptr_t)(BandAlign - 1));
+		memcpy(band - headerBytes, header, headerBytes);
 
-		// write out the image header
-		fprintf(fp, "P6\n%d %d\n255\n", pb.getWidth(), pb.getHeight());
+		bool ok = true;
+		size_t pending = headerBytes;
+
+		for (size_t bandRow = 0; bandRow < pb.getHeight() && ok; bandRow += bandRows)
+		{
+			int nRows = (int)(pb.getHeight() - bandRow);
+			if (nRows > (int)bandRows)
+				nRows = (int)bandRows;
+
+			ok = packRows(pb, bandRow, nRows, band, pixelBytes);
+			if (!ok)
+				break;
+
+			size_t bytes = pending + rowBytes * nRows;
+			ok = fwrite(band - pending, 1, bytes, fp) == bytes;
+			pending = 0;
+		}
+
+		// an empty image is just the header
+		if (ok && pending)
+			ok = fwrite(band - pending, 1, pending, fp) == pending;
+
+		free(block);
+		if (fclose(fp) != 0)
+			ok = false;
 	
-		// write the individual pixel values in binary form
-		for (size_t row = 0; row < pb.getHeight(); row++) 
+		return ok;
+	}
+};
+
+
+/*
+	PBMFile
+
+	A PPM, PGM or PAM file, mapped into memory and parsed where it is.
+	Only the header is looked at when it's opened.  The rows of a
+	binary file with one byte samples are right there in the mapping,
+	and getRow() hands them out without copying anything, which is
+	the quickest way to use a texture or compare against a golden
+	image.  readInto() converts the pixels into a buffer, a band of
+	rows at a time across the scheduler's workers.
+
+	P2 and P3, with the samples written out as text, can only be read
+	from the front to the back, so they're converted on one thread.
+
+		PBMFile file;
+		if (file.open("golden.ppm")) {
+			const uint8_t * row = file.getRow(10);
+		}
+*/
+class PBMFile
+{
+public:
+	PBMFile()
+		: format(0), width(0), height(0), channels(0), maxval(0), sampleBytes(0), pixelOffset(0)
+	{}
+
+	virtual ~PBMFile()
+	{
+		close();
+	}
+
+	/*
+	open()
+
+	Map the file and read its header.  Returns false if it isn't a
+	P2, P3, P5, P6 or P7 file, or a binary one is cut short.
+	*/
+	bool open(const char *filename)
+	{
+		close();
+		if (!file.open(filename))
+			return false;
+
+		if (!parseHeader())
 		{
-			for (size_t col = 0; col < pb.getWidth(); col++)
+			close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void close()
+	{
+		file.close();
+		format = 0;
+		width = height = 0;
+		channels = maxval = sampleBytes = 0;
+		pixelOffset = 0;
+	}
+
+	// '2', '3', '5', '6' or '7', from the magic number
+	char getFormat() const { return format; }
+	size_t getWidth() const { return width; }
+	size_t getHeight() const { return height; }
+
+	// 1 for gray, 2 for gray and alpha, 3 for RGB, 4 for RGBA
+	int getChannels() const { return channels; }
+	int getMaxval() const { return maxval; }
+
+	// Samples are bytes, or big endian pairs of bytes when maxval is
+	// over 255.  Text files are neither.
+	bool isBinary() const { return format >= '5'; }
+	size_t getRowBytes() const { return width * channels * sampleBytes; }
+
+	/*
+	getRow()
+
+	The bytes of row y, as they are in the file.  Only for binary files
+	with one byte samples, otherwise NULL.
+	*/
+	const uint8_t * getRow(size_t y) const
+	{
+		if (!isBinary() || sampleBytes != 1 || y >= height)
+			return NULL;
+
+		return file.getData() + pixelOffset + y * getRowBytes();
+	}
+
+	/*
+	readInto()
+
+	Convert the pixels into the top left of a buffer, which has to be
+	at least as big as the image.  Samples are scaled to 0..255.  Gray
+	files go into a gray buffer a row at a time with setGraySpan(), so
+	with a byte a sample, they're copied straight across.
+	*/
+	bool readInto(PixelBuffer &pb) const
+	{
+		if (!format || pb.getWidth() < width || pb.getHeight() < height)
+			return false;
+
+		if (!isBinary())
+			return readText(pb);
+
+		return readRows(pb, 0, height);
+	}
+
+	/*
+	readRows()
+
+	Convert rows first to first + count of a binary file into the top
+	rows of a buffer, the same way readInto() does the whole image.
+	The buffer only has to be as wide as the image, and as tall as
+	count, so an image too big for memory can be read a band at a time.
+	*/
+	bool readRows(PixelBuffer &pb, size_t first, size_t count) const
+	{
+		if (!format || !isBinary() || first > height || count > height - first
+			|| pb.getWidth() < width || pb.getHeight() < count)
+			return false;
+
+		TaskScheduler &scheduler = TaskScheduler::shared();
+		scheduler.parallelFor(0, (int)count, scheduler.rowGrain((int)count), [&](int begin, int end) {
+			uint8_t * gray = NULL;
+			PixRGBA * row = NULL;
+			if (channels == 1 && pb.getChannels() == 1)
+				gray = (uint8_t *)malloc(width);
+			else
+				row = (PixRGBA *)malloc(width * sizeof(PixRGBA));
+
+			for (int y = begin; y < end; y++)
 			{
-				fwrite(pb.getPixel(col, row).data, 3, 1, fp);
+				const uint8_t * src = file.getData() + pixelOffset + (first + y) * getRowBytes();
+				if (gray)
+				{
+					if (sampleBytes == 1 && maxval == 255)
+					{
+						pb.setGraySpan(0, (GRCOORD)y, (GRSIZE)width, src);
+					}
+					else
+					{
+						for (size_t x = 0; x < width; x++)
+							gray[x] = sample(src, x);
+						pb.setGraySpan(0, (GRCOORD)y, (GRSIZE)width, gray);
+					}
+				}
+				else
+				{
+					convertRow(src, row);
+					pb.setSpan(0, (GRCOORD)y, (GRSIZE)width, row);
+				}
 			}
+			free(gray);
+			free(row);
+		});
+
+		return true;
+	}
+
+	// Rows before end won't be read again, so the memory holding them
+	// can go back to the system
+	void releaseRows(size_t end)
+	{
+		if (isBinary() && end <= height)
+			file.release(0, pixelOffset + end * getRowBytes());
+	}
+
+	// A new buffer with the image in it, gray for gray files, RGBA for the
+	// rest, or NULL if it's too big for a buffer.  The caller deletes it.
+	PixelBuffer * createBuffer() const
+	{
+		// every pixel has to have a coordinate
+		if (!format || (size_t)(GRCOORD)(width - 1) != width - 1 || (size_t)(GRCOORD)(height - 1) != height - 1)
+			return NULL;
+
+		PixelBuffer * pb;
+		if (channels == 1)
+			pb = new PixelBufferGray((GRSIZE)width, (GRSIZE)height);
+		else
+			pb = new PixelBufferRGBA32((GRSIZE)width, (GRSIZE)height);
+
+		if (!readInto(*pb))
+		{
+			delete pb;
+			return NULL;
 		}
 
-		fclose(fp);
-	
+		return pb;
+	}
+
+	// Unpack RGB pixels to RGBA.  Four pixels at a time come out of
+	// three 32 bit words, with red in the low byte of intValue, as on x86.
+	static void unpackRGB(const uint8_t * src, PixRGBA * dst, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			uint32_t words[3];
+			memcpy(words, src, 12);
+			dst[i].intValue = (words[0] & 0xffffff) | 0xff000000;
+			dst[i + 1].intValue = (words[0] >> 24) | ((words[1] & 0xffff) << 8) | 0xff000000;
+			dst[i + 2].intValue = (words[1] >> 16) | ((words[2] & 0xff) << 16) | 0xff000000;
+			dst[i + 3].intValue = (words[2] >> 8) | 0xff000000;
+			src += 12;
+		}
+		for (; i < count; i++)
+		{
+			dst[i].r = src[0];
+			dst[i].g = src[1];
+			dst[i].b = src[2];
+			dst[i].a = 255;
+			src += 3;
+		}
+	}
+
+private:
+	// Skip spaces, and comments, which run from '#' to the end of the line
+	static size_t skipSpace(const uint8_t * data, size_t size, size_t at)
+	{
+		while (at < size)
+		{
+			if (data[at] == '#')
+			{
+				while (at < size && data[at] != '\n' && data[at] != '\r')
+					at++;
+			}
+			else if (isSpace(data[at]))
+			{
+				at++;
+			}
+			else
+			{
+				break;
+			}
+		}
+		return at;
+	}
+
+	static bool isSpace(uint8_t c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+	}
+
+	// A whole number, after any spaces.  Anything too big to be a size
+	// or a sample fails, rather than wrapping around.
+	static bool readNumber(const uint8_t * data, size_t size, size_t &at, size_t &value)
+	{
+		at = skipSpace(data, size, at);
+		if (at >= size || data[at] < '0' || data[at] > '9')
+			return false;
+
+		value = 0;
+		while (at < size && data[at] >= '0' && data[at] <= '9')
+		{
+			value = value * 10 + (data[at] - '0');
+			if (value > 0x7fffffff)
+				return false;
+			at++;
+		}
+		return true;
+	}
+
+	// A word, for the PAM header
+	static bool readWord(const uint8_t * data, size_t size, size_t &at, const char * &word, size_t &length)
+	{
+		at = skipSpace(data, size, at);
+		word = (const char *)data + at;
+		length = 0;
+		while (at < size && !isSpace(data[at]))
+		{
+			at++;
+			length++;
+		}
+		return length > 0;
+	}
+
+	static bool isWord(const char * word, size_t length, const char * expected)
+	{
+		return strlen(expected) == length && memcmp(word, expected, length) == 0;
+	}
+
+	bool parseHeader()
+	{
+		const uint8_t * data = file.getData();
+		size_t size = file.getSize();
+		if (size < 3 || data[0] != 'P')
+			return false;
+
+		format = (char)data[1];
+		size_t at = 2;
+		size_t w = 0, h = 0, depth = 0, maxv = 0;
+
+		if (format == '2' || format == '3' || format == '5' || format == '6')
+		{
+			channels = (format == '3' || format == '6') ? 3 : 1;
+			if (!readNumber(data, size, at, w) || !readNumber(data, size, at, h) || !readNumber(data, size, at, maxv))
+				return false;
+
+			// a single space between the header and binary samples
+			if (at >= size || !isSpace(data[at]))
+				return false;
+			at++;
+		}
+		else if (format == '7')
+		{
+			const char * word;
+			size_t length;
+			while (true)
+			{
+				if (!readWord(data, size, at, word, length))
+					return false;
+
+				if (isWord(word, length, "ENDHDR"))
+				{
+					// then the rest of that line
+					while (at < size && data[at] != '\n')
+						at++;
+					at++;
+					break;
+				}
+				else if (isWord(word, length, "WIDTH"))
+				{
+					if (!readNumber(data, size, at, w))
+						return false;
+				}
+				else if (isWord(word, length, "HEIGHT"))
+				{
+					if (!readNumber(data, size, at, h))
+						return false;
+				}
+				else if (isWord(word, length, "DEPTH"))
+				{
+					if (!readNumber(data, size, at, depth))
+						return false;
+				}
+				else if (isWord(word, length, "MAXVAL"))
+				{
+					if (!readNumber(data, size, at, maxv))
+						return false;
+				}
+				else if (isWord(word, length, "TUPLTYPE"))
+				{
+					// the depth says all we need
+					while (at < size && data[at] != '\n')
+						at++;
+				}
+				else
+				{
+					return false;
+				}
+			}
+			if (depth < 1 || depth > 4)
+				return false;
+			channels = (int)depth;
+		}
+		else
+		{
+			return false;
+		}
+
+		if (w == 0 || h == 0 || maxv == 0 || maxv > 65535)
+			return false;
+
+		width = w;
+		height = h;
+		maxval = (int)maxv;
+		sampleBytes = maxval > 255 ? 2 : 1;
+		pixelOffset = at;
+
+		// binary samples have to all be there
+		if (isBinary() && (at > size || (size - at) / height < getRowBytes()))
+			return false;
+
 		return true;
 	}
+
+	// Sample i of a binary row, scaled to 0..255
+	uint8_t sample(const uint8_t * src, size_t i) const
+	{
+		unsigned value = sampleBytes == 1 ? src[i] : (src[i * 2] << 8) | src[i * 2 + 1];
+		if (maxval == 255)
+			return (uint8_t)value;
+		if (value > (unsigned)maxval)
+			value = maxval;
+		return (uint8_t)((value * 255 + maxval / 2) / maxval);
+	}
+
+	// A binary row to RGBA
+	void convertRow(const uint8_t * src, PixRGBA * dst) const
+	{
+		if (sampleBytes == 1 && maxval == 255)
+		{
+			if (channels == 3)
+			{
+				unpackRGB(src, dst, width);
+				return;
+			}
+			if (channels == 4)
+			{
+				memcpy(dst, src, width * sizeof(PixRGBA));
+				return;
+			}
+		}
+
+		for (size_t x = 0; x < width; x++)
+			dst[x] = toPixel(src, x * channels);
+	}
+
+	// The pixel whose first sample is sample i
+	PixRGBA toPixel(const uint8_t * src, size_t i) const
+	{
+		PixRGBA pix;
+		if (channels <= 2)
+		{
+			pix.r = pix.g = pix.b = sample(src, i);
+			pix.a = channels == 2 ? sample(src, i + 1) : 255;
+		}
+		else
+		{
+			pix.r = sample(src, i);
+			pix.g = sample(src, i + 1);
+			pix.b = sample(src, i + 2);
+			pix.a = channels == 4 ? sample(src, i + 3) : 255;
+		}
+		return pix;
+	}
+
+	// P2 and P3, a number at a time
+	bool readText(PixelBuffer &pb) const
+	{
+		const uint8_t * data = file.getData();
+		size_t size = file.getSize();
+		size_t at = pixelOffset;
+		size_t perRow = width * channels;
+
+		// the numbers of a row, as if they were one byte samples, then
+		// scaled with everything else
+		uint8_t * samples = (uint8_t *)malloc(perRow * 2);
+		PixRGBA * row = (PixRGBA *)malloc(width * sizeof(PixRGBA));
+		bool ok = samples && row;
+
+		PBMFile scaled;
+		scaled.format = '5';
+		scaled.width = width;
+		scaled.channels = channels;
+		scaled.maxval = maxval;
+		scaled.sampleBytes = sampleBytes;
+
+		for (size_t y = 0; y < height && ok; y++)
+		{
+			for (size_t i = 0; i < perRow && ok; i++)
+			{
+				size_t value = 0;
+				ok = readNumber(data, size, at, value);
+				if (value > (size_t)maxval)
+					value = maxval;
+				if (sampleBytes == 1)
+				{
+					samples[i] = (uint8_t)value;
+				}
+				else
+				{
+					samples[i * 2] = (uint8_t)(value >> 8);
+					samples[i * 2 + 1] = (uint8_t)value;
+				}
+			}
+			if (!ok)
+				break;
+
+			if (channels == 1 && pb.getChannels() == 1)
+			{
+				for (size_t x = 0; x < width; x++)
+					samples[x] = scaled.sample(samples, x);
+				pb.setGraySpan(0, (GRCOORD)y, (GRSIZE)width, samples);
+			}
+			else
+			{
+				scaled.convertRow(samples, row);
+				pb.setSpan(0, (GRCOORD)y, (GRSIZE)width, row);
+			}
+		}
+
+		free(samples);
+		free(row);
+		return ok;
+	}
+
+	// Not copyable, it owns the mapping
+	PBMFile(const PBMFile &);
+	PBMFile & operator=(const PBMFile &);
+
+	MappedFile file;
+	char format;
+	size_t width;
+	size_t height;
+	int channels;
+	int maxval;
+	int sampleBytes;
+	size_t pixelOffset;     // where the samples start
+};
+
+inline PixelBuffer * PBM::readImage(const char *filename)
+{
+	PBMFile file;
+	if (!file.open(filename))
+		return NULL;
+
+	return file.createBuffer();
+}
+
+
+/*
+	PBMWriter
+
+	Writes a binary PGM, PPM or PAM a band of rows at a time, for an
+	image that's too big to have in a buffer all at once.  The header
+	goes out when it's opened, then each writeRows() packs the rows of
+	a band buffer with packRows() and writes them straight out.
+
+		PBMWriter out;
+		out.open("scan.ppm", width, 100000, '6');
+		for (size_t y = 0; y < 100000; y += bandRows) {
+			drawBand(band, y);
+			out.writeRows(band, bandRows);
+		}
+		out.close();
+*/
+class PBMWriter
+{
+public:
+	PBMWriter()
+		: fp(NULL), format(0), width(0), height(0), pixelBytes(0), rowsWritten(0),
+		packed(NULL), packedRows(0), failed(false)
+	{}
+
+	virtual ~PBMWriter()
+	{
+		close();
+	}
+
+	/*
+	open()
+
+	Start a file of width by height pixels.  format is '5' for a PGM,
+	'6' for a PPM, or '7' for a PAM with alpha, as PBMFile::getFormat()
+	says them.
+	*/
+	bool open(const char *filename, size_t awidth, size_t aheight, char aformat)
+	{
+		close();
+		if (awidth == 0 || (aformat != '5' && aformat != '6' && aformat != '7'))
+			return false;
+
+		fp = fopen(filename, "wb");
+		if (!fp)
+			return false;
+		setvbuf(fp, NULL, _IONBF, 0);
+
+		format = aformat;
+		width = awidth;
+		height = aheight;
+		pixelBytes = format == '5' ? 1 : format == '6' ? 3 : 4;
+		rowsWritten = 0;
+		failed = false;
+
+		char header[128];
+		int headerBytes = PBM::formatHeader(header, sizeof(header), format, width, height, pixelBytes);
+		if (fwrite(header, 1, headerBytes, fp) != (size_t)headerBytes)
+			failed = true;
+
+		return !failed;
+	}
+
+	/*
+	writeRows()
+
+	Write the top count rows of pb as the next rows of the image.  pb
+	has to be at least as wide as the image.  Returns false if there
+	are more rows than the image has left, or memory runs out, or they
+	can't be written.
+	*/
+	bool writeRows(const PixelBuffer &pb, size_t count)
+	{
+		if (!fp || failed || pb.getWidth() < width || pb.getHeight() < count || count > height - rowsWritten)
+			return false;
+
+		size_t rowBytes = width * pixelBytes;
+		if (count > packedRows)
+		{
+			free(packed);
+			packed = (uint8_t *)malloc(count * rowBytes);
+			packedRows = packed ? count : 0;
+			if (!packed)
+			{
+				failed = true;
+				return false;
+			}
+		}
+
+		// packRows() takes the whole width of pb, so a wider buffer is
+		// packed a row at a time
+		if (pb.getWidth() == width)
+		{
+			if (!PBM::packRows(pb, 0, (int)count, packed, pixelBytes))
+			{
+				failed = true;
+				return false;
+			}
+		}
+		else
+		{
+			PixRGBA * row = pixelBytes == 1 ? NULL : (PixRGBA *)malloc(width * sizeof(PixRGBA));
+			if (pixelBytes != 1 && !row)
+			{
+				failed = true;
+				return false;
+			}
+			for (size_t y = 0; y < count; y++)
+			{
+				uint8_t * out = packed + y * rowBytes;
+				if (pixelBytes == 1)
+				{
+					pb.getGraySpan(0, (GRCOORD)y, (GRSIZE)width, out);
+				}
+				else
+				{
+					pb.getSpan(0, (GRCOORD)y, (GRSIZE)width, row);
+					if (pixelBytes == 3)
+						PBM::packRGB(row, out, width);
+					else
+						memcpy(out, row, rowBytes);
+				}
+			}
+			free(row);
+		}
+
+		if (fwrite(packed, 1, count * rowBytes, fp) != count * rowBytes)
+			failed = true;
+		rowsWritten += count;
+
+		return !failed;
+	}
+
+	// Close the file.  Returns false if it doesn't have all its rows,
+	// or any of it couldn't be written.
+	bool close()
+	{
+		bool ok = !failed && rowsWritten == height;
+		if (fp && fclose(fp) != 0)
+			ok = false;
+		fp = NULL;
+
+		free(packed);
+		packed = NULL;
+		packedRows = 0;
+
+		return ok;
+	}
+
+	size_t getRowsWritten() const { return rowsWritten; }
+
+private:
+	// Not copyable, it owns the file
+	PBMWriter(const PBMWriter &);
+	PBMWriter & operator=(const PBMWriter &);
+
+	FILE * fp;
+	char format;
+	size_t width;
+	size_t height;
+	int pixelBytes;
+	size_t rowsWritten;
+	uint8_t * packed;       // the rows on their way out
+	size_t packedRows;
+	bool failed;
 };
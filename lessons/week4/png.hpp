@@ -0,0 +1,502 @@
+#pragma once
+
+#include "grtypes.hpp"
+#include "grmath.hpp"
+#include "PixelBuffer.hpp"
+#include "TaskScheduler.hpp"
+#include "Deflate.hpp"
+#include "pbm.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+
+/*
+	PNG
+
+	Writes PNG files, with nothing from outside.
+
+	The rows are split into chunks of about ChunkBytes, and each chunk
+	is filtered and compressed on its own, across the scheduler's
+	workers.  Each row gets whichever of the five PNG filters leaves
+	the smallest numbers, which is what compresses best.  The chunks
+	are compressed with their own Deflater, each ending in a sync
+	flush, so their output just goes one after the other into the
+	zlib stream.  Each chunk is its own IDAT chunk in the file.  A
+	group of chunks is done at a time, so the memory used doesn't
+	grow with the size of the image.
+
+	The level is the deflate level, 0 for no compression and fastest,
+	up to 9 for the smallest files and slowest.
+
+	A gray buffer is written as 8 bit gray, and an RGBA buffer as RGBA,
+	or as RGB when every pixel is opaque.
+*/
+class PNG
+{
+public:
+	static const int DefaultLevel = 6;
+
+	// Rows are filtered and compressed in chunks of about this many bytes
+	static const size_t ChunkBytes = 256 * 1024;
+
+	// How many chunks are kept in memory at once
+	static const int GroupChunks = 32;
+
+	static bool writePNG(const char *filename, const PixelBuffer &pb, int level = DefaultLevel)
+	{
+		if (pb.getWidth() == 0 || pb.getHeight() == 0)
+			return false;
+
+		FILE * fp = fopen(filename, "wb");
+		if (!fp)
+			return false;
+
+		// how the pixels are stored, 1 gray, 3 RGB or 4 RGBA
+		int channels = pb.getChannels() == 1 ? 1 : isOpaque(pb) ? 3 : 4;
+		size_t width = pb.getWidth();
+		size_t height = pb.getHeight();
+		size_t rowBytes = width * channels;
+
+		static const uint8_t signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+		bool ok = fwrite(signature, 1, 8, fp) == 8;
+
+		uint8_t header[13];
+		putBig32(header, (uint32_t)width);
+		putBig32(header + 4, (uint32_t)height);
+		header[8] = 8;      // bits a sample
+		header[9] = channels == 1 ? 0 : channels == 3 ? 2 : 6;
+		header[10] = 0;     // deflate
+		header[11] = 0;     // the five filters
+		header[12] = 0;     // not interlaced
+		ok = ok && writeChunk(fp, "IHDR", header, 13);
+
+		size_t chunkRows = ChunkBytes / (rowBytes + 1);
+		if (chunkRows < 1)
+			chunkRows = 1;
+		int chunkCount = (int)((height + chunkRows - 1) / chunkRows);
+
+		Chunk * chunks = new Chunk[GroupChunks];
+		uint32_t adler = 1;
+		TaskScheduler &scheduler = TaskScheduler::shared();
+
+		for (int group = 0; group < chunkCount && ok; group += GroupChunks)
+		{
+			int groupCount = chunkCount - group < GroupChunks ? chunkCount - group : GroupChunks;
+			scheduler.parallelFor(0, groupCount, 1, [&](int first, int last) {
+				for (int c = first; c < last; c++)
+				{
+					size_t row = (size_t)(group + c) * chunkRows;
+					size_t rows = height - row < chunkRows ? height - row : chunkRows;
+					compressChunk(pb, channels, row, rows, level, group + c == 0, group + c == chunkCount - 1, chunks[c]);
+				}
+			});
+
+			for (int c = 0; c < groupCount && ok; c++)
+			{
+				Chunk &chunk = chunks[c];
+				if (!chunk.ok)
+				{
+					ok = false;
+					break;
+				}
+				adler = Deflater::adler32Combine(adler, chunk.adler, chunk.rawSize);
+
+				uint8_t length[4];
+				uint8_t crc[4];
+				uint8_t trailer[4];
+				size_t size = chunk.deflater->getOutputSize() + (group + c == 0 ? 2 : 0);
+				uint32_t chunkCrc = chunk.crc;
+
+				// the last chunk carries the checksum of the whole stream
+				if (group + c == chunkCount - 1)
+				{
+					putBig32(trailer, adler);
+					chunkCrc = crc32(chunkCrc, trailer, 4);
+					size += 4;
+				}
+				putBig32(length, (uint32_t)size);
+				putBig32(crc, chunkCrc ^ 0xffffffff);
+
+				ok = fwrite(length, 1, 4, fp) == 4 && fwrite("IDAT", 1, 4, fp) == 4;
+				if (ok && group + c == 0)
+					ok = fwrite(chunk.zlibHeader, 1, 2, fp) == 2;
+				if (ok)
+					ok = fwrite(chunk.deflater->getOutput(), 1, chunk.deflater->getOutputSize(), fp) == chunk.deflater->getOutputSize();
+				if (ok && group + c == chunkCount - 1)
+					ok = fwrite(trailer, 1, 4, fp) == 4;
+				ok = ok && fwrite(crc, 1, 4, fp) == 4;
+
+				delete chunk.deflater;
+				chunk.deflater = NULL;
+			}
+		}
+
+		delete [] chunks;
+		ok = ok && writeChunk(fp, "IEND", NULL, 0);
+		if (fclose(fp) != 0)
+			ok = false;
+
+		return ok;
+	}
+
+	// The CRC-32 the chunks end with, carried on from crc, which
+	// starts at 0xffffffff.  The final value is flipped.
+	// Four bytes go through at a time, with a table for each.
+	static uint32_t crc32(uint32_t crc, const uint8_t * data, size_t size)
+	{
+		const uint32_t (* table)[256] = crcTables();
+		size_t i = 0;
+		for (; i + 4 <= size; i += 4)
+		{
+			crc ^= data[i] | (data[i + 1] << 8) | (data[i + 2] << 16) | ((uint32_t)data[i + 3] << 24);
+			crc = table[3][crc & 0xff] ^ table[2][(crc >> 8) & 0xff] ^ table[1][(crc >> 16) & 0xff] ^ table[0][crc >> 24];
+		}
+		for (; i < size; i++)
+			crc = table[0][(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		return crc;
+	}
+
+	/*
+	filterRow()
+
+	Pick the filter for a row that leaves the smallest sum of the bytes
+	taken as signed, which tends to compress best, and filter it with
+	that.  out gets the filter type, then the row.  prev is the row
+	above, or NULL for the first row, and zeros is a row of zeros.
+
+	Each filter is summed in its own loop, without branches, which the
+	compiler can turn into vector code, then only the best is written.
+	*/
+	static void filterRow(const uint8_t * row, const uint8_t * prev, size_t rowBytes, int bpp, uint8_t * out, const uint8_t * zeros)
+	{
+		if (!prev)
+			prev = zeros;
+
+		uint32_t sums[5] = {
+			filterPass<0>(row, prev, rowBytes, bpp, NULL),
+			filterPass<1>(row, prev, rowBytes, bpp, NULL),
+			filterPass<2>(row, prev, rowBytes, bpp, NULL),
+			filterPass<3>(row, prev, rowBytes, bpp, NULL),
+			filterPass<4>(row, prev, rowBytes, bpp, NULL)
+		};
+
+		int best = 0;
+		for (int k = 1; k < 5; k++)
+		{
+			if (sums[k] < sums[best])
+				best = k;
+		}
+
+		out[0] = (uint8_t)best;
+		switch (best)
+		{
+		case 0: memcpy(out + 1, row, rowBytes); break;
+		case 1: filterPass<1>(row, prev, rowBytes, bpp, out + 1); break;
+		case 2: filterPass<2>(row, prev, rowBytes, bpp, out + 1); break;
+		case 3: filterPass<3>(row, prev, rowBytes, bpp, out + 1); break;
+		case 4: filterPass<4>(row, prev, rowBytes, bpp, out + 1); break;
+		}
+	}
+
+private:
+	// A chunk of rows, filtered and compressed
+	struct Chunk {
+		Chunk() : deflater(NULL), adler(1), crc(0), rawSize(0), ok(false) {}
+		~Chunk() { delete deflater; }
+
+		Deflater * deflater;
+		uint8_t zlibHeader[2];
+		uint32_t adler;     // of the filtered rows
+		uint32_t crc;       // of the IDAT chunk so far, not flipped
+		size_t rawSize;     // how many filtered bytes
+		bool ok;            // false if memory ran out compressing it
+	};
+
+	static void compressChunk(const PixelBuffer &pb, int channels, size_t row, size_t rows, int level, bool first, bool last, Chunk &chunk)
+	{
+		size_t width = pb.getWidth();
+		size_t rowBytes = width * channels;
+		size_t filteredBytes = (rowBytes + 1) * rows;
+
+		uint8_t * filtered = (uint8_t *)malloc(filteredBytes);
+		uint8_t * lines = (uint8_t *)malloc(rowBytes * 2);
+		uint8_t * zeros = (uint8_t *)calloc(rowBytes, 1);
+		PixRGBA * pixels = channels == 1 ? NULL : (PixRGBA *)malloc(width * sizeof(PixRGBA));
+		chunk.ok = filtered && lines && zeros && (pixels || channels == 1);
+		if (!chunk.ok)
+		{
+			free(filtered);
+			free(lines);
+			free(zeros);
+			free(pixels);
+			return;
+		}
+
+		// the row above the chunk is needed to filter its first row
+		uint8_t * prev = NULL;
+		uint8_t * cur = lines;
+		if (row > 0)
+		{
+			readRow(pb, channels, row - 1, lines + rowBytes, pixels);
+			prev = lines + rowBytes;
+		}
+
+		for (size_t r = 0; r < rows; r++)
+		{
+			readRow(pb, channels, row + r, cur, pixels);
+			if (level == 0)
+			{
+				filtered[r * (rowBytes + 1)] = 0;
+				memcpy(filtered + r * (rowBytes + 1) + 1, cur, rowBytes);
+			}
+			else
+			{
+				filterRow(cur, prev, rowBytes, channels, filtered + r * (rowBytes + 1), zeros);
+			}
+
+			prev = cur;
+			cur = cur == lines ? lines + rowBytes : lines;
+		}
+
+		chunk.deflater = new Deflater(level);
+		chunk.ok = chunk.deflater->compress(filtered, filteredBytes, last);
+		chunk.adler = Deflater::adler32(1, filtered, filteredBytes);
+		chunk.rawSize = filteredBytes;
+
+		uint32_t crc = crc32(0xffffffff, (const uint8_t *)"IDAT", 4);
+		if (first)
+		{
+			Deflater::zlibHeader(level, chunk.zlibHeader);
+			crc = crc32(crc, chunk.zlibHeader, 2);
+		}
+		chunk.crc = crc32(crc, chunk.deflater->getOutput(), chunk.deflater->getOutputSize());
+
+		free(filtered);
+		free(lines);
+		free(zeros);
+		free(pixels);
+	}
+
+	// A row, as bytes, the way the file stores them
+	static void readRow(const PixelBuffer &pb, int channels, size_t y, uint8_t * dst, PixRGBA * pixels)
+	{
+		if (channels == 1)
+		{
+			pb.getGraySpan(0, (GRCOORD)y, pb.getWidth(), dst);
+		}
+		else if (channels == 4)
+		{
+			pb.getSpan(0, (GRCOORD)y, pb.getWidth(), pixels);
+			memcpy(dst, pixels, pb.getWidth() * sizeof(PixRGBA));
+		}
+		else
+		{
+			pb.getSpan(0, (GRCOORD)y, pb.getWidth(), pixels);
+			PBM::packRGB(pixels, dst, pb.getWidth());
+		}
+	}
+
+	// Whether every pixel's alpha is 255, so the alpha can be left out.
+	// If memory runs out it says no, and the alpha is written.
+	static bool isOpaque(const PixelBuffer &pb)
+	{
+		TaskScheduler &scheduler = TaskScheduler::shared();
+		int height = (int)pb.getHeight();
+		std::atomic<bool> opaque(true);
+
+		scheduler.parallelFor(0, height, scheduler.rowGrain(height), [&](int first, int last) {
+			PixRGBA * pixels = (PixRGBA *)malloc(pb.getWidth() * sizeof(PixRGBA));
+			if (!pixels)
+			{
+				// can't look, so keep the alpha, which is never wrong
+				opaque = false;
+				return;
+			}
+			for (int y = first; y < last && opaque; y++)
+			{
+				pb.getSpan(0, (GRCOORD)y, pb.getWidth(), pixels);
+				PixRGBA all;
+				all.intValue = 0xffffffff;
+				for (size_t x = 0; x < pb.getWidth(); x++)
+					all.intValue &= pixels[x].intValue;
+				if (all.a != 255)
+					opaque = false;
+			}
+			free(pixels);
+		});
+
+		return opaque;
+	}
+
+	// Filter a row with filter K, writing it to dst if there is one,
+	// and return the sum of the filtered bytes taken as signed.  The
+	// filter is a template argument so each loop is free of branches.
+	template <int K>
+	static uint32_t filterPass(const uint8_t * row, const uint8_t * prev, size_t rowBytes, int bpp, uint8_t * dst)
+	{
+		uint32_t sum = 0;
+		size_t lead = (size_t)bpp < rowBytes ? bpp : rowBytes;
+		for (size_t i = 0; i < lead; i++)
+		{
+			uint8_t f = filterByte<K>(row[i], 0, prev[i], 0);
+			sum += magnitude(f);
+			if (dst)
+				dst[i] = f;
+		}
+
+		size_t i = lead;
+#ifdef GR_USE_SSE2
+		// 16 bytes at a time, the sum of sizes by _mm_sad_epu8()
+		const __m128i zero = _mm_setzero_si128();
+		__m128i total = zero;
+		for (; i + 16 <= rowBytes; i += 16)
+		{
+			__m128i f = filter16<K>(_mm_loadu_si128((const __m128i *)(row + i)),
+				_mm_loadu_si128((const __m128i *)(row + i - bpp)),
+				_mm_loadu_si128((const __m128i *)(prev + i)),
+				_mm_loadu_si128((const __m128i *)(prev + i - bpp)));
+			if (dst)
+			{
+				_mm_storeu_si128((__m128i *)(dst + i), f);
+			}
+			else
+			{
+				__m128i size = _mm_min_epu8(f, _mm_sub_epi8(zero, f));
+				total = _mm_add_epi64(total, _mm_sad_epu8(size, zero));
+			}
+		}
+		sum += (uint32_t)_mm_cvtsi128_si32(total) + (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(total, 8));
+#endif
+		for (; i < rowBytes; i++)
+		{
+			uint8_t f = filterByte<K>(row[i], row[i - bpp], prev[i], prev[i - bpp]);
+			sum += magnitude(f);
+			if (dst)
+				dst[i] = f;
+		}
+		return sum;
+	}
+
+#ifdef GR_USE_SSE2
+	// Filter K on 16 bytes.  Paeth needs 16 bit lanes, as a + b - c
+	// doesn't fit in a byte, so it's done as two halves.
+	template <int K>
+	static inline __m128i filter16(__m128i x, __m128i a, __m128i b, __m128i c)
+	{
+		if (K == 1)
+			return _mm_sub_epi8(x, a);
+		if (K == 2)
+			return _mm_sub_epi8(x, b);
+		if (K == 3)
+		{
+			// _mm_avg_epu8() rounds up, and the filter rounds down
+			__m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+			return _mm_sub_epi8(x, avg);
+		}
+		if (K == 4)
+		{
+			const __m128i zero = _mm_setzero_si128();
+			__m128i lo = paeth8(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+			__m128i hi = paeth8(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+			return _mm_sub_epi8(x, _mm_packus_epi16(lo, hi));
+		}
+		return x;
+	}
+
+	// The Paeth predictor for 8 lanes of 16 bits
+	static inline __m128i paeth8(__m128i a, __m128i b, __m128i c)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		__m128i pa = _mm_sub_epi16(b, c);
+		__m128i pb = _mm_sub_epi16(a, c);
+		__m128i pc = _mm_add_epi16(pa, pb);
+		pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+		pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+		pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+
+		__m128i useB = _mm_cmpgt_epi16(pa, pb);
+		__m128i ab = _mm_or_si128(_mm_and_si128(useB, b), _mm_andnot_si128(useB, a));
+		__m128i pab = _mm_min_epi16(pa, pb);
+		__m128i useC = _mm_cmpgt_epi16(pab, pc);
+		return _mm_or_si128(_mm_and_si128(useC, c), _mm_andnot_si128(useC, ab));
+	}
+#endif
+
+	// Byte x with filter K, given a to the left, b above, and c above left
+	template <int K>
+	static inline uint8_t filterByte(int x, int a, int b, int c)
+	{
+		if (K == 1) return (uint8_t)(x - a);
+		if (K == 2) return (uint8_t)(x - b);
+		if (K == 3) return (uint8_t)(x - ((a + b) >> 1));
+		if (K == 4) return (uint8_t)(x - paeth(a, b, c));
+		return (uint8_t)x;
+	}
+
+	// Whichever of a, b and c is closest to a + b - c
+	static inline int paeth(int a, int b, int c)
+	{
+		int pa = abs(b - c);
+		int pb = abs(a - c);
+		int pc = abs(a + b - c - c);
+		int ab = pa <= pb ? a : b;
+		int pab = pa <= pb ? pa : pb;
+		return pab <= pc ? ab : c;
+	}
+
+	// The size of a filtered byte, taken as signed
+	static inline uint32_t magnitude(uint8_t value)
+	{
+		return value < 128 ? value : 256 - value;
+	}
+
+	static bool writeChunk(FILE * fp, const char * type, const uint8_t * data, size_t size)
+	{
+		uint8_t length[4];
+		uint8_t crc[4];
+		putBig32(length, (uint32_t)size);
+		uint32_t c = crc32(0xffffffff, (const uint8_t *)type, 4);
+		c = crc32(c, data, size);
+		putBig32(crc, c ^ 0xffffffff);
+
+		return fwrite(length, 1, 4, fp) == 4 && fwrite(type, 1, 4, fp) == 4
+			&& (size == 0 || fwrite(data, 1, size, fp) == size) && fwrite(crc, 1, 4, fp) == 4;
+	}
+
+	static void putBig32(uint8_t * out, uint32_t value)
+	{
+		out[0] = (uint8_t)(value >> 24);
+		out[1] = (uint8_t)(value >> 16);
+		out[2] = (uint8_t)(value >> 8);
+		out[3] = (uint8_t)value;
+	}
+
+	// table[0] is the usual table, a byte at a time.  table[k] is a
+	// byte followed by k zero bytes.
+	static const uint32_t (* crcTables())[256]
+	{
+		struct Tables {
+			uint32_t entries[4][256];
+			Tables()
+			{
+				for (uint32_t n = 0; n < 256; n++)
+				{
+					uint32_t c = n;
+					for (int k = 0; k < 8; k++)
+						c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+					entries[0][n] = c;
+				}
+				for (int k = 1; k < 4; k++)
+				{
+					for (uint32_t n = 0; n < 256; n++)
+						entries[k][n] = entries[0][entries[k - 1][n] & 0xff] ^ (entries[k - 1][n] >> 8);
+				}
+			}
+		};
+		static const Tables tables;
+		return tables.entries;
+	}
+};
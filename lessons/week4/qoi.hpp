@@ -0,0 +1,421 @@
+#pragma once
+
+#include "grtypes.hpp"
+#include "PixelBuffer.hpp"
+#include "PixelBufferRGBA32.hpp"
+#include "PixelBufferGray.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/*
+	QOI
+
+	Reads and writes QOI, the "Quite OK Image" format.  It's lossless
+	and much smaller than a PPM, and there's so little to it that it
+	goes at about the speed of just copying the pixels, which makes it
+	good for passing images between steps of a pipeline.
+
+	Each pixel is one of:  a run of the one before, an index into the
+	last 64 colors seen, a small difference from the one before, or
+	the color itself.
+
+	Both ways stream through the file in fixed size pieces, a row of
+	pixels and StreamBytes of file at a time, so the memory used
+	doesn't depend on the size of the image.  Rows are read with
+	getSpan() and written with setSpan(), a whole row at a time.
+
+	QOI has no gray, so a gray buffer is written as RGB with all three
+	the same, and can be read back into a gray buffer.
+*/
+class QOI
+{
+public:
+	// How much of the file is held at once
+	static const size_t StreamBytes = 64 * 1024;
+
+	static bool writeQOI(const char *filename, const PixelBuffer &pb)
+	{
+		if (pb.getWidth() == 0 || pb.getHeight() == 0)
+			return false;
+
+		FILE * fp = fopen(filename, "wb");
+		if (!fp)
+			return false;
+
+		bool gray = pb.getChannels() == 1;
+		size_t width = pb.getWidth();
+		Stream out(fp);
+
+		PixRGBA * row = (PixRGBA *)malloc(width * sizeof(PixRGBA));
+		uint8_t * grayRow = gray ? (uint8_t *)malloc(width) : NULL;
+		if (!row || (gray && !grayRow) || out.hasFailed())
+		{
+			free(row);
+			free(grayRow);
+			fclose(fp);
+			return false;
+		}
+
+		uint8_t header[14] = {'q', 'o', 'i', 'f'};
+		putBig32(header + 4, (uint32_t)width);
+		putBig32(header + 8, (uint32_t)pb.getHeight());
+		header[12] = gray ? 3 : 4;
+		header[13] = 0;     // sRGB, with linear alpha
+		out.put(header, 14);
+
+		PixRGBA index[64];
+		memset(index, 0, sizeof(index));
+		PixRGBA prev;
+		prev.r = prev.g = prev.b = 0;
+		prev.a = 255;
+		int run = 0;
+
+		for (size_t y = 0; y < pb.getHeight(); y++)
+		{
+			if (gray)
+			{
+				pb.getGraySpan(0, (GRCOORD)y, (GRSIZE)width, grayRow);
+				for (size_t x = 0; x < width; x++)
+				{
+					row[x].r = row[x].g = row[x].b = grayRow[x];
+					row[x].a = 255;
+				}
+			}
+			else
+			{
+				pb.getSpan(0, (GRCOORD)y, (GRSIZE)width, row);
+			}
+
+			for (size_t x = 0; x < width; x++)
+			{
+				PixRGBA px = row[x];
+				if (px.intValue == prev.intValue)
+				{
+					run++;
+					if (run == 62)
+					{
+						out.put((uint8_t)(OpRun | (run - 1)));
+						run = 0;
+					}
+					continue;
+				}
+
+				if (run > 0)
+				{
+					out.put((uint8_t)(OpRun | (run - 1)));
+					run = 0;
+				}
+
+				int h = hash(px);
+				if (index[h].intValue == px.intValue)
+				{
+					out.put((uint8_t)(OpIndex | h));
+				}
+				else
+				{
+					index[h] = px;
+					if (px.a == prev.a)
+					{
+						int dr = (int8_t)(px.r - prev.r);
+						int dg = (int8_t)(px.g - prev.g);
+						int db = (int8_t)(px.b - prev.b);
+						int drg = dr - dg;
+						int dbg = db - dg;
+
+						if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+						{
+							out.put((uint8_t)(OpDiff | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+						}
+						else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+						{
+							uint8_t luma[2] = {(uint8_t)(OpLuma | (dg + 32)), (uint8_t)(((drg + 8) << 4) | (dbg + 8))};
+							out.put(luma, 2);
+						}
+						else
+						{
+							uint8_t rgb[4] = {OpRGB, px.r, px.g, px.b};
+							out.put(rgb, 4);
+						}
+					}
+					else
+					{
+						uint8_t rgba[5] = {OpRGBA, px.r, px.g, px.b, px.a};
+						out.put(rgba, 5);
+					}
+				}
+				prev = px;
+			}
+		}
+
+		if (run > 0)
+			out.put((uint8_t)(OpRun | (run - 1)));
+
+		static const uint8_t ending[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+		out.put(ending, 8);
+
+		free(row);
+		free(grayRow);
+		bool ok = out.flush();
+		if (fclose(fp) != 0)
+			ok = false;
+
+		return ok;
+	}
+
+	/*
+	readQOI()
+
+	Read a QOI file into a new buffer, gray if gray is true, RGBA
+	otherwise.  A gray buffer takes the red of each pixel, which is
+	all of it, for a file written from a gray buffer.  Returns NULL if
+	the file can't be read.  The caller deletes the buffer.
+	*/
+	static PixelBuffer * readQOI(const char *filename, bool gray = false)
+	{
+		FILE * fp = fopen(filename, "rb");
+		if (!fp)
+			return NULL;
+
+		Stream in(fp);
+		uint8_t header[14];
+		size_t width = 0, height = 0;
+		bool ok = in.get(header, 14) && memcmp(header, "qoif", 4) == 0;
+		if (ok)
+		{
+			width = getBig32(header + 4);
+			height = getBig32(header + 8);
+
+			// every pixel has to have a coordinate
+			ok = width > 0 && height > 0 && (header[12] == 3 || header[12] == 4)
+				&& (size_t)(GRCOORD)(width - 1) == width - 1 && (size_t)(GRCOORD)(height - 1) == height - 1;
+		}
+
+		PixelBuffer * pb = NULL;
+		if (ok)
+		{
+			if (gray)
+				pb = new PixelBufferGray((GRSIZE)width, (GRSIZE)height);
+			else
+				pb = new PixelBufferRGBA32((GRSIZE)width, (GRSIZE)height);
+
+			if (!readPixels(in, *pb))
+			{
+				delete pb;
+				pb = NULL;
+			}
+		}
+
+		fclose(fp);
+		return pb;
+	}
+
+private:
+	enum {
+		OpIndex = 0x00,
+		OpDiff = 0x40,
+		OpLuma = 0x80,
+		OpRun = 0xc0,
+		OpRGB = 0xfe,
+		OpRGBA = 0xff
+	};
+
+	/*
+	Stream
+
+	A FILE, read or written StreamBytes at a time.  Reads that run
+	past the end of the file fail, rather than making up bytes.  If
+	the buffer can't be allocated, it has failed from the start.
+	*/
+	class Stream
+	{
+	public:
+		Stream(FILE * afp)
+			: fp(afp), pos(0), size(0), failed(false)
+		{
+			buffer = (uint8_t *)malloc(StreamBytes);
+			failed = buffer == NULL;
+		}
+
+		virtual ~Stream()
+		{
+			free(buffer);
+		}
+
+		void put(uint8_t value)
+		{
+			if (!buffer)
+				return;
+			if (size == StreamBytes)
+				flush();
+			buffer[size++] = value;
+		}
+
+		void put(const uint8_t * data, size_t count)
+		{
+			if (!buffer)
+				return;
+			if (size + count > StreamBytes)
+				flush();
+			memcpy(buffer + size, data, count);
+			size += count;
+		}
+
+		bool flush()
+		{
+			if (size > 0 && fwrite(buffer, 1, size, fp) != size)
+				failed = true;
+			size = 0;
+			return !failed;
+		}
+
+		// The next byte, or 0 once the file runs out, which sets failed
+		uint8_t get()
+		{
+			if (pos == size && !refill())
+				return 0;
+			return buffer[pos++];
+		}
+
+		bool get(uint8_t * data, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+				data[i] = get();
+			return !failed;
+		}
+
+		bool hasFailed() const { return failed; }
+
+	private:
+		bool refill()
+		{
+			if (!buffer)
+				return false;
+			pos = 0;
+			size = fread(buffer, 1, StreamBytes, fp);
+			if (size == 0)
+				failed = true;
+			return size > 0;
+		}
+
+		// Not copyable, it owns its buffer
+		Stream(const Stream &);
+		Stream & operator=(const Stream &);
+
+		FILE * fp;
+		uint8_t * buffer;
+		size_t pos;
+		size_t size;
+		bool failed;
+	};
+
+	// Decode the pixels into pb, a row at a time
+	static bool readPixels(Stream &in, PixelBuffer &pb)
+	{
+		size_t width = pb.getWidth();
+		bool gray = pb.getChannels() == 1;
+		PixRGBA * row = (PixRGBA *)malloc(width * sizeof(PixRGBA));
+		uint8_t * grayRow = gray ? (uint8_t *)malloc(width) : NULL;
+		if (!row || (gray && !grayRow))
+		{
+			free(row);
+			free(grayRow);
+			return false;
+		}
+
+		PixRGBA index[64];
+		memset(index, 0, sizeof(index));
+		PixRGBA px;
+		px.r = px.g = px.b = 0;
+		px.a = 255;
+		int run = 0;
+
+		for (size_t y = 0; y < pb.getHeight() && !in.hasFailed(); y++)
+		{
+			for (size_t x = 0; x < width; x++)
+			{
+				if (run > 0)
+				{
+					run--;
+					row[x] = px;
+					continue;
+				}
+
+				uint8_t op = in.get();
+				if (op == OpRGB)
+				{
+					px.r = in.get();
+					px.g = in.get();
+					px.b = in.get();
+				}
+				else if (op == OpRGBA)
+				{
+					px.r = in.get();
+					px.g = in.get();
+					px.b = in.get();
+					px.a = in.get();
+				}
+				else if ((op & 0xc0) == OpIndex)
+				{
+					px = index[op];
+				}
+				else if ((op & 0xc0) == OpDiff)
+				{
+					px.r += ((op >> 4) & 3) - 2;
+					px.g += ((op >> 2) & 3) - 2;
+					px.b += (op & 3) - 2;
+				}
+				else if ((op & 0xc0) == OpLuma)
+				{
+					uint8_t second = in.get();
+					int dg = (op & 0x3f) - 32;
+					px.r += dg - 8 + ((second >> 4) & 0x0f);
+					px.g += dg;
+					px.b += dg - 8 + (second & 0x0f);
+				}
+				else
+				{
+					run = op & 0x3f;
+				}
+
+				index[hash(px)] = px;
+				row[x] = px;
+			}
+
+			if (gray)
+			{
+				for (size_t x = 0; x < width; x++)
+					grayRow[x] = row[x].r;
+				pb.setGraySpan(0, (GRCOORD)y, (GRSIZE)width, grayRow);
+			}
+			else
+			{
+				pb.setSpan(0, (GRCOORD)y, (GRSIZE)width, row);
+			}
+		}
+
+		free(row);
+		free(grayRow);
+		return !in.hasFailed();
+	}
+
+	static int hash(const PixRGBA px)
+	{
+		return (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) & 63;
+	}
+
+	static void putBig32(uint8_t * out, uint32_t value)
+	{
+		out[0] = (uint8_t)(value >> 24);
+		out[1] = (uint8_t)(value >> 16);
+		out[2] = (uint8_t)(value >> 8);
+		out[3] = (uint8_t)value;
+	}
+
+	static uint32_t getBig32(const uint8_t * in)
+	{
+		return ((uint32_t)in[0] << 24) | (in[1] << 16) | (in[2] << 8) | in[3];
+	}
+};
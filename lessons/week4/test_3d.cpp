@@ -0,0 +1,116 @@
+/*
+    Draw a few colored cubes sitting on a floor that runs right past
+    the camera, so the floor has to be clipped against the near plane.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "DrawingContext.hpp"
+#include "Renderer3D.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+
+#include <chrono>
+
+// 12 triangles of a unit cube, counter clockwise from outside
+int addCube(Vertex3D *verts, const Vec3 &center, REAL size)
+{
+    static const int faces[6][4] = {
+        {0, 1, 3, 2}, {4, 6, 7, 5},     // -x, +x
+        {0, 4, 5, 1}, {2, 3, 7, 6},     // -y, +y
+        {0, 2, 6, 4}, {1, 5, 7, 3}      // -z, +z
+    };
+    PixRGBA faceColors[6] = {colors.red, colors.green, colors.blue, colors.yellow, colors.cyan, colors.white};
+
+    Vec3 corners[8];
+    for (int i = 0; i < 8; i++) {
+        corners[i] = center + Vec3((i & 4) ? size : -size, (i & 2) ? size : -size, (i & 1) ? size : -size);
+    }
+
+    int n = 0;
+    for (int f = 0; f < 6; f++) {
+        int quad[6] = {faces[f][0], faces[f][1], faces[f][2], faces[f][0], faces[f][2], faces[f][3]};
+        for (int i = 0; i < 6; i++) {
+            verts[n].pos = corners[quad[i]];
+            verts[n].color = faceColors[f];
+            // darken one corner, so the interpolation shows
+            if (i == 1 || i == 4) {
+                verts[n].color = colors.black;
+            }
+            n++;
+        }
+    }
+    return n;
+}
+
+int renderScene(PixelBuffer &pb)
+{
+    DrawingContext dc(pb);
+    dc.setBackground(colors.gray50);
+    dc.clear();
+
+    Renderer3D r3d(pb);
+    r3d.begin();
+
+    Mat4 projection = Mat4::perspective(1.0f, (REAL)pb.getWidth() / pb.getHeight(), 0.5f, 100.0f);
+    Mat4 view = Mat4::lookAt(Vec3(0, 1.5f, 4), Vec3(0, 0, -2), Vec3(0, 1, 0));
+    r3d.setTransform(projection * view);
+    r3d.setBackfaceCulling(true);
+
+    // The floor goes from behind the camera to far away
+    Vertex3D floor[6];
+    Vec3 fc[4] = {Vec3(-20, -1, 10), Vec3(20, -1, 10), Vec3(20, -1, -40), Vec3(-20, -1, -40)};
+    PixRGBA floorColors[4] = {colors.white, colors.red, colors.blue, colors.green};
+    int idx[6] = {0, 1, 2, 0, 2, 3};
+    for (int i = 0; i < 6; i++) {
+        floor[i].pos = fc[idx[i]];
+        floor[i].color = floorColors[idx[i]];
+    }
+    r3d.drawTriangles(floor, 6);
+
+    Vertex3D cubes[36 * 9];
+    int n = 0;
+    for (int i = 0; i < 9; i++) {
+        n += addCube(&cubes[n], Vec3((i % 3 - 1) * 2.5f, -0.4f, -2.0f - (i / 3) * 3.0f), 0.6f);
+    }
+
+    // spin the cubes a little about the y axis
+    r3d.setTransform(projection * view * Mat4::rotationY(0.3f));
+    r3d.drawTriangles(cubes, n);
+
+    r3d.end();
+    return n / 3;
+}
+
+void main()
+{
+    PixelBufferRGBA32 serial(1280, 720);
+    PixelBufferRGBA32 tiled(1280, 720);
+
+    TaskScheduler &scheduler = TaskScheduler::shared();
+
+    auto start = std::chrono::steady_clock::now();
+    int workers = scheduler.getWorkerCount();
+    scheduler.setWorkerCount(0);
+    int triangles = renderScene(serial);
+    auto middle = std::chrono::steady_clock::now();
+
+    scheduler.setWorkerCount(workers > 0 ? workers : 3);
+    renderScene(tiled);
+    auto finish = std::chrono::steady_clock::now();
+
+    printf("%d triangles\n", triangles);
+    printf("Serial: %d ms\n", (int)std::chrono::duration_cast<std::chrono::milliseconds>(middle - start).count());
+    printf("Tiled: %d ms\n", (int)std::chrono::duration_cast<std::chrono::milliseconds>(finish - middle).count());
+
+    int differences = 0;
+    for (GRSIZE y = 0; y < serial.getHeight(); y++) {
+        for (GRSIZE x = 0; x < serial.getWidth(); x++) {
+            if (serial.getPixel(x, y).intValue != tiled.getPixel(x, y).intValue) {
+                differences++;
+            }
+        }
+    }
+    printf("Serial vs tiled differences: %d\n", differences);
+
+    PBM::writePPMBinary("test3d.ppm", tiled);
+}
@@ -0,0 +1,203 @@
+/*
+    Processing an image a band at a time.
+
+    A PPM is written a band at a time with PBMWriter, then run through
+    a BandProcessor three ways:  a 3x3 blur, which needs a row of halo
+    above and below each band, a conversion to a PGM, and scaling down
+    to half the size.  Each should give exactly what the same transform
+    gives run over the whole image in memory at once.
+
+    Then an image 100,000 rows tall, which is written and blurred with
+    only the band buffers in memory.  And a PBMWriter given too many
+    rows, or too few, should say so.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "PixelBufferGray.hpp"
+#include "pbm.hpp"
+#include "BandProcessor.hpp"
+#include "testing.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+int elapsed(std::chrono::steady_clock::time_point start)
+{
+    return (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Rows first on of a made up picture, into the top of a band
+void drawBand(PixelBuffer &band, size_t first, size_t count)
+{
+    for (size_t y = 0; y < count; y++) {
+        size_t row = first + y;
+        for (size_t x = 0; x < band.getWidth(); x++) {
+            PixRGBA pix;
+            pix.r = (uint8_t)(x * 255 / band.getWidth());
+            pix.g = (uint8_t)((row / 7) * 31 + x / 5);
+            pix.b = (uint8_t)(((x - 300) * (x - 300) + (row % 500) * (row % 500)) < 120 * 120 ? 255 : (x ^ row));
+            pix.a = 255;
+            band.setPixel((GRCOORD)x, (GRCOORD)y, pix);
+        }
+    }
+}
+
+bool writePicture(const char *filename, size_t width, size_t height)
+{
+    PixelBufferRGBA32 band((GRSIZE)width, 256);
+    PBMWriter out;
+    out.open(filename, width, height, '6');
+    for (size_t y = 0; y < height; y += 256) {
+        size_t count = height - y < 256 ? height - y : 256;
+        drawBand(band, y, count);
+        out.writeRows(band, count);
+    }
+    return out.close();
+}
+
+// The input pixel at image coordinates, from wherever the band has it,
+// clamped to the edges of the image
+PixRGBA inputPixel(const ImageBand &band, long x, long y)
+{
+    x = x < 0 ? 0 : (x >= (long)band.inputWidth ? (long)band.inputWidth - 1 : x);
+    y = y < 0 ? 0 : (y >= (long)band.inputHeight ? (long)band.inputHeight - 1 : y);
+    return band.input->getPixel((GRCOORD)x, (GRCOORD)(y - band.inputFirst));
+}
+
+void blur3x3(const ImageBand &band)
+{
+    for (size_t oy = 0; oy < band.outputRows; oy++) {
+        long y = (long)(band.outputFirst + oy);
+        for (long x = 0; x < (long)band.outputWidth; x++) {
+            int r = 0, g = 0, b = 0;
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    PixRGBA p = inputPixel(band, x + dx, y + dy);
+                    r += p.r;
+                    g += p.g;
+                    b += p.b;
+                }
+            }
+            PixRGBA out;
+            out.r = (uint8_t)(r / 9);
+            out.g = (uint8_t)(g / 9);
+            out.b = (uint8_t)(b / 9);
+            out.a = 255;
+            band.output->setPixel((GRCOORD)x, (GRCOORD)oy, out);
+        }
+    }
+}
+
+// Into a gray band, which takes the gray of each pixel
+void toGrayBand(const ImageBand &band)
+{
+    for (size_t oy = 0; oy < band.outputRows; oy++) {
+        for (size_t x = 0; x < band.outputWidth; x++) {
+            band.output->setPixel((GRCOORD)x, (GRCOORD)oy,
+                inputPixel(band, (long)x, (long)(band.outputFirst + oy)));
+        }
+    }
+}
+
+// Each output pixel the average of the 2x2 under it
+void halve(const ImageBand &band)
+{
+    for (size_t oy = 0; oy < band.outputRows; oy++) {
+        long y = (long)(band.outputFirst + oy) * 2;
+        for (long x = 0; x < (long)band.outputWidth; x++) {
+            PixRGBA p[4] = {inputPixel(band, x * 2, y), inputPixel(band, x * 2 + 1, y),
+                inputPixel(band, x * 2, y + 1), inputPixel(band, x * 2 + 1, y + 1)};
+            PixRGBA out;
+            out.r = (uint8_t)((p[0].r + p[1].r + p[2].r + p[3].r + 2) / 4);
+            out.g = (uint8_t)((p[0].g + p[1].g + p[2].g + p[3].g + 2) / 4);
+            out.b = (uint8_t)((p[0].b + p[1].b + p[2].b + p[3].b + 2) / 4);
+            out.a = 255;
+            band.output->setPixel((GRCOORD)x, (GRCOORD)oy, out);
+        }
+    }
+}
+
+// The transform run over the whole image at once, as one band
+PixelBuffer * wholeImage(const PixelBuffer &input, const BandTransform &transform, size_t outWidth, size_t outHeight, bool gray)
+{
+    PixelBuffer *output;
+    if (gray) {
+        output = new PixelBufferGray((GRSIZE)outWidth, (GRSIZE)outHeight);
+    } else {
+        output = new PixelBufferRGBA32((GRSIZE)outWidth, (GRSIZE)outHeight);
+    }
+    ImageBand band;
+    band.input = &input;
+    band.inputFirst = 0;
+    band.inputRows = input.getHeight();
+    band.output = output;
+    band.outputFirst = 0;
+    band.outputRows = outHeight;
+    band.inputWidth = input.getWidth();
+    band.inputHeight = input.getHeight();
+    band.outputWidth = outWidth;
+    band.outputHeight = outHeight;
+    transform(band);
+    return output;
+}
+
+void check(const char *name, const PixelBuffer &input, const char *outName, const BandTransform &transform,
+    size_t outWidth, size_t outHeight, bool gray)
+{
+    PixelBuffer *whole = wholeImage(input, transform, outWidth, outHeight, gray);
+    PixelBuffer *banded = PBM::readImage(outName);
+    printf("%s: %d pixels different from doing it all at once\n", name,
+        expectZero(countDifferences(*whole, banded), name));
+    delete whole;
+    delete banded;
+    remove(outName);
+}
+
+void main()
+{
+    // 600 by 3000, in bands of 64 rows, which doesn't go evenly
+    writePicture("testbands.ppm", 600, 3000);
+    PixelBuffer *input = PBM::readImage("testbands.ppm");
+
+    BandProcessor blurring(64, 1);
+    bool ok = blurring.process("testbands.ppm", "testbands_blur.ppm", blur3x3);
+    printf("blur: %s, band buffers %zu bytes\n", ok ? "done" : "FAILED", blurring.getBandBytes());
+    check("blur", *input, "testbands_blur.ppm", blur3x3, 600, 3000, false);
+
+    BandProcessor bands(64);
+    ok = bands.process("testbands.ppm", "testbands_gray.pgm", toGrayBand, '5');
+    printf("gray: %s\n", ok ? "done" : "FAILED");
+    check("gray", *input, "testbands_gray.pgm", toGrayBand, 600, 3000, true);
+
+    ok = bands.process("testbands.ppm", "testbands_half.ppm", halve, 0, 300, 1500);
+    printf("half size: %s\n", ok ? "done" : "FAILED");
+    check("half size", *input, "testbands_half.ppm", halve, 300, 1500, false);
+    delete input;
+    remove("testbands.ppm");
+
+    // 100,000 rows
+    auto start = std::chrono::steady_clock::now();
+    ok = writePicture("testbands_tall.ppm", 1000, 100000);
+    int writeMs = elapsed(start);
+    start = std::chrono::steady_clock::now();
+    BandProcessor tall(256, 1);
+    ok = ok && tall.process("testbands_tall.ppm", "testbands_tall_blur.ppm", blur3x3);
+    int blurMs = elapsed(start);
+    PBMFile result;
+    ok = ok && result.open("testbands_tall_blur.ppm") && result.getHeight() == 100000;
+    result.close();
+    printf("1000 x 100000: %s, %d ms to write, %d ms to blur, with %zu bytes of band buffers\n",
+        ok ? "done" : "FAILED", writeMs, blurMs, tall.getBandBytes());
+    remove("testbands_tall.ppm");
+    remove("testbands_tall_blur.ppm");
+
+    // Wrong numbers of rows
+    PixelBufferRGBA32 band(100, 10);
+    PBMWriter out;
+    out.open("testbands_short.ppm", 100, 15, '6');
+    bool tooMany = out.writeRows(band, 10) && out.writeRows(band, 10);
+    bool tooFew = out.close();
+    printf("too many rows written: %s, too few closed: %s\n", tooMany ? "YES" : "no", tooFew ? "YES" : "no");
+    remove("testbands_short.ppm");
+}
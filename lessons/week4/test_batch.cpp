@@ -0,0 +1,137 @@
+/*
+    Draw a scatter plot of many little shapes, once the old way, one
+    call at a time with a color change in between, and once with the
+    batched calls.  The pictures should be the same.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "DrawingContext.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+
+#include <stdlib.h>
+#include <chrono>
+
+static const size_t COUNT = 200000;
+
+GRCOORD xs[COUNT], ys[COUNT], x2s[COUNT], y2s[COUNT];
+GRSIZE widths[COUNT], heights[COUNT];
+PixRGBA fills[COUNT];
+
+int elapsed(std::chrono::steady_clock::time_point start)
+{
+    return (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void main()
+{
+    PixelBufferRGBA32 single(1920, 1080);
+    PixelBufferRGBA32 batched(1920, 1080);
+    DrawingContext sdc(single);
+    DrawingContext bdc(batched);
+
+    sdc.setBackground(colors.white);
+    sdc.clear();
+    bdc.setBackground(colors.white);
+    bdc.clear();
+
+    srand(7);
+    for (size_t i = 0; i < COUNT; i++) {
+        xs[i] = 10 + rand() % 1900;
+        ys[i] = 10 + rand() % 1060;
+        x2s[i] = xs[i] + rand() % 21 - 10;
+        y2s[i] = ys[i] + rand() % 21 - 10;
+        widths[i] = 1 + rand() % 6;
+        heights[i] = 1 + rand() % 6;
+        fills[i].intValue = 0xff000000 | ((uint32_t)(rand() & 0xffff) << 8) | (uint32_t)(rand() & 0xff);
+    }
+
+    // One at a time
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < COUNT; i++) {
+        sdc.setFill(fills[i]);
+        sdc.fillRectangle(xs[i], ys[i], widths[i], heights[i]);
+    }
+    for (size_t i = 0; i < COUNT; i++) {
+        sdc.setFill(fills[i]);
+        sdc.fillEllipse(xs[i], ys[i], widths[i], heights[i]);
+    }
+    for (size_t i = 0; i < COUNT; i++) {
+        sdc.setStroke(fills[i]);
+        sdc.strokeLine(xs[i], ys[i], x2s[i], y2s[i]);
+    }
+    printf("One at a time: %d ms\n", elapsed(start));
+
+    // All at once
+    start = std::chrono::steady_clock::now();
+    bdc.fillRectangles(COUNT, xs, ys, widths, heights, fills);
+    bdc.fillEllipses(COUNT, xs, ys, widths, heights, fills);
+    bdc.strokeLines(COUNT, xs, ys, x2s, y2s, fills);
+    printf("Batched: %d ms\n", elapsed(start));
+
+    int differences = 0;
+    for (GRSIZE y = 0; y < single.getHeight(); y++) {
+        for (GRSIZE x = 0; x < single.getWidth(); x++) {
+            if (single.getPixel(x, y).intValue != batched.getPixel(x, y).intValue) {
+                differences++;
+            }
+        }
+    }
+    printf("Single vs batched differences: %d\n", differences);
+
+    // A batch can be recorded and replayed like anything else
+    DisplayList list;
+    PixelBufferRGBA32 replayed(1920, 1080);
+    DrawingContext rdc(replayed);
+    rdc.setBackground(colors.white);
+    rdc.clear();
+    rdc.beginRecording(list);
+    rdc.fillRectangles(COUNT, xs, ys, widths, heights, fills);
+    rdc.fillEllipses(COUNT, xs, ys, widths, heights, fills);
+    rdc.strokeLines(COUNT, xs, ys, x2s, y2s, fills);
+    rdc.endRecording();
+    rdc.replay(list);
+
+    differences = 0;
+    for (GRSIZE y = 0; y < single.getHeight(); y++) {
+        for (GRSIZE x = 0; x < single.getWidth(); x++) {
+            if (replayed.getPixel(x, y).intValue != batched.getPixel(x, y).intValue) {
+                differences++;
+            }
+        }
+    }
+    printf("Batched vs replayed differences: %d\n", differences);
+
+    PBM::writePPMBinary("testbatch.ppm", batched);
+
+    // A big ellipse, where the radius squared times the radius is well
+    // past what an int holds, should still cover its area
+    PixelBufferRGBA32 big(4200, 4200);
+    DrawingContext gdc(big);
+    GRCOORD cx = 2100, cy = 2100;
+    GRSIZE xradius = 2000, yradius = 1900;
+    for (int pass = 0; pass < 2; pass++) {
+        gdc.setBackground(colors.white);
+        gdc.clear();
+        gdc.setFill(colors.black);
+        if (pass == 0) {
+            gdc.fillEllipse(cx, cy, xradius, yradius);
+        } else {
+            gdc.fillEllipses(1, &cx, &cy, &xradius, &yradius);
+        }
+
+        size_t covered = 0;
+        for (GRSIZE y = 0; y < big.getHeight(); y++) {
+            for (GRSIZE x = 0; x < big.getWidth(); x++) {
+                covered += big.getPixel(x, y).intValue == colors.black.intValue;
+            }
+        }
+        double area = 3.14159265358979 * xradius * yradius;
+        printf("%s ellipse, radii %d by %d: %.4f of its area\n", pass == 0 ? "One" : "Batched",
+            (int)xradius, (int)yradius, covered / area);
+        if (covered < area * 0.99 || covered > area * 1.01) {
+            printf("WRONG COVERAGE\n");
+            exit(1);
+        }
+    }
+}
@@ -0,0 +1,223 @@
+/*
+    BMP files.
+
+    A picture with some see-through parts, and a gray one, written as
+    BMP and read back, which should give exactly the same pixels, at
+    widths that need the rows padded out.  The bytes of a small file,
+    against what the headers should say, with the bottom row first.
+
+    Files written by hand in the kinds we don't write ourselves:  24
+    bit, top down, a color palette, and 32 bit with nothing in the
+    alpha.  Files that are cut short, or compressed, shouldn't read.
+
+    And how long a 4K frame takes, against a PAM, which needs no
+    converting at all.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "PixelBufferGray.hpp"
+#include "DrawingContext.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+#include "bmp.hpp"
+#include "testing.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+int elapsed(std::chrono::steady_clock::time_point start)
+{
+    return (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void drawScene(DrawingContext &dc, int width, int height)
+{
+    dc.setBackground(colors.white);
+    dc.clear();
+    dc.setFill(colors.yellow);
+    dc.fillRectangle(10, 10, width / 2, height / 3);
+    dc.setFill(colors.red);
+    dc.fillEllipse((GRCOORD)(width / 2), (GRCOORD)(height / 2), width / 3, height / 4);
+    PixRGBA glass = colors.blue;
+    glass.a = 100;
+    dc.setFill(glass);
+    dc.fillRectangle((GRCOORD)(width / 4), (GRCOORD)(height / 4), width / 2, height / 2);
+    dc.setStroke(colors.black);
+    for (int i = 0; i < 20; i++) {
+        dc.strokeLine(0, (GRCOORD)(i * height / 20), (GRCOORD)(width - 1), (GRCOORD)(height - 1 - i * height / 20));
+    }
+}
+
+void putLittle(uint8_t *out, uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        out[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+// The headers of a 3x2 file, by hand, then whatever comes after
+size_t handHeaders(uint8_t *file, int bits, int height, uint32_t compression, int colors, size_t pixelBytes)
+{
+    size_t offset = 54 + colors * 4;
+    memset(file, 0, offset);
+    file[0] = 'B';
+    file[1] = 'M';
+    putLittle(file + 2, (uint32_t)(offset + pixelBytes), 4);
+    putLittle(file + 10, (uint32_t)offset, 4);
+    putLittle(file + 14, 40, 4);
+    putLittle(file + 18, 3, 4);
+    putLittle(file + 22, (uint32_t)height, 4);
+    putLittle(file + 26, 1, 2);
+    putLittle(file + 28, bits, 2);
+    putLittle(file + 30, compression, 4);
+    putLittle(file + 46, colors, 4);
+    return offset;
+}
+
+void writeFile(const char *filename, const uint8_t *data, size_t size)
+{
+    FILE *fp = fopen(filename, "wb");
+    fwrite(data, 1, size, fp);
+    fclose(fp);
+}
+
+// Whether the pixels read from a file are the ones given, top row first
+bool readsAs(const char *name, const uint8_t *file, size_t size, const uint32_t *expected, int channels)
+{
+    writeFile("testbmp_hand.bmp", file, size);
+    PixelBuffer *pb = BMP::readBMP("testbmp_hand.bmp");
+    bool same = pb && pb->getWidth() == 3 && pb->getHeight() == 2 && pb->getChannels() == channels;
+    for (int i = 0; same && i < 6; i++) {
+        same = pb->getPixel((GRCOORD)(i % 3), (GRCOORD)(i / 3)).intValue == expected[i];
+    }
+    printf("%s: %s\n", name, same ? "as written" : "WRONG");
+    delete pb;
+    return same;
+}
+
+void main()
+{
+    // Round trips, at widths with and without padding
+    int widths[] = {400, 397};
+    for (int w = 0; w < 2; w++) {
+        int width = widths[w];
+        PixelBufferRGBA32 fb(width, 300);
+        DrawingContext dc(fb);
+        drawScene(dc, width, 300);
+        PixelBufferGray gray(width, 300);
+        DrawingContext gdc(gray);
+        drawScene(gdc, width, 300);
+
+        BMP::writeBMP("testbmp.bmp", fb);
+        PixelBuffer *back = BMP::readBMP("testbmp.bmp");
+        printf("%d wide RGBA: %d different\n", width,
+            expectZero(countDifferences(fb, back), "RGBA round trip"));
+        delete back;
+
+        BMP::writeBMP("testbmp_gray.bmp", gray);
+        back = BMP::readBMP("testbmp_gray.bmp");
+        printf("%d wide gray: %d different, %s\n", width,
+            expectZero(countDifferences(gray, back), "gray round trip"),
+            back && back->getChannels() == 1 ? "gray buffer" : "NOT GRAY");
+        delete back;
+    }
+
+    // The bytes of a small gray file: headers, palette, then the
+    // bottom row, padded from 3 bytes to 4
+    PixelBufferGray tiny(3, 2);
+    uint8_t top[3] = {1, 2, 3}, bottom[3] = {4, 5, 6};
+    tiny.setGraySpan(0, 0, 3, top);
+    tiny.setGraySpan(0, 1, 3, bottom);
+    BMP::writeBMP("testbmp_hand.bmp", tiny);
+    uint8_t bytes[2048];
+    FILE *fp = fopen("testbmp_hand.bmp", "rb");
+    size_t n = fread(bytes, 1, sizeof(bytes), fp);
+    fclose(fp);
+    uint8_t expected[2048];
+    size_t offset = handHeaders(expected, 8, 2, 0, 256, 8);
+    putLittle(expected + 34, 8, 4);
+    putLittle(expected + 38, 2835, 4);
+    putLittle(expected + 42, 2835, 4);
+    for (int i = 0; i < 256; i++) {
+        expected[54 + i * 4] = expected[55 + i * 4] = expected[56 + i * 4] = (uint8_t)i;
+    }
+    const uint8_t rows[8] = {4, 5, 6, 0, 1, 2, 3, 0};
+    memcpy(expected + offset, rows, 8);
+    printf("small gray file: %s\n", n == offset + 8 && memcmp(bytes, expected, n) == 0 ? "as the headers say" : "WRONG");
+
+    // Kinds we don't write.  Pixels are 0xAABBGGRR, as intValue is.
+    uint8_t file[2048];
+    const uint32_t rgb[6] = {0xff030201, 0xff060504, 0xff090807, 0xff0c0b0a, 0xff0f0e0d, 0xff121110};
+    int good = 0;
+
+    // 24 bit, bottom up, 9 bytes a row padded to 12
+    offset = handHeaders(file, 24, 2, 0, 0, 24);
+    const uint8_t bgr[24] = {12, 11, 10, 15, 14, 13, 18, 17, 16, 0, 0, 0, 3, 2, 1, 6, 5, 4, 9, 8, 7, 0, 0, 0};
+    memcpy(file + offset, bgr, 24);
+    good += readsAs("24 bit", file, offset + 24, rgb, 4);
+
+    // 32 bit, top down, with nothing in the alpha
+    offset = handHeaders(file, 32, -2, 0, 0, 24);
+    for (int i = 0; i < 6; i++) {
+        putLittle(file + offset + i * 4, ((rgb[i] & 0xff) << 16) | (rgb[i] & 0xff00) | ((rgb[i] >> 16) & 0xff), 4);
+    }
+    good += readsAs("32 bit top down, no alpha", file, offset + 24, rgb, 4);
+
+    // A color palette of 3, 3 bytes a row padded to 4
+    offset = handHeaders(file, 8, 2, 0, 3, 8);
+    const uint8_t quads[12] = {0, 0, 255, 0, 0, 255, 0, 0, 255, 0, 0, 0};
+    memcpy(file + 54, quads, 12);
+    const uint8_t indexes[8] = {2, 2, 2, 0, 0, 1, 2, 0};
+    memcpy(file + offset, indexes, 8);
+    const uint32_t paletted[6] = {0xff0000ff, 0xff00ff00, 0xffff0000, 0xffff0000, 0xffff0000, 0xffff0000};
+    good += readsAs("color palette", file, offset + 8, paletted, 4);
+    printf("hand made files read right: %d of 3\n", good);
+
+    // Bad files
+    int read = 0;
+    offset = handHeaders(file, 24, 2, 0, 0, 24);
+    memcpy(file + offset, bgr, 24);
+    writeFile("testbmp_hand.bmp", file, offset + 20);
+    PixelBuffer *pb = BMP::readBMP("testbmp_hand.bmp");
+    read += pb != NULL;
+    delete pb;
+    handHeaders(file, 8, 2, 1, 0, 24);
+    writeFile("testbmp_hand.bmp", file, 2048);
+    pb = BMP::readBMP("testbmp_hand.bmp");
+    read += pb != NULL;
+    delete pb;
+    writeFile("testbmp_hand.bmp", (const uint8_t *)"P6\n3 2\n255\n", 11);
+    pb = BMP::readBMP("testbmp_hand.bmp");
+    read += pb != NULL;
+    delete pb;
+    pb = BMP::readBMP("testbmp_missing.bmp");
+    read += pb != NULL;
+    delete pb;
+    printf("bad files that read: %d\n", read);
+
+    // A 4K frame
+    PixelBufferRGBA32 frame(3840, 2160);
+    DrawingContext fdc(frame);
+    drawScene(fdc, 3840, 2160);
+    auto start = std::chrono::steady_clock::now();
+    BMP::writeBMP("testbmp.bmp", frame);
+    int writeMs = elapsed(start);
+    start = std::chrono::steady_clock::now();
+    pb = BMP::readBMP("testbmp.bmp");
+    int readMs = elapsed(start);
+    delete pb;
+    start = std::chrono::steady_clock::now();
+    PBM::writePAM("testbmp.pam", frame);
+    int pamWriteMs = elapsed(start);
+    start = std::chrono::steady_clock::now();
+    pb = PBM::readImage("testbmp.pam");
+    int pamReadMs = elapsed(start);
+    delete pb;
+    printf("4K frame: BMP %d ms to write, %d ms to read, PAM %d ms to write, %d ms to read\n",
+        writeMs, readMs, pamWriteMs, pamReadMs);
+
+    remove("testbmp_hand.bmp");
+    remove("testbmp.pam");
+}
@@ -0,0 +1,293 @@
+/*
+    Anti-aliased fills.
+
+    The same shapes, a heart with a hole, a star by both fill rules, and
+    a few turned thin slivers, drawn with hard edges on the left and
+    smooth ones on the right, with a see-through one laid over the top.
+
+    Then some checks:  a rectangle with its edges part way across
+    pixels, where the coverage is easy to work out by hand.  Smooth
+    edges against drawing 4 times bigger with hard edges and averaging
+    back down, for how long each takes, and how close they are, which
+    can only be to within a few 16ths, near flat edges.  The SSE2 running sum against the plain one.  A
+    shape cut off by the clip, against the same part of it unclipped.
+    And a recording against drawing directly.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "DrawingContext.hpp"
+#include "CoverageRasterizer.hpp"
+#include "Path.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+#include "testing.hpp"
+
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+
+int elapsed(std::chrono::steady_clock::time_point start)
+{
+    return (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void makeHeart(Path &path)
+{
+    path.moveTo(0, -8);
+    path.cubicTo(-4, -20, -20, -20, -20, -6);
+    path.cubicTo(-20, 6, -6, 12, 0, 20);
+    path.cubicTo(6, 12, 20, 6, 20, -6);
+    path.cubicTo(20, -20, 4, -20, 0, -8);
+    path.close();
+
+    const REAL r = 5;
+    path.moveTo(r, 0);
+    path.quadTo(r, r, 0, r);
+    path.quadTo(-r, r, -r, 0);
+    path.quadTo(-r, -r, 0, -r);
+    path.quadTo(r, -r, r, 0);
+    path.close();
+}
+
+void makeStar(PointFx *pts, REAL cx, REAL cy, REAL radius)
+{
+    for (int i = 0; i < 5; i++) {
+        double a = -3.14159265358979 / 2 + i * 4 * 3.14159265358979 / 5;
+        pts[i] = PointFx::fromReal(cx + radius * (REAL)cos(a), cy + radius * (REAL)sin(a));
+    }
+}
+
+// The shapes, either way, with the left edge at x
+void drawShapes(DrawingContext &dc, const Path &heart, REAL x, bool smooth)
+{
+    dc.setFill(colors.red);
+    dc.push();
+    dc.translate(x + 60, 70);
+    dc.scale(2.5f, 2.5f);
+    dc.rotate(0.2f);
+    if (smooth) dc.fillPathAA(heart); else dc.fillPath(heart);
+    dc.pop();
+
+    PointFx star[5];
+    dc.setFill(colors.blue);
+    makeStar(star, x + 170, 70, 55);
+    if (smooth) dc.fillPolygonAA(star, 5, GR_NONZERO); else dc.fillPolygon(star, 5, GR_NONZERO);
+    makeStar(star, x + 90, 210, 55);
+    if (smooth) dc.fillPolygonAA(star, 5, GR_EVENODD); else dc.fillPolygon(star, 5, GR_EVENODD);
+
+    // thin slivers, fanned out
+    dc.setFill(colors.black);
+    for (int i = 0; i < 8; i++) {
+        REAL a = i * 0.18f;
+        REAL cx = x + 220, cy = 270;
+        PointFx sliver[4] = {
+            PointFx::fromReal(cx, cy),
+            PointFx::fromReal(cx + 90 * cosf(-a), cy + 90 * sinf(-a)),
+            PointFx::fromReal(cx + 90 * cosf(-a - 0.05f), cy + 90 * sinf(-a - 0.05f)),
+            PointFx::fromReal(cx, cy)
+        };
+        if (smooth) dc.fillPolygonAA(sliver, 4); else dc.fillPolygon(sliver, 4);
+    }
+
+    // half see-through, over the bottom of the star
+    PixRGBA glass = colors.green;
+    glass.a = 128;
+    dc.setFill(glass);
+    Point2D box[4] = {Point2D((GRCOORD)(x + 130), 100), Point2D((GRCOORD)(x + 260), 110),
+        Point2D((GRCOORD)(x + 250), 160), Point2D((GRCOORD)(x + 120), 150)};
+    if (smooth) dc.fillPolygonAA(box, 4); else dc.fillPolygon(box, 4);
+}
+
+void main()
+{
+    Path heart;
+    makeHeart(heart);
+
+    PixelBufferRGBA32 fb(640, 320);
+    DrawingContext dc(fb);
+    dc.setBackground(colors.white);
+    dc.clear();
+    drawShapes(dc, heart, 0, false);
+    drawShapes(dc, heart, 320, true);
+
+    printf("center of the smooth non-zero star is %s\n",
+        fb.getPixel(490, 70).intValue == colors.blue.intValue ? "filled" : "not filled");
+    printf("center of the smooth even-odd star is %s\n",
+        fb.getPixel(410, 210).intValue == colors.white.intValue ? "empty" : "not empty");
+    PBM::writePPMBinary("testcoverage.ppm", fb);
+
+    // A rectangle, where a pixel's coverage is how much of the
+    // square from half a pixel before its center to half after is inside
+    PixelBufferRGBA32 rect(64, 64);
+    DrawingContext rdc0(rect);
+    rdc0.setBackground(colors.black);
+    rdc0.clear();
+    rdc0.setFill(colors.white);
+    const REAL left = 10.3f, top = 20.6f, right = 50.85f, bottom = 40.1f;
+    PointFx corners[4] = {
+        PointFx::fromReal(left, top), PointFx::fromReal(right, top),
+        PointFx::fromReal(right, bottom), PointFx::fromReal(left, bottom)
+    };
+    rdc0.fillPolygonAA(corners, 4);
+
+    int wrong = 0;
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 64; x++) {
+            REAL w = fminf(x + 0.5f, right) - fmaxf(x - 0.5f, left);
+            REAL h = fminf(y + 0.5f, bottom) - fmaxf(y - 0.5f, top);
+            int expected = (w > 0 && h > 0) ? (int)(w * h * 255 + 0.5f) : 0;
+            if (abs(expected - (int)rect.getPixel(x, y).r) > 1) {
+                wrong++;
+            }
+        }
+    }
+    printf("rectangle pixels more than 1 off the exact coverage: %d\n", wrong);
+
+    // Smooth edges, against 4 x 4 samples a pixel, white on black
+    const int SIZE = 300;
+    const int REPEATS = 50;
+    PixelBufferRGBA32 smooth(SIZE, SIZE);
+    PixelBufferRGBA32 big(SIZE * 4, SIZE * 4);
+    DrawingContext sdc(smooth);
+    DrawingContext bdc(big);
+    sdc.setBackground(colors.black);
+    bdc.setBackground(colors.black);
+
+    PointFx star[5];
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < REPEATS; i++) {
+        sdc.clear();
+        sdc.setFill(colors.white);
+        sdc.push();
+        sdc.translate(150, 150);
+        sdc.scale(6, 6);
+        sdc.rotate(0.3f);
+        sdc.fillPathAA(heart);
+        sdc.pop();
+        makeStar(star, 60, 240, 50);
+        sdc.fillPolygonAA(star, 5);
+    }
+    int smoothMs = elapsed(start);
+
+    // the samples of pixel i are at 4i - 1.5, 4i - 0.5, 4i + 0.5, 4i + 1.5,
+    // which have to land on the big buffer's pixel centers
+    PixelBufferRGBA32 averaged(SIZE, SIZE);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < REPEATS; i++) {
+        bdc.clear();
+        bdc.setFill(colors.white);
+        bdc.push();
+        bdc.translate(1.5f, 1.5f);
+        bdc.scale(4, 4);
+        bdc.push();
+        bdc.translate(150, 150);
+        bdc.scale(6, 6);
+        bdc.rotate(0.3f);
+        bdc.fillPath(heart);
+        bdc.pop();
+        makeStar(star, 60, 240, 50);
+        bdc.fillPolygon(star, 5);
+        bdc.pop();
+
+        for (int y = 0; y < SIZE; y++) {
+            for (int x = 0; x < SIZE; x++) {
+                int sum = 0;
+                for (int j = 0; j < 16; j++) {
+                    sum += big.getPixel(x * 4 + (j & 3), y * 4 + (j >> 2)).r;
+                }
+                PixRGBA pix = colors.black;
+                pix.r = pix.g = pix.b = (uint8_t)((sum + 8) / 16);
+                averaged.setPixel(x, y, pix);
+            }
+        }
+    }
+    int bigMs = elapsed(start);
+
+    int worst = 0;
+    double total = 0;
+    for (int y = 0; y < SIZE; y++) {
+        for (int x = 0; x < SIZE; x++) {
+            int d = abs((int)smooth.getPixel(x, y).r - (int)averaged.getPixel(x, y).r);
+            if (d > worst) worst = d;
+            total += d;
+        }
+    }
+    printf("%d times: %d ms smooth, %d ms 4x4 samples\n", REPEATS, smoothMs, bigMs);
+    printf("against 4x4 samples: worst difference %d, average %.3f (of 255)\n", worst, total / (SIZE * SIZE));
+
+    // The running sum, with SSE2 and without
+    const int CELLS = 1000;
+    float *cells = new float[CELLS];
+    float *copy = new float[CELLS];
+    uint8_t *fast = new uint8_t[CELLS];
+    uint8_t *plain = new uint8_t[CELLS];
+    srand(7);
+    int mismatched = 0;
+    for (int rule = 0; rule < 2; rule++) {
+        for (int trial = 0; trial < 1000; trial++) {
+            for (int i = 0; i < CELLS; i++) {
+                cells[i] = (rand() % 9 == 0) ? (rand() % 2001 - 1000) / 500.0f : 0;
+                copy[i] = cells[i];
+            }
+            CoverageRasterizer::accumulate(cells, fast, CELLS - trial % 4, (GRFillRule)rule);
+            CoverageRasterizer::accumulateScalar(copy, plain, CELLS - trial % 4, (GRFillRule)rule);
+            for (int i = 0; i < CELLS - trial % 4; i++) {
+                if (abs((int)fast[i] - (int)plain[i]) > 1) {
+                    mismatched++;
+                }
+            }
+        }
+    }
+    printf("SSE2 vs plain running sum: %d differ by more than 1\n", mismatched);
+    delete [] cells;
+    delete [] copy;
+    delete [] fast;
+    delete [] plain;
+
+    // Cut off by the clip, against unclipped
+    PixelBufferRGBA32 clipped(320, 320);
+    PixelBufferRGBA32 whole(320, 320);
+    DrawingContext cdc(clipped);
+    DrawingContext wdc(whole);
+    cdc.clear();
+    wdc.clear();
+    cdc.setClip(70, 50, 150, 180);
+    drawShapes(cdc, heart, 0, true);
+    drawShapes(wdc, heart, 0, true);
+
+    int inside = 0, outside = 0;
+    for (int y = 0; y < 320; y++) {
+        for (int x = 0; x < 320; x++) {
+            if (x >= 70 && x < 220 && y >= 50 && y < 230) {
+                // where the clip starts moves the rounding a little
+                PixRGBA p = clipped.getPixel(x, y), q = whole.getPixel(x, y);
+                for (int c = 0; c < 4; c++) {
+                    if (abs((int)p.data[c] - (int)q.data[c]) > 1) {
+                        inside++;
+                        break;
+                    }
+                }
+            } else {
+                outside += clipped.getPixel(x, y).intValue != colors.gray50.intValue;
+            }
+        }
+    }
+    printf("clipped vs unclipped, more than 1 off: %d, drawn outside the clip: %d\n", inside, outside);
+
+    // Recorded and replayed, against drawn directly
+    DisplayList list;
+    PixelBufferRGBA32 direct(640, 320);
+    PixelBufferRGBA32 replayed(640, 320);
+    DrawingContext ddc(direct);
+    DrawingContext rdc(replayed);
+    ddc.clear();
+    rdc.clear();
+
+    drawShapes(ddc, heart, 20, true);
+    rdc.beginRecording(list);
+    drawShapes(rdc, heart, 0, true);
+    rdc.endRecording();
+    rdc.replay(list, 20, 0);
+    printf("replayed vs direct differences: %d\n",
+        expectZero(countDifferences(direct, replayed), "replayed vs direct"));
+}
@@ -0,0 +1,76 @@
+/*
+    Record a small scene into a display list, then play it back
+    several times, at different offsets, and onto different kinds
+    of pixel buffers.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "PixelBufferGray.hpp"
+#include "DrawingContext.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+
+void drawBadge(DrawingContext &dc)
+{
+    dc.setFill(colors.blue);
+    dc.setStroke(colors.white);
+    dc.drawRectangle(0, 0, 120, 80);
+
+    dc.setFill(colors.yellow);
+    dc.fillEllipse(60, 40, 30, 20);
+
+    dc.setStroke(colors.red);
+    dc.strokeLine(0, 0, 119, 79);
+    dc.strokeLine(0, 79, 119, 0);
+}
+
+void main()
+{
+    PixelBufferRGBA32 fb(640, 480);
+    DrawingContext dc(fb);
+
+    dc.setBackground(colors.white);
+    dc.clear();
+
+    // Record the badge once
+    DisplayList badge;
+    dc.beginRecording(badge);
+    drawBadge(dc);
+    dc.endRecording();
+
+    printf("Badge recorded in %d words\n", (int)badge.size());
+
+    // Then stamp it all over the canvas, including off the edges
+    for (int row = -1; row < 7; row++) {
+        for (int col = -1; col < 6; col++) {
+            dc.replay(badge, col * 130 + (row & 1) * 65, row * 90);
+        }
+    }
+
+    PBM::writePPMBinary("testdisplaylist.ppm", fb);
+
+    // Replaying at the origin should match drawing directly
+    PixelBufferRGBA32 direct(200, 200);
+    PixelBufferRGBA32 replayed(200, 200);
+    DrawingContext ddc(direct);
+    DrawingContext rdc(replayed);
+    drawBadge(ddc);
+    rdc.replay(badge);
+
+    int differences = 0;
+    for (GRSIZE y = 0; y < direct.getHeight(); y++) {
+        for (GRSIZE x = 0; x < direct.getWidth(); x++) {
+            if (direct.getPixel(x, y).intValue != replayed.getPixel(x, y).intValue) {
+                differences++;
+            }
+        }
+    }
+    printf("Direct vs replayed differences: %d\n", differences);
+
+    // The same list works on a gray buffer too
+    PixelBufferGray gray(320, 240);
+    DrawingContext gdc(gray);
+    gdc.clear();
+    gdc.replay(badge, 100, 80);
+    PBM::writePPMBinary("testdisplaylistgray.ppm", gray);
+}
@@ -0,0 +1,145 @@
+/*
+    Exporting in the background.
+
+    A render loop at 1080p that saves every tenth frame as a PNG, first
+    writing it right there in the loop, then through an ImageExporter,
+    with the slowest frame of each, which is where the saving shows.
+
+    A frame that's exported, then drawn over straight away, should be
+    in the file as it was when it was exported.  With a queue of one,
+    exports that don't wait should be turned away while the writer's
+    busy.  And a file that can't be written should say so, both to
+    waitFor() and to the completion function.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "DrawingContext.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+#include "png.hpp"
+#include "ImageExporter.hpp"
+#include "testing.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+
+int elapsedUs(std::chrono::steady_clock::time_point start)
+{
+    return (int)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void drawFrame(DrawingContext &dc, int width, int height, int frame)
+{
+    dc.setBackground(colors.white);
+    dc.clear();
+    dc.setStroke(colors.black);
+    double turn = frame * 3.14159265358979 / 60;
+    for (int i = 0; i < 60; i++) {
+        double a = turn + i * 3.14159265358979 / 30;
+        dc.strokeLine((GRCOORD)(width / 2), (GRCOORD)(height / 2),
+            (GRCOORD)(width / 2 + cos(a) * height / 2.5), (GRCOORD)(height / 2 - sin(a) * height / 2.5));
+    }
+    dc.setFill(colors.red);
+    dc.fillEllipse((GRCOORD)(width / 2 + cos(turn) * width / 3), (GRCOORD)(height / 2), 60, 60);
+}
+
+void main()
+{
+    const int Frames = 60;
+    PixelBufferRGBA32 fb(1920, 1080);
+    DrawingContext dc(fb);
+
+    // Saving in the loop
+    int slowest = 0, total = 0;
+    for (int i = 0; i < Frames; i++) {
+        auto start = std::chrono::steady_clock::now();
+        drawFrame(dc, 1920, 1080, i);
+        if (i % 10 == 0) {
+            PNG::writePNG("testexport.png", fb, 1);
+        }
+        int us = elapsedUs(start);
+        slowest = us > slowest ? us : slowest;
+        total += us;
+    }
+    printf("saving in the loop: slowest frame %.1f ms, %.1f ms a frame\n", slowest / 1000.0, total / 1000.0 / Frames);
+
+    // Through the exporter, which still has to be waited for at the end
+    {
+        ImageExporter exporter;
+        exporter.setPNGLevel(1);
+        slowest = 0;
+        total = 0;
+        auto loopStart = std::chrono::steady_clock::now();
+        for (int i = 0; i < Frames; i++) {
+            auto start = std::chrono::steady_clock::now();
+            drawFrame(dc, 1920, 1080, i);
+            if (i % 10 == 0) {
+                exporter.exportImage("testexport.png", fb, ImageExporter::FormatPNG);
+            }
+            int us = elapsedUs(start);
+            slowest = us > slowest ? us : slowest;
+            total += us;
+        }
+        bool ok = exporter.waitAll();
+        printf("with an exporter: slowest frame %.1f ms, %.1f ms a frame, %.1f ms with the wait at the end, %s\n",
+            slowest / 1000.0, total / 1000.0 / Frames, elapsedUs(loopStart) / 1000.0 / Frames, ok ? "all written" : "NOT ALL WRITTEN");
+    }
+    remove("testexport.png");
+
+    // What's written is the frame as it was exported
+    PixelBufferRGBA32 small(320, 240);
+    DrawingContext sdc(small);
+    PixelBufferRGBA32 expected(320, 240);
+    drawFrame(sdc, 320, 240, 7);
+    PixRGBA glass = colors.blue;
+    glass.a = 90;
+    sdc.setFill(glass);
+    sdc.fillRectangle(40, 40, 100, 100);
+    for (size_t y = 0; y < 240; y++) {
+        for (size_t x = 0; x < 320; x++) {
+            expected.setPixel((GRCOORD)x, (GRCOORD)y, small.getPixel((GRCOORD)x, (GRCOORD)y));
+        }
+    }
+
+    std::atomic<int> finished(0), failed(0);
+    {
+        ImageExporter exporter;
+        exporter.setCompletion([&](int, const char *, bool ok) {
+            finished++;
+            failed += !ok;
+        });
+        int id = exporter.exportImage("testexport.pam", small, ImageExporter::FormatPAM);
+        drawFrame(sdc, 320, 240, 30);
+        bool ok = exporter.waitFor(id);
+        PixelBuffer *back = PBM::readImage("testexport.pam");
+        printf("export %d: written %d, %d pixels different from when it was exported\n", id, ok,
+            expectZero(countDifferences(expected, back), "exported snapshot"));
+        delete back;
+        remove("testexport.pam");
+
+        // Somewhere that can't be written
+        id = exporter.exportImage("no such directory/testexport.ppm", small, ImageExporter::FormatPPM);
+        printf("export %d to nowhere: written %d\n", id, exporter.waitFor(id));
+    }
+    printf("completions: %d, %d of them failed\n", finished.load(), failed.load());
+
+    // Back-pressure, with a queue of one
+    {
+        ImageExporter exporter(1);
+        int taken = 0, turnedAway = 0;
+        for (int i = 0; i < 20; i++) {
+            drawFrame(dc, 1920, 1080, i);
+            if (exporter.exportImage("testexport.png", fb, ImageExporter::FormatPNG, false)) {
+                taken++;
+            } else {
+                turnedAway++;
+            }
+        }
+        exporter.waitAll();
+        printf("queue of one, 20 frames: %d exported, %d turned away\n", taken, turnedAway);
+    }
+    remove("testexport.png");
+}
@@ -0,0 +1,125 @@
+/*
+    Fixed point coordinates.
+
+    The top strip is the same little scene drawn 16 times, with
+    everything moved 1/16 of a pixel further right and down each time.
+    With whole pixels it would sit still and then jump.  It starts off
+    the top left of the canvas, where whole pixel coordinates can't go.
+
+    Below that, a five pointed star, filled with the non-zero rule,
+    which fills the middle, and the even-odd rule, which leaves it as a
+    hole.
+
+    Then a few checks: a polygon against the same shape as triangles,
+    and a recording against drawing directly.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "DrawingContext.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+#include "testing.hpp"
+
+#include <math.h>
+
+void drawScene(DrawingContext &dc, GRFIXED ox, GRFIXED oy)
+{
+    PointFx tri[3] = {
+        PointFx(ox + fixedFromInt(4), oy + fixedFromInt(-6)),
+        PointFx(ox + fixedFromInt(30), oy + fixedFromInt(10)),
+        PointFx(ox + fixedFromInt(8), oy + fixedFromInt(28))
+    };
+    dc.setFill(colors.blue);
+    dc.fillTriangle(tri);
+
+    dc.setFill(colors.yellow);
+    dc.fillEllipse(PointFx(ox + fixedFromInt(22), oy + fixedFromInt(22)), fixedFromReal(7.5f), fixedFromReal(4.25f));
+
+    dc.setStroke(colors.red);
+    dc.strokeLine(PointFx(ox - fixedFromInt(10), oy), PointFx(ox + fixedFromInt(36), oy + fixedFromInt(20)));
+    dc.strokeEllipse(PointFx(ox + fixedFromInt(22), oy + fixedFromInt(22)), fixedFromInt(10), fixedFromInt(7));
+}
+
+// The points of a star, going around twice, so the middle is
+// wound around twice
+void makeStar(PointFx *pts, GRFIXED cx, GRFIXED cy, GRFIXED radius)
+{
+    for (int i = 0; i < 5; i++) {
+        double a = -3.14159265358979 / 2 + i * 4 * 3.14159265358979 / 5;
+        pts[i] = PointFx(cx + (GRFIXED)(radius * cos(a)), cy + (GRFIXED)(radius * sin(a)));
+    }
+}
+
+void main()
+{
+    PixelBufferRGBA32 fb(640, 300);
+    DrawingContext dc(fb);
+    dc.setBackground(colors.white);
+    dc.clear();
+
+    // a frame of the animation every 40 pixels, moving 1/16 pixel each
+    for (int frame = 0; frame < 16; frame++) {
+        int left = frame * 40;
+        dc.setClip(left, 0, 38, 40);
+        drawScene(dc, fixedFromInt(left - 8) + frame * GRFIXED_ONE / 16, fixedFromInt(-4) + frame * GRFIXED_ONE / 16);
+    }
+    dc.clearClip();
+
+    PointFx star[5];
+    dc.setFill(colors.green);
+    makeStar(star, fixedFromInt(150), fixedFromInt(160), fixedFromReal(100.5f));
+    dc.fillPolygon(star, 5, GR_NONZERO);
+    makeStar(star, fixedFromInt(400), fixedFromInt(160), fixedFromReal(100.5f));
+    dc.fillPolygon(star, 5, GR_EVENODD);
+
+    printf("center of the non-zero star is %s\n",
+        fb.getPixel(150, 160).intValue == colors.green.intValue ? "filled" : "empty");
+    printf("center of the even-odd star is %s\n",
+        fb.getPixel(400, 160).intValue == colors.green.intValue ? "filled" : "empty");
+
+    PBM::writePPMBinary("testfixed.ppm", fb);
+
+    // A quadrilateral as a polygon, and as two triangles, should cover
+    // exactly the same pixels, with nothing drawn twice or missed
+    PixelBufferRGBA32 polyPb(200, 200);
+    PixelBufferRGBA32 triPb(200, 200);
+    DrawingContext pdc(polyPb);
+    DrawingContext tdc(triPb);
+    pdc.clear();
+    tdc.clear();
+
+    PointFx quad[4] = {
+        PointFx::fromReal(10.3f, 20.7f), PointFx::fromReal(180.1f, 5.5f),
+        PointFx::fromReal(150.6f, 190.25f), PointFx::fromReal(-20.9f, 120.125f)
+    };
+    PointFx half1[3] = {quad[0], quad[1], quad[2]};
+    PointFx half2[3] = {quad[0], quad[2], quad[3]};
+    pdc.fillPolygon(quad, 4);
+    tdc.fillTriangle(half1);
+    tdc.fillTriangle(half2);
+    printf("polygon vs triangles differences: %d\n",
+        expectZero(countDifferences(polyPb, triPb), "polygon vs triangles"));
+
+    // Recording, then replaying at an offset, should match
+    // drawing directly at that offset
+    DisplayList list;
+    PixelBufferRGBA32 direct(200, 120);
+    PixelBufferRGBA32 replayed(200, 120);
+    DrawingContext ddc(direct);
+    DrawingContext rdc(replayed);
+    ddc.clear();
+    rdc.clear();
+
+    rdc.beginRecording(list);
+    drawScene(rdc, fixedFromReal(0.3f), fixedFromReal(0.6f));
+    makeStar(star, fixedFromInt(60), fixedFromInt(60), fixedFromInt(40));
+    rdc.fillPolygon(star, 5, GR_EVENODD);
+    rdc.endRecording();
+    rdc.replay(list, 25, 15);
+
+    drawScene(ddc, fixedFromReal(25.3f), fixedFromReal(15.6f));
+    makeStar(star, fixedFromInt(85), fixedFromInt(75), fixedFromInt(40));
+    ddc.fillPolygon(star, 5, GR_EVENODD);
+    printf("replayed vs direct differences: %d\n",
+        expectZero(countDifferences(direct, replayed), "replayed vs direct"));
+}
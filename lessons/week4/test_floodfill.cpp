@@ -0,0 +1,90 @@
+/*
+    Flood fill some shapes, a noisy area with a tolerance, and then
+    a whole 8K canvas worth of maze, which would have blown the stack
+    with a recursive fill.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "PixelBufferGray.hpp"
+#include "DrawingContext.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+#include "testing.hpp"
+
+#include <stdlib.h>
+#include <chrono>
+
+int elapsed(std::chrono::steady_clock::time_point start)
+{
+    return (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void main()
+{
+    PixelBufferRGBA32 fb(640, 480);
+    DrawingContext dc(fb);
+
+    dc.setBackground(colors.white);
+    dc.clear();
+
+    // outlines to fill inside of
+    dc.setStroke(colors.black);
+    dc.strokeEllipse(160, 160, 120, 100);
+    dc.strokeRectangle(320, 40, 280, 240);
+    dc.strokeLine(320, 40, 599, 279);
+    dc.strokeTriangle(GRTriangle(100, 300, 300, 460, 20, 440));
+
+    dc.setFill(colors.red);
+    dc.floodFill(160, 160);
+    dc.setFill(colors.green);
+    dc.floodFill(500, 100);
+    dc.setFill(colors.blue);
+    dc.floodFill(380, 220);
+    dc.setFill(colors.yellow);
+    dc.floodFill(120, 400);
+
+    // noisy patch, only fills with some tolerance
+    srand(3);
+    for (int y = 320; y < 460; y++) {
+        for (int x = 360; x < 620; x++) {
+            PixRGBA pix = colors.gray50;
+            pix.r = pix.r + rand() % 16;
+            pix.g = pix.g + rand() % 16;
+            pix.b = pix.b + rand() % 16;
+            fb.setPixel(x, y, pix);
+        }
+    }
+    dc.setFill(colors.cyan);
+    dc.floodFill(361, 321, 16);
+
+    PBM::writePPMBinary("testfloodfill.ppm", fb);
+
+    // A serpentine maze over an 8K canvas, one single region
+    PixelBufferGray big(7680, 4320);
+    DrawingContext bdc(big);
+    bdc.setBackground(colors.white);
+    bdc.clear();
+    bdc.setStroke(colors.black);
+    for (int x = 4; x < 7680; x += 4) {
+        if ((x / 4) % 2) {
+            bdc.strokeVerticalLine(x, 0, 4318);
+        } else {
+            bdc.strokeVerticalLine(x, 2, 4318);
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    bdc.setFill(colors.gray50);
+    bdc.floodFill(0, 0);
+    printf("8K maze fill: %d ms\n", elapsed(start));
+
+    int unfilled = 0;
+    for (GRSIZE y = 0; y < big.getHeight(); y++) {
+        for (GRSIZE x = 0; x < big.getWidth(); x++) {
+            if (big.getPixel(x, y).r == 255) {
+                unfilled++;
+            }
+        }
+    }
+    printf("Unfilled pixels left: %d\n", expectZero(unfilled, "unfilled pixels"));
+}
@@ -0,0 +1,231 @@
+/*
+    Writing frames of an animation.
+
+    Two frames of noise, at a size that's odd both ways, written as a
+    Y4M and read back, where every Y, U and V should be what the
+    formulas say.  A few frames as a raw RGBA stream, which should be
+    the pixels exactly.
+
+    And an animation of 120 frames, written a PPM a frame, the way it
+    used to be done, against a single Y4M and a single raw stream, with
+    the frames converted and written while the next one is drawn.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "DrawingContext.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+#include "FrameWriter.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+
+int elapsed(std::chrono::steady_clock::time_point start)
+{
+    return (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void fillNoise(PixelBufferRGBA32 &pb)
+{
+    for (size_t y = 0; y < pb.getHeight(); y++) {
+        for (size_t x = 0; x < pb.getWidth(); x++) {
+            PixRGBA pix;
+            pix.intValue = (uint32_t)rand() ^ ((uint32_t)rand() << 16);
+            pb.setPixel((GRCOORD)x, (GRCOORD)y, pix);
+        }
+    }
+}
+
+// BT.601, video range, worked out one pixel at a time
+int lumaOf(PixRGBA p)
+{
+    return ((66 * p.r + 129 * p.g + 25 * p.b + 128) >> 8) + 16;
+}
+
+// The U and V of the 2x2 block at (x, y), with the pixels past the
+// edges being the ones on the edge
+void chromaOf(const PixelBuffer &pb, size_t x, size_t y, int &u, int &v)
+{
+    size_t x1 = x + 1 < pb.getWidth() ? x + 1 : x;
+    size_t y1 = y + 1 < pb.getHeight() ? y + 1 : y;
+    PixRGBA p[4] = {pb.getPixel((GRCOORD)x, (GRCOORD)y), pb.getPixel((GRCOORD)x1, (GRCOORD)y),
+        pb.getPixel((GRCOORD)x, (GRCOORD)y1), pb.getPixel((GRCOORD)x1, (GRCOORD)y1)};
+    int r = (p[0].r + p[1].r + p[2].r + p[3].r + 2) >> 2;
+    int g = (p[0].g + p[1].g + p[2].g + p[3].g + 2) >> 2;
+    int b = (p[0].b + p[1].b + p[2].b + p[3].b + 2) >> 2;
+    u = ((112 * b - 38 * r - 74 * g + 128) >> 8) + 128;
+    v = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+}
+
+// The bytes that don't match the formulas, or -1 if the frame isn't there
+int checkY4MFrame(FILE *fp, const PixelBuffer &pb)
+{
+    char marker[6];
+    if (fread(marker, 1, 6, fp) != 6 || memcmp(marker, "FRAME\n", 6) != 0) {
+        return -1;
+    }
+    size_t width = pb.getWidth(), height = pb.getHeight();
+    size_t cw = (width + 1) / 2, ch = (height + 1) / 2;
+    size_t bytes = width * height + cw * ch * 2;
+    uint8_t *planes = (uint8_t *)malloc(bytes);
+    if (fread(planes, 1, bytes, fp) != bytes) {
+        free(planes);
+        return -1;
+    }
+
+    int wrong = 0;
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            wrong += planes[y * width + x] != lumaOf(pb.getPixel((GRCOORD)x, (GRCOORD)y));
+        }
+    }
+    for (size_t y = 0; y < ch; y++) {
+        for (size_t x = 0; x < cw; x++) {
+            int u, v;
+            chromaOf(pb, x * 2, y * 2, u, v);
+            wrong += planes[width * height + y * cw + x] != u;
+            wrong += planes[width * height + cw * ch + y * cw + x] != v;
+        }
+    }
+    free(planes);
+    return wrong;
+}
+
+void drawFrame(DrawingContext &dc, int width, int height, int frame)
+{
+    dc.setBackground(colors.white);
+    dc.clear();
+    dc.setStroke(colors.black);
+    double turn = frame * 3.14159265358979 / 60;
+    for (int i = 0; i < 60; i++) {
+        double a = turn + i * 3.14159265358979 / 30;
+        dc.strokeLine((GRCOORD)(width / 2), (GRCOORD)(height / 2),
+            (GRCOORD)(width / 2 + cos(a) * height / 2.5), (GRCOORD)(height / 2 - sin(a) * height / 2.5));
+    }
+    dc.setFill(colors.red);
+    dc.fillEllipse((GRCOORD)(width / 2 + cos(turn) * width / 3), (GRCOORD)(height / 2), 60, 60);
+}
+
+void main()
+{
+    // Noise, 37 by 21, which is 32 pixels with SSE2 and 5 without
+    srand(47);
+    PixelBufferRGBA32 noise(37, 21);
+    PixelBufferRGBA32 second(37, 21);
+    fillNoise(noise);
+    fillNoise(second);
+
+    FrameWriter video;
+    bool opened = video.open("testframes_noise.y4m", 37, 21, FrameWriter::Y4M, 24);
+    video.addFrame(noise);
+    video.addFrame(second);
+    bool closed = video.close();
+
+    FILE *fp = fopen("testframes_noise.y4m", "rb");
+    char header[128];
+    bool headerOk = fgets(header, sizeof(header), fp) && strcmp(header, "YUV4MPEG2 W37 H21 F24:1 Ip A1:1 C420jpeg\n") == 0;
+    int first = checkY4MFrame(fp, noise);
+    int next = checkY4MFrame(fp, second);
+    bool atEnd = fgetc(fp) == EOF;
+    fclose(fp);
+    printf("Y4M: opened %d, closed %d, header %s, wrong bytes %d and %d, %s\n", opened, closed,
+        headerOk ? "right" : "WRONG", first, next, atEnd ? "nothing after" : "EXTRA BYTES");
+
+    // Raw RGBA
+    video.open("testframes_noise.rgba", 37, 21, FrameWriter::RawRGBA);
+    video.addFrame(noise);
+    video.addFrame(second);
+    video.addFrame(noise);
+    video.close();
+    fp = fopen("testframes_noise.rgba", "rb");
+    int rawWrong = 0;
+    const PixelBufferRGBA32 *frames[3] = {&noise, &second, &noise};
+    for (int f = 0; f < 3; f++) {
+        for (size_t y = 0; y < 21; y++) {
+            for (size_t x = 0; x < 37; x++) {
+                PixRGBA pix;
+                rawWrong += fread(&pix, 4, 1, fp) != 1 || pix.intValue != frames[f]->getPixel((GRCOORD)x, (GRCOORD)y).intValue;
+            }
+        }
+    }
+    bool rawAtEnd = fgetc(fp) == EOF;
+    fclose(fp);
+    printf("raw RGBA: %d wrong pixels, %s\n", rawWrong, rawAtEnd ? "nothing after" : "EXTRA BYTES");
+    remove("testframes_noise.y4m");
+    remove("testframes_noise.rgba");
+
+    // Too small, or not open
+    PixelBufferRGBA32 small(20, 20);
+    bool wrongAdds = video.addFrame(small);
+    video.open("testframes_noise.y4m", 37, 21);
+    wrongAdds = wrongAdds || video.addFrame(small);
+    video.close();
+    remove("testframes_noise.y4m");
+    printf("frames that shouldn't have been added: %s\n", wrongAdds ? "ADDED" : "none");
+
+    // An animation, 120 frames at 720p
+    const int Frames = 120;
+    PixelBufferRGBA32 fb(1280, 720);
+    DrawingContext dc(fb);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < Frames; i++) {
+        drawFrame(dc, 1280, 720, i);
+    }
+    int drawMs = elapsed(start);
+
+    start = std::chrono::steady_clock::now();
+    char name[64];
+    for (int i = 0; i < Frames; i++) {
+        drawFrame(dc, 1280, 720, i);
+        snprintf(name, sizeof(name), "testframes_%03d.ppm", i);
+        PBM::writePPMBinary(name, fb);
+    }
+    int ppmMs = elapsed(start);
+    for (int i = 0; i < Frames; i++) {
+        snprintf(name, sizeof(name), "testframes_%03d.ppm", i);
+        remove(name);
+    }
+
+    start = std::chrono::steady_clock::now();
+    video.open("testframes.y4m", 1280, 720);
+    for (int i = 0; i < Frames; i++) {
+        drawFrame(dc, 1280, 720, i);
+        video.addFrame(fb);
+    }
+    video.close();
+    int y4mMs = elapsed(start);
+
+    start = std::chrono::steady_clock::now();
+    video.open("testframes.rgba", 1280, 720, FrameWriter::RawRGBA);
+    for (int i = 0; i < Frames; i++) {
+        drawFrame(dc, 1280, 720, i);
+        video.addFrame(fb);
+    }
+    video.close();
+    int rawMs = elapsed(start);
+    remove("testframes.y4m");
+    remove("testframes.rgba");
+
+    printf("%d frames at 720p: %d ms just drawing, %d ms with a PPM each, %d ms to one Y4M, %d ms to raw RGBA\n",
+        Frames, drawMs, ppmMs, y4mMs, rawMs);
+
+    // The conversion on its own
+    PixRGBA *pixels = (PixRGBA *)malloc(3840 * 2160 * sizeof(PixRGBA));
+    memset(pixels, 0x80, 3840 * 2160 * sizeof(PixRGBA));
+    uint8_t *planes = (uint8_t *)malloc(3840 * 2160 * 3 / 2);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 10; i++) {
+        for (size_t y = 0; y < 2160; y += 2) {
+            const PixRGBA *row = pixels + y * 3840;
+            FrameWriter::rgbToYUV420(row, row + 3840, 3840, planes + y * 3840, planes + (y + 1) * 3840,
+                planes + 3840 * 2160 + y / 2 * 1920, planes + 3840 * 2160 * 5 / 4 + y / 2 * 1920);
+        }
+    }
+    printf("4K frame to YUV 4:2:0: %.1f ms\n", elapsed(start) / 10.0);
+    free(pixels);
+    free(planes);
+}
@@ -0,0 +1,165 @@
+/*
+    Animated GIFs.
+
+    A 60 frame loop at 640x480, drawn with a DrawingContext, written
+    as a GIF, with how long it takes and how big it is.  The file is
+    walked through block by block, and should have a frame for every
+    frame that changed, with the delays adding up to the whole loop.
+
+    A few frames that don't change, which should only make the frame
+    before them last longer, and a frame with one pixel changed, which
+    should be a frame of one pixel.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "DrawingContext.hpp"
+#include "colors.hpp"
+#include "GIFWriter.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+
+int elapsed(std::chrono::steady_clock::time_point start)
+{
+    return (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void drawFrame(DrawingContext &dc, int width, int height, int frame)
+{
+    dc.setBackground(colors.white);
+    dc.clear();
+
+    // a gradient down the side, for more colors than fit in a palette
+    for (int y = 0; y < height; y += 2) {
+        PixRGBA band;
+        band.r = (uint8_t)(255 * y / height);
+        band.g = (uint8_t)(128 + frame);
+        band.b = (uint8_t)(255 - 255 * y / height);
+        band.a = 255;
+        dc.setFill(band);
+        dc.fillRectangle(0, (GRCOORD)y, width / 4, 2);
+    }
+
+    dc.setStroke(colors.black);
+    double turn = frame * 3.14159265358979 / 30;
+    for (int i = 0; i < 24; i++) {
+        double a = turn + i * 3.14159265358979 / 12;
+        dc.strokeLine((GRCOORD)(width * 5 / 8), (GRCOORD)(height / 2),
+            (GRCOORD)(width * 5 / 8 + cos(a) * height / 3), (GRCOORD)(height / 2 - sin(a) * height / 3));
+    }
+    dc.setFill(colors.red);
+    dc.fillEllipse((GRCOORD)(width * 5 / 8 + cos(turn) * height / 2.5), (GRCOORD)(height / 2 - sin(turn) * height / 2.5), 20, 20);
+}
+
+// What's in a GIF
+struct GIFSummary {
+    bool valid;
+    int frames;
+    int totalDelay;
+    int lastWidth, lastHeight;
+};
+
+// Walk the blocks of a GIF, without decoding the pixels
+GIFSummary summarize(const char *filename)
+{
+    GIFSummary summary = {false, 0, 0, 0, 0};
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return summary;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t *data = (uint8_t *)malloc(size);
+    fread(data, 1, size, fp);
+    fclose(fp);
+
+    long at = 13;
+    bool ok = size > 13 && memcmp(data, "GIF89a", 6) == 0;
+    while (ok && at < size) {
+        uint8_t kind = data[at];
+        if (kind == 0x3b) {
+            summary.valid = at == size - 1;
+            break;
+        }
+        if (kind == 0x21) {
+            if (data[at + 1] == 0xf9) {
+                summary.totalDelay += data[at + 4] | (data[at + 5] << 8);
+            }
+            at += 2;
+        } else if (kind == 0x2c) {
+            summary.frames++;
+            summary.lastWidth = data[at + 5] | (data[at + 6] << 8);
+            summary.lastHeight = data[at + 7] | (data[at + 8] << 8);
+            uint8_t flags = data[at + 9];
+            at += 10;
+            if (flags & 0x80) {
+                at += 3 << ((flags & 7) + 1);
+            }
+            at++;   // LZW code size
+        } else {
+            ok = false;
+            break;
+        }
+        // sub-blocks, to the empty one
+        while (at < size && data[at] != 0) {
+            at += data[at] + 1;
+        }
+        at++;
+    }
+
+    free(data);
+    return summary;
+}
+
+void main()
+{
+    const int Frames = 60;
+    PixelBufferRGBA32 fb(640, 480);
+    DrawingContext dc(fb);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < Frames; i++) {
+        drawFrame(dc, 640, 480, i);
+    }
+    int drawMs = elapsed(start);
+
+    GIFWriter gif;
+    start = std::chrono::steady_clock::now();
+    gif.open("testgif.gif", 640, 480, 4);
+    for (int i = 0; i < Frames; i++) {
+        drawFrame(dc, 640, 480, i);
+        gif.addFrame(fb);
+    }
+    bool closed = gif.close();
+    int gifMs = elapsed(start);
+
+    GIFSummary summary = summarize("testgif.gif");
+    FILE *fp = fopen("testgif.gif", "rb");
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+    printf("%d frames at 640x480: %d ms just drawing, %d ms drawing and writing the GIF, %ld bytes\n",
+        Frames, drawMs, gifMs, size);
+    printf("  closed %d, %s, %d frames, %d hundredths of a second\n", closed,
+        summary.valid ? "valid" : "NOT VALID", summary.frames, summary.totalDelay);
+
+    // Frames that don't change, then one pixel that does
+    gif.open("testgif_still.gif", 640, 480, 10);
+    drawFrame(dc, 640, 480, 0);
+    for (int i = 0; i < 5; i++) {
+        gif.addFrame(fb);
+    }
+    dc.setStroke(colors.blue);
+    dc.fillPixel(300, 200);
+    gif.addFrame(fb, 50);
+    gif.close();
+    summary = summarize("testgif_still.gif");
+    printf("still frames: %s, %d frames for 6 added, %d hundredths, the last %dx%d\n",
+        summary.valid ? "valid" : "NOT VALID", summary.frames, summary.totalDelay,
+        summary.lastWidth, summary.lastHeight);
+    remove("testgif_still.gif");
+}
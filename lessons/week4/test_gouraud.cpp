@@ -0,0 +1,215 @@
+/*
+    Flat and smooth shaded triangles.
+
+    A jittered mesh is filled into a buffer that counts how many times
+    each pixel is written, to show that triangles sharing edges cover
+    every pixel exactly once.  Then the same mesh is smooth shaded,
+    recorded and replayed, and timed.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "DrawingContext.hpp"
+#include "DisplayList.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+int elapsed(std::chrono::steady_clock::time_point start)
+{
+    return (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// A pixel buffer that keeps track of how often each pixel is written
+class CountingBuffer : public PixelBufferRGBA32 {
+public:
+    CountingBuffer(GRSIZE width, GRSIZE height)
+        : PixelBufferRGBA32(width, height)
+    {
+        counts = new int[width*height]{};
+    }
+
+    virtual ~CountingBuffer()
+    {
+        delete [] counts;
+    }
+
+    bool setPixel(GRCOORD x, GRCOORD y, const PixRGBA pix)
+    {
+        counts[y*getWidth() + x]++;
+        return PixelBufferRGBA32::setPixel(x, y, pix);
+    }
+
+    void setPixels(GRCOORD x, GRCOORD y, GRSIZE width, const PixRGBA pix)
+    {
+        count(x, y, width);
+        PixelBufferRGBA32::setPixels(x, y, width, pix);
+    }
+
+    bool setSpan(GRCOORD x, GRCOORD y, const GRSIZE width, const PixRGBA * pix)
+    {
+        count(x, y, width);
+        return PixelBufferRGBA32::setSpan(x, y, width, pix);
+    }
+
+    void fillSpans(const GRSpan *spans, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) {
+            count(spans[i].x, spans[i].y, spans[i].width);
+        }
+        PixelBufferRGBA32::fillSpans(spans, n);
+    }
+
+    int getCount(int x, int y) const { return counts[y*getWidth() + x]; }
+
+private:
+    void count(int x, int y, int width)
+    {
+        for (int i = 0; i < width; i++) {
+            counts[y*getWidth() + x + i]++;
+        }
+    }
+
+    int *counts;
+};
+
+static const int COLS = 40;
+static const int ROWS = 30;
+static const int CELL = 24;
+
+GRCOORD px[ROWS+1][COLS+1], py[ROWS+1][COLS+1];
+PixRGBA pc[ROWS+1][COLS+1];
+
+// Two triangles for each cell of the grid
+template <typename T>
+void eachTriangle(T body)
+{
+    for (int row = 0; row < ROWS; row++) {
+        for (int col = 0; col < COLS; col++) {
+            body(GRColorTriangle(px[row][col], py[row][col], pc[row][col],
+                px[row][col+1], py[row][col+1], pc[row][col+1],
+                px[row+1][col], py[row+1][col], pc[row+1][col]));
+            body(GRColorTriangle(px[row][col+1], py[row][col+1], pc[row][col+1],
+                px[row+1][col+1], py[row+1][col+1], pc[row+1][col+1],
+                px[row+1][col], py[row+1][col], pc[row+1][col]));
+        }
+    }
+}
+
+void main()
+{
+    // grid of points, jittered inside, straight along the outside
+    srand(11);
+    for (int row = 0; row <= ROWS; row++) {
+        for (int col = 0; col <= COLS; col++) {
+            int jx = (col > 0 && col < COLS) ? rand() % 11 - 5 : 0;
+            int jy = (row > 0 && row < ROWS) ? rand() % 11 - 5 : 0;
+            px[row][col] = 20 + col * CELL + jx;
+            py[row][col] = 20 + row * CELL + jy;
+            pc[row][col].r = (uint8_t)(col * 255 / COLS);
+            pc[row][col].g = (uint8_t)(row * 255 / ROWS);
+            pc[row][col].b = (uint8_t)(rand() % 256);
+            pc[row][col].a = 255;
+        }
+    }
+
+    int width = 2 * 20 + COLS * CELL;
+    int height = 2 * 20 + ROWS * CELL;
+
+    // Coverage: every pixel inside the mesh is written exactly once
+    CountingBuffer counted(width, height);
+    DrawingContext cdc(counted);
+    cdc.setFill(colors.white);
+    eachTriangle([&](const GRColorTriangle &t) {
+        cdc.fillTriangle(GRTriangle(t.verts[0].x, t.verts[0].y, t.verts[1].x, t.verts[1].y, t.verts[2].x, t.verts[2].y));
+    });
+
+    int missed = 0, doubled = 0;
+    for (int y = 20; y < 20 + ROWS * CELL; y++) {
+        for (int x = 20; x < 20 + COLS * CELL; x++) {
+            int n = counted.getCount(x, y);
+            if (n == 0) missed++;
+            if (n > 1) doubled++;
+        }
+    }
+    printf("flat mesh: %d pixels missed, %d drawn more than once\n", missed, doubled);
+
+    // The smooth shaded version covers the same pixels
+    CountingBuffer shadedCount(width, height);
+    DrawingContext sdc(shadedCount);
+    eachTriangle([&](const GRColorTriangle &t) {
+        sdc.fillTriangle(t);
+    });
+
+    int different = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (counted.getCount(x, y) != shadedCount.getCount(x, y)) {
+                different++;
+            }
+        }
+    }
+    printf("shaded mesh: %d pixels covered differently from flat\n", different);
+
+    // Smooth shading, drawn directly, and recorded then replayed
+    PixelBufferRGBA32 direct(width, height);
+    PixelBufferRGBA32 replayed(width, height);
+    DrawingContext ddc(direct);
+    DrawingContext rdc(replayed);
+
+    ddc.setBackground(colors.black);
+    ddc.clear();
+    eachTriangle([&](const GRColorTriangle &t) {
+        ddc.fillTriangle(t);
+    });
+    ddc.fillTriangle(GRColorTriangle(60, 60, colors.red, 400, 120, colors.green, 180, 420, colors.blue));
+
+    DisplayList list;
+    rdc.beginRecording(list);
+    rdc.setBackground(colors.black);
+    rdc.clear();
+    eachTriangle([&](const GRColorTriangle &t) {
+        rdc.fillTriangle(t);
+    });
+    rdc.fillTriangle(GRColorTriangle(60, 60, colors.red, 400, 120, colors.green, 180, 420, colors.blue));
+    rdc.endRecording();
+    rdc.replay(list);
+
+    different = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (direct.getPixel(x, y).intValue != replayed.getPixel(x, y).intValue) {
+                different++;
+            }
+        }
+    }
+    printf("replayed: %d pixels differ from direct drawing\n", different);
+
+    PBM::writePPMBinary("testgouraud.ppm", direct);
+
+    // Throughput, for small and big triangles
+    PixelBufferRGBA32 fb(1920, 1080);
+    DrawingContext dc(fb);
+    const int NTRIS = 200000;
+
+    srand(5);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < NTRIS; i++) {
+        GRCOORD x = 20 + rand() % 1880;
+        GRCOORD y = 20 + rand() % 1040;
+        dc.fillTriangle(GRColorTriangle(x, y, colors.red,
+            x + rand() % 21 - 10, y + rand() % 21 - 10, colors.green,
+            x + rand() % 21 - 10, y + rand() % 21 - 10, colors.blue));
+    }
+    int ms = elapsed(start);
+    printf("%d small shaded triangles: %d ms\n", NTRIS, ms);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 1000; i++) {
+        dc.fillTriangle(GRColorTriangle(0, 0, colors.red, 1919, 100, colors.green, 300, 1079, colors.blue));
+    }
+    ms = elapsed(start);
+    printf("1000 large shaded triangles: %d ms\n", ms);
+}
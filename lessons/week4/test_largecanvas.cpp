@@ -0,0 +1,149 @@
+/*
+    Large canvases.
+
+    Built with GR_LARGE_CANVAS, so coordinates are signed 32 bits, and
+    sizes 64 bits.
+
+    A really big canvas, 80000 x 80000, is 6.4 billion pixels, which is
+    more memory than most machines have to spare.  So the first check
+    uses a pixel buffer that doesn't store anything, it just remembers
+    the offsets it's asked to write to.  Drawing into its far corner
+    should land past the 32 bit limit, at exactly the right place.
+
+    Then a real canvas that is wider than 65535 pixels, and short, with
+    things drawn off the left edge at negative coordinates, and out
+    past where 16 bit coordinates would have wrapped around.
+*/
+
+#define GR_LARGE_CANVAS 1
+
+#include "PixelBufferGray.hpp"
+#include "PixelBufferRGBA32.hpp"
+#include "DrawingContext.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+
+#include <chrono>
+
+// Remembers the lowest and highest offsets written, rather than pixels
+class OffsetProbe : public PixelBuffer {
+public:
+    OffsetProbe(GRSIZE width, GRSIZE height)
+        : PixelBuffer(width, height), lowest(~(GROFFSET)0), highest(0), written(0)
+    {}
+
+    bool setPixel(GRCOORD x, GRCOORD y, const PixRGBA)
+    {
+        record(pixelOffset(x, y), 1);
+        return true;
+    }
+
+    PixRGBA getPixel(GRCOORD, GRCOORD) const { return colors.black; }
+
+    void setPixels(GRCOORD x, GRCOORD y, GRSIZE width, const PixRGBA)
+    {
+        record(pixelOffset(x, y), width);
+    }
+
+    bool setSpan(GRCOORD x, GRCOORD y, const GRSIZE width, const PixRGBA *)
+    {
+        record(pixelOffset(x, y), width);
+        return true;
+    }
+
+    bool setAllPixels(const PixRGBA)
+    {
+        record(0, pixelCount());
+        return true;
+    }
+
+    void record(GROFFSET offset, GRSIZE width)
+    {
+        if (offset < lowest) lowest = offset;
+        if (offset + width - 1 > highest) highest = offset + width - 1;
+        written += width;
+    }
+
+    GROFFSET lowest, highest, written;
+};
+
+void main()
+{
+    const GRCOORD BIG = 80000;
+
+    OffsetProbe probe(BIG, BIG);
+    DrawingContext pdc(probe);
+
+    pdc.fillRectangle(BIG - 100, BIG - 100, 200, 200);
+    printf("bottom right 100x100: offsets %llu to %llu, %llu pixels\n",
+        (unsigned long long)probe.lowest, (unsigned long long)probe.highest, (unsigned long long)probe.written);
+    printf("expected: offsets %llu to %llu, %llu pixels\n",
+        (unsigned long long)(BIG - 100) * BIG + (BIG - 100),
+        (unsigned long long)BIG * BIG - 1, 100ULL * 100);
+
+    // a line corner to corner should touch the first and last pixels
+    probe.lowest = ~(GROFFSET)0;
+    probe.highest = 0;
+    probe.written = 0;
+    pdc.strokeLine(-50, -50, BIG + 50, BIG + 50);
+    printf("corner to corner line: offsets %llu to %llu, %llu pixels\n",
+        (unsigned long long)probe.lowest, (unsigned long long)probe.highest, (unsigned long long)probe.written);
+
+    // an ellipse across most of it, where the midpoint terms need
+    // 64 bits, should reach from its top row to its bottom row, and
+    // the filled one should cover its area
+    const GRSIZE RADIUS = 30000;
+    probe.lowest = ~(GROFFSET)0;
+    probe.highest = 0;
+    probe.written = 0;
+    pdc.strokeEllipse(BIG / 2, BIG / 2, RADIUS, RADIUS);
+    printf("ellipse outline: rows %llu to %llu, %llu pixels\n",
+        (unsigned long long)(probe.lowest / BIG), (unsigned long long)(probe.highest / BIG), (unsigned long long)probe.written);
+    printf("expected: rows %llu to %llu\n",
+        (unsigned long long)(BIG / 2 - RADIUS), (unsigned long long)(BIG / 2 + RADIUS));
+
+    probe.written = 0;
+    pdc.fillEllipse(BIG / 2, BIG / 2, RADIUS, RADIUS);
+    printf("filled ellipse: %.4f of its area\n", probe.written / (3.14159265358979 * RADIUS * RADIUS));
+
+    // A real one, past 16 bits across
+    const GRSIZE WIDE = 100000;
+    const GRSIZE HIGH = 200;
+    PixelBufferRGBA32 wide(WIDE, HIGH);
+    DrawingContext dc(wide);
+
+    auto start = std::chrono::steady_clock::now();
+    dc.setBackground(colors.white);
+    dc.clear();
+
+    dc.setFill(colors.blue);
+    dc.fillRectangle(-40, 20, 100, 50);             // hangs off the left
+    dc.fillRectangle(70000, 20, 100, 50);           // where 16 bits would wrap to 4464
+    dc.setFill(colors.red);
+    dc.fillEllipse(99990, 100, 30, 30);             // hangs off the right
+
+    dc.setStroke(colors.black);
+    dc.strokeLine(-1000, 199, 99999 + 1000, 0);
+
+    Point2D poly[4] = {Point2D(65000, 120), Point2D(66000, 120), Point2D(66000, 180), Point2D(65000, 180)};
+    dc.setFill(colors.green);
+    dc.fillPolygon(poly, 4);
+
+    int ms = (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    printf("%llu x %llu drawn in %d ms\n", (unsigned long long)WIDE, (unsigned long long)HIGH, ms);
+
+    printf("pixel at (10, 40) is %s\n", wide.getPixel(10, 40).intValue == colors.blue.intValue ? "blue" : "not blue");
+    printf("pixel at (70050, 40) is %s\n", wide.getPixel(70050, 40).intValue == colors.blue.intValue ? "blue" : "not blue");
+    printf("pixel at (4514, 40) is %s\n", wide.getPixel(4514, 40).intValue == colors.white.intValue ? "white" : "not white");
+    printf("pixel at (65500, 150) is %s\n", wide.getPixel(65500, 150).intValue == colors.green.intValue ? "green" : "not green");
+
+    // the header has to say 100000, not whatever 32 bits of it look like
+    PBM::writePPMBinary("testlargecanvas.ppm", wide);
+    FILE *fp = fopen("testlargecanvas.ppm", "rb");
+    if (fp) {
+        char header[32] = {0};
+        fread(header, 1, 16, fp);
+        fclose(fp);
+        printf("ppm header: %.14s\n", header);
+    }
+}
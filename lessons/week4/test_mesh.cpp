@@ -0,0 +1,165 @@
+/*
+    Indexed meshes.
+
+    A torus, drawn as an indexed mesh, and again as a plain list of
+    triangles with every vertex repeated.  The pictures should be the
+    same, the indexed one just gets there with less work.
+
+    Then a jittered grid that covers the whole screen, where any pixel
+    left showing the background is a crack between triangles.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "DrawingContext.hpp"
+#include "Renderer3D.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+
+int elapsed(std::chrono::steady_clock::time_point start)
+{
+    return (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// A torus around the y axis, as rings x segments vertices, and two
+// triangles for each, counter clockwise from outside
+void makeTorus(int rings, int segments, Vertex3D *verts, uint32_t *indices)
+{
+    const REAL pi = 3.14159265f;
+    for (int r = 0; r < rings; r++) {
+        REAL a = 2 * pi * r / rings;
+        for (int s = 0; s < segments; s++) {
+            REAL b = 2 * pi * s / segments;
+            Vertex3D &v = verts[r * segments + s];
+            v.pos = Vec3((1 + 0.4f * cosf(b)) * cosf(a), 0.4f * sinf(b), (1 + 0.4f * cosf(b)) * sinf(a));
+            v.color.r = (uint8_t)(128 + 127 * cosf(a));
+            v.color.g = (uint8_t)(128 + 127 * sinf(b));
+            v.color.b = (uint8_t)(128 + 127 * sinf(a));
+            v.color.a = 255;
+        }
+    }
+
+    int n = 0;
+    for (int r = 0; r < rings; r++) {
+        for (int s = 0; s < segments; s++) {
+            uint32_t i00 = r * segments + s;
+            uint32_t i01 = r * segments + (s + 1) % segments;
+            uint32_t i10 = ((r + 1) % rings) * segments + s;
+            uint32_t i11 = ((r + 1) % rings) * segments + (s + 1) % segments;
+            indices[n++] = i00; indices[n++] = i01; indices[n++] = i11;
+            indices[n++] = i00; indices[n++] = i11; indices[n++] = i10;
+        }
+    }
+}
+
+void main()
+{
+    const int RINGS = 512;
+    const int SEGMENTS = 256;
+    const int NVERTS = RINGS * SEGMENTS;
+    const int NINDICES = RINGS * SEGMENTS * 6;
+
+    Vertex3D *verts = new Vertex3D[NVERTS];
+    uint32_t *indices = new uint32_t[NINDICES];
+    Vertex3D *expanded = new Vertex3D[NINDICES];
+    makeTorus(RINGS, SEGMENTS, verts, indices);
+    for (int i = 0; i < NINDICES; i++) {
+        expanded[i] = verts[indices[i]];
+    }
+
+    PixelBufferRGBA32 indexedPb(1280, 720);
+    PixelBufferRGBA32 listPb(1280, 720);
+
+    Mat4 projection = Mat4::perspective(1.0f, 1280.0f / 720, 0.5f, 100.0f);
+    Mat4 view = Mat4::lookAt(Vec3(0, 1.8f, 2.6f), Vec3(0, 0, 0), Vec3(0, 1, 0));
+
+    Renderer3D indexed(indexedPb);
+    indexed.setTransform(projection * view * Mat4::rotationX(0.4f));
+    indexed.setBackfaceCulling(true);
+    indexed.clear(colors.gray50);
+
+    auto start = std::chrono::steady_clock::now();
+    indexed.drawIndexed(verts, NVERTS, indices, NINDICES);
+    int indexedMs = elapsed(start);
+    indexed.end();
+
+    Renderer3D list(listPb);
+    list.setTransform(projection * view * Mat4::rotationX(0.4f));
+    list.setBackfaceCulling(true);
+    list.clear(colors.gray50);
+
+    start = std::chrono::steady_clock::now();
+    list.drawTriangles(expanded, NINDICES);
+    int listMs = elapsed(start);
+    list.end();
+
+    printf("%d vertices, %d triangles\n", NVERTS, NINDICES / 3);
+    printf("indexed: %d ms, %.1f M triangles/s, %zu edges reused from the cache\n",
+        indexedMs, indexedMs ? NINDICES / 3 / 1000.0 / indexedMs : 0.0, indexed.getEdgeCacheHits());
+    printf("triangle list: %d ms, %.1f M triangles/s\n",
+        listMs, listMs ? NINDICES / 3 / 1000.0 / listMs : 0.0);
+
+    int different = 0;
+    for (int y = 0; y < 720; y++) {
+        for (int x = 0; x < 1280; x++) {
+            if (indexedPb.getPixel(x, y).intValue != listPb.getPixel(x, y).intValue) {
+                different++;
+            }
+        }
+    }
+    printf("indexed vs triangle list differences: %d\n", different);
+
+    PBM::writePPMBinary("testmesh.ppm", indexedPb);
+
+    // A flat grid, jittered, straight on, a bit bigger than the screen
+    const int COLS = 64;
+    const int ROWS = 36;
+    Vertex3D grid[(ROWS + 1) * (COLS + 1)];
+    uint32_t gridIndices[ROWS * COLS * 6];
+
+    srand(9);
+    for (int r = 0; r <= ROWS; r++) {
+        for (int c = 0; c <= COLS; c++) {
+            REAL jx = (c > 0 && c < COLS) ? (rand() % 100 - 50) / 250.0f : 0;
+            REAL jy = (r > 0 && r < ROWS) ? (rand() % 100 - 50) / 250.0f : 0;
+            Vertex3D &v = grid[r * (COLS + 1) + c];
+            v.pos = Vec3((c + jx) * 2.1f / COLS - 1.05f, 1.05f - (r + jy) * 2.1f / ROWS, 0);
+            v.color = ((r + c) % 2) ? colors.white : colors.blue;
+        }
+    }
+
+    int n = 0;
+    for (int r = 0; r < ROWS; r++) {
+        for (int c = 0; c < COLS; c++) {
+            uint32_t i00 = r * (COLS + 1) + c;
+            uint32_t i01 = i00 + 1;
+            uint32_t i10 = i00 + COLS + 1;
+            uint32_t i11 = i10 + 1;
+            gridIndices[n++] = i00; gridIndices[n++] = i10; gridIndices[n++] = i11;
+            gridIndices[n++] = i00; gridIndices[n++] = i11; gridIndices[n++] = i01;
+        }
+    }
+
+    PixelBufferRGBA32 gridPb(1280, 720);
+    Renderer3D gridR(gridPb);
+    gridR.clear(colors.red);
+    gridR.drawIndexed(grid, (ROWS + 1) * (COLS + 1), gridIndices, n);
+    gridR.end();
+
+    int cracks = 0;
+    for (int y = 0; y < 720; y++) {
+        for (int x = 0; x < 1280; x++) {
+            if (gridPb.getPixel(x, y).intValue == colors.red.intValue) {
+                cracks++;
+            }
+        }
+    }
+    printf("grid: %d pixels showing through cracks\n", cracks);
+
+    delete [] verts;
+    delete [] indices;
+    delete [] expanded;
+}
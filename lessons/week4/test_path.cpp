@@ -0,0 +1,198 @@
+/*
+    Paths.
+
+    A heart, made of cubic curves, with a round hole in it made of
+    quadratic ones, going the other way.  Drawn as icons, many times
+    over, moved and turned, which shouldn't flatten the path again.
+    Then a chart, a series of points as an open path, stroked, and
+    closed along the bottom and filled underneath.
+
+    Then some checks:  the path is only flattened again when it's
+    drawn bigger, and how much drawing the same icons costs when the
+    path is made and flattened every time, and how much of that is
+    just making and flattening it.  A square path should fill exactly the pixels of
+    the same square as a polygon, and a recording should match drawing
+    directly.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "DrawingContext.hpp"
+#include "Path.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+#include "testing.hpp"
+
+#include <math.h>
+#include <chrono>
+
+int elapsed(std::chrono::steady_clock::time_point start)
+{
+    return (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// A heart about 40 across, centered on (0, 0), with a hole in it
+void makeHeart(Path &path)
+{
+    path.moveTo(0, -8);
+    path.cubicTo(-4, -20, -20, -20, -20, -6);
+    path.cubicTo(-20, 6, -6, 12, 0, 20);
+    path.cubicTo(6, 12, 20, 6, 20, -6);
+    path.cubicTo(20, -20, 4, -20, 0, -8);
+    path.close();
+
+    // the hole, the other way around
+    const REAL r = 5;
+    path.moveTo(r, 0);
+    path.quadTo(r, r, 0, r);
+    path.quadTo(-r, r, -r, 0);
+    path.quadTo(-r, -r, 0, -r);
+    path.quadTo(r, -r, r, 0);
+    path.close();
+}
+
+void drawIcons(DrawingContext &dc, const Path &heart, int count)
+{
+    for (int i = 0; i < count; i++) {
+        dc.push();
+        dc.translate((REAL)(30 + (i % 12) * 45), (REAL)(40 + (i / 12) % 4 * 45));
+        dc.rotate(i * 0.1f);
+        dc.fillPath(heart);
+        dc.strokePath(heart);
+        dc.pop();
+    }
+}
+
+void main()
+{
+    PixelBufferRGBA32 fb(560, 400);
+    DrawingContext dc(fb);
+    dc.setBackground(colors.white);
+    dc.clear();
+
+    Path heart;
+    makeHeart(heart);
+    dc.setFill(colors.red);
+    dc.setStroke(colors.black);
+    drawIcons(dc, heart, 48);
+    printf("48 hearts, flattened %d time(s)\n", heart.getFlattenCount());
+    printf("middle of the first heart is %s\n",
+        fb.getPixel(30, 40).intValue == colors.white.intValue ? "a hole" : "filled");
+
+    // bigger, so it has to be flattened again, finer
+    dc.push();
+    dc.translate(480, 300);
+    dc.scale(3, 3);
+    dc.setFill(colors.yellow);
+    dc.fillPath(heart);
+    dc.strokePath(heart);
+    dc.pop();
+    printf("at 3x, flattened %d time(s), %d points\n", heart.getFlattenCount(), heart.getFlatPointCount());
+
+    // a chart series, stroked on top of the area under it
+    Path series, area;
+    area.moveTo(20, 390);
+    for (int i = 0; i <= 80; i++) {
+        REAL x = 20 + i * 5.0f;
+        REAL y = 330 - 40 * sinf(i * 0.15f) - i * 0.5f;
+        if (i == 0) {
+            series.moveTo(x, y);
+        } else {
+            series.lineTo(x, y);
+        }
+        area.lineTo(x, y);
+    }
+    area.lineTo(420, 390);
+    area.close();
+
+    dc.setFill(colors.cyan);
+    dc.fillPath(area);
+    dc.setStroke(colors.blue);
+    dc.strokePath(series);
+
+    PBM::writePPMBinary("testpath.ppm", fb);
+
+    // The same icons, flattened every time, against using what's kept
+    PixelBufferRGBA32 icons(560, 200);
+    DrawingContext idc(icons);
+    idc.clear();
+    const int FRAMES = 200;
+
+    Path icon;
+    makeHeart(icon);
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        drawIcons(idc, icon, 48);
+    }
+    int keptMs = elapsed(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        for (int i = 0; i < 48; i++) {
+            Path fresh;
+            makeHeart(fresh);
+            idc.push();
+            idc.translate((REAL)(30 + (i % 12) * 45), (REAL)(40 + (i / 12) % 4 * 45));
+            idc.rotate(i * 0.1f);
+            idc.fillPath(fresh);
+            idc.strokePath(fresh);
+            idc.pop();
+        }
+    }
+    int freshMs = elapsed(start);
+
+    int points = 0;
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        for (int i = 0; i < 48; i++) {
+            Path fresh;
+            makeHeart(fresh);
+            fresh.flatten(1);
+            points += fresh.getFlatPointCount();
+        }
+    }
+    int flattenMs = elapsed(start);
+
+    printf("%d frames of 48 icons: %d ms flattened once, %d ms flattened every time\n", FRAMES, keptMs, freshMs);
+    printf("just making and flattening them: %d ms, %d points\n", flattenMs, points);
+
+    // A square path, and the same square as a polygon
+    PixelBufferRGBA32 pathPb(100, 100);
+    PixelBufferRGBA32 polyPb(100, 100);
+    DrawingContext pdc(pathPb);
+    DrawingContext qdc(polyPb);
+    pdc.clear();
+    qdc.clear();
+
+    Path square;
+    square.moveTo(10.25f, 12.5f);
+    square.lineTo(80.75f, 8.0f);
+    square.lineTo(90.5f, 85.25f);
+    square.lineTo(5.0f, 70.0f);
+    square.close();
+    pdc.fillPath(square);
+
+    PointFx corners[4] = {
+        PointFx::fromReal(10.25f, 12.5f), PointFx::fromReal(80.75f, 8.0f),
+        PointFx::fromReal(90.5f, 85.25f), PointFx::fromReal(5.0f, 70.0f)
+    };
+    qdc.fillPolygon(corners, 4);
+    printf("square path vs polygon differences: %d\n",
+        expectZero(countDifferences(pathPb, polyPb), "square path vs polygon"));
+
+    // Recorded and replayed, against drawn directly
+    DisplayList list;
+    PixelBufferRGBA32 direct(560, 200);
+    PixelBufferRGBA32 replayed(560, 200);
+    DrawingContext ddc(direct);
+    DrawingContext rdc(replayed);
+    ddc.clear();
+    rdc.clear();
+
+    drawIcons(ddc, heart, 48);
+    rdc.beginRecording(list);
+    drawIcons(rdc, heart, 48);
+    rdc.endRecording();
+    rdc.replay(list);
+    printf("replayed vs direct differences: %d\n",
+        expectZero(countDifferences(direct, replayed), "replayed vs direct"));
+}
@@ -0,0 +1,198 @@
+/*
+    Reading PPM, PGM and PAM files.
+
+    A picture is written out in each of the formats we can write, and
+    read back, which should give the same pixels, less the alpha for
+    the ones that don't keep it.  The rows of a mapped file, used where
+    they are, against the buffer.  Small files written by hand, as
+    text, with comments, with a maxval other than 255, and with two
+    byte samples.  Files that are cut short, or aren't images at all,
+    shouldn't read.
+
+    And how long a 4K frame takes to load, against reading it a byte at
+    a time with fgetc(), the way the old reader did.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "PixelBufferGray.hpp"
+#include "DrawingContext.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+#include "testing.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+int elapsedUs(std::chrono::steady_clock::time_point start)
+{
+    return (int)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void drawScene(DrawingContext &dc)
+{
+    dc.setBackground(colors.gray50);
+    dc.clear();
+    dc.setFill(colors.yellow);
+    dc.fillRectangle(20, 20, 200, 100);
+    dc.setFill(colors.red);
+    dc.fillEllipse(250, 150, 120, 80);
+    PixRGBA glass = colors.blue;
+    glass.a = 100;
+    dc.setFill(glass);
+    dc.fillRectangle(100, 50, 200, 200);
+    dc.setStroke(colors.black);
+    for (int i = 0; i < 20; i++) {
+        dc.strokeLine(0, (GRCOORD)(i * 15), 398, (GRCOORD)(299 - i * 15));
+    }
+}
+
+void writeText(const char *filename, const char *text)
+{
+    FILE *fp = fopen(filename, "wb");
+    fputs(text, fp);
+    fclose(fp);
+}
+
+void writeBytes(const char *filename, const char *header, const uint8_t *bytes, size_t count)
+{
+    FILE *fp = fopen(filename, "wb");
+    fputs(header, fp);
+    fwrite(bytes, 1, count, fp);
+    fclose(fp);
+}
+
+// One pixel, or -1 for a file that didn't read
+int pixelAt(const char *filename, int x, int y, int channel)
+{
+    PixelBuffer *pb = PBM::readImage(filename);
+    if (!pb) {
+        return -1;
+    }
+    int value = pb->getPixel(x, y).data[channel];
+    delete pb;
+    return value;
+}
+
+void main()
+{
+    // Round trips
+    PixelBufferRGBA32 rgba(399, 300);
+    DrawingContext dc(rgba);
+    drawScene(dc);
+    PixelBufferGray gray(399, 300);
+    DrawingContext gdc(gray);
+    drawScene(gdc);
+
+    PBM::writePPMBinary("testpbmread.ppm", rgba);
+    PBM::writePAM("testpbmread.pam", rgba);
+    PBM::writePGMBinary("testpbmread.pgm", gray);
+    PBM::writePAM("testpbmread_gray.pam", gray);
+
+    PixelBuffer *pb = PBM::readImage("testpbmread.ppm");
+    printf("P6 differences: %d\n",
+        expectZero(countDifferences(rgba, pb, false), "P6 read"));
+    delete pb;
+    pb = PBM::readImage("testpbmread.pam");
+    printf("P7 RGBA differences: %d\n",
+        expectZero(countDifferences(rgba, pb), "P7 RGBA read"));
+    delete pb;
+    pb = PBM::readImage("testpbmread.pgm");
+    printf("P5 differences: %d, %s buffer\n", expectZero(countDifferences(gray, pb), "P5 read"),
+        pb && pb->getChannels() == 1 ? "gray" : "RGBA");
+    delete pb;
+    pb = PBM::readImage("testpbmread_gray.pam");
+    printf("P7 gray differences: %d\n", expectZero(countDifferences(gray, pb), "P7 gray read"));
+    delete pb;
+
+    // A gray file into an RGBA buffer
+    PixelBufferRGBA32 expanded(399, 300);
+    PBMFile file;
+    file.open("testpbmread.pgm");
+    file.readInto(expanded);
+    printf("P5 into RGBA differences: %d\n",
+        expectZero(countDifferences(gray, &expanded), "P5 into RGBA"));
+
+    // Rows where they are
+    file.open("testpbmread.pam");
+    int wrongRows = 0;
+    PixRGBA row[399];
+    for (size_t y = 0; y < file.getHeight(); y++) {
+        rgba.getSpan(0, (GRCOORD)y, 399, row);
+        if (memcmp(file.getRow(y), row, file.getRowBytes()) != 0) {
+            wrongRows++;
+        }
+    }
+    printf("mapped P7 rows different: %d\n", wrongRows);
+    file.close();
+
+    // By hand
+    writeText("testpbmread_p2.pgm", "P2\n# a comment\n3 2\n# another\n15\n0 5 10\n15 7\n3\n");
+    printf("P2, maxval 15: %d %d %d (expect 85 255 51)\n",
+        pixelAt("testpbmread_p2.pgm", 1, 0, 0), pixelAt("testpbmread_p2.pgm", 0, 1, 0), pixelAt("testpbmread_p2.pgm", 2, 1, 0));
+    writeText("testpbmread_p3.ppm", "P3 2 1 255 10 20 30 #comment\n 200 100 0\n");
+    printf("P3: %d %d %d (expect 10 100 0)\n",
+        pixelAt("testpbmread_p3.ppm", 0, 0, 0), pixelAt("testpbmread_p3.ppm", 1, 0, 1), pixelAt("testpbmread_p3.ppm", 1, 0, 2));
+    uint8_t wide[4] = {0xff, 0xff, 0x80, 0x00};
+    writeBytes("testpbmread_16.pgm", "P5 2 1 65535\n", wide, 4);
+    printf("P5, 16 bits: %d %d (expect 255 128)\n", pixelAt("testpbmread_16.pgm", 0, 0, 0), pixelAt("testpbmread_16.pgm", 1, 0, 0));
+    uint8_t ga[4] = {10, 20, 30, 40};
+    writeBytes("testpbmread_ga.pam", "P7\nWIDTH 2\nHEIGHT 1\nDEPTH 2\nMAXVAL 255\nTUPLTYPE GRAYSCALE_ALPHA\nENDHDR\n", ga, 4);
+    printf("P7 gray and alpha: %d %d (expect 30 40)\n", pixelAt("testpbmread_ga.pam", 1, 0, 1), pixelAt("testpbmread_ga.pam", 1, 0, 3));
+
+    // Bad files
+    int read = 0;
+    writeBytes("testpbmread_bad.ppm", "P6 4 4 255\n", ga, 4);
+    read += PBM::readImage("testpbmread_bad.ppm") != NULL;
+    writeText("testpbmread_bad.ppm", "P3 2 1 255 10 20 30 40\n");
+    read += PBM::readImage("testpbmread_bad.ppm") != NULL;
+    writeText("testpbmread_bad.ppm", "GIF89a");
+    read += PBM::readImage("testpbmread_bad.ppm") != NULL;
+    writeText("testpbmread_bad.ppm", "");
+    read += PBM::readImage("testpbmread_bad.ppm") != NULL;
+    read += PBM::readImage("testpbmread_missing.ppm") != NULL;
+    printf("bad files that read: %d\n", read);
+
+    // A 4K frame
+    PixelBufferRGBA32 frame(3840, 2160);
+    DrawingContext fdc(frame);
+    fdc.setBackground(colors.cyan);
+    fdc.clear();
+    PBM::writePPMBinary("testpbmread_4k.ppm", frame);
+
+    auto start = std::chrono::steady_clock::now();
+    pb = PBM::readImage("testpbmread_4k.ppm");
+    int readUs = elapsedUs(start);
+    expectZero(countDifferences(frame, pb, false), "4K P6 read");
+    printf("4K P6 read: same\n");
+    delete pb;
+
+    start = std::chrono::steady_clock::now();
+    FILE *fp = fopen("testpbmread_4k.ppm", "rb");
+    PixelBufferRGBA32 slow(3840, 2160);
+    char line[64];
+    for (int i = 0; i < 3; i++) {
+        fgets(line, sizeof(line), fp);
+    }
+    for (int y = 0; y < 2160; y++) {
+        for (int x = 0; x < 3840; x++) {
+            PixRGBA pix;
+            pix.r = (uint8_t)fgetc(fp);
+            pix.g = (uint8_t)fgetc(fp);
+            pix.b = (uint8_t)fgetc(fp);
+            pix.a = 255;
+            slow.setPixel(x, y, pix);
+        }
+    }
+    fclose(fp);
+    int slowUs = elapsedUs(start);
+    printf("4K P6: %d us mapped, %d us with fgetc()\n", readUs, slowUs);
+
+    const char *files[] = {"testpbmread.ppm", "testpbmread.pam", "testpbmread.pgm", "testpbmread_gray.pam",
+        "testpbmread_p2.pgm", "testpbmread_p3.ppm", "testpbmread_16.pgm", "testpbmread_ga.pam",
+        "testpbmread_bad.ppm", "testpbmread_4k.ppm"};
+    for (int i = 0; i < 10; i++) {
+        remove(files[i]);
+    }
+}
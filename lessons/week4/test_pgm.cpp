@@ -0,0 +1,159 @@
+/*
+    Gray and alpha files.
+
+    A gray buffer saved as a PGM, a byte a pixel, against the PPM of
+    the same buffer, which should be three times as big.  An RGBA
+    buffer with see-through parts saved as a PAM, which keeps the
+    alpha.  Every file is read back here, a pixel at a time, and
+    checked against getPixel().  And how long a big gray frame takes
+    each way.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "PixelBufferGray.hpp"
+#include "DrawingContext.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+int elapsed(std::chrono::steady_clock::time_point start)
+{
+    return (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+long fileSize(const char *filename)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+    return size;
+}
+
+// Skip the header, which ends after the line starting with 'last',
+// then compare each pixel's bytes, 'channels' of them
+int countWrongPixels(const char *filename, const PixelBuffer &pb, const char *last, int lines, int channels)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return -1;
+    }
+    char line[128];
+    for (int i = 0; i < lines; i++) {
+        if (!fgets(line, sizeof(line), fp)) {
+            fclose(fp);
+            return -1;
+        }
+    }
+    if (strncmp(line, last, strlen(last)) != 0) {
+        fclose(fp);
+        return -1;
+    }
+
+    int wrong = 0;
+    for (size_t y = 0; y < pb.getHeight(); y++) {
+        for (size_t x = 0; x < pb.getWidth(); x++) {
+            PixRGBA pix = pb.getPixel((GRCOORD)x, (GRCOORD)y);
+            uint8_t bytes[4];
+            if (fread(bytes, channels, 1, fp) != 1) {
+                fclose(fp);
+                return -1;
+            }
+            bool same = channels == 1 ? bytes[0] == pix.r : memcmp(bytes, pix.data, channels) == 0;
+            if (!same) {
+                wrong++;
+            }
+        }
+    }
+    if (fgetc(fp) != EOF) {
+        wrong++;
+    }
+    fclose(fp);
+    return wrong;
+}
+
+void drawScene(DrawingContext &dc)
+{
+    dc.setBackground(colors.gray50);
+    dc.clear();
+    dc.setFill(colors.white);
+    dc.fillRectangle(20, 20, 200, 100);
+    dc.setFill(colors.red);
+    dc.fillEllipse(250, 150, 120, 80);
+    dc.setStroke(colors.black);
+    for (int i = 0; i < 20; i++) {
+        dc.strokeLine(0, (GRCOORD)(i * 15), 399, (GRCOORD)(299 - i * 15));
+    }
+}
+
+void main()
+{
+    // Gray, as PGM and PPM
+    PixelBufferGray gray(400, 300);
+    DrawingContext gdc(gray);
+    drawScene(gdc);
+    PBM::writeImage("testpgm.pgm", gray);
+    PBM::writePPMBinary("testpgm.ppm", gray);
+    printf("gray: %ld bytes as PGM, %ld bytes as PPM\n", fileSize("testpgm.pgm"), fileSize("testpgm.ppm"));
+    printf("gray PGM pixels wrong: %d\n", countWrongPixels("testpgm.pgm", gray, "255", 3, 1));
+
+    // RGBA, with some see-through parts, as PAM
+    PixelBufferRGBA32 rgba(400, 300);
+    DrawingContext rdc(rgba);
+    drawScene(rdc);
+    PixRGBA glass = colors.blue;
+    glass.a = 100;
+    rdc.setFill(glass);
+    rdc.fillRectangle(100, 50, 200, 200);
+    PixRGBA hole = colors.transparent;
+    rdc.setFill(hole);
+    rdc.fillRectangle(10, 200, 50, 50);
+    PBM::writeImage("testpgm.pam", rgba);
+    printf("RGBA PAM pixels wrong: %d\n", countWrongPixels("testpgm.pam", rgba, "ENDHDR", 7, 4));
+
+    // A color buffer as gray, and a gray buffer as PAM
+    PBM::writePGMBinary("testpgm_color.pgm", rgba);
+    int wrong = 0;
+    FILE *fp = fopen("testpgm_color.pgm", "rb");
+    char line[64];
+    for (int i = 0; i < 3; i++) {
+        fgets(line, sizeof(line), fp);
+    }
+    for (int y = 0; y < 300; y++) {
+        for (int x = 0; x < 400; x++) {
+            if (fgetc(fp) != toGray(rgba.getPixel(x, y))) {
+                wrong++;
+            }
+        }
+    }
+    fclose(fp);
+    printf("color buffer as PGM, pixels wrong: %d\n", wrong);
+
+    PBM::writePAM("testpgm_gray.pam", gray);
+    printf("gray PAM pixels wrong: %d\n", countWrongPixels("testpgm_gray.pam", gray, "ENDHDR", 7, 1));
+
+    // A big gray frame
+    PixelBufferGray big(3840, 2160);
+    DrawingContext bdc(big);
+    bdc.setBackground(colors.gray50);
+    bdc.clear();
+    auto start = std::chrono::steady_clock::now();
+    PBM::writeImage("testpgm_big.pgm", big);
+    int pgmMs = elapsed(start);
+    start = std::chrono::steady_clock::now();
+    PBM::writePPMBinary("testpgm_big.ppm", big);
+    int ppmMs = elapsed(start);
+    printf("4K gray: %d ms as PGM, %d ms as PPM\n", pgmMs, ppmMs);
+
+    remove("testpgm_color.pgm");
+    remove("testpgm_gray.pam");
+    remove("testpgm_big.pgm");
+    remove("testpgm_big.ppm");
+}
@@ -0,0 +1,545 @@
+/*
+    PNG files.
+
+    A picture written as a PNG at a few levels, for how big each comes
+    out and how long it takes, against the PPM.  A gray buffer, and one
+    with see-through parts, which has to keep its alpha.  Each file is
+    read back with a small inflater of the test's own, and has to come
+    out the same as the buffer it was written from.
+
+    The checksums against their known values, and combining the
+    checksums of two pieces against summing the whole.  And a 4K frame,
+    with the scheduler's workers and with none, which is enough rows
+    for many chunks, and more than one group of them.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "PixelBufferGray.hpp"
+#include "DrawingContext.hpp"
+#include "TaskScheduler.hpp"
+#include "Deflate.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+#include "png.hpp"
+#include "testing.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+
+int elapsed(std::chrono::steady_clock::time_point start)
+{
+    return (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+long fileSize(const char *filename)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+    return size;
+}
+
+/*
+    Inflater
+
+    Deflate decoding, as plain as it can be, to check the Deflater
+    with.  Huffman codes are decoded a bit at a time from the counts
+    of each length, the way zlib's puff does, so it has nothing in
+    common with the code it's checking.
+*/
+class Inflater
+{
+public:
+    Inflater() : in(NULL), inSize(0), inPos(0), bitBuffer(0), bitCount(0), failed(false),
+        output(NULL), outputSize(0), outputCapacity(0)
+    {}
+
+    ~Inflater()
+    {
+        free(output);
+    }
+
+    // Decode a whole raw deflate stream.  Returns false if it's broken.
+    bool inflate(const uint8_t *data, size_t size)
+    {
+        in = data;
+        inSize = size;
+        int last;
+        do {
+            last = bits(1);
+            int type = bits(2);
+            if (type == 0) {
+                stored();
+            } else if (type == 1) {
+                fixed();
+            } else if (type == 2) {
+                dynamic();
+            } else {
+                failed = true;
+            }
+        } while (!last && !failed);
+        return !failed;
+    }
+
+    const uint8_t * getOutput() const { return output; }
+    size_t getOutputSize() const { return outputSize; }
+
+private:
+    struct Huffman {
+        int16_t count[16];      // how many codes of each length
+        int16_t symbol[288];    // the symbols, in the order of their codes
+    };
+
+    int bits(int need)
+    {
+        uint32_t value = bitBuffer;
+        while (bitCount < need) {
+            if (inPos == inSize) {
+                failed = true;
+                return 0;
+            }
+            value |= (uint32_t)in[inPos++] << bitCount;
+            bitCount += 8;
+        }
+        bitBuffer = value >> need;
+        bitCount -= need;
+        return (int)(value & ((1u << need) - 1));
+    }
+
+    void put(uint8_t value)
+    {
+        if (outputSize == outputCapacity) {
+            size_t capacity = outputCapacity ? outputCapacity * 2 : 65536;
+            uint8_t *grown = (uint8_t *)realloc(output, capacity);
+            if (!grown) {
+                failed = true;
+                return;
+            }
+            output = grown;
+            outputCapacity = capacity;
+        }
+        output[outputSize++] = value;
+    }
+
+    static void build(Huffman &h, const uint8_t *lengths, int n)
+    {
+        memset(h.count, 0, sizeof(h.count));
+        for (int i = 0; i < n; i++) {
+            h.count[lengths[i]]++;
+        }
+        int16_t offsets[16];
+        offsets[1] = 0;
+        for (int len = 1; len < 15; len++) {
+            offsets[len + 1] = offsets[len] + h.count[len];
+        }
+        for (int i = 0; i < n; i++) {
+            if (lengths[i]) {
+                h.symbol[offsets[lengths[i]]++] = (int16_t)i;
+            }
+        }
+    }
+
+    int decode(const Huffman &h)
+    {
+        int code = 0, first = 0, index = 0;
+        for (int len = 1; len < 16 && !failed; len++) {
+            code |= bits(1);
+            int count = h.count[len];
+            if (code - count < first) {
+                return h.symbol[index + (code - first)];
+            }
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+        }
+        failed = true;
+        return -1;
+    }
+
+    void stored()
+    {
+        bitBuffer = 0;
+        bitCount = 0;
+        if (inSize - inPos < 4) {
+            failed = true;
+            return;
+        }
+        size_t len = in[inPos] | (in[inPos + 1] << 8);
+        size_t check = in[inPos + 2] | (in[inPos + 3] << 8);
+        inPos += 4;
+        if (len != (~check & 0xffff) || inSize - inPos < len) {
+            failed = true;
+            return;
+        }
+        for (size_t i = 0; i < len; i++) {
+            put(in[inPos++]);
+        }
+    }
+
+    void codes(const Huffman &lit, const Huffman &dist)
+    {
+        static const uint16_t lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+            35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        static const uint8_t lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+        static const uint16_t distBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+            257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+        static const uint8_t distExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+            7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+        while (!failed) {
+            int symbol = decode(lit);
+            if (symbol < 0) {
+                return;
+            } else if (symbol < 256) {
+                put((uint8_t)symbol);
+            } else if (symbol == 256) {
+                return;
+            } else {
+                symbol -= 257;
+                if (symbol >= 29) {
+                    failed = true;
+                    return;
+                }
+                size_t length = lengthBase[symbol] + bits(lengthExtra[symbol]);
+                int code = decode(dist);
+                if (code < 0 || code >= 30) {
+                    failed = true;
+                    return;
+                }
+                size_t distance = distBase[code] + bits(distExtra[code]);
+                if (distance > outputSize) {
+                    failed = true;
+                    return;
+                }
+                for (size_t i = 0; i < length && !failed; i++) {
+                    put(output[outputSize - distance]);
+                }
+            }
+        }
+    }
+
+    void fixed()
+    {
+        uint8_t lengths[288];
+        for (int i = 0; i < 288; i++) {
+            lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+        }
+        Huffman lit, dist;
+        build(lit, lengths, 288);
+        memset(lengths, 5, 30);
+        build(dist, lengths, 30);
+        codes(lit, dist);
+    }
+
+    void dynamic()
+    {
+        static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+        int litCount = bits(5) + 257;
+        int distCount = bits(5) + 1;
+        int codeCount = bits(4) + 4;
+        if (litCount > 286 || distCount > 30) {
+            failed = true;
+            return;
+        }
+
+        uint8_t lengths[320];
+        memset(lengths, 0, sizeof(lengths));
+        for (int i = 0; i < codeCount; i++) {
+            lengths[order[i]] = (uint8_t)bits(3);
+        }
+        Huffman lenCode;
+        build(lenCode, lengths, 19);
+
+        int n = 0;
+        while (n < litCount + distCount && !failed) {
+            int symbol = decode(lenCode);
+            if (symbol < 0) {
+                return;
+            }
+            if (symbol < 16) {
+                lengths[n++] = (uint8_t)symbol;
+                continue;
+            }
+            uint8_t repeat = 0;
+            int times;
+            if (symbol == 16) {
+                if (n == 0) {
+                    failed = true;
+                    return;
+                }
+                repeat = lengths[n - 1];
+                times = 3 + bits(2);
+            } else if (symbol == 17) {
+                times = 3 + bits(3);
+            } else {
+                times = 11 + bits(7);
+            }
+            if (n + times > litCount + distCount) {
+                failed = true;
+                return;
+            }
+            while (times--) {
+                lengths[n++] = repeat;
+            }
+        }
+
+        Huffman lit, dist;
+        build(lit, lengths, litCount);
+        build(dist, lengths + litCount, distCount);
+        codes(lit, dist);
+    }
+
+    const uint8_t *in;
+    size_t inSize;
+    size_t inPos;
+    uint32_t bitBuffer;
+    int bitCount;
+    bool failed;
+
+    uint8_t *output;
+    size_t outputSize;
+    size_t outputCapacity;
+};
+
+uint32_t getBig32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+int paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+/*
+    Read a PNG written by PNG::writePNG() back into a new buffer, gray
+    for 8 bit gray, RGBA otherwise.  The chunk CRCs and the zlib header
+    and checksum have to be right.  NULL if anything about it isn't.
+*/
+PixelBuffer * readBack(const char *filename)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    size_t size = (size_t)ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t *file = (uint8_t *)malloc(size);
+    bool ok = file && fread(file, 1, size, fp) == size;
+    fclose(fp);
+    ok = ok && size >= 8 && memcmp(file, "\x89PNG\r\n\x1a\n", 8) == 0;
+
+    // the IDATs, one after the other, are the zlib stream
+    uint8_t *stream = NULL;
+    size_t streamSize = 0;
+    size_t width = 0, height = 0;
+    int channels = 0;
+    bool ended = false;
+    for (size_t pos = 8; ok && !ended; ) {
+        ok = size - pos >= 12;
+        size_t length = ok ? getBig32(file + pos) : 0;
+        ok = ok && size - pos - 12 >= length;
+        if (!ok) {
+            break;
+        }
+        const uint8_t *type = file + pos + 4;
+        const uint8_t *data = type + 4;
+        ok = (PNG::crc32(0xffffffff, type, length + 4) ^ 0xffffffff) == getBig32(data + length);
+
+        if (ok && memcmp(type, "IHDR", 4) == 0) {
+            width = getBig32(data);
+            height = getBig32(data + 4);
+            channels = data[9] == 0 ? 1 : data[9] == 2 ? 3 : data[9] == 6 ? 4 : 0;
+            ok = length == 13 && data[8] == 8 && channels != 0 && data[10] == 0 && data[11] == 0 && data[12] == 0;
+        } else if (ok && memcmp(type, "IDAT", 4) == 0) {
+            uint8_t *grown = (uint8_t *)realloc(stream, streamSize + length);
+            ok = grown != NULL;
+            if (ok) {
+                stream = grown;
+                memcpy(stream + streamSize, data, length);
+                streamSize += length;
+            }
+        } else if (ok && memcmp(type, "IEND", 4) == 0) {
+            ended = true;
+        }
+        pos += 12 + length;
+    }
+    free(file);
+
+    size_t rowBytes = width * channels;
+    Inflater inflater;
+    ok = ok && ended && channels != 0 && streamSize >= 6
+        && (stream[0] & 0x0f) == 8 && ((stream[0] << 8) | stream[1]) % 31 == 0
+        && inflater.inflate(stream + 2, streamSize - 6)
+        && inflater.getOutputSize() == (rowBytes + 1) * height
+        && Deflater::adler32(1, inflater.getOutput(), inflater.getOutputSize()) == getBig32(stream + streamSize - 4);
+    free(stream);
+    if (!ok) {
+        return NULL;
+    }
+
+    PixelBuffer *pb;
+    if (channels == 1) {
+        pb = new PixelBufferGray((GRSIZE)width, (GRSIZE)height);
+    } else {
+        pb = new PixelBufferRGBA32((GRSIZE)width, (GRSIZE)height);
+    }
+
+    // undo the filters, in place, a row at a time
+    uint8_t *rows = (uint8_t *)inflater.getOutput();
+    PixRGBA *pixels = (PixRGBA *)malloc(width * sizeof(PixRGBA));
+    for (size_t y = 0; y < height && pixels; y++) {
+        uint8_t *row = rows + y * (rowBytes + 1) + 1;
+        const uint8_t *prev = y > 0 ? row - (rowBytes + 1) : NULL;
+        int filter = row[-1];
+        for (size_t i = 0; i < rowBytes; i++) {
+            int a = i >= (size_t)channels ? row[i - channels] : 0;
+            int b = prev ? prev[i] : 0;
+            int c = prev && i >= (size_t)channels ? prev[i - channels] : 0;
+            int add = filter == 1 ? a : filter == 2 ? b : filter == 3 ? (a + b) / 2 : filter == 4 ? paeth(a, b, c) : 0;
+            row[i] = (uint8_t)(row[i] + add);
+        }
+
+        if (channels == 1) {
+            pb->setGraySpan(0, (GRCOORD)y, (GRSIZE)width, row);
+            continue;
+        }
+        for (size_t x = 0; x < width; x++) {
+            pixels[x].r = row[x * channels];
+            pixels[x].g = row[x * channels + 1];
+            pixels[x].b = row[x * channels + 2];
+            pixels[x].a = channels == 4 ? row[x * channels + 3] : 255;
+        }
+        pb->setSpan(0, (GRCOORD)y, (GRSIZE)width, pixels);
+    }
+    if (!pixels) {
+        delete pb;
+        pb = NULL;
+    }
+    free(pixels);
+    return pb;
+}
+
+// Pixels of the file that aren't the same as pb's, or -1 if it can't be read back
+int roundTrip(const PixelBuffer &pb, const char *filename)
+{
+    PixelBuffer *back = readBack(filename);
+    int different = countDifferences(pb, back);
+    delete back;
+    return different;
+}
+
+void drawScene(DrawingContext &dc, int width, int height)
+{
+    dc.setBackground(colors.white);
+    dc.clear();
+    for (int y = 0; y < height; y += 4) {
+        PixRGBA band;
+        band.r = (uint8_t)(255 * y / height);
+        band.g = 128;
+        band.b = (uint8_t)(255 - 255 * y / height);
+        band.a = 255;
+        dc.setFill(band);
+        dc.fillRectangle(0, (GRCOORD)y, width / 3, 4);
+    }
+    dc.setFill(colors.red);
+    dc.fillEllipse((GRCOORD)(width / 2), (GRCOORD)(height / 2), height / 3, height / 4);
+    dc.setStroke(colors.black);
+    for (int i = 0; i < 40; i++) {
+        double a = i * 3.14159265358979 / 40;
+        dc.strokeLine((GRCOORD)(width / 2), (GRCOORD)(height / 2),
+            (GRCOORD)(width / 2 + cos(a) * height / 2.2), (GRCOORD)(height / 2 - sin(a) * height / 2.2));
+    }
+    PixRGBA glass = colors.blue;
+    glass.a = 128;
+    dc.setFill(glass);
+    dc.fillRectangle((GRCOORD)(width * 2 / 3), 20, width / 4, height / 2);
+}
+
+void main()
+{
+    // Checksums
+    const uint8_t *digits = (const uint8_t *)"123456789";
+    printf("CRC-32 of 123456789: %08x (expect cbf43926)\n", PNG::crc32(0xffffffff, digits, 9) ^ 0xffffffff);
+    printf("Adler-32 of Wikipedia: %08x (expect 11e60398)\n", Deflater::adler32(1, (const uint8_t *)"Wikipedia", 9));
+
+    uint8_t *noise = new uint8_t[100000];
+    srand(4);
+    for (int i = 0; i < 100000; i++) {
+        noise[i] = (uint8_t)rand();
+    }
+    uint32_t whole = Deflater::adler32(1, noise, 100000);
+    uint32_t pieces = Deflater::adler32Combine(Deflater::adler32(1, noise, 37000), Deflater::adler32(1, noise + 37000, 63000), 63000);
+    printf("Adler-32 of two pieces combined: %s\n", whole == pieces ? "same" : "DIFFERENT");
+    delete [] noise;
+
+    // A picture, at a few levels
+    PixelBufferRGBA32 fb(640, 480);
+    DrawingContext dc(fb);
+    drawScene(dc, 640, 480);
+    PBM::writePPMBinary("testpng.ppm", fb);
+    printf("PPM: %ld bytes\n", fileSize("testpng.ppm"));
+
+    int levels[4] = {0, 1, 6, 9};
+    for (int i = 0; i < 4; i++) {
+        auto start = std::chrono::steady_clock::now();
+        PNG::writePNG("testpng.png", fb, levels[i]);
+        int ms = elapsed(start);
+        printf("level %d: %ld bytes, %d ms, %d pixels different read back\n", levels[i], fileSize("testpng.png"), ms,
+            expectZero(roundTrip(fb, "testpng.png"), "level round trip"));
+    }
+    PNG::writePNG("testpng.png", fb);
+
+    // Gray, and with alpha
+    PixelBufferGray gray(640, 480);
+    DrawingContext gdc(gray);
+    drawScene(gdc, 640, 480);
+    PNG::writePNG("testpng_gray.png", gray);
+    printf("gray: %ld bytes, %d pixels different read back\n", fileSize("testpng_gray.png"),
+        expectZero(roundTrip(gray, "testpng_gray.png"), "gray round trip"));
+
+    PixelBufferRGBA32 clear(200, 200);
+    DrawingContext cdc(clear);
+    cdc.setFill(colors.red);
+    cdc.fillEllipse(100, 100, 80, 50);
+    PNG::writePNG("testpng_alpha.png", clear);
+    printf("with alpha: %ld bytes, %d pixels different read back\n", fileSize("testpng_alpha.png"),
+        expectZero(roundTrip(clear, "testpng_alpha.png"), "alpha round trip"));
+
+    // A 4K frame
+    PixelBufferRGBA32 big(3840, 2160);
+    DrawingContext bdc(big);
+    drawScene(bdc, 3840, 2160);
+    auto start = std::chrono::steady_clock::now();
+    PNG::writePNG("testpng_4k.png", big, 1);
+    int fastMs = elapsed(start);
+    int fastDifferent = expectZero(roundTrip(big, "testpng_4k.png"), "4K level 1 round trip");
+    start = std::chrono::steady_clock::now();
+    PNG::writePNG("testpng_4k.png", big);
+    int defaultMs = elapsed(start);
+
+    TaskScheduler &scheduler = TaskScheduler::shared();
+    int workers = scheduler.getWorkerCount();
+    scheduler.setWorkerCount(0);
+    start = std::chrono::steady_clock::now();
+    PNG::writePNG("testpng_4k.png", big);
+    int serialMs = elapsed(start);
+    scheduler.setWorkerCount(workers);
+
+    printf("4K: %d ms at level 1, %d ms at level 6, %d ms at level 6 with no workers, %ld bytes\n",
+        fastMs, defaultMs, serialMs, fileSize("testpng_4k.png"));
+    printf("4K read back: %d pixels different at level 1, %d at level 6\n", fastDifferent,
+        expectZero(roundTrip(big, "testpng_4k.png"), "4K level 6 round trip"));
+    remove("testpng_4k.png");
+}
@@ -0,0 +1,130 @@
+/*
+    Writing PPM files.
+
+    A 4K frame with something in every pixel, written with the band
+    writer, and the old way, a pixel at a time through getPixel() and
+    fwrite(), for how long each takes.  The two files should be the
+    same, byte for byte.
+
+    Then odd sizes, where the rows don't come out to whole groups of
+    four pixels or whole bands, and a gray buffer.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "PixelBufferGray.hpp"
+#include "DrawingContext.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+int elapsed(std::chrono::steady_clock::time_point start)
+{
+    return (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// How it used to be done
+bool writeOneAtATime(const char *filename, const PixelBuffer &pb)
+{
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        return false;
+    }
+    fprintf(fp, "P6\n%llu %llu\n255\n", (unsigned long long)pb.getWidth(), (unsigned long long)pb.getHeight());
+    for (size_t row = 0; row < pb.getHeight(); row++) {
+        for (size_t col = 0; col < pb.getWidth(); col++) {
+            fwrite(pb.getPixel((GRCOORD)col, (GRCOORD)row).data, 3, 1, fp);
+        }
+    }
+    fclose(fp);
+    return true;
+}
+
+// Both files whole, and the same
+bool sameFiles(const char *a, const char *b)
+{
+    FILE *fa = fopen(a, "rb");
+    FILE *fb = fopen(b, "rb");
+    bool same = fa && fb;
+    while (same) {
+        int ca = fgetc(fa);
+        int cb = fgetc(fb);
+        if (ca != cb) {
+            same = false;
+        }
+        if (ca == EOF) {
+            break;
+        }
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return same;
+}
+
+void fillPattern(PixelBuffer &pb)
+{
+    srand(3);
+    for (size_t y = 0; y < pb.getHeight(); y++) {
+        for (size_t x = 0; x < pb.getWidth(); x++) {
+            PixRGBA pix;
+            pix.r = (uint8_t)(x * 7 + y);
+            pix.g = (uint8_t)(y * 3);
+            pix.b = (uint8_t)rand();
+            pix.a = (uint8_t)rand();
+            pb.setPixel((GRCOORD)x, (GRCOORD)y, pix);
+        }
+    }
+}
+
+void main()
+{
+    PixelBufferRGBA32 frame(3840, 2160);
+    fillPattern(frame);
+
+    // once first, so neither pays for the disk waking up
+    PBM::writePPMBinary("testppmwrite.ppm", frame);
+
+    auto start = std::chrono::steady_clock::now();
+    const int REPEATS = 10;
+    for (int i = 0; i < REPEATS; i++) {
+        PBM::writePPMBinary("testppmwrite.ppm", frame);
+    }
+    int bandMs = elapsed(start);
+
+    start = std::chrono::steady_clock::now();
+    writeOneAtATime("testppmwrite_old.ppm", frame);
+    int oldMs = elapsed(start);
+
+    printf("4K frame: %.1f ms in bands, %d ms a pixel at a time\n", (double)bandMs / REPEATS, oldMs);
+    printf("4K files are %s\n", sameFiles("testppmwrite.ppm", "testppmwrite_old.ppm") ? "the same" : "DIFFERENT");
+
+    // Odd sizes
+    int sizes[][2] = {{1, 1}, {3, 5}, {7, 2}, {1001, 3}, {2, 3000}, {5000, 700}, {10, 0}};
+    int different = 0;
+    for (int s = 0; s < 7; s++) {
+        PixelBufferRGBA32 pb(sizes[s][0], sizes[s][1]);
+        fillPattern(pb);
+        PBM::writePPMBinary("testppmwrite_odd.ppm", pb);
+        writeOneAtATime("testppmwrite_old.ppm", pb);
+        if (!sameFiles("testppmwrite_odd.ppm", "testppmwrite_old.ppm")) {
+            printf("  %d x %d is different\n", sizes[s][0], sizes[s][1]);
+            different++;
+        }
+    }
+    printf("odd sizes different: %d\n", different);
+
+    PixelBufferGray gray(1921, 1081);
+    DrawingContext dc(gray);
+    dc.setBackground(colors.gray50);
+    dc.clear();
+    dc.setFill(colors.white);
+    dc.fillRectangle(100, 100, 600, 400);
+    PBM::writePPMBinary("testppmwrite_gray.ppm", gray);
+    writeOneAtATime("testppmwrite_old.ppm", gray);
+    printf("gray files are %s\n", sameFiles("testppmwrite_gray.ppm", "testppmwrite_old.ppm") ? "the same" : "DIFFERENT");
+
+    remove("testppmwrite_old.ppm");
+    remove("testppmwrite_odd.ppm");
+}
@@ -0,0 +1,177 @@
+/*
+    QOI files.
+
+    A picture, and a noisy one, written as QOI and read back, which
+    should give exactly the same pixels, against PPM for how big they
+    are and how long they take, and against PNG at its fastest.
+
+    A gray buffer, written and read back as gray.  A few pixels by
+    hand, against the bytes the QOI spec says they should make.  And
+    files that are cut short, or aren't QOI, which shouldn't read.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "PixelBufferGray.hpp"
+#include "DrawingContext.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+#include "png.hpp"
+#include "qoi.hpp"
+#include "testing.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+
+int elapsed(std::chrono::steady_clock::time_point start)
+{
+    return (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+long fileSize(const char *filename)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+    return size;
+}
+
+void drawScene(DrawingContext &dc, int width, int height)
+{
+    dc.setBackground(colors.white);
+    dc.clear();
+    for (int y = 0; y < height; y += 4) {
+        PixRGBA band;
+        band.r = (uint8_t)(255 * y / height);
+        band.g = 128;
+        band.b = (uint8_t)(255 - 255 * y / height);
+        band.a = 255;
+        dc.setFill(band);
+        dc.fillRectangle(0, (GRCOORD)y, width / 3, 4);
+    }
+    dc.setFill(colors.red);
+    dc.fillEllipse((GRCOORD)(width / 2), (GRCOORD)(height / 2), height / 3, height / 4);
+    dc.setStroke(colors.black);
+    for (int i = 0; i < 40; i++) {
+        double a = i * 3.14159265358979 / 40;
+        dc.strokeLine((GRCOORD)(width / 2), (GRCOORD)(height / 2),
+            (GRCOORD)(width / 2 + cos(a) * height / 2.2), (GRCOORD)(height / 2 - sin(a) * height / 2.2));
+    }
+    PixRGBA glass = colors.blue;
+    glass.a = 128;
+    dc.setFill(glass);
+    dc.fillRectangle((GRCOORD)(width * 2 / 3), 20, width / 4, height / 2);
+}
+
+// Write, read back, and compare, with the times
+void roundTrip(const char *name, const PixelBuffer &pb, bool gray)
+{
+    auto start = std::chrono::steady_clock::now();
+    QOI::writeQOI("testqoi.qoi", pb);
+    int writeMs = elapsed(start);
+    start = std::chrono::steady_clock::now();
+    PixelBuffer *back = QOI::readQOI("testqoi.qoi", gray);
+    int readMs = elapsed(start);
+    int different = countDifferences(pb, back);
+    delete back;
+
+    start = std::chrono::steady_clock::now();
+    PBM::writePPMBinary("testqoi.ppm", pb);
+    int ppmMs = elapsed(start);
+    start = std::chrono::steady_clock::now();
+    back = PBM::readImage("testqoi.ppm");
+    int ppmReadMs = elapsed(start);
+    delete back;
+
+    start = std::chrono::steady_clock::now();
+    PNG::writePNG("testqoi.png", pb, 1);
+    int pngMs = elapsed(start);
+
+    printf("%s: %d different\n", name, expectZero(different, name));
+    printf("  QOI %ld bytes, %d ms to write, %d ms to read\n", fileSize("testqoi.qoi"), writeMs, readMs);
+    printf("  PPM %ld bytes, %d ms to write, %d ms to read\n", fileSize("testqoi.ppm"), ppmMs, ppmReadMs);
+    printf("  PNG %ld bytes, %d ms to write at level 1\n", fileSize("testqoi.png"), pngMs);
+}
+
+void main()
+{
+    // A picture, big
+    PixelBufferRGBA32 fb(3840, 2160);
+    DrawingContext dc(fb);
+    drawScene(dc, 3840, 2160);
+    roundTrip("4K picture", fb, false);
+
+    // Noise, which is the worst case
+    PixelBufferRGBA32 noise(1000, 1000);
+    srand(8);
+    for (int y = 0; y < 1000; y++) {
+        for (int x = 0; x < 1000; x++) {
+            PixRGBA pix;
+            pix.r = (uint8_t)rand();
+            pix.g = (uint8_t)(x + (rand() % 5));
+            pix.b = (uint8_t)(y / 4);
+            pix.a = (uint8_t)(x < 500 ? 255 : rand() % 4 + 250);
+            noise.setPixel(x, y, pix);
+        }
+    }
+    roundTrip("noise", noise, false);
+
+    // Gray
+    PixelBufferGray gray(1920, 1080);
+    DrawingContext gdc(gray);
+    drawScene(gdc, 1920, 1080);
+    roundTrip("gray", gray, true);
+
+    // By hand: black, black, a step up in red, then something far off.
+    // Black is where the encoder starts, so it's a run of 2, then a
+    // small difference, then the color itself.
+    PixelBufferRGBA32 tiny(2, 2);
+    PixRGBA black = colors.black, step = colors.black, far = colors.black;
+    step.r = 1;
+    far.r = 100;
+    far.g = 50;
+    far.b = 20;
+    tiny.setPixel(0, 0, black);
+    tiny.setPixel(1, 0, black);
+    tiny.setPixel(0, 1, step);
+    tiny.setPixel(1, 1, far);
+    QOI::writeQOI("testqoi.qoi", tiny);
+    const uint8_t expected[] = {'q', 'o', 'i', 'f', 0, 0, 0, 2, 0, 0, 0, 2, 4, 0,
+        0xc1, 0x7a, 0xfe, 100, 50, 20, 0, 0, 0, 0, 0, 0, 0, 1};
+    uint8_t bytes[64];
+    FILE *fp = fopen("testqoi.qoi", "rb");
+    size_t n = fread(bytes, 1, sizeof(bytes), fp);
+    fclose(fp);
+    printf("hand made pixels: %s\n", n == sizeof(expected) && memcmp(bytes, expected, n) == 0 ? "as the spec says" : "WRONG");
+
+    // Bad files
+    int read = 0;
+    QOI::writeQOI("testqoi.qoi", noise);
+    FILE *in = fopen("testqoi.qoi", "rb");
+    FILE *out = fopen("testqoi_short.qoi", "wb");
+    for (int i = 0; i < 100000; i++) {
+        fputc(fgetc(in), out);
+    }
+    fclose(in);
+    fclose(out);
+    PixelBuffer *pb = QOI::readQOI("testqoi_short.qoi");
+    read += pb != NULL;
+    delete pb;
+    pb = QOI::readQOI("testqoi.ppm");
+    read += pb != NULL;
+    delete pb;
+    pb = QOI::readQOI("testqoi_missing.qoi");
+    read += pb != NULL;
+    delete pb;
+    printf("bad files that read: %d\n", read);
+
+    remove("testqoi_short.qoi");
+    remove("testqoi.ppm");
+    remove("testqoi.png");
+}
@@ -0,0 +1,86 @@
+/*
+    Exercise the shared task scheduler: plain parallel loops, loops
+    started from inside other loops, tiles, and the serial fallback.
+    Then use it the way the rest of the library does, clearing a big
+    buffer and writing it out.
+*/
+
+#include "TaskScheduler.hpp"
+#include "PixelBufferRGBA32.hpp"
+#include "PixelBufferGray.hpp"
+#include "DrawingContext.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+#include "testing.hpp"
+
+#include <atomic>
+#include <chrono>
+
+bool checkSums(TaskScheduler &scheduler)
+{
+    // every index should be visited exactly once
+    const int count = 100000;
+    std::atomic<int64_t> sum(0);
+    scheduler.parallelFor(0, count, 64, [&](int first, int last) {
+        for (int i = first; i < last; i++) {
+            sum += i;
+        }
+    });
+
+    int64_t expected = (int64_t)count * (count - 1) / 2;
+    printf("  parallelFor sum off by: %d\n", expectZero((int)(sum.load() - expected), "parallelFor sum"));
+
+    // nested loops, as a filter might do per row within a band
+    std::atomic<int> cells(0);
+    scheduler.parallelFor(0, 100, 1, [&](int first, int last) {
+        for (int row = first; row < last; row++) {
+            scheduler.parallelFor(0, 1000, 50, [&](int a, int b) {
+                cells += b - a;
+            });
+        }
+    });
+    printf("  nested cells off by: %d\n", expectZero(cells.load() - 100000, "nested cells"));
+
+    // tiles should cover the area without overlap
+    std::atomic<int> area(0);
+    scheduler.parallelForTiles(GRRectangle(0, 0, 1000, 700), 64, 64, [&](const GRRectangle &tile) {
+        area += tile.width * tile.height;
+    });
+    printf("  tile area off by: %d\n", expectZero(area.load() - 700000, "tile area"));
+
+    return true;
+}
+
+void main()
+{
+    TaskScheduler &scheduler = TaskScheduler::shared();
+
+    printf("Shared scheduler, %d workers\n", scheduler.getWorkerCount());
+    checkSums(scheduler);
+
+    TaskScheduler serial(0);
+    printf("Serial fallback\n");
+    checkSums(serial);
+
+    TaskScheduler many(7);
+    printf("Seven workers\n");
+    checkSums(many);
+
+    // The pixel buffers and writer share the scheduler
+    PixelBufferRGBA32 fb(3840, 2160);
+    DrawingContext dc(fb);
+
+    auto start = std::chrono::steady_clock::now();
+    dc.setBackground(colors.cyan);
+    dc.clear();
+    auto middle = std::chrono::steady_clock::now();
+    PBM::writePPMBinary("testscheduler.ppm", fb);
+    auto finish = std::chrono::steady_clock::now();
+
+    printf("Clear 4K: %d ms\n", (int)std::chrono::duration_cast<std::chrono::milliseconds>(middle - start).count());
+    printf("Write 4K: %d ms\n", (int)std::chrono::duration_cast<std::chrono::milliseconds>(finish - middle).count());
+
+    PixelBufferGray gray(3840, 2160);
+    gray.setAllPixels(colors.white);
+    PBM::writePPMBinary("testschedulergray.ppm", gray);
+}
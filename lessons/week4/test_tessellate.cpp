@@ -0,0 +1,257 @@
+/*
+    Tessellation.
+
+    A wobbly ring with holes in it, cut into triangles, each filled a
+    different color with its edges drawn, so you can see how it was cut.
+
+    Then some checks, on lots of random polygons with holes:  every
+    triangle has to go the same way around as the outline, their areas
+    have to add up to exactly the polygon's, and filling them has to
+    cover exactly the pixels that filling the polygon does.
+
+    How long it takes, on zig-zags of more and more points, which
+    should grow a little faster than the number of points, not with
+    its square.  And the cache, which should only do a polygon again
+    when it's changed.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "DrawingContext.hpp"
+#include "Tessellator.hpp"
+#include "Path.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+#include "testing.hpp"
+
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+
+int elapsedUs(std::chrono::steady_clock::time_point start)
+{
+    return (int)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Points around (cx, cy), at random distances between rmin and rmax,
+// clockwise or not.  Returns how many.
+int makeBlob(Point2D *pts, int n, int cx, int cy, int rmin, int rmax, bool clockwise)
+{
+    for (int i = 0; i < n; i++) {
+        double a = 2 * 3.14159265358979 * i / n;
+        if (clockwise) {
+            a = -a;
+        }
+        int r = rmin + rand() % (rmax - rmin + 1);
+        pts[i] = Point2D((GRCOORD)(cx + (int)floor(r * cos(a) + 0.5)), (GRCOORD)(cy + (int)floor(r * sin(a) + 0.5)));
+    }
+    return n;
+}
+
+// A blob with up to four holes, which can't touch each other or the outline
+int makeHoleyBlob(Point2D *pts, int *counts, int cx, int cy)
+{
+    int contours = 0;
+    int n = 8 + rand() % 57;
+    counts[contours++] = makeBlob(pts, n, cx, cy, 80, 140, rand() % 2 == 0);
+
+    int holes = rand() % 5;
+    for (int h = 0; h < holes; h++) {
+        int hx = cx + (h == 0 ? 40 : h == 2 ? -40 : 0);
+        int hy = cy + (h == 1 ? 40 : h == 3 ? -40 : 0);
+        int m = 3 + rand() % 10;
+        counts[contours] = makeBlob(pts + n, m, hx, hy, 10, 25, rand() % 2 == 0);
+        n += counts[contours];
+        contours++;
+    }
+    return contours;
+}
+
+// Twice the area, with a sign for which way around
+int64_t doubleArea(const Point2D *pts, int n)
+{
+    int64_t area = 0;
+    for (int i = 0; i < n; i++) {
+        const Point2D &a = pts[i];
+        const Point2D &b = pts[(i + 1) % n];
+        area += (int64_t)a.x * b.y - (int64_t)b.x * a.y;
+    }
+    return area;
+}
+
+void fillAsPath(DrawingContext &dc, const Point2D *pts, const int *counts, int contours)
+{
+    Path path;
+    int start = 0;
+    for (int c = 0; c < contours; c++) {
+        for (int i = 0; i < counts[c]; i++) {
+            if (i == 0) {
+                path.moveTo(pts[start].x, pts[start].y);
+            } else {
+                path.lineTo(pts[start + i].x, pts[start + i].y);
+            }
+        }
+        path.close();
+        start += counts[c];
+    }
+    dc.fillPath(path, GR_EVENODD);
+}
+
+void fillAsTriangles(DrawingContext &dc, const Point2D *pts, const uint32_t *indices, size_t count)
+{
+    for (size_t i = 0; i < count; i += 3) {
+        PointFx tri[3];
+        for (int k = 0; k < 3; k++) {
+            const Point2D &p = pts[indices[i + k]];
+            tri[k] = PointFx::fromInt(p.x, p.y);
+        }
+        dc.fillTriangle(tri);
+    }
+}
+
+void main()
+{
+    Tessellator tess;
+    Point2D *pts = new Point2D[200000];
+    int counts[8];
+
+    // The picture
+    srand(11);
+    int contours = 0;
+    counts[contours++] = makeBlob(pts, 90, 200, 200, 150, 190, false);
+    int n = counts[0];
+    for (int h = 0; h < 6; h++) {
+        double a = h * 2 * 3.14159265358979 / 6;
+        counts[contours] = makeBlob(pts + n, 7 + h * 3, 200 + (int)(90 * cos(a)), 200 + (int)(90 * sin(a)), 20, 35, h % 2 == 0);
+        n += counts[contours++];
+    }
+    counts[contours] = makeBlob(pts + n, 5, 200, 200, 25, 30, true);
+    n += counts[contours++];
+
+    PixelBufferRGBA32 fb(400, 400);
+    DrawingContext dc(fb);
+    dc.setBackground(colors.white);
+    dc.clear();
+    if (tess.triangulate(pts, counts, contours)) {
+        const uint32_t *indices = tess.getIndices();
+        for (size_t i = 0; i < tess.getIndexCount(); i += 3) {
+            PixRGBA color;
+            color.r = (uint8_t)(80 + (i * 37) % 160);
+            color.g = (uint8_t)(80 + (i * 71) % 160);
+            color.b = (uint8_t)(80 + (i * 13) % 160);
+            color.a = 255;
+            dc.setFill(color);
+            dc.setStroke(colors.black);
+            const Point2D &a = pts[indices[i]], &b = pts[indices[i + 1]], &c = pts[indices[i + 2]];
+            PointFx tri[3] = {PointFx::fromInt(a.x, a.y), PointFx::fromInt(b.x, b.y), PointFx::fromInt(c.x, c.y)};
+            dc.fillTriangle(tri);
+            dc.strokeLine(a.x, a.y, b.x, b.y);
+            dc.strokeLine(b.x, b.y, c.x, c.y);
+            dc.strokeLine(c.x, c.y, a.x, a.y);
+        }
+        printf("%d points in %d contours: %d triangles\n", n, contours, (int)tess.getIndexCount() / 3);
+    } else {
+        printf("the picture's polygon couldn't be tessellated\n");
+    }
+    PBM::writePPMBinary("testtessellate.ppm", fb);
+
+    // Random polygons with holes
+    PixelBufferRGBA32 asPath(300, 300);
+    PixelBufferRGBA32 asTriangles(300, 300);
+    DrawingContext pdc(asPath);
+    DrawingContext tdc(asTriangles);
+    pdc.setFill(colors.blue);
+    tdc.setFill(colors.blue);
+
+    const int POLYGONS = 2000;
+    int failed = 0, wrongCount = 0, wrongArea = 0, flipped = 0, wrongPixels = 0;
+    srand(5);
+    for (int p = 0; p < POLYGONS; p++) {
+        contours = makeHoleyBlob(pts, counts, 150, 150);
+        if (!tess.triangulate(pts, counts, contours)) {
+            failed++;
+            continue;
+        }
+
+        const uint32_t *indices = tess.getIndices();
+        size_t count = tess.getIndexCount();
+
+        int total = 0;
+        int64_t area = 0;
+        int64_t outline = doubleArea(pts, counts[0]);
+        for (int c = 0; c < contours; c++) {
+            int64_t a = doubleArea(pts + total, counts[c]);
+            area += (c == 0) ? (a < 0 ? -a : a) : -(a < 0 ? -a : a);
+            total += counts[c];
+        }
+
+        int64_t sum = 0;
+        for (size_t i = 0; i < count; i += 3) {
+            Point2D tri[3] = {pts[indices[i]], pts[indices[i + 1]], pts[indices[i + 2]]};
+            int64_t a = doubleArea(tri, 3);
+            if ((a < 0 && outline > 0) || (a > 0 && outline < 0)) {
+                flipped++;
+            }
+            sum += a < 0 ? -a : a;
+        }
+        if (sum != area) {
+            wrongArea++;
+        }
+        if ((int)count / 3 != total + 2 * (contours - 1) - 2) {
+            wrongCount++;
+        }
+
+        pdc.clear();
+        tdc.clear();
+        fillAsPath(pdc, pts, counts, contours);
+        fillAsTriangles(tdc, pts, indices, count);
+        if (countDifferences(asPath, asTriangles) != 0) {
+            wrongPixels++;
+        }
+    }
+    printf("%d random polygons: %d failed, %d wrong triangle count, %d wrong area, %d triangles flipped, %d with different pixels\n",
+        POLYGONS, failed, wrongCount, wrongArea, flipped, wrongPixels);
+    expectZero(wrongPixels, "polygons with different pixels as triangles");
+
+    // Zig-zags, all the way along the top
+    int sizes[3] = {1000, 10000, 50000};
+    for (int s = 0; s < 3; s++) {
+        int size = sizes[s];
+        for (int i = 0; i < size; i++) {
+            pts[i] = Point2D((GRCOORD)i, (GRCOORD)(rand() % 1000));
+        }
+        pts[size] = Point2D((GRCOORD)(size - 1), 2000);
+        pts[size + 1] = Point2D(0, 2000);
+
+        auto start = std::chrono::steady_clock::now();
+        bool ok = tess.triangulate(pts, size + 2);
+        int us = elapsedUs(start);
+        printf("zig-zag of %d points: %s, %d triangles, %d us, %.3f us a point\n",
+            size + 2, ok ? "ok" : "failed", (int)tess.getIndexCount() / 3, us, (double)us / (size + 2));
+    }
+
+    // The cache
+    srand(9);
+    contours = makeHoleyBlob(pts, counts, 150, 150);
+    size_t count = 0;
+    const int FRAMES = 1000;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        tess.triangulate(pts, counts, contours);
+    }
+    int everyUs = elapsedUs(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FRAMES; frame++) {
+        tess.tessellate(pts, counts, contours, count);
+    }
+    int cachedUs = elapsedUs(start);
+    printf("%d frames: %d us tessellated every time, %d us from the cache (%d hits, %d misses)\n",
+        FRAMES, everyUs, cachedUs, tess.getCacheHits(), tess.getCacheMisses());
+
+    pts[3].x = pts[3].x + 1;
+    tess.tessellate(pts, counts, contours, count);
+    printf("after moving a point: %d hits, %d misses\n", tess.getCacheHits(), tess.getCacheMisses());
+
+    delete [] pts;
+}
@@ -0,0 +1,129 @@
+/*
+    Texture mapped triangles.
+
+    A checkerboard floor running off into the distance, drawn four ways:
+
+        top left        nearest, no mipmaps, which shimmers into noise
+        top right       bilinear with mipmaps, which fades to gray
+        bottom left     bilinear with mipmaps, but without perspective,
+                        so the far rows are spread evenly down the
+                        floor, squashed so small it's all gray
+        bottom right    nearest with mipmaps
+
+    Then some timing.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "DrawingContext.hpp"
+#include "Texture.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+
+#include <chrono>
+
+int elapsed(std::chrono::steady_clock::time_point start)
+{
+    return (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static const int PANEL = 512;
+
+// A floor point at (fx, fz), with the camera above it, projected
+// into the panel at (left, top)
+GRTexVertex floorPoint(int left, int top, REAL fx, REAL fz, REAL u, REAL v)
+{
+    REAL focal = 400;
+    REAL height = 300;
+
+    REAL x = left + PANEL / 2 + focal * fx / fz;
+    REAL y = top + PANEL / 4 + focal * height / fz;
+
+    return GRTexVertex((GRCOORD)(x + 0.5f), (GRCOORD)(y + 0.5f), u, v, fz);
+}
+
+void drawFloor(DrawingContext &dc, int left, int top, const Texture &tex, TextureFilter filter, bool perspective)
+{
+    // 10 repeats of the texture across, and 150 going away.  The
+    // corners have to stay on the canvas, as coordinates are unsigned
+    GRTexVertex nearLeft = floorPoint(left, top, -250, 420, 0, 0);
+    GRTexVertex nearRight = floorPoint(left, top, 250, 420, 10, 0);
+    GRTexVertex farLeft = floorPoint(left, top, -250, 20000, 0, 150);
+    GRTexVertex farRight = floorPoint(left, top, 250, 20000, 10, 150);
+
+    GRTexVertex first[3] = {nearLeft, nearRight, farRight};
+    GRTexVertex second[3] = {nearLeft, farRight, farLeft};
+
+    dc.setClip(left, top, PANEL, PANEL);
+    dc.fillTriangle(first, tex, filter, perspective);
+    dc.fillTriangle(second, tex, filter, perspective);
+    dc.clearClip();
+}
+
+void main()
+{
+    // an 8x8 checkerboard, with a red line through it
+    PixelBufferRGBA32 checks(64, 64);
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 64; x++) {
+            checks.setPixel(x, y, ((x / 8 + y / 8) % 2) ? colors.white : colors.black);
+        }
+        checks.setPixel(y, y, colors.red);
+    }
+
+    Texture plain(checks, false);
+    Texture mipmapped(checks);
+    printf("texture: %d x %d, %d levels\n", mipmapped.getWidth(), mipmapped.getHeight(), mipmapped.getLevelCount());
+
+    PixelBufferRGBA32 fb(2 * PANEL, 2 * PANEL);
+    DrawingContext dc(fb);
+    dc.setBackground(colors.cyan);
+    dc.clear();
+
+    drawFloor(dc, 0, 0, plain, TEX_NEAREST, true);
+    drawFloor(dc, PANEL, 0, mipmapped, TEX_BILINEAR, true);
+    drawFloor(dc, 0, PANEL, mipmapped, TEX_BILINEAR, false);
+    drawFloor(dc, PANEL, PANEL, mipmapped, TEX_NEAREST, true);
+
+    // a flat 2D quad, at exactly one texel per pixel, should be an exact
+    // copy of the texture.  The half texel lands pixel centers on texel centers
+    REAL h = 0.5f / 64;
+    GRTexVertex quad1[3] = {GRTexVertex(20, 20, h, h), GRTexVertex(84, 20, 1 + h, h), GRTexVertex(84, 84, 1 + h, 1 + h)};
+    GRTexVertex quad2[3] = {GRTexVertex(20, 20, h, h), GRTexVertex(84, 84, 1 + h, 1 + h), GRTexVertex(20, 84, h, 1 + h)};
+    dc.fillTriangle(quad1, mipmapped, TEX_BILINEAR, false);
+    dc.fillTriangle(quad2, mipmapped, TEX_BILINEAR, false);
+
+    int different = 0;
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 64; x++) {
+            if (fb.getPixel(20 + x, 20 + y).intValue != checks.getPixel(x, y).intValue) {
+                different++;
+            }
+        }
+    }
+    printf("1:1 copy: %d pixels differ from the texture\n", different);
+
+    PBM::writePPMBinary("testtexture.ppm", fb);
+
+    // Timing, a full screen of perspective floor, each way
+    PixelBufferRGBA32 screen(1920, 1080);
+    DrawingContext sdc(screen);
+    GRTexVertex near1(0, 1079, 0, 0, 1), near2(1919, 1079, 20, 0, 1);
+    GRTexVertex far1(0, 0, 0, 20, 4), far2(1919, 0, 20, 20, 4);
+    GRTexVertex tri1[3] = {near1, near2, far2};
+    GRTexVertex tri2[3] = {near1, far2, far1};
+
+    const char *names[4] = {"nearest, affine", "nearest, perspective", "bilinear, affine", "bilinear, perspective"};
+    for (int mode = 0; mode < 4; mode++) {
+        TextureFilter filter = mode < 2 ? TEX_NEAREST : TEX_BILINEAR;
+        bool perspective = (mode % 2) == 1;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 20; i++) {
+            sdc.fillTriangle(tri1, mipmapped, filter, perspective);
+            sdc.fillTriangle(tri2, mipmapped, filter, perspective);
+        }
+        int ms = elapsed(start);
+        printf("%s: %d ms for 20 frames, %.1f Mpixels/s\n", names[mode], ms,
+            ms ? 20.0 * 1920 * 1080 / ms / 1000 : 0.0);
+    }
+}
@@ -0,0 +1,86 @@
+/*
+    Record a busy scene, then render it both on a single thread, and
+    with the tile renderer, and make sure the two are identical.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "DrawingContext.hpp"
+#include "TileRenderer.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+
+#include <stdlib.h>
+#include <chrono>
+
+PixRGBA randomColor()
+{
+    PixRGBA pix;
+    pix.r = rand() % 256;
+    pix.g = rand() % 256;
+    pix.b = rand() % 256;
+    pix.a = 255;
+    return pix;
+}
+
+void main()
+{
+    const int width = 3840;
+    const int height = 2160;
+
+    PixelBufferRGBA32 serial(width, height);
+    PixelBufferRGBA32 tiled(width, height);
+
+    // Record a dashboard-like scene
+    DisplayList scene;
+    DrawingContext recorder(serial);
+    recorder.beginRecording(scene);
+
+    recorder.setBackground(colors.white);
+    recorder.clear();
+
+    srand(42);
+    for (int i = 0; i < 20000; i++) {
+        recorder.setFill(randomColor());
+        recorder.setStroke(randomColor());
+
+        int x = rand() % width;
+        int y = rand() % height;
+
+        switch (i % 4) {
+            case 0: recorder.drawRectangle(x, y, 1 + rand() % 300, 1 + rand() % 200); break;
+            case 1: recorder.drawEllipse(x, y, 1 + rand() % 100, 1 + rand() % 100); break;
+            case 2: recorder.strokeLine(x, y, rand() % width, rand() % height); break;
+            case 3:
+                recorder.setClip(x, y, 400, 400);
+                recorder.fillRectangle(x - 50, y - 50, 500, 500);
+                recorder.clearClip();
+            break;
+        }
+    }
+    recorder.endRecording();
+
+    auto start = std::chrono::steady_clock::now();
+    DrawingContext dc(serial);
+    dc.replay(scene);
+    auto middle = std::chrono::steady_clock::now();
+
+    TileRenderer renderer;
+    renderer.render(scene, tiled);
+    auto finish = std::chrono::steady_clock::now();
+
+    printf("Serial: %d ms\n", (int)std::chrono::duration_cast<std::chrono::milliseconds>(middle - start).count());
+    printf("Tiled (%d threads): %d ms\n", renderer.getThreadCount(),
+        (int)std::chrono::duration_cast<std::chrono::milliseconds>(finish - middle).count());
+
+    int differences = 0;
+    for (GRSIZE y = 0; y < serial.getHeight(); y++) {
+        for (GRSIZE x = 0; x < serial.getWidth(); x++) {
+            if (serial.getPixel(x, y).intValue != tiled.getPixel(x, y).intValue) {
+                differences++;
+            }
+        }
+    }
+    printf("Serial vs tiled differences: %d\n", differences);
+
+    PBM::writePPMBinary("testtilerender.ppm", tiled);
+}
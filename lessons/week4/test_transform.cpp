@@ -0,0 +1,161 @@
+/*
+    Transforms.
+
+    A little scene, drawn twelve times around a circle with rotate(),
+    each copy a bit bigger than the last with scale(), using push() and
+    pop() to get back to the middle each time.
+
+    Then some checks:  a whole pixel translate() should be exactly the
+    same as moving the coordinates by hand, and should cost about the
+    same.  The SSE2 point transform should match the plain one exactly.
+    And a rotated scene, recorded then replayed, should match drawing it
+    directly.
+*/
+
+#include "PixelBufferRGBA32.hpp"
+#include "DrawingContext.hpp"
+#include "grmath.hpp"
+#include "colors.hpp"
+#include "pbm.hpp"
+#include "testing.hpp"
+
+#include <stdlib.h>
+#include <chrono>
+
+int elapsed(std::chrono::steady_clock::time_point start)
+{
+    return (int)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// A house, with its door at (dx, dy)
+void drawHouse(DrawingContext &dc, int dx, int dy)
+{
+    dc.setFill(colors.yellow);
+    dc.setStroke(colors.black);
+    dc.drawRectangle(dx - 20, dy - 30, 40, 30);
+
+    Point2D roof[3] = {Point2D(dx - 26, dy - 30), Point2D(dx, dy - 50), Point2D(dx + 26, dy - 30)};
+    dc.setFill(colors.red);
+    dc.drawPolygon(roof, 3);
+
+    dc.setFill(colors.blue);
+    dc.fillRectangle(dx - 5, dy - 14, 10, 14);
+    dc.fillEllipse(dx + 12, dy - 20, 4, 4);
+    dc.strokeLine(dx - 30, dy, dx + 30, dy);
+}
+
+void main()
+{
+    PixelBufferRGBA32 fb(600, 600);
+    DrawingContext dc(fb);
+    dc.setBackground(colors.white);
+    dc.clear();
+
+    dc.translate(300, 300);
+    for (int i = 0; i < 12; i++) {
+        dc.push();
+        dc.rotate(i * 3.14159265f / 6);
+        dc.translate(0, -120);
+        dc.scale(1 + i / 8.0f, 1 + i / 8.0f);
+        dc.translate(-30, -50);         // coordinates are unsigned, so
+        drawHouse(dc, 30, 50);          // the house is drawn away from 0
+        dc.pop();
+    }
+    dc.setFill(colors.green);
+    dc.fillEllipse(0, 0, 40, 40);
+    dc.resetTransform();
+
+    PBM::writePPMBinary("testtransform.ppm", fb);
+
+    // A whole pixel translation against moving things by hand
+    PixelBufferRGBA32 moved(400, 300);
+    PixelBufferRGBA32 byHand(400, 300);
+    DrawingContext mdc(moved);
+    DrawingContext hdc(byHand);
+    mdc.clear();
+    hdc.clear();
+
+    const int REPEATS = 20000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < REPEATS; i++) {
+        hdc.resetTransform();
+        drawHouse(hdc, 40 + (i % 320), 60 + (i % 230));
+    }
+    int byHandMs = elapsed(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < REPEATS; i++) {
+        mdc.resetTransform();
+        mdc.translate((REAL)(i % 320), (REAL)(i % 230));
+        drawHouse(mdc, 40, 60);
+    }
+    int movedMs = elapsed(start);
+
+    printf("translate() vs by hand differences: %d\n",
+        expectZero(countDifferences(moved, byHand), "translate() vs by hand"));
+    printf("%d houses: %d ms by hand, %d ms with translate()\n", REPEATS, byHandMs, movedMs);
+
+    // The batch point transform, with and without SSE2
+    const int NPOINTS = 1000000;
+    Point2D *pts = new Point2D[NPOINTS];
+    PointFx *fast = new PointFx[NPOINTS];
+    PointFx *plain = new PointFx[NPOINTS];
+    srand(3);
+    for (int i = 0; i < NPOINTS; i++) {
+        pts[i] = Point2D((GRCOORD)(rand() % 4000), (GRCOORD)(rand() % 4000));
+    }
+
+    Mat2D m = Mat2D::translation(12.25f, -40) * Mat2D::rotation(0.3f) * Mat2D::scaling(1.5f, 0.75f);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 20; i++) {
+        transformPoints(m, pts, fast, NPOINTS);
+    }
+    int fastMs = elapsed(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 20; i++) {
+        transformPointsScalar(m, pts, plain, NPOINTS);
+    }
+    int plainMs = elapsed(start);
+
+    int mismatched = 0;
+    for (int i = 0; i < NPOINTS; i++) {
+        if (fast[i].x != plain[i].x || fast[i].y != plain[i].y) {
+            mismatched++;
+        }
+    }
+    printf("20 x %d points: %d ms transformPoints(), %d ms scalar, %d mismatched\n",
+        NPOINTS, fastMs, plainMs, mismatched);
+
+    delete [] pts;
+    delete [] fast;
+    delete [] plain;
+
+    // A rotated scene, recorded and replayed
+    DisplayList list;
+    PixelBufferRGBA32 direct(300, 300);
+    PixelBufferRGBA32 replayed(300, 300);
+    DrawingContext ddc(direct);
+    DrawingContext rdc(replayed);
+    ddc.clear();
+    rdc.clear();
+
+    ddc.translate(150, 180);
+    ddc.rotate(0.5f);
+    ddc.scale(2, 2);
+    ddc.translate(-30, -50);
+    drawHouse(ddc, 30, 50);
+
+    rdc.beginRecording(list);
+    rdc.translate(150, 180);
+    rdc.rotate(0.5f);
+    rdc.scale(2, 2);
+    rdc.translate(-30, -50);
+    drawHouse(rdc, 30, 50);
+    rdc.endRecording();
+    rdc.replay(list);
+
+    printf("rotated replay vs direct differences: %d\n",
+        expectZero(countDifferences(direct, replayed), "rotated replay vs direct"));
+}
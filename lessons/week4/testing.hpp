@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "grtypes.hpp"
+#include "PixelBuffer.hpp"
+
+/*
+    What the tests share.
+
+    countDifferences() compares two pixel buffers, and expectZero()
+    stops a test with a failure, so that a test run from a script
+    exits with a nonzero status when something doesn't match, rather
+    than only printing it.
+
+        printf("replayed vs direct differences: %d\n",
+            expectZero(countDifferences(direct, replayed), "replayed vs direct"));
+*/
+
+// The pixels of b that aren't the same as a's, or -1 if there's no b,
+// or it's a different size.  With alpha false, a's alpha wasn't kept,
+// and b should be opaque wherever a is.
+inline int countDifferences(const PixelBuffer &a, const PixelBuffer *b, bool alpha = true)
+{
+    if (!b || a.getWidth() != b->getWidth() || a.getHeight() != b->getHeight()) {
+        return -1;
+    }
+    int different = 0;
+    for (size_t y = 0; y < a.getHeight(); y++) {
+        for (size_t x = 0; x < a.getWidth(); x++) {
+            PixRGBA p = a.getPixel((GRCOORD)x, (GRCOORD)y);
+            PixRGBA q = b->getPixel((GRCOORD)x, (GRCOORD)y);
+            if (!alpha) {
+                p.a = 255;
+            }
+            if (p.intValue != q.intValue) {
+                different++;
+            }
+        }
+    }
+    return different;
+}
+
+inline int countDifferences(const PixelBuffer &a, const PixelBuffer &b, bool alpha = true)
+{
+    return countDifferences(a, &b, alpha);
+}
+
+// Stop the test, saying what failed, if count isn't 0.  Returns count,
+// so it can go straight into the printf() that reports it.
+inline int expectZero(int count, const char *what)
+{
+    if (count != 0) {
+        printf("FAILED: %s, %d\n", what, count);
+        exit(1);
+    }
+    return count;
+}